@@ -5,6 +5,7 @@
 
 #define MAX_VOICES				32
 #define SND_BUFFERSIZE			384				// output 2ms sound data at 48KHz
+#define SND_MAXBUFFERS			8				// max. output buffers queued to the AI
 #define	DSP_STREAMBUFFER_SIZE	1152			// input 2ms sound data at max. 144KHz
 
 #if defined(HW_DOL)
@@ -16,6 +17,9 @@
 #define VOICE_STATE_STOPPED		0
 #define VOICE_STATE_RUNNING		1
 #define VOICE_STATE_STREAM		2
+#define VOICE_STATE_UNDERRUN	3
+
+#define STREAM_MAXBLOCKS		32				// ring blocks per streaming voice
 
 #define VOICE_MONO8             0x00000000
 #define VOICE_STEREO8           0x00000001
@@ -39,12 +43,18 @@ typedef void (*AESNDVoiceCallbackArg)(AESNDPB *pb,u32 state,void *cbArg);
 typedef void (*AESNDVoiceCallback)(AESNDPB *pb,u32 state);
 typedef void (*AESNDAudioCallbackArg)(void *audio_buffer,u32 len,void *cbArg);
 typedef void (*AESNDAudioCallback)(void *audio_buffer,u32 len);
+typedef s32 (*AESNDStreamReaderArg)(AESNDPB *pb,void *buffer,u32 len,void *cbArg);
+typedef s32 (*AESNDStreamReader)(AESNDPB *pb,void *buffer,u32 len);
 
 void AESND_Init(void);
 void AESND_Reset(void);
 void AESND_Pause(bool pause);
 u32 AESND_GetDSPProcessTime(void);
 f32 AESND_GetDSPProcessUsage(void);
+void AESND_SetBufferCount(u32 count);
+void AESND_SetLatencyTarget(u32 usecs);
+u32 AESND_GetLatency(void);
+u32 AESND_GetUnderruns(void);
 AESNDAudioCallbackArg AESND_RegisterAudioCallbackWithArg(AESNDAudioCallbackArg cb, void *cbArg);
 static inline AESNDAudioCallback AESND_RegisterAudioCallback(AESNDAudioCallback cb)
 {
@@ -73,6 +83,17 @@ static inline AESNDVoiceCallback AESND_RegisterVoiceCallback(AESNDPB *pb,AESNDVo
 	return (AESNDVoiceCallback)AESND_RegisterVoiceCallbackWithArg(pb,(AESNDVoiceCallbackArg)cb,NULL);
 }
 
+// Streaming voices: the reader is called from the stream thread to fill ring
+// blocks of blocksize bytes ahead of the DSP play position. Returning less than
+// len ends the stream once the short block has been played.
+AESNDPB* AESND_AllocateStreamWithArg(u32 blocks,u32 blocksize,AESNDStreamReaderArg reader,AESNDVoiceCallbackArg cb,void *cbArg);
+static inline AESNDPB* AESND_AllocateStream(u32 blocks,u32 blocksize,AESNDStreamReader reader,AESNDVoiceCallback cb)
+{
+	return AESND_AllocateStreamWithArg(blocks,blocksize,(AESNDStreamReaderArg)reader,(AESNDVoiceCallbackArg)cb,NULL);
+}
+s32 AESND_PlayStream(AESNDPB *pb,u32 format,f32 freq,u32 delay);
+u32 AESND_GetStreamUnderruns(AESNDPB *pb);
+
 #ifdef __cplusplus
 	}
 #endif
@@ -70,6 +70,7 @@ All buffers in this document need to be 32-byte aligned!
 #define DVD_COVER_DISC_INSERTED 0x02
 
 #define LIBDI_MAX_RETRIES		16
+#define DI_MAXSTREAMS			4
 
 #define DEVICE_TYPE_WII_DVD		(('W'<<24)|('D'<<16)|('V'<<8)|'D')
 
@@ -83,6 +84,13 @@ typedef struct{
 	uint32_t	rel_date;
 }DI_DriveID;
 
+typedef struct{
+	uint32_t	next;		// block the stream is expected to read next
+	uint32_t	hits;		// reads served from the cache
+	uint32_t	misses;		// reads that had to wait for the drive
+	uint32_t	prefetches;	// read-ahead windows issued
+}DI_StreamStats;
+
 typedef int(*di_callback)(uint32_t status, uint32_t error);
 typedef int(*read_func)(void*,uint32_t,uint32_t);
 typedef int(*read_func_async)(void*,uint32_t,uint32_t,ipccallback);
@@ -111,6 +119,14 @@ int DI_KillDrive(void);
 
 int DI_ReadDVD(void* buf, uint32_t len, uint32_t lba);
 int DI_ReadDVDAsync(void* buf, uint32_t len, uint32_t lba, ipccallback ipc_cb);
+/*
+Hint that len blocks starting at lba will be read soon. Blocks not cached yet are
+read in the background, up to 32 (the cache of one stream); sequential reads from
+there keep the read-ahead going.
+*/
+int DI_Prefetch(uint32_t lba, uint32_t len);
+int DI_GetStreamStats(DI_StreamStats *stats);
+void DI_ResetStreamStats(void);
 
 int DI_Read(void *buf, u32 size, u32 offset);
 int DI_UnencryptedRead(void *buf, u32 size, u32 offset);
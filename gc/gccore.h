@@ -64,6 +64,7 @@ distribution.
 #include "ogc/usbgecko.h"
 #include "ogc/video_types.h"
 #include "ogc/texconv.h"
+#include "ogc/dspadpcm.h"
 
 #if defined(HW_RVL)
 #include "ogc/ipc.h"
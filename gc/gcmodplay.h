@@ -22,6 +22,7 @@ typedef struct _modplay {
 	BOOL playing,paused;
 	BOOL bits,stereo,manual_polling;
 	u32 playfreq,numSFXChans;
+	u32 mixmode;
 	MODSNDBUF soundBuf;
 } MODPlay;
 
@@ -36,6 +37,7 @@ s32 MODPlay_Stop(MODPlay *mod);
 s32 MODPlay_TriggerNote(MODPlay *mod,u32 chan,u8 inst,u16 freq,u8 vol);
 s32 MODPlay_Pause(MODPlay *mod,BOOL);
 void MODPlay_SetVolume(MODPlay * mod, s32 musicvolume, s32 sfxvolume);
+s32 MODPlay_SetMixMode(MODPlay *mod,u32 mode);
 
 #ifdef __cplusplus
    }
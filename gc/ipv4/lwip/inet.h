@@ -39,13 +39,14 @@
 #include "lwip/ip_addr.h"
 
 u16_t inet_chksum(void *dataptr, u16_t len);
-#if 0 /* optimized routine */
-u16_t inet_chksum4(u8_t *dataptr, u16_t len);
-#endif
+u16_t inet_chksum_copy(void *dst, const void *src, u16_t len);
 u16_t inet_chksum_pbuf(struct pbuf *p);
 u16_t inet_chksum_pseudo(struct pbuf *p,
        struct ip_addr *src, struct ip_addr *dest,
        u8_t proto, u16_t proto_len);
+u16_t inet_chksum_pseudo_partial(struct pbuf *p,
+       struct ip_addr *src, struct ip_addr *dest,
+       u8_t proto, u16_t proto_len, u16_t chksum_len, u16_t data_chksum);
 
 u32_t inet_addr(const char *cp);
 s8_t inet_aton(const char *cp, struct in_addr *addr);
@@ -78,6 +78,16 @@ struct netbuf {
   err_t err;
 };
 
+/* a zero-copy write waiting for the peer to acknowledge its last byte */
+struct netconn_zcreq {
+	struct netconn_zcreq *next;
+	u32 seq_end;
+	const void *data;
+	u32 len;
+	void (*cb)(s32 s,const void *data,s32 len,s32 result,void *usrdata);
+	void *usrdata;
+};
+
 struct netconn {
 	enum netconn_type type;
 	enum netconn_state state;
@@ -91,9 +101,10 @@ struct netconn {
 	sys_mbox mbox;
 	sys_mbox recvmbox;
 	sys_mbox acceptmbox;
-	u16 recvavail;
+	u32 recvavail;
 	s32 socket;
 	void (*callback)(struct netconn *,enum netconn_evt,u32);
+	struct netconn_zcreq *zcsent;
 };
 
 #endif /* __LWIP_API_H__ */
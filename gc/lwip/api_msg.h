@@ -71,6 +71,7 @@ struct apimsg_msg {
 			void *dataptr;
 			u32 len;
 			u8 copy;
+			struct netconn_zcreq *zc;
 		} w;
 		sys_mbox mbox;
 		u16 len;
@@ -38,6 +38,8 @@
 #define LWIP_CALLBACK_API				1
 #undef  LWIP_EVENT_API
 #define TCPIP_THREAD_PRIO               125
+#define LWIP_TCPIP_CORE_LOCKING         1
+#define TCPIP_RXQ_SIZE                  64
 #define SYS_LIGHTWEIGHT_PROT            1
 
 /* ---------- Memory options ---------- */
@@ -115,7 +117,17 @@ a lot of data that needs to be copied, this should be set high. */
 #define TCP_SND_QUEUELEN        (36*TCP_SND_BUF/TCP_MSS)
 
 /* TCP receive window. */
-#define TCP_WND                 (TCP_MSS)
+#define TCP_WND                 (32*TCP_MSS)
+
+/* Window scaling, so SO_RCVBUF can open the window up to 256K. */
+#define LWIP_WND_SCALE          1
+#define TCP_RCV_SCALE           2
+
+/* Report out-of-sequence data in SACK blocks. */
+#define LWIP_TCP_SACK_OUT       1
+
+/* Sum copied data on the way in, see inet_chksum_copy(). */
+#define TCP_CHECKSUM_ON_COPY    1
 
 /* Maximum number of retransmissions of data segments. */
 #define TCP_MAXRTX              12
@@ -266,6 +266,17 @@ a lot of data that needs to be copied, this should be set high. */
 #define TCP_WND                         2048
 #endif 
 
+/* Negotiate the RFC 1323 window scale option. Needed for receive
+   windows (TCP_WND or SO_RCVBUF) larger than 64K. */
+#ifndef LWIP_WND_SCALE
+#define LWIP_WND_SCALE                  0
+#endif
+
+/* Shift count we announce in the window scale option. */
+#ifndef TCP_RCV_SCALE
+#define TCP_RCV_SCALE                   0
+#endif
+
 #ifndef TCP_MAXRTX
 #define TCP_MAXRTX                      12
 #endif
@@ -281,6 +292,22 @@ a lot of data that needs to be copied, this should be set high. */
 #define TCP_QUEUE_OOSEQ                 1
 #endif
 
+/* Offer SACK-permitted and report queued out-of-sequence data in
+   SACK blocks of our ACKs. */
+#ifndef LWIP_TCP_SACK_OUT
+#define LWIP_TCP_SACK_OUT               0
+#endif
+#if !TCP_QUEUE_OOSEQ
+#undef LWIP_TCP_SACK_OUT
+#define LWIP_TCP_SACK_OUT               0
+#endif
+
+/* Checksum data while tcp_write() copies it into the segment instead
+   of in a second pass when the segment goes out. */
+#ifndef TCP_CHECKSUM_ON_COPY
+#define TCP_CHECKSUM_ON_COPY            0
+#endif
+
 /* TCP Maximum segment size. */
 #ifndef TCP_MSS
 #define TCP_MSS                         128 /* A *very* conservative default. */
@@ -331,6 +358,19 @@ a lot of data that needs to be copied, this should be set high. */
 #define TCPIP_THREAD_PRIO               1
 #endif
 
+/* Run the lwIP core for socket calls in the calling thread, under a
+   mutex shared with the tcpip thread, instead of posting every call
+   to the tcpip thread and waiting for it. */
+#ifndef LWIP_TCPIP_CORE_LOCKING
+#define LWIP_TCPIP_CORE_LOCKING         0
+#endif
+
+/* Received frames waiting for the tcpip thread, which takes all of
+   them on a single wakeup. Must be a power of two. */
+#ifndef TCPIP_RXQ_SIZE
+#define TCPIP_RXQ_SIZE                  64
+#endif
+
 #ifndef SLIPIF_THREAD_PRIO
 #define SLIPIF_THREAD_PRIO              1
 #endif
@@ -523,6 +563,10 @@ a lot of data that needs to be copied, this should be set high. */
 #ifndef CHECKSUM_GEN_TCP
 #define CHECKSUM_GEN_TCP                1
 #endif
+#if !CHECKSUM_GEN_TCP
+#undef TCP_CHECKSUM_ON_COPY
+#define TCP_CHECKSUM_ON_COPY            0
+#endif
  
 #ifndef CHECKSUM_CHECK_IP
 #define CHECKSUM_CHECK_IP               1
@@ -75,6 +75,13 @@ void             tcp_err     (struct tcp_pcb *pcb,
 #define          tcp_mss(pcb)      ((pcb)->mss)
 #define          tcp_sndbuf(pcb)   ((pcb)->snd_buf)
 
+/* Receive window as it goes into the header of a non-SYN segment. */
+#if LWIP_WND_SCALE
+#define          tcp_adv_wnd(pcb)  ((u16_t)((((pcb)->rcv_wnd >> (pcb)->rcv_scale) > 0xffff) ? 0xffff : ((pcb)->rcv_wnd >> (pcb)->rcv_scale)))
+#else
+#define          tcp_adv_wnd(pcb)  ((u16_t)(((pcb)->rcv_wnd > 0xffff) ? 0xffff : (pcb)->rcv_wnd))
+#endif
+
 void             tcp_recved  (struct tcp_pcb *pcb, u16_t len);
 err_t            tcp_bind    (struct tcp_pcb *pcb, struct ip_addr *ipaddr,
             u16_t port);
@@ -235,9 +242,21 @@ struct tcp_pcb {
 #define TF_GOT_FIN   (u8_t)0x20U   /* Connection was closed by the remote end. */
 #define TF_NODELAY   (u8_t)0x40U   /* Disable Nagle algorithm */
 
+  u8_t optflags;
+#define TF_OPT_WSCALE (u8_t)0x01U  /* Window scaling was negotiated. */
+#define TF_OPT_SACK   (u8_t)0x02U  /* Peer accepts SACK blocks. */
+
   /* receiver variables */
   u32_t rcv_nxt;   /* next seqno expected */
-  u16_t rcv_wnd;   /* receiver window */
+  u32_t rcv_wnd;   /* receiver window */
+  u32_t rcv_wnd_max; /* receive buffer size (SO_RCVBUF) */
+#if LWIP_WND_SCALE
+  u8_t snd_scale;  /* shift applied to windows received from the peer */
+  u8_t rcv_scale;  /* shift applied to windows we advertise */
+#endif /* LWIP_WND_SCALE */
+#if LWIP_TCP_SACK_OUT
+  u32_t sack_recent; /* seqno of the last out-of-sequence segment */
+#endif /* LWIP_TCP_SACK_OUT */
   
   /* Timers */
   u32_t tmr;
@@ -275,6 +294,7 @@ struct tcp_pcb {
   u16_t acked;
   
   u16_t snd_buf;   /* Available buffer space for sending (in bytes). */
+  u16_t snd_buf_max; /* send buffer size (SO_SNDBUF) */
   u16_t snd_queuelen; /* Available buffer space for sending (in tcp_segs). */
   
   
@@ -394,6 +414,10 @@ struct tcp_seg {
   void *dataptr;           /* pointer to the TCP data in the pbuf */
   u16_t len;               /* the TCP length of this segment */
   struct tcp_hdr *tcphdr;  /* the TCP header */
+#if TCP_CHECKSUM_ON_COPY
+  u16_t chksum;            /* lwip checksum of the data, if chksum_valid */
+  u8_t chksum_valid;
+#endif
 };
 
 /* Internal functions and global variables: */
@@ -417,6 +441,7 @@ struct tcp_seg *tcp_seg_copy(struct tcp_seg *seg);
                          tcp_output(pcb)
 
 err_t tcp_send_ctrl(struct tcp_pcb *pcb, u8_t flags);
+u8_t tcp_synopts(struct tcp_pcb *pcb, u32_t *optdata);
 err_t tcp_enqueue(struct tcp_pcb *pcb, void *dataptr, u16_t len,
     u8_t flags, u8_t copy,
                 u8_t *optdata, u8_t optlen);
@@ -34,5 +34,7 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 int mix_mono_16bit ( MOD * mod, s16 * buf, int numSamples );
 int mix_stereo_16bit ( MOD * mod, s16 * buf, int numSamples );
+int mix_mono_16bit_interp ( MOD * mod, s16 * buf, int numSamples );
+int mix_stereo_16bit_interp ( MOD * mod, s16 * buf, int numSamples );
 
 #endif
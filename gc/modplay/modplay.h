@@ -33,6 +33,12 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #define MAX_VOICES  32
 
+struct _tracker;
+
+#define MOD_MIX_NEAREST   0   /* Nearest sample, no volume ramping */
+#define MOD_MIX_LINEAR    1   /* Linear interpolation */
+#define MOD_MIX_CUBIC     2   /* 4-point Catmull-Rom interpolation */
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -54,7 +60,8 @@ typedef struct _mod
   {
     BOOL loaded;
     s8 name[21];
-    MOD_INSTR instrument[31];
+    MOD_INSTR * instrument;   /* modinstr for MODs, tracker samples otherwise */
+    MOD_INSTR modinstr[31];
     s32 num_patterns;
     u8 song_length;
     u8 ciaa;
@@ -81,6 +88,7 @@ typedef struct _mod
     s32 bits;
     s32 channels;     /* 1 = mono, 2 = stereo */
     u32 playpos[MAX_VOICES];   /* Playing position for each channel */
+    u32 chaninc[MAX_VOICES];   /* 16.16 step, overrides chanfreq when non zero */
     u8 instnum[MAX_VOICES];    /* Current instrument */
     u16 chanfreq[MAX_VOICES];  /* Current frequency */
     u16 channote[MAX_VOICES];  /* Last note triggered */
@@ -119,6 +127,11 @@ typedef struct _mod
     
     u8 musicvolume;
     u8 sfxvolume;
+
+    u8 mixmode;                /* One of MOD_MIX_* */
+    s32 rampvol[MAX_VOICES];   /* Current ramped volume (16.16) */
+
+    struct _tracker * trk;     /* S3M/XM/IT pattern engine, NULL for MODs */
     
     BOOL set;
     BOOL *notify;
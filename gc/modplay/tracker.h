@@ -0,0 +1,229 @@
+/*-------------------------------------------------------------
+
+tracker.h -- Shared S3M/XM/IT pattern engine
+
+Copyright (C) 2026
+
+This software is provided 'as-is', without any express or implied
+warranty.  In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1.	The origin of this software must not be misrepresented; you
+must not claim that you wrote the original software. If you use
+this software in a product, an acknowledgment in the product
+documentation would be appreciated but is not required.
+
+2.	Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3.	This notice may not be removed or altered from any source
+distribution.
+
+-------------------------------------------------------------*/
+
+/* The loaders decode every format into the same pre-decoded event array
+ * and effect set. The engine then drives the MOD channel state (instnum,
+ * playpos, volume, chaninc), so the regular MOD_Player mixing path is
+ * reused unchanged.
+ */
+
+#ifndef __TRACKER_H__
+#define __TRACKER_H__
+
+#include "defines.h"
+#include "modplay.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TRK_FMT_S3M         1
+#define TRK_FMT_XM          2
+#define TRK_FMT_IT          3
+
+#define TRK_MAX_ROWS        256
+#define TRK_MAX_ENVPOINTS   25
+
+/* Event note values. 1..120 are notes C-0..B-9 (+1), 0 means no note. */
+#define TRK_NOTE_NONE       0
+#define TRK_NOTE_FADE       253
+#define TRK_NOTE_CUT        254
+#define TRK_NOTE_OFF        255
+
+/* Volume column, XM encoding for all formats */
+#define TRK_VOL_SET         0x10    /* 0x10..0x50 */
+#define TRK_VOL_SLIDEDOWN   0x60
+#define TRK_VOL_SLIDEUP     0x70
+#define TRK_VOL_FINEDOWN    0x80
+#define TRK_VOL_FINEUP      0x90
+#define TRK_VOL_VIBSPEED    0xa0
+#define TRK_VOL_VIBRATO     0xb0
+#define TRK_VOL_TONEPORTA   0xf0
+
+/* Effects, after format specific decoding */
+enum
+  {
+    TRK_FX_NONE = 0,
+    TRK_FX_ARPEGGIO,
+    TRK_FX_PORTA_UP,          /* XM 1xx */
+    TRK_FX_PORTA_DOWN,        /* XM 2xx */
+    TRK_FX_S3M_PORTA_UP,      /* S3M/IT Fxx incl. FFx/FEx fine forms */
+    TRK_FX_S3M_PORTA_DOWN,    /* S3M/IT Exx incl. EFx/EEx fine forms */
+    TRK_FX_FINE_PORTA_UP,
+    TRK_FX_FINE_PORTA_DOWN,
+    TRK_FX_XFINE_PORTA_UP,
+    TRK_FX_XFINE_PORTA_DOWN,
+    TRK_FX_TONEPORTA,
+    TRK_FX_TONEPORTA_VOL,
+    TRK_FX_VIBRATO,
+    TRK_FX_FINE_VIBRATO,
+    TRK_FX_VIBRATO_VOL,
+    TRK_FX_VIBWAVE,
+    TRK_FX_TREMOLO,
+    TRK_FX_TREMWAVE,
+    TRK_FX_OFFSET,
+    TRK_FX_VOLSLIDE,          /* XM Axy, no fine forms */
+    TRK_FX_S3M_VOLSLIDE,      /* S3M/IT Dxy incl. DxF/DFx fine forms */
+    TRK_FX_FINE_VOL_UP,
+    TRK_FX_FINE_VOL_DOWN,
+    TRK_FX_SET_VOLUME,
+    TRK_FX_CHANVOL,
+    TRK_FX_CHANVOL_SLIDE,
+    TRK_FX_GLOBALVOL,
+    TRK_FX_GLOBALVOL_SLIDE,
+    TRK_FX_JUMP,
+    TRK_FX_BREAK,
+    TRK_FX_SPEED,
+    TRK_FX_TEMPO,
+    TRK_FX_RETRIG,
+    TRK_FX_KEYOFF,
+    TRK_FX_PATLOOP,
+    TRK_FX_NOTECUT,
+    TRK_FX_NOTEDELAY,
+    TRK_FX_PATDELAY
+  };
+
+/* Envelope flags */
+#define TRK_ENV_ON          0x01
+#define TRK_ENV_LOOP        0x02
+#define TRK_ENV_SUSTAIN     0x04
+
+typedef struct _trkevent
+  {
+    u8 note;
+    u8 instr;
+    u8 vol;
+    u8 fx;
+    u8 param;
+  } TRK_EVENT;
+
+typedef struct _trkpattern
+  {
+    u16 rows;
+    TRK_EVENT * events;   /* rows*num_channels, row major */
+  } TRK_PATTERN;
+
+typedef struct _trkenv
+  {
+    u8 flags;
+    u8 num;
+    u8 loop_start, loop_end;
+    u8 sus_start, sus_end;
+    u16 tick[TRK_MAX_ENVPOINTS];
+    u8 value[TRK_MAX_ENVPOINTS];  /* 0..64 */
+  } TRK_ENV;
+
+typedef struct _trkinstr
+  {
+    u8 sample[120];       /* Sample number per note, 0 = none */
+    u8 note[120];         /* Note actually played */
+    u16 fadeout;          /* Subtracted from 65536 each tick after key off */
+    u8 gvol;              /* 0..64 */
+    TRK_ENV volenv;
+  } TRK_INSTR;
+
+typedef struct _trksample
+  {
+    u32 c5speed;          /* Playback rate for C-5 */
+    u8 volume;            /* 0..64 */
+    u8 gvol;              /* 0..64 */
+  } TRK_SAMPLE;
+
+typedef struct _trkchan
+  {
+    u8 note;
+    u8 instr;
+    u8 sample;
+    u8 keyon;
+    u8 fading;
+    s8 vol;
+    u8 chanvol;
+    u8 fx, param;
+    u8 volcmd;
+    s32 period;
+    s32 porta_target;
+    u8 porta_speed;
+    u8 mem_porta, mem_fineporta, mem_volslide, mem_offset;
+    u8 mem_retrig, mem_chanvol, mem_gvol, mem_arp;
+    u8 vib_speed, vib_depth, vib_pos, vib_wave;
+    u8 trem_speed, trem_depth, trem_pos, trem_wave;
+    s32 vib_delta;
+    s32 trem_delta;
+    u8 arp_note;
+    u8 retrig_count;
+    u8 loop_row, loop_count;
+    u16 env_pos;
+    s32 fadevol;
+    TRK_EVENT delayed;
+  } TRK_CHAN;
+
+typedef struct _tracker
+  {
+    u8 format;
+    BOOL linear;            /* Linear frequency slides */
+    BOOL instmode;          /* Instruments (XM, IT) or samples only (S3M, IT) */
+    u8 num_channels;
+    u16 num_orders;
+    u16 num_patterns;
+    u16 num_instr;
+    u16 num_samples;
+    u8 restart;
+    u8 init_speed, init_tempo, init_gvol;
+    u8 init_chanvol[MAX_VOICES];
+    u8 orders[256];
+    TRK_PATTERN * patterns;
+    TRK_INSTR * instr;
+    TRK_SAMPLE * samples;
+    MOD_INSTR * smp;        /* Mixer view of the samples */
+    TRK_EVENT * eventdata;
+    s8 * sampledata;
+
+    /* Player state */
+    u8 gvol;                /* 0..128 */
+    u8 patdelay;
+    s16 jump_order;
+    s16 break_row;
+    s16 loop_row;
+    TRK_CHAN chan[MAX_VOICES];
+  } TRACKER;
+
+BOOL TRK_IsModule ( const u8 * mem );
+s32 TRK_SetModule ( MOD * mod, const u8 * mem );
+void TRK_Free ( MOD * mod );
+void TRK_Start ( MOD * mod );
+u32 TRK_Tick ( MOD * mod );
+
+/* Loaders, trkload.c */
+s32 TRK_LoadS3M ( TRACKER * trk, const u8 * mem );
+s32 TRK_LoadXM ( TRACKER * trk, const u8 * mem );
+s32 TRK_LoadIT ( TRACKER * trk, const u8 * mem );
+
+#ifdef __cplusplus
+  }
+#endif
+
+#endif
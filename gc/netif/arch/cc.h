@@ -46,6 +46,7 @@ typedef u16		u16_t;
 typedef s16		s16_t;
 typedef	u32		u32_t;
 typedef s32		s32_t;
+typedef u64		u64_t;
 typedef u32		mem_ptr_t;
 
 
@@ -38,8 +38,11 @@ static inline void cpu_to_be32s(u32 *a) {*a = cpu_to_be32(*a);}
 
 typedef void* dev_s;
 
+struct net_ifstats;
+
 dev_s bba_create(struct netif *);
 err_t bba_init(struct netif *);
 void bba_process(struct pbuf *p,struct netif *dev);
+void bba_getstats(struct netif *dev,struct net_ifstats *stats);
 
 #endif
@@ -285,6 +285,111 @@ s32 net_shutdown(s32 s, u32 how);
 
 struct hostent * net_gethostbyname(const char *addrString);
 
+#ifdef HW_RVL
+/* Asynchronous and batched socket I/O (IOS stack only).
+ *
+ * Every socket call is an IPC round trip to IOS. The _async calls queue
+ * the request and return at once; cb later runs from the IPC interrupt
+ * with what the synchronous call would have returned, and must not
+ * block. Send data is copied right away, receive buffers, from/fromlen
+ * and pollsd arrays have to stay valid until cb ran. -EAGAIN means the
+ * IPC queue is full, -ENOMEM that the request could not be allocated.
+ *
+ * net_batch() takes an array of sends and receives, keeps several of
+ * them in flight at a time and returns once all have completed, so the
+ * round trips overlap instead of adding up. Every op gets its own
+ * result; the return value is the number of ops that succeeded.
+ * net_batch_async() does the same and reports that number to cb.
+ */
+#define NET_OP_SENDTO		0
+#define NET_OP_RECVFROM		1
+
+struct net_op {
+	u32 op;
+	s32 s;
+	void *data;
+	s32 len;
+	u32 flags;
+	struct sockaddr *addr;		/* destination or source, may be NULL */
+	socklen_t addrlen;
+	s32 result;
+};
+
+s32 net_sendto_async(s32 s,const void *data,s32 len,u32 flags,struct sockaddr *to,socklen_t tolen,netcallback cb,void *usrdata);
+s32 net_recvfrom_async(s32 s,void *mem,s32 len,u32 flags,struct sockaddr *from,socklen_t *fromlen,netcallback cb,void *usrdata);
+s32 net_poll_async(struct pollsd *sds,s32 nsds,s32 timeout,netcallback cb,void *usrdata);
+s32 net_batch(struct net_op *ops,s32 nops);
+s32 net_batch_async(struct net_op *ops,s32 nops,netcallback cb,void *usrdata);
+#endif
+
+#ifndef HW_RVL
+/* Zero-copy socket I/O (BBA stack only).
+ *
+ * net_send_zc() queues data on a TCP socket without copying it. The
+ * buffer belongs to the stack until cb runs, which happens exactly
+ * once: from the network thread after the peer acknowledged the last
+ * byte (result 0) or the connection went away (result < 0), or from
+ * net_send_zc() itself, before it returns, when the data never reached
+ * the stack. cb must not block. Closing the socket waits up to 10
+ * seconds for outstanding zero-copy data, then aborts the connection.
+ *
+ * net_recv_zc() loans the next received chain instead of copying it.
+ * The pieces stay valid until net_zcbuf_release(); as they are taken
+ * from the driver's receive pool, release them promptly.
+ */
+struct netzcbuf {
+	struct netzcbuf *next;	/* next piece, NULL at the end of the chain */
+	void *data;				/* payload of this piece */
+	u16 tot_len;			/* bytes in this and all following pieces */
+	u16 len;				/* bytes in this piece */
+};
+
+typedef void (*netzcsent)(s32 s,const void *data,s32 len,s32 result,void *usrdata);
+
+s32 net_send_zc(s32 s,const void *data,s32 len,u32 flags,netzcsent cb,void *usrdata);
+s32 net_recv_zc(s32 s,struct netzcbuf **zb,u32 flags);
+void net_zcbuf_release(struct netzcbuf *zb);
+
+/* Readiness notification (BBA stack only).
+ *
+ * Sockets are registered with an epoll set for POLLIN and/or POLLOUT;
+ * POLLERR is always reported. net_epoll_wait() only looks at sockets
+ * that became ready, so its cost does not grow with the number
+ * registered. Level-triggered sockets are reported again as long as
+ * they stay ready, NET_EPOLLET ones once per readiness change. A
+ * socket can belong to one epoll set at a time. net_epoll_close()
+ * wakes pending net_epoll_wait() calls, which then return -EBADF.
+ */
+#define NET_EPOLL_CTL_ADD	1
+#define NET_EPOLL_CTL_DEL	2
+#define NET_EPOLL_CTL_MOD	3
+
+#define NET_EPOLLET			0x80000000
+
+struct net_epoll_event {
+	u32 events;
+	void *data;
+};
+
+s32 net_epoll_create(void);
+s32 net_epoll_ctl(s32 epfd,s32 op,s32 s,struct net_epoll_event *event);
+s32 net_epoll_wait(s32 epfd,struct net_epoll_event *events,s32 maxevents,s32 timeout);
+s32 net_epoll_close(s32 epfd);
+
+/* BBA interface counters. irq_usecs is the time spent in the driver's
+ * interrupt handler, which moves every frame in and out of the
+ * adapter; divided by the frame counts it gives the per packet cost.
+ */
+struct net_ifstats {
+	u32 interrupts;
+	u64 irq_usecs;
+	u32 rx_packets,rx_bytes,rx_errors,rx_nobufs;
+	u32 tx_packets,tx_bytes,tx_errors;
+};
+
+s32 net_get_ifstats(struct net_ifstats *stats);
+#endif
+
 #ifdef __cplusplus
 	}
 #endif
@@ -70,6 +70,35 @@ distribution.
    extern "C" {
 #endif /* __cplusplus */
 
+
+/*!
+ * \typedef struct _aidmastats aidmastats
+ * \brief Audio DMA timing statistics. All times are in microseconds.
+ *
+ * \param interrupts count of audio DMA interrupts
+ * \param period_min shortest time between two DMA interrupts
+ * \param period_max longest time between two DMA interrupts
+ * \param period_avg running average of the time between two DMA interrupts
+ * \param callback_max longest time spent in the DMA callback
+ * \param callback_avg running average of the time spent in the DMA callback
+ * \param mix_max longest time from a DMA interrupt until the mixer called AUDIO_SignalMixDone()
+ * \param mix_avg running average of the mixing time
+ * \param headroom_min smallest time left between mix completion and the next DMA interrupt, negative if a mix was late
+ * \param late count of mixes not signalled before the next DMA interrupt
+ */
+typedef struct _aidmastats {
+	u32 interrupts;
+	u32 period_min;
+	u32 period_max;
+	u32 period_avg;
+	u32 callback_max;
+	u32 callback_avg;
+	u32 mix_max;
+	u32 mix_avg;
+	s32 headroom_min;
+	u32 late;
+} aidmastats;
+
 /*! 
  * \typedef void (*AIDCallback)(void)
  * \brief function pointer typedef for the user's Audio DMA interrupt callback
@@ -312,6 +341,35 @@ void AUDIO_SetStreamPlayState(u32 state);
  */
 u32 AUDIO_GetStreamPlayState(void);
 
+
+/*!
+ * \fn void AUDIO_SignalMixDone(void)
+ * \brief Called by the mixer when the buffer for the next DMA block is complete. Only the first call after each DMA interrupt is accounted.
+ *
+ * \return none
+ */
+void AUDIO_SignalMixDone(void);
+
+
+/*!
+ * \fn void AUDIO_GetDMAStats(aidmastats *stats)
+ * \brief Get the audio DMA timing statistics.
+ *
+ * \param[out] stats pointer to a aidmastats structure receiving the statistics
+ *
+ * \return none
+ */
+void AUDIO_GetDMAStats(aidmastats *stats);
+
+
+/*!
+ * \fn void AUDIO_ResetDMAStats(void)
+ * \brief Reset the audio DMA timing statistics.
+ *
+ * \return none
+ */
+void AUDIO_ResetDMAStats(void);
+
 #ifdef __cplusplus
    }
 #endif /* __cplusplus */
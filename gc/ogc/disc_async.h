@@ -0,0 +1,206 @@
+/*-------------------------------------------------------------
+
+disc_async.h -- Asynchronous sector reads for DISC_INTERFACE devices
+
+Copyright (C) 2026
+
+This software is provided 'as-is', without any express or implied
+warranty.  In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1.	The origin of this software must not be misrepresented; you
+must not claim that you wrote the original software. If you use
+this software in a product, an acknowledgment in the product
+documentation would be appreciated but is not required.
+
+2.	Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3.	This notice may not be removed or altered from any source
+distribution.
+
+-------------------------------------------------------------*/
+
+
+#ifndef __DISC_ASYNC_H__
+#define __DISC_ASYNC_H__
+
+/*! \file disc_async.h
+\brief Asynchronous sector reads for DISC_INTERFACE devices
+
+Devices with a native asynchronous path (the GameCube DVD driver, and libdi once DI_Init() ran) are driven
+directly. All other devices are served by a worker thread calling the device's readSectors().
+
+*/
+
+#include <gctypes.h>
+#include <ogc/disc_io.h>
+
+#define DISCASYNC_MAXREQ			32			/*!< max. number of requests queued or in flight */
+#define DISCASYNC_MAXDEVICES		8			/*!< max. number of devices with requests at the same time */
+#define DISCASYNC_MAXBACKENDS		4			/*!< max. number of native backends */
+
+#define DISCASYNC_OK				0			/*!< read completed */
+#define DISCASYNC_PENDING			1			/*!< request is queued or being read */
+#define DISCASYNC_EINVAL			-1			/*!< invalid parameter or unknown request */
+#define DISCASYNC_ENOSLOT			-2			/*!< no free request or device slot */
+#define DISCASYNC_EIO				-3			/*!< the device failed the read */
+#define DISCASYNC_ECANCELED			-4			/*!< request was canceled before it started */
+#define DISCASYNC_EBUSY				-5			/*!< request already reached the device and can't be canceled */
+
+#ifdef __cplusplus
+   extern "C" {
+#endif /* __cplusplus */
+
+
+typedef struct _discasync_req discasync_req;
+
+/*! \typedef void (*DiscAsyncCallback)(s32 result,discasync_req *req,void *usrdata)
+\brief function pointer typedef for the completion callback. Depending on the backend it is called from interrupt context.
+\param[in] result DISCASYNC_OK or a negative DISCASYNC_E* code
+\param[in] req the completed request
+\param[in] usrdata user data passed to DiscAsync_Submit()
+*/
+typedef void (*DiscAsyncCallback)(s32 result,discasync_req *req,void *usrdata);
+
+
+/*! \typedef struct _discasync_req discasync_req
+\brief An asynchronous read. Backends read the request fields, applications only use the id returned by DiscAsync_Submit().
+*/
+struct _discasync_req {
+	discasync_req *next;
+	const DISC_INTERFACE *disc;
+	sec_t sector;
+	sec_t count;
+	void *buffer;
+	DiscAsyncCallback cb;
+	void *usrdata;
+	u32 id;
+	vu32 state;
+	vs32 result;
+	u64 submit_time;
+};
+
+
+/*! \typedef struct _discasync_backend discasync_backend
+\brief Native asynchronous read path of a device type
+\param submit start the read and return 0, or a negative DISCASYNC_E* code. DiscAsync_Complete() has to be called once the read finished. Always called from thread context.
+\param max_inflight number of requests the backend accepts at the same time
+*/
+typedef struct _discasync_backend {
+	s32 (*submit)(discasync_req *req);
+	u32 max_inflight;
+} discasync_backend;
+
+
+/*! \typedef struct _discasync_stats discasync_stats
+\brief Request statistics, latencies are from submission to completion in microseconds
+\param submitted requests accepted
+\param completed requests finished successfully
+\param canceled requests canceled
+\param errors requests failed by the device
+\param depth requests currently queued or in flight
+\param max_depth highest depth seen
+\param latency_min shortest latency
+\param latency_max longest latency
+\param latency_avg running average latency
+*/
+typedef struct _discasync_stats {
+	u32 submitted;
+	u32 completed;
+	u32 canceled;
+	u32 errors;
+	u32 depth;
+	u32 max_depth;
+	u32 latency_min;
+	u32 latency_max;
+	u32 latency_avg;
+} discasync_stats;
+
+
+/*! \fn s32 DiscAsync_Submit(const DISC_INTERFACE *disc,sec_t sector,sec_t numSectors,void *buffer,DiscAsyncCallback cb,void *usrdata)
+\brief Queue a read. Requests to the same device complete in submission order.
+\param[in] disc device to read from
+\param[in] sector first sector
+\param[in] numSectors number of sectors
+\param[out] buffer destination, 32 byte aligned for DMA capable devices
+\param[in] cb completion callback, may be NULL
+\param[in] usrdata passed to the callback
+
+\return request id (>0) or a negative DISCASYNC_E* code. The id of a request with a callback becomes invalid once the callback returned, the id of one without has to be reaped with DiscAsync_Poll() or DiscAsync_Wait().
+*/
+s32 DiscAsync_Submit(const DISC_INTERFACE *disc,sec_t sector,sec_t numSectors,void *buffer,DiscAsyncCallback cb,void *usrdata);
+
+
+/*! \fn s32 DiscAsync_Poll(s32 id)
+\brief Check a request without blocking. A finished request is released.
+\param[in] id request id
+
+\return DISCASYNC_PENDING, DISCASYNC_OK or a negative DISCASYNC_E* code
+*/
+s32 DiscAsync_Poll(s32 id);
+
+
+/*! \fn s32 DiscAsync_Wait(s32 id)
+\brief Block until a request finished and release it.
+\param[in] id request id
+
+\return DISCASYNC_OK or a negative DISCASYNC_E* code
+*/
+s32 DiscAsync_Wait(s32 id);
+
+
+/*! \fn s32 DiscAsync_Cancel(s32 id)
+\brief Cancel a request that hasn't been passed to the device yet. Its callback runs with DISCASYNC_ECANCELED.
+\param[in] id request id
+
+\return DISCASYNC_OK, DISCASYNC_EBUSY if the read already started or DISCASYNC_EINVAL
+*/
+s32 DiscAsync_Cancel(s32 id);
+
+
+/*! \fn void DiscAsync_GetStats(discasync_stats *stats)
+\brief Get the request statistics.
+\param[out] stats statistics
+
+\return none
+*/
+void DiscAsync_GetStats(discasync_stats *stats);
+
+
+/*! \fn void DiscAsync_ResetStats(void)
+\brief Clear the request statistics, except for the current depth.
+
+\return none
+*/
+void DiscAsync_ResetStats(void);
+
+
+/*! \fn s32 DiscAsync_SetBackend(u32 ioType,const discasync_backend *backend)
+\brief Register the native asynchronous path for a device type, replacing the worker thread for it.
+\param[in] ioType DISC_INTERFACE ioType the backend serves
+\param[in] backend backend, NULL to remove it
+
+\return DISCASYNC_OK or DISCASYNC_ENOSLOT
+*/
+s32 DiscAsync_SetBackend(u32 ioType,const discasync_backend *backend);
+
+
+/*! \fn void DiscAsync_Complete(discasync_req *req,s32 result)
+\brief Called by backends when a read finished. May be called from interrupt context.
+\param[in] req finished request
+\param[in] result DISCASYNC_OK or a negative DISCASYNC_E* code
+
+\return none
+*/
+void DiscAsync_Complete(discasync_req *req,s32 result);
+
+#ifdef __cplusplus
+   }
+#endif /* __cplusplus */
+
+#endif
@@ -0,0 +1,140 @@
+/*-------------------------------------------------------------
+
+disc_cache.h -- Set-associative sector cache for DISC_INTERFACE devices
+
+Copyright (C) 2026
+
+This software is provided 'as-is', without any express or implied
+warranty.  In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1.	The origin of this software must not be misrepresented; you
+must not claim that you wrote the original software. If you use
+this software in a product, an acknowledgment in the product
+documentation would be appreciated but is not required.
+
+2.	Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3.	This notice may not be removed or altered from any source
+distribution.
+
+-------------------------------------------------------------*/
+
+
+#ifndef __DISC_CACHE_H__
+#define __DISC_CACHE_H__
+
+/*! \file disc_cache.h
+\brief Set-associative sector cache for DISC_INTERFACE devices
+
+*/
+
+#include <gctypes.h>
+#include <ogc/disc_io.h>
+
+#define DISCCACHE_MAX				4			/*!< max. number of caches active at the same time */
+
+#define DISCCACHE_POLICY_LRU		0			/*!< evict the least recently used page of a set */
+#define DISCCACHE_POLICY_2Q			1			/*!< scan resistant 2Q: pages have to be referenced twice to enter the main LRU queue */
+
+#ifdef __cplusplus
+   extern "C" {
+#endif /* __cplusplus */
+
+
+/*! \typedef struct _disccache_stats disccache_stats
+\brief Cache statistics, page counts unless noted otherwise.
+\param read_hits pages read from the cache
+\param read_misses pages that had to be fetched from the device on read
+\param readahead pages fetched ahead of a sequential reader
+\param write_hits pages written that were already cached
+\param write_misses pages written that had to be allocated
+\param evictions valid pages dropped to make room
+\param writebacks dirty pages written back to the device
+\param bytes_read bytes read from the device
+\param bytes_written bytes written to the device
+*/
+typedef struct _disccache_stats {
+	u32 read_hits;
+	u32 read_misses;
+	u32 readahead;
+	u32 write_hits;
+	u32 write_misses;
+	u32 evictions;
+	u32 writebacks;
+	u64 bytes_read;
+	u64 bytes_written;
+} disccache_stats;
+
+
+/*! \fn const DISC_INTERFACE* DiscCache_Create(const DISC_INTERFACE *disc,u32 sector_size,u32 page_sectors,u32 pages,u32 ways,u32 policy)
+\brief Wrap a device with a write-back cache. The returned interface is used in place of the device one.
+\param[in] disc device to cache
+\param[in] sector_size sector size of the device in bytes
+\param[in] page_sectors sectors per cache page
+\param[in] pages total number of cache pages, rounded down to a multiple of ways
+\param[in] ways pages per set
+\param[in] policy DISCCACHE_POLICY_LRU or DISCCACHE_POLICY_2Q
+
+\return cached interface or NULL if no slot or memory is available
+*/
+const DISC_INTERFACE* DiscCache_Create(const DISC_INTERFACE *disc,u32 sector_size,u32 page_sectors,u32 pages,u32 ways,u32 policy);
+
+
+/*! \fn bool DiscCache_Destroy(const DISC_INTERFACE *cached)
+\brief Write back all dirty pages and release the cache.
+\param[in] cached interface returned by DiscCache_Create()
+
+\return true if all dirty pages were written
+*/
+bool DiscCache_Destroy(const DISC_INTERFACE *cached);
+
+
+/*! \fn bool DiscCache_Flush(const DISC_INTERFACE *cached)
+\brief Write back all dirty pages. The pages stay cached.
+\param[in] cached interface returned by DiscCache_Create()
+
+\return true if all dirty pages were written
+*/
+bool DiscCache_Flush(const DISC_INTERFACE *cached);
+
+
+/*! \fn void DiscCache_Invalidate(const DISC_INTERFACE *cached)
+\brief Drop all pages without writing them back, e.g. after a medium change.
+\param[in] cached interface returned by DiscCache_Create()
+*/
+void DiscCache_Invalidate(const DISC_INTERFACE *cached);
+
+
+/*! \fn void DiscCache_SetReadAhead(const DISC_INTERFACE *cached,u32 max_pages)
+\brief Set the maximum read-ahead window used for sequential readers. 0 disables read-ahead.
+\param[in] cached interface returned by DiscCache_Create()
+\param[in] max_pages window in pages
+*/
+void DiscCache_SetReadAhead(const DISC_INTERFACE *cached,u32 max_pages);
+
+
+/*! \fn void DiscCache_GetStats(const DISC_INTERFACE *cached,disccache_stats *stats)
+\brief Get the cache statistics.
+\param[in] cached interface returned by DiscCache_Create()
+\param[out] stats structure receiving the statistics
+*/
+void DiscCache_GetStats(const DISC_INTERFACE *cached,disccache_stats *stats);
+
+
+/*! \fn void DiscCache_ResetStats(const DISC_INTERFACE *cached)
+\brief Reset the cache statistics.
+\param[in] cached interface returned by DiscCache_Create()
+*/
+void DiscCache_ResetStats(const DISC_INTERFACE *cached);
+
+#ifdef __cplusplus
+   }
+#endif /* __cplusplus */
+
+#endif
@@ -0,0 +1,162 @@
+/*-------------------------------------------------------------
+
+dspadpcm.h -- DSP-ADPCM encoder and decoder
+
+Copyright (C) 2026
+
+This software is provided 'as-is', without any express or implied
+warranty.  In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1.	The origin of this software must not be misrepresented; you
+must not claim that you wrote the original software. If you use
+this software in a product, an acknowledgment in the product
+documentation would be appreciated but is not required.
+
+2.	Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3.	This notice may not be removed or altered from any source
+distribution.
+
+-------------------------------------------------------------*/
+
+
+#ifndef __DSPADPCM_H__
+#define __DSPADPCM_H__
+
+/*! \file dspadpcm.h
+\brief DSP-ADPCM encoder and decoder
+
+*/
+
+#include <gctypes.h>
+
+#define DSPADPCM_FRAME_SAMPLES		14			/*!< samples per 8 byte frame */
+#define DSPADPCM_FRAME_BYTES		8
+#define DSPADPCM_FRAME_NIBBLES		16
+
+#ifdef __cplusplus
+   extern "C" {
+#endif /* __cplusplus */
+
+
+/*! \typedef struct _dspadpcm_context dspadpcm_context
+\brief Codec state. The encoder and decoder both work in consecutive calls on frame aligned data.
+\param coef 8 pairs of 4.11 fixed point predictor coefficients
+\param pred_scale predictor/scale byte of the last frame
+\param yn1 last output sample
+\param yn2 second to last output sample
+*/
+typedef struct _dspadpcm_context {
+	s16 coef[16];
+	u16 pred_scale;
+	s16 yn1;
+	s16 yn2;
+} dspadpcm_context;
+
+
+/*! \typedef struct _dspadpcm_header dspadpcm_header
+\brief 96 byte sound header as used by .dsp files. All addresses are nibble addresses, loop_end points at the last nibble played.
+*/
+typedef struct _dspadpcm_header {
+	u32 num_samples;
+	u32 num_nibbles;
+	u32 sample_rate;
+	u16 loop_flag;
+	u16 format;
+	u32 loop_start;
+	u32 loop_end;
+	u32 curr_addr;
+	s16 coef[16];
+	u16 gain;
+	u16 pred_scale;
+	s16 yn1;
+	s16 yn2;
+	u16 loop_pred_scale;
+	s16 loop_yn1;
+	s16 loop_yn2;
+	u16 pad[11];
+} dspadpcm_header;
+
+
+/*! \fn u32 DSPADPCM_GetEncodedSize(u32 samples)
+\brief Get the number of bytes needed to hold samples encoded samples.
+\param[in] samples number of samples
+
+\return size in bytes, rounded up to whole frames
+*/
+u32 DSPADPCM_GetEncodedSize(u32 samples);
+
+
+/*! \fn u32 DSPADPCM_SampleToNibble(u32 sample)
+\brief Convert a sample index into the nibble address used by the DSP accelerator.
+\param[in] sample sample index
+
+\return nibble address
+*/
+u32 DSPADPCM_SampleToNibble(u32 sample);
+
+
+/*! \fn void DSPADPCM_FindCoefficients(const s16 *src,u32 samples,s16 *coef)
+\brief Search the 8 predictor coefficient pairs that best fit the given PCM data.
+\param[in] src 16bit signed mono PCM data
+\param[in] samples number of samples in src
+\param[out] coef array of 16 coefficients receiving the result
+*/
+void DSPADPCM_FindCoefficients(const s16 *src,u32 samples,s16 *coef);
+
+
+/*! \fn void DSPADPCM_Encode(dspadpcm_context *ctx,const s16 *src,u8 *dst,u32 samples)
+\brief Encode PCM data. ctx->coef has to be set up, the history is carried over to the next call.
+\param[in,out] ctx codec state
+\param[in] src 16bit signed mono PCM data
+\param[out] dst buffer receiving DSPADPCM_GetEncodedSize(samples) bytes
+\param[in] samples number of samples. Has to be a multiple of DSPADPCM_FRAME_SAMPLES except for the last call.
+*/
+void DSPADPCM_Encode(dspadpcm_context *ctx,const s16 *src,u8 *dst,u32 samples);
+
+
+/*! \fn void DSPADPCM_Decode(dspadpcm_context *ctx,const u8 *src,s16 *dst,u32 samples)
+\brief Decode ADPCM data the same way the DSP accelerator does.
+\param[in,out] ctx codec state
+\param[in] src ADPCM data, starting at a frame boundary
+\param[out] dst buffer receiving samples PCM samples
+\param[in] samples number of samples to decode
+*/
+void DSPADPCM_Decode(dspadpcm_context *ctx,const u8 *src,s16 *dst,u32 samples);
+
+
+/*! \fn void DSPADPCM_GetLoopContext(const dspadpcm_context *ctx,const u8 *src,u32 loop_start,u16 *pred_scale,s16 *yn1,s16 *yn2)
+\brief Compute the decoder state the DSP needs when jumping back to loop_start.
+\param[in] ctx codec state holding the coefficients, the history is taken as the state at sample 0
+\param[in] src ADPCM data of the whole sound
+\param[in] loop_start loop start sample index
+\param[out] pred_scale predictor/scale byte of the frame holding loop_start
+\param[out] yn1 decoded sample at loop_start-1
+\param[out] yn2 decoded sample at loop_start-2
+*/
+void DSPADPCM_GetLoopContext(const dspadpcm_context *ctx,const u8 *src,u32 loop_start,u16 *pred_scale,s16 *yn1,s16 *yn2);
+
+
+/*! \fn void DSPADPCM_EncodeSound(const s16 *src,u32 samples,u32 rate,s32 loop_start,s32 loop_end,u8 *dst,dspadpcm_header *hdr)
+\brief Encode a whole sound: search coefficients, encode and fill in the header including the loop context.
+\param[in] src 16bit signed mono PCM data
+\param[in] samples number of samples
+\param[in] rate sample rate in Hz
+\param[in] loop_start loop start sample or -1 for a one shot sound
+\param[in] loop_end last sample of the loop, ignored for one shot sounds
+\param[out] dst buffer receiving DSPADPCM_GetEncodedSize(samples) bytes
+\param[out] hdr header receiving the sound description, all zero when samples is 0
+*/
+void DSPADPCM_EncodeSound(const s16 *src,u32 samples,u32 rate,s32 loop_start,s32 loop_end,u8 *dst,dspadpcm_header *hdr);
+
+#ifdef __cplusplus
+   }
+#endif /* __cplusplus */
+
+#endif
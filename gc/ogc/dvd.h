@@ -99,6 +99,19 @@ distribution.
  */
 
 
+/*! 
+ * \addtogroup dvd_schedmode DVD read scheduling modes
+ * @{
+ */
+
+#define DVD_SCHED_FIFO					0			/*!< Issue reads in submission order (default) */
+#define DVD_SCHED_CSCAN					1			/*!< Sort reads of equal priority by disc offset and merge adjacent ones */
+
+/*!
+ * @}
+ */
+
+
 #ifdef __cplusplus
    extern "C" {
 #endif /* __cplusplus */
@@ -225,6 +238,30 @@ struct _dvdfileinfo {
 };
 
 
+/*!
+ * \typedef struct _dvdschedstats dvdschedstats
+ *
+ *        This structure holds the read scheduler statistics.
+ *
+ * \param commands drive read commands issued
+ * \param requests read requests completed
+ * \param merged read requests served by another request's drive command
+ * \param seeks drive read commands not starting where the previous one ended
+ * \param seekdist total seek distance in bytes
+ * \param bytes bytes transferred by completed read commands
+ * \param throughput transfer rate in KB/s while the drive was reading
+ */
+typedef struct _dvdschedstats {
+	u32 commands;
+	u32 requests;
+	u32 merged;
+	u32 seeks;
+	u64 seekdist;
+	u64 bytes;
+	u32 throughput;
+} dvdschedstats;
+
+
 /*! 
  * \fn void DVD_Init(void)
  * \brief Initializes the DVD subsystem
@@ -356,6 +393,43 @@ u32 DVD_SetAutoInvalidation(u32 auto_inv);
 dvddiskid* DVD_GetCurrentDiskID(void);
 dvddrvinfo* DVD_GetDriveInfo(void);
 
+
+/*! 
+ * \fn u32 DVD_SetScheduler(u32 mode)
+ * \brief Selects how queued read requests are ordered.
+ *
+ *        With DVD_SCHED_CSCAN, pending reads of the same priority are served in ascending<br>
+ *        disc offset order starting from the current head position, wrapping around once<br>
+ *        the end is reached. Reads that continue both on disc and in memory are merged into<br>
+ *        a single drive command. Higher priorities are still served first and other commands<br>
+ *        are never moved across.
+ *
+ * \param[in] mode \ref dvd_schedmode "scheduling mode"
+ *
+ * \return previous scheduling mode
+ */
+u32 DVD_SetScheduler(u32 mode);
+
+
+/*! 
+ * \fn void DVD_GetSchedStats(dvdschedstats *stats)
+ * \brief Returns the read scheduler statistics.
+ *
+ * \param[out] stats pointer to a dvdschedstats structure to fill
+ *
+ * \return none
+ */
+void DVD_GetSchedStats(dvdschedstats *stats);
+
+
+/*! 
+ * \fn void DVD_ResetSchedStats(void)
+ * \brief Clears the read scheduler statistics.
+ *
+ * \return none
+ */
+void DVD_ResetSchedStats(void);
+
 #define DVD_SetUserData(block, data) ((block)->usrdata = (data))
 #define DVD_GetUserData(block)       ((block)->usrdata)
 
@@ -25,6 +25,32 @@
 #define	USBSTORAGE_EINIT		-10009
 #define USBSTORAGE_PROCESSING	-10010
 
+#define USBSTORAGE_PIPE_DEPTH	4		// bulk transfers queued to IOS per command
+
+typedef struct
+{
+	u64 bytes_read;
+	u64 bytes_written;
+	u64 read_ticks;
+	u64 write_ticks;
+	u32 commands;
+	u32 errors;
+	u32 staged;				// data chunks that went through a staging buffer
+	u32 latency_min;		// per command, in microseconds
+	u32 latency_max;
+	u32 latency_avg;
+	f32 read_mbps;			// MB/s while reading
+	f32 write_mbps;
+} usbstorage_stats;
+
+typedef struct
+{
+	vs32 retval;
+	u8 *stage;
+	u8 *dst;
+	u32 len;
+} usbstorage_xfer;
+
 typedef struct
 {
 	u8 configuration;
@@ -48,6 +74,11 @@ typedef struct
 	u8 suspended;
 
 	u8 *buffer;
+	u8 *pool[USBSTORAGE_PIPE_DEPTH];
+	usbstorage_xfer xfer[USBSTORAGE_PIPE_DEPTH];
+	vs32 cbw_retval;
+	vs32 csw_retval;
+	usbstorage_stats stats;
 } usbstorage_handle;
 
 #define B_RAW_DEVICE_DATA_IN 0x01
@@ -79,6 +110,8 @@ s32 USBStorage_ReadCapacity(usbstorage_handle *dev, u8 lun, u32 *sector_size, u3
 s32 USBStorage_Read(usbstorage_handle *dev, u8 lun, u32 sector, u16 n_sectors, u8 *buffer);
 s32 USBStorage_Write(usbstorage_handle *dev, u8 lun, u32 sector, u16 n_sectors, const u8 *buffer);
 s32 USBStorage_StartStop(usbstorage_handle *dev, u8 lun, u8 lo_ej, u8 start, u8 imm);
+void USBStorage_GetStats(usbstorage_handle *dev, usbstorage_stats *stats);
+void USBStorage_ResetStats(usbstorage_handle *dev);
 
 #define DEVICE_TYPE_WII_USB (('W'<<24)|('U'<<16)|('S'<<8)|'B')
 
@@ -24,6 +24,15 @@ typedef enum {
     CARD_IO_BYTE_ADDRESSING = 1,
 } card_addressing_type_t;
 
+typedef struct _sdgecko_stats {
+	u64 sectors_read;
+	u64 sectors_written;
+	u64 read_ticks;
+	u64 write_ticks;
+	u32 read_sps;			// sustained sectors/sec, filled in by sdgecko_getStats
+	u32 write_sps;
+} sdgecko_stats;
+
 #ifdef __cplusplus
    extern "C" {
 #endif /* __cplusplus */
@@ -57,6 +66,12 @@ s32 sdgecko_setPageSize(s32 drv_no, u32 size);
 
 card_addressing_type_t sdgecko_getAddressingType(s32 drv_no);
 
+// Move data blocks with EXI DMA instead of immediate transfers. Off by
+// default; compare both paths with sdgecko_getStats.
+void sdgecko_setDMA(s32 drv_no, bool enable);
+void sdgecko_getStats(s32 drv_no, sdgecko_stats *stats);
+void sdgecko_resetStats(s32 drv_no);
+
 
 #ifdef __cplusplus
    }
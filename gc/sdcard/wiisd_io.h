@@ -39,6 +39,35 @@
 
 #define DEVICE_TYPE_WII_SD (('W'<<24)|('I'<<16)|('S'<<8)|'D')
 
+#define WIISD_BOUNCE_DEFAULT	8		// sectors
+
+typedef struct _wiisd_stats {
+	u64 bytes_read;
+	u64 bytes_written;
+	u64 read_ticks;
+	u64 write_ticks;
+	u64 bytes_bounced;		// bytes copied: writes via the bounce pool, read tails via rw_buffer
+	u32 commands;			// SDIO data commands issued
+	u32 errors;
+	f32 read_mbps;			// filled in by WIISD_GetStats
+	f32 write_mbps;
+} wiisd_stats;
+
 extern const DISC_INTERFACE __io_wiisd;
 
+#ifdef __cplusplus
+	extern "C" {
+#endif
+
+// Size of the buffer used for writes from (and read tails into) buffers
+// that aren't 32 byte aligned. 0 selects the default. Don't call while
+// the device is in use.
+bool WIISD_SetBouncePool(u32 sectors);
+void WIISD_GetStats(wiisd_stats *stats);
+void WIISD_ResetStats(void);
+
+#ifdef __cplusplus
+	}
+#endif
+
 #endif
@@ -51,6 +51,7 @@
 #define SMB_BAD_KEYLEN			   -6
 #define SMB_BAD_DATALEN			   -7
 #define SMB_BAD_LOGINDATA		   -8
+#define SMB_NO_MORE_FILES		   -9
 
 /**
 * SMB File Open Function
@@ -110,6 +111,32 @@ typedef void* SMBFILE;
   char name[768]; //unicode
 } SMBDIRENTRY;
 
+/*** smb_cache_stats
+     Cache statistics of a mounted share
+ ***/
+typedef struct
+{
+  u32 hits;           // page lookups served from the cache
+  u32 misses;         // page lookups fetched by the reader
+  u32 prefetched;     // pages fetched by the read-ahead thread
+  u32 prefetch_hits;  // prefetched pages used before eviction
+  u32 evictions;
+  u32 meta_hits;      // stat/open/opendir lookups served from the metadata cache
+  u32 meta_misses;    // lookups that had to ask the server
+  u32 meta_negative;  // lookups answered "not found" from a cached listing
+} smb_cache_stats;
+
+/*** SMBSTATS
+     Transfer statistics of a connection
+ ***/
+typedef struct
+{
+  u64 read_bytes;
+  u64 read_usecs;     // time spent in SMB_ReadFile
+  u64 write_bytes;
+  u64 write_usecs;    // time spent in SMB_WriteFile
+} SMBSTATS;
+
 /**
  * Prototypes
  */
@@ -120,11 +147,16 @@ bool smbInit(const char *user, const char *password, const char *share,	const ch
 void smbClose(const char* name);
 bool smbCheckConnection(const char* name);
 void smbSetSearchFlags(unsigned short flags);
+bool smbSetMetadataCache(const char *name, u32 entries, u32 ttl);
+bool smbGetCacheStats(const char *name, smb_cache_stats *stats);
+void smbResetCacheStats(const char *name);
 
 /*** Session ***/
 s32 SMB_Connect(SMBCONN *smbhndl, const char *user, const char *password, const char *share, const char *IP);
 void SMB_Close(SMBCONN smbhndl);
 s32 SMB_Reconnect(SMBCONN *_smbhndl, bool test_conn);
+s32 SMB_SetPipelineDepth(SMBCONN smbhndl, u32 depth);
+s32 SMB_GetStats(SMBCONN smbhndl, SMBSTATS *stats);
 
 /*** File Find ***/
 s32 SMB_PathInfo(const char *filename, SMBDIRENTRY *sdir, SMBCONN smbhndl);
@@ -136,6 +168,7 @@ s32 SMB_FindClose(SMBDIRENTRY *sdir,SMBCONN smbhndl);
 SMBFILE SMB_OpenFile(const char *filename, unsigned short access, unsigned short creation,SMBCONN smbhndl);
 void SMB_CloseFile(SMBFILE sfid);
 s32 SMB_ReadFile(char *buffer, size_t size, off_t offset, SMBFILE sfid);
+s32 SMB_ReadPath(const char *filename, char *buffer, size_t size, off_t offset, SMBCONN smbhndl);
 s32 SMB_WriteFile(const char *buffer, size_t size, off_t offset, SMBFILE sfid);
 s32 SMB_CreateDirectory(const char *dirname, SMBCONN smbhndl);
 s32 SMB_DeleteDirectory(const char *dirname, SMBCONN smbhndl);
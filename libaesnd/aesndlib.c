@@ -1,6 +1,8 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <malloc.h>
 #include <ogcsys.h>
 #include <gccore.h>
 #include <ogc/lwp_watchdog.h>
@@ -12,6 +14,14 @@
 #define PB_STRUCT_SIZE			64
 #define DSP_DRAMSIZE			8192
 
+#define ADAPT_WINDOW			1000			// quiet DMA periods before shrinking the buffer count
+
+#define STREAM_STACKSIZE		16384
+#define STREAM_PRIORITY			80
+#if defined(HW_DOL)
+#define STREAM_ARAMSIZE			(256*1024)
+#endif
+
 
 #define VOICE_PAUSE    0x00000008
 #define VOICE_LOOP     0x00000010
@@ -20,6 +30,8 @@
 
 #define VOICE_FINISHED			0x00100000
 #define VOICE_STOPPED			0x00200000
+#define VOICE_RING				0x00400000
+#define VOICE_STARVED			0x00800000
 #define VOICE_RUNNING			0x40000000
 #define VOICE_USED				0x80000000
 
@@ -62,10 +74,38 @@ struct aesndpb_t
 	void *audioCBArg;
 };
 
+typedef struct _aesndstream
+{
+	AESNDStreamReaderArg reader;
+	void *cbArg;
+
+	u8 *buffer;					// ring on Wii, ARAM staging block on GC
+	u32 aram;
+	u32 size;
+	u32 blocks;
+	u32 blocksize;
+
+	vu32 ready;					// one bit per filled block
+	u32 fill_block;
+	u32 play_block;
+	u32 eos_block;
+	vu32 underruns;
+	volatile bool eos;
+	volatile bool active;
+} aesndstream;
+
 static dsptask_t __aesnddsptask;
 
 static vu32 __aesndinit = 0;
-static vu32 __aesndcurrab = 0;
+static vu32 __aesndplayab = 0;
+static vu32 __aesndmixab = 0;
+static vu32 __aesndqueuedab = 0;
+static vu32 __aesnddoneab = 0;
+static vs32 __aesndlastab = -1;
+static vu32 __aesndnumab = 2;
+static vu32 __aesndtargetab = 0;
+static vu32 __aesndquietcnt = 0;
+static vu32 __aesndunderruns = 0;
 static vu32 __aesnddspinit = 0;
 static vu32 __aesndcurrvoice = 0;
 static vu32 __aesnddspcomplete = 0;
@@ -78,14 +118,23 @@ static volatile bool __aesndvoicesstopped = true;
 #if defined(HW_DOL)
 static u32 __aesndarambase = 0;
 static u32 __aesndaramblocks[MAX_VOICES];
-static u32 __aesndarammemory[MAX_VOICES];
+static u32 __aesndarammemory[MAX_VOICES+1];
+static u32 __aesndstreamarambase = 0;
 #endif
 
+static lwp_t __aesndstreamthread = LWP_THREAD_NULL;
+static lwpq_t __aesndstreamqueue = LWP_TQUEUE_NULL;
+static mutex_t __aesndstreamlock = LWP_MUTEX_NULL;
+static vu32 __aesndstreampending = 0;
+static volatile bool __aesndstreamrun = false;
+static aesndstream __aesndstream[MAX_VOICES];
+static u8 __aesndstreamstack[STREAM_STACKSIZE] ATTRIBUTE_ALIGN(8);
+
 static AESNDPB __aesndvoicepb[MAX_VOICES];
 static AESNDPB __aesndcommand ATTRIBUTE_ALIGN(32);
 static u8 __dspdram[DSP_DRAMSIZE] ATTRIBUTE_ALIGN(32);
 static u8 mute_buffer[SND_BUFFERSIZE] ATTRIBUTE_ALIGN(32);
-static u8 audio_buffer[2][SND_BUFFERSIZE] ATTRIBUTE_ALIGN(32);
+static u8 audio_buffer[SND_MAXBUFFERS][SND_BUFFERSIZE] ATTRIBUTE_ALIGN(32);
 
 static __inline__ void snd_set0b(char *p,int n)
 {
@@ -303,6 +352,184 @@ static __inline__ void __aesndhandlerequest(AESNDPB *pb)
 }
 #endif
 
+static void __aesndstreamfill(AESNDPB *pb,aesndstream *s)
+{
+	s32 len;
+	u8 *ptr;
+	u32 level;
+	bool last;
+
+	while(!s->eos && !(s->ready&(1<<s->fill_block))) {
+#if defined(HW_DOL)
+		ptr = s->buffer;
+#elif defined(HW_RVL)
+		ptr = s->buffer + (s->fill_block*s->blocksize);
+#endif
+		last = false;
+		len = s->reader(pb,ptr,s->blocksize,s->cbArg);
+		if(len<(s32)s->blocksize) {
+			if(len<0) len = 0;
+			memset(ptr + len,0,s->blocksize - len);
+			last = true;
+		}
+		DCFlushRange(ptr,s->blocksize);
+#if defined(HW_DOL)
+		ARQ_PostRequest(&arq_request[pb->voiceno],pb->voiceno,ARQ_MRAMTOARAM,ARQ_PRIO_LO,s->aram + (s->fill_block*s->blocksize),(u32)MEM_VIRTUAL_TO_PHYSICAL(ptr),s->blocksize);
+#endif
+
+		_CPU_ISR_Disable(level);
+		s->ready |= (1<<s->fill_block);
+		if(last==true) {
+			s->eos_block = s->fill_block;
+			s->eos = true;
+		}
+		s->fill_block = (s->fill_block + 1)%s->blocks;
+		_CPU_ISR_Restore(level);
+	}
+}
+
+static void* __aesndstreamthreadfunc(void *arg)
+{
+	u32 i,level;
+
+	while(__aesndstreamrun==true) {
+		_CPU_ISR_Disable(level);
+		__aesndstreampending = 0;
+		_CPU_ISR_Restore(level);
+
+		LWP_MutexLock(__aesndstreamlock);
+		for(i=0;i<MAX_VOICES;i++) {
+			if(__aesndstream[i].active==true)
+				__aesndstreamfill(&__aesndvoicepb[i],&__aesndstream[i]);
+		}
+		LWP_MutexUnlock(__aesndstreamlock);
+
+		_CPU_ISR_Disable(level);
+		if(!__aesndstreampending && __aesndstreamrun==true)
+			LWP_ThreadSleep(__aesndstreamqueue);
+		_CPU_ISR_Restore(level);
+	}
+	return NULL;
+}
+
+static __inline__ void __aesndhandlestream(AESNDPB *pb)
+{
+	register u32 pos,curr,ahead,bytes;
+	aesndstream *s = &__aesndstream[pb->voiceno];
+
+	if(s->active==false) return;
+
+	pos = (pb->buf_curr - pb->buf_start)<<pb->shift;
+	curr = pos/s->blocksize;
+	while(s->play_block!=curr) {
+		s->ready &= ~(1<<s->play_block);
+		if(s->eos==true && s->play_block==s->eos_block) {
+			s->active = false;
+			pb->flags |= VOICE_STOPPED;
+			return;
+		}
+		s->play_block = (s->play_block + 1)%s->blocks;
+
+		__aesndstreampending = 1;
+		LWP_ThreadSignal(__aesndstreamqueue);
+	}
+
+	// bytes the DSP will consume during the next 2ms frame
+	bytes = (((pb->freq_h<<16)|pb->freq_l)*(SND_BUFFERSIZE>>2))>>16;
+	bytes = (bytes + 1)<<pb->shift;
+	if(pb->flags&0x01) bytes <<= 1;
+
+	ahead = ((pos + bytes)%s->size)/s->blocksize;
+	if(s->eos==true && curr==s->eos_block) ahead = curr;
+
+	if(!(s->ready&(1<<curr)) || !(s->ready&(1<<ahead))) {
+		if(!(pb->flags&VOICE_STARVED)) {
+			s->underruns++;
+			pb->flags |= (VOICE_PAUSE|VOICE_STARVED);
+			if(pb->cb) pb->cb(pb,VOICE_STATE_UNDERRUN,pb->cbArg);
+		}
+	} else if(pb->flags&VOICE_STARVED)
+		pb->flags &= ~(VOICE_PAUSE|VOICE_STARVED);
+}
+
+#if defined(HW_DOL)
+static u32 __aesndstreamaramalloc(u32 len)
+{
+	u32 i,addr;
+	bool moved;
+
+	addr = __aesndstreamarambase;
+	do {
+		moved = false;
+		for(i=0;i<MAX_VOICES;i++) {
+			aesndstream *s = &__aesndstream[i];
+			if(!s->aram) continue;
+			if(addr<(s->aram + s->size) && s->aram<(addr + len)) {
+				addr = s->aram + s->size;
+				moved = true;
+			}
+		}
+	} while(moved==true);
+
+	if((addr + len)>(__aesndstreamarambase + STREAM_ARAMSIZE)) return 0;
+	return addr;
+}
+#endif
+
+static void __aesndreleasestream(AESNDPB *pb)
+{
+	u32 level;
+	aesndstream *s = &__aesndstream[pb->voiceno];
+
+	LWP_MutexLock(__aesndstreamlock);
+	_CPU_ISR_Disable(level);
+	s->active = false;
+	pb->flags &= ~VOICE_RING;
+	_CPU_ISR_Restore(level);
+
+	if(s->buffer) free(s->buffer);
+	memset(s,0,sizeof(aesndstream));
+	LWP_MutexUnlock(__aesndstreamlock);
+}
+
+static s32 __aesndstartstreamthread(void)
+{
+	if(__aesndstreamthread!=LWP_THREAD_NULL) return 0;
+
+	LWP_InitQueue(&__aesndstreamqueue);
+	LWP_MutexInit(&__aesndstreamlock,false);
+
+	__aesndstreamrun = true;
+	if(LWP_CreateThread(&__aesndstreamthread,__aesndstreamthreadfunc,NULL,__aesndstreamstack,STREAM_STACKSIZE,STREAM_PRIORITY)<0) {
+		__aesndstreamrun = false;
+		__aesndstreamthread = LWP_THREAD_NULL;
+		LWP_MutexDestroy(__aesndstreamlock);
+		LWP_CloseQueue(__aesndstreamqueue);
+		return -1;
+	}
+	return 0;
+}
+
+static void __aesndstopstreamthread(void)
+{
+	u32 i;
+
+	if(__aesndstreamthread==LWP_THREAD_NULL) return;
+
+	for(i=0;i<MAX_VOICES;i++) {
+		if(__aesndvoicepb[i].flags&VOICE_RING)
+			__aesndreleasestream(&__aesndvoicepb[i]);
+	}
+
+	__aesndstreamrun = false;
+	LWP_ThreadSignal(__aesndstreamqueue);
+	LWP_JoinThread(__aesndstreamthread,NULL);
+	__aesndstreamthread = LWP_THREAD_NULL;
+
+	LWP_MutexDestroy(__aesndstreamlock);
+	LWP_CloseQueue(__aesndstreamqueue);
+}
+
 static void __dsp_initcallback(dsptask_t *task)
 {
 	DSP_SendMailTo(0xface0080);
@@ -319,12 +546,46 @@ static void __dsp_resumecallback(dsptask_t *task)
 {
 }
 
+static void __aesndstartmix(void)
+{
+	__aesndcurrvoice = 0;
+	__aesnddspprocesstime = 0;
+	while(__aesndcurrvoice<MAX_VOICES && (!(__aesndvoicepb[__aesndcurrvoice].flags&VOICE_USED) || (__aesndvoicepb[__aesndcurrvoice].flags&VOICE_STOPPED))) __aesndcurrvoice++;
+	if(__aesndcurrvoice>=MAX_VOICES) {
+		__aesndvoicesstopped = true;
+		return;
+	}
+
+	__aesnddspcomplete = 0;
+	__aesndvoicesstopped = false;
+	__aesndcopycommand(&__aesndcommand,&__aesndvoicepb[__aesndcurrvoice]);
+
+	if(__aesndcommand.cb) __aesndcommand.cb(&__aesndcommand,VOICE_STATE_RUNNING,__aesndcommand.cbArg);
+
+	__aesnddoneab &= ~(1<<__aesndmixab);
+	__aesndqueuedab++;
+
+	__aesndcommand.out_buf = (u32)MEM_VIRTUAL_TO_PHYSICAL(audio_buffer[__aesndmixab]);
+	DCFlushRange(&__aesndcommand,PB_STRUCT_SIZE);
+
+	__aesnddspstarttime = gettime();
+	DSP_SendMailTo(0xface0010);
+	while(DSP_CheckMailTo());
+}
+
 static void __dsp_requestcallback(dsptask_t *task)
 {
 	if(__aesnddspabrequested==1) {
 		__aesnddspprocesstime = (gettime() - __aesnddspstarttime);
 		__aesnddspabrequested = 0;
+		__aesnddoneab |= (1<<__aesndmixab);
+		__aesndmixab = (__aesndmixab + 1)%SND_MAXBUFFERS;
 		__aesnddspcomplete = 1;
+		AUDIO_SignalMixDone();
+
+		// with more than two buffers keep mixing ahead of the AI
+		if(__aesndglobalpause==false && (__aesndqueuedab + 2)<__aesndnumab)
+			__aesndstartmix();
 		return;
 	}
 
@@ -333,7 +594,10 @@ static void __dsp_requestcallback(dsptask_t *task)
 	if(__aesndcommand.flags&VOICE_FINISHED) {
 		__aesndcommand.flags &= ~VOICE_FINISHED;
 
-		__aesndhandlerequest(&__aesndcommand);
+		if(__aesndcommand.flags&VOICE_RING)
+			__aesndhandlestream(&__aesndcommand);
+		else
+			__aesndhandlerequest(&__aesndcommand);
 
 		if(__aesndcommand.flags&VOICE_STOPPED && __aesndcommand.cb) __aesndcommand.cb(&__aesndcommand,VOICE_STATE_STOPPED,__aesndcommand.cbArg);
 
@@ -368,42 +632,55 @@ static void __dsp_donecallback(dsptask_t *task)
 	__aesnddspabrequested = 0;
 }
 
+static void __aesndadaptbuffers(bool underrun)
+{
+	if(!__aesndtargetab) return;
+
+	if(underrun==true) {
+		__aesndquietcnt = 0;
+		if(__aesndnumab<SND_MAXBUFFERS) __aesndnumab++;
+	} else if(__aesndnumab>__aesndtargetab) {
+		if(++__aesndquietcnt>=ADAPT_WINDOW) {
+			__aesndquietcnt = 0;
+			__aesndnumab--;
+		}
+	}
+}
+
 static void __audio_dma_callback(void)
 {
 	void *ptr;
+	bool underrun = false;
 
-	__aesndcurrab ^= 1;
-	if(__aesndglobalpause==true || __aesndvoicesstopped==true)
-		ptr = mute_buffer;
-	else
-		ptr = audio_buffer[__aesndcurrab];
-
-	if(__aesndcommand.audioCB) __aesndcommand.audioCB(ptr,SND_BUFFERSIZE,__aesndcommand.audioCBArg);
-	AUDIO_InitDMA((u32)ptr,SND_BUFFERSIZE);
-
-	if(__aesndglobalpause==true) return;
-	if(!__aesnddspcomplete || !__aesnddspinit) return;
-
-	__aesndcurrvoice = 0;
-	__aesnddspprocesstime = 0;
-	while(__aesndcurrvoice<MAX_VOICES && (!(__aesndvoicepb[__aesndcurrvoice].flags&VOICE_USED) || (__aesndvoicepb[__aesndcurrvoice].flags&VOICE_STOPPED))) __aesndcurrvoice++;
-	if(__aesndcurrvoice>=MAX_VOICES) {
-		__aesndvoicesstopped = true;
+	if(__aesndglobalpause==true) {
+		__aesndlastab = -1;
+		if(__aesndcommand.audioCB) __aesndcommand.audioCB(mute_buffer,SND_BUFFERSIZE,__aesndcommand.audioCBArg);
+		AUDIO_InitDMA((u32)mute_buffer,SND_BUFFERSIZE);
 		return;
 	}
 
-	__aesnddspcomplete = 0;
-	__aesndvoicesstopped = false;
-	__aesndcopycommand(&__aesndcommand,&__aesndvoicepb[__aesndcurrvoice]);
+	// the buffer handed over on the previous interrupt starts playing now
+	if(__aesndlastab>=0 && !(__aesnddoneab&(1<<__aesndlastab))) underrun = true;
 
-	if(__aesndcommand.cb) __aesndcommand.cb(&__aesndcommand,VOICE_STATE_RUNNING,__aesndcommand.cbArg);
+	if(__aesndqueuedab<(__aesndnumab - 1) && __aesnddspcomplete && __aesnddspinit)
+		__aesndstartmix();
 
-	__aesndcommand.out_buf = (u32)MEM_VIRTUAL_TO_PHYSICAL(audio_buffer[__aesndcurrab]);
-	DCFlushRange(&__aesndcommand,PB_STRUCT_SIZE);
+	if(__aesndqueuedab) {
+		ptr = audio_buffer[__aesndplayab];
+		__aesndlastab = __aesndplayab;
+		__aesndplayab = (__aesndplayab + 1)%SND_MAXBUFFERS;
+		__aesndqueuedab--;
+	} else {
+		if(__aesndvoicesstopped==false) underrun = true;
+		ptr = mute_buffer;
+		__aesndlastab = -1;
+	}
 
-	__aesnddspstarttime = gettime();
-	DSP_SendMailTo(0xface0010);
-	while(DSP_CheckMailTo());
+	if(underrun==true) __aesndunderruns++;
+	__aesndadaptbuffers(underrun);
+
+	if(__aesndcommand.audioCB) __aesndcommand.audioCB(ptr,SND_BUFFERSIZE,__aesndcommand.audioCBArg);
+	AUDIO_InitDMA((u32)ptr,SND_BUFFERSIZE);
 }
 
 
@@ -429,7 +706,7 @@ void AESND_Init(void)
 	u32 i,level;
 
 #if defined(HW_DOL)
-	__aesndarambase = AR_Init(__aesndarammemory,MAX_VOICES);
+	__aesndarambase = AR_Init(__aesndarammemory,MAX_VOICES+1);
 	ARQ_Init();
 #endif
 	DSP_Init();
@@ -440,7 +717,12 @@ void AESND_Init(void)
 	_CPU_ISR_Disable(level);
 	if(!__aesndinit) {
 		__aesndinit = 1;
-		__aesndcurrab = 0;
+		__aesndplayab = 0;
+		__aesndmixab = 0;
+		__aesndqueuedab = 0;
+		__aesnddoneab = 0;
+		__aesndlastab = -1;
+		__aesndunderruns = 0;
 		__aesnddspinit = 0;
 		__aesnddspcomplete = 0;
 		__aesndglobalpause = false;
@@ -448,13 +730,12 @@ void AESND_Init(void)
 
 #if defined(HW_DOL)
 		for(i=0;i<MAX_VOICES;i++) __aesndaramblocks[i] = AR_Alloc(DSP_STREAMBUFFER_SIZE*2);
+		__aesndstreamarambase = AR_Alloc(STREAM_ARAMSIZE);
 #endif
 		snd_set0w((int*)mute_buffer,SND_BUFFERSIZE>>2);
-		snd_set0w((int*)audio_buffer[0],SND_BUFFERSIZE>>2);
-		snd_set0w((int*)audio_buffer[1],SND_BUFFERSIZE>>2);
+		snd_set0w((int*)audio_buffer,(SND_BUFFERSIZE*SND_MAXBUFFERS)>>2);
 		DCFlushRange(mute_buffer,SND_BUFFERSIZE);
-		DCFlushRange(audio_buffer[0],SND_BUFFERSIZE);
-		DCFlushRange(audio_buffer[1],SND_BUFFERSIZE);
+		DCFlushRange(audio_buffer,SND_BUFFERSIZE*SND_MAXBUFFERS);
 
 		snd_set0w((int*)&__aesndcommand,sizeof(struct aesndpb_t)>>2);
 		for(i=0;i<MAX_VOICES;i++)
@@ -464,7 +745,7 @@ void AESND_Init(void)
 	}
 
 	AUDIO_RegisterDMACallback(__audio_dma_callback);
-	AUDIO_InitDMA((u32)audio_buffer[__aesndcurrab],SND_BUFFERSIZE);
+	AUDIO_InitDMA((u32)mute_buffer,SND_BUFFERSIZE);
 	AUDIO_StartDMA();
 
 	_CPU_ISR_Restore(level);
@@ -474,6 +755,8 @@ void AESND_Reset(void)
 {
 	u32 level;
 
+	__aesndstopstreamthread();
+
 	_CPU_ISR_Disable(level);
 	if(__aesndinit) {
 		AUDIO_StopDMA();
@@ -488,7 +771,7 @@ void AESND_Reset(void)
 		
 #if defined(HW_DOL)
 		u32 i=0;
-		for(;i<MAX_VOICES;i++) 
+		for(;i<(MAX_VOICES+1);i++)
 			AR_Free(NULL);
 #endif
 		__aesndinit = 0;
@@ -579,6 +862,8 @@ void AESND_FreeVoice(AESNDPB *pb)
 	u32 level;
 	if(pb==NULL) return;
 
+	if(pb->flags&VOICE_RING) __aesndreleasestream(pb);
+
 	_CPU_ISR_Disable(level);
 	snd_set0w((int*)pb,sizeof(struct aesndpb_t)>>2);
 	_CPU_ISR_Restore(level);
@@ -715,3 +1000,146 @@ void AESND_SetVoiceDelay(AESNDPB *pb,u32 delay)
 	pb->delay = (delay*48);
 	_CPU_ISR_Restore(level);
 }
+
+AESNDPB* AESND_AllocateStreamWithArg(u32 blocks,u32 blocksize,AESNDStreamReaderArg reader,AESNDVoiceCallbackArg cb,void *cbArg)
+{
+	u32 level;
+	AESNDPB *pb;
+	aesndstream *s;
+
+	if(reader==NULL || blocks<2 || blocks>STREAM_MAXBLOCKS) return NULL;
+	if(blocksize<DSP_STREAMBUFFER_SIZE) blocksize = DSP_STREAMBUFFER_SIZE;
+	blocksize = (blocksize + 31)&~31;
+
+	if(__aesndstartstreamthread()<0) return NULL;
+
+	pb = AESND_AllocateVoiceWithArg(cb,cbArg);
+	if(pb==NULL) return NULL;
+
+	LWP_MutexLock(__aesndstreamlock);
+	s = &__aesndstream[pb->voiceno];
+	memset(s,0,sizeof(aesndstream));
+	s->reader = reader;
+	s->cbArg = cbArg;
+	s->blocks = blocks;
+	s->blocksize = blocksize;
+	s->size = blocks*blocksize;
+
+#if defined(HW_DOL)
+	_CPU_ISR_Disable(level);
+	s->aram = __aesndstreamaramalloc(s->size);
+	_CPU_ISR_Restore(level);
+	if(s->aram) s->buffer = memalign(32,blocksize);
+#elif defined(HW_RVL)
+	s->buffer = memalign(32,s->size);
+#endif
+	if(s->buffer==NULL) {
+		memset(s,0,sizeof(aesndstream));
+		LWP_MutexUnlock(__aesndstreamlock);
+		AESND_FreeVoice(pb);
+		return NULL;
+	}
+
+	_CPU_ISR_Disable(level);
+	pb->flags |= VOICE_RING;
+	_CPU_ISR_Restore(level);
+	LWP_MutexUnlock(__aesndstreamlock);
+
+	return pb;
+}
+
+s32 AESND_PlayStream(AESNDPB *pb,u32 format,f32 freq,u32 delay)
+{
+	u32 level;
+	u32 buf_addr;
+	aesndstream *s;
+
+	if(pb==NULL || !(pb->flags&VOICE_RING)) return -1;
+
+	s = &__aesndstream[pb->voiceno];
+
+	LWP_MutexLock(__aesndstreamlock);
+	_CPU_ISR_Disable(level);
+	s->active = false;
+	pb->flags |= VOICE_STOPPED;
+	pb->flags &= ~(VOICE_RUNNING|VOICE_STARVED|VOICE_PAUSE|VOICE_LOOP|VOICE_ONCE);
+	_CPU_ISR_Restore(level);
+
+	s->ready = 0;
+	s->eos = false;
+	s->fill_block = 0;
+	s->play_block = 0;
+	__aesndstreamfill(pb,s);
+
+#if defined(HW_DOL)
+	buf_addr = s->aram;
+#elif defined(HW_RVL)
+	buf_addr = (u32)MEM_VIRTUAL_TO_PHYSICAL(s->buffer);
+#endif
+
+	_CPU_ISR_Disable(level);
+	__aesndsetvoiceformat(pb,format);
+	__aesndsetvoicefreq(pb,freq);
+	pb->buf_start = buf_addr>>pb->shift;
+	pb->buf_end = (buf_addr + s->size - (1<<pb->shift))>>pb->shift;
+	pb->buf_curr = pb->buf_start;
+	pb->mram_start = pb->mram_curr = pb->mram_end = 0;
+	pb->stream_last = 0;
+	pb->delay = (delay*48);
+	pb->pds = pb->yn1 = pb->yn2 = 0;
+	pb->counter = 0;
+
+	s->active = true;
+	pb->flags &= ~VOICE_STOPPED;
+	pb->flags |= VOICE_RUNNING;
+	_CPU_ISR_Restore(level);
+	LWP_MutexUnlock(__aesndstreamlock);
+
+	return 0;
+}
+
+u32 AESND_GetStreamUnderruns(AESNDPB *pb)
+{
+	if(pb==NULL || !(pb->flags&VOICE_RING)) return 0;
+	return __aesndstream[pb->voiceno].underruns;
+}
+
+void AESND_SetBufferCount(u32 count)
+{
+	u32 level;
+
+	if(count<2) count = 2;
+	if(count>SND_MAXBUFFERS) count = SND_MAXBUFFERS;
+
+	_CPU_ISR_Disable(level);
+	__aesndtargetab = 0;
+	__aesndnumab = count;
+	_CPU_ISR_Restore(level);
+}
+
+void AESND_SetLatencyTarget(u32 usecs)
+{
+	u32 level;
+	u32 count;
+
+	// one buffer is always being played, latency comes from the ones queued behind it
+	count = ((usecs + 1999)/2000) + 1;
+	if(count<2) count = 2;
+	if(count>SND_MAXBUFFERS) count = SND_MAXBUFFERS;
+
+	_CPU_ISR_Disable(level);
+	__aesndtargetab = usecs ? count : 0;
+	__aesndnumab = count;
+	__aesndquietcnt = 0;
+	_CPU_ISR_Restore(level);
+}
+
+u32 AESND_GetLatency(void)
+{
+	return (__aesndnumab - 1)*2000;
+}
+
+u32 AESND_GetUnderruns(void)
+{
+	return __aesndunderruns;
+}
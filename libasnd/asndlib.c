@@ -142,6 +142,7 @@ static void __dsp_requestcallback(dsptask_t *task)
 		if(!global_pause) global_counter++;
 
 		dsp_complete = 1;
+		AUDIO_SignalMixDone();
 		return;
 	}
 
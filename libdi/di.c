@@ -42,7 +42,9 @@ distribution.
 #include <ogc/es.h>
 #include <ogc/ipc.h>
 #include <ogc/ios.h>
+#include <ogc/lwp.h>
 #include <ogc/mutex.h>
+#include <ogc/disc_async.h>
 #include <ogc/lwp_watchdog.h>
 #include <ogc/machine/processor.h>
 
@@ -55,6 +57,10 @@ static int have_ahbprot = 0;
 static int state = DVD_INIT | DVD_NO_DISC;
 
 static s32 _cover_callback(s32 ret, void* usrdata);
+static s32 diio_SubmitAsync(discasync_req *req);
+
+static discasync_req *diio_asyncreq = NULL;
+static const discasync_backend diio_async = { diio_SubmitAsync, 1 };
 
 static u32 bufferMutex = 0;
 static uint32_t outbuf[8] __attribute__((aligned(32)));
@@ -188,59 +194,293 @@ static int _DI_ReadDVD_D0(void* buf, uint32_t len, uint32_t lba){
 ///// Cache
 #define CACHE_FREE 0xFFFFFFFF
 #define BLOCK_SIZE 0x800
-#define CACHEBLOCKS 26
+#define CACHEBLOCKS 16
+#define CACHEPAGES 2
 typedef struct
 {
 	uint32_t block;
 	void *ptr;
+	volatile bool busy;
 } cache_page;
-static cache_page *cache_read = NULL;
+
+typedef struct
+{
+	uint32_t next;
+	uint32_t used;
+	uint32_t last;
+	cache_page page[CACHEPAGES];
+	DI_StreamStats stats;
+} cache_stream;
+
+static cache_stream *cache_read = NULL;
+static cache_page *cache_pending = NULL;
+static uint32_t cache_pending_pages = 0;
+static uint32_t cache_clock = 0;
+static lwpq_t cache_queue;
+static uint32_t pfdic[8] __attribute__((aligned(32)));
 
 static void CreateDVDCache(void)
 {
+	int i, j;
+	u8 *ptr;
+
 	if (cache_read != NULL)
 		return;
-	cache_read = (cache_page *) malloc(sizeof(cache_page));
+	cache_read = (cache_stream *) calloc(DI_MAXSTREAMS, sizeof(cache_stream));
 	if (cache_read == NULL)
 		return;
 
-	cache_read->block = CACHE_FREE;
-	cache_read->ptr = memalign(32, BLOCK_SIZE * CACHEBLOCKS);
-	if (cache_read->ptr == NULL)
+	ptr = memalign(32, BLOCK_SIZE * CACHEBLOCKS * CACHEPAGES * DI_MAXSTREAMS);
+	if (ptr == NULL)
 	{
 		free(cache_read);
 		cache_read = NULL;
 		return;
 	}
-	memset(cache_read->ptr, 0, BLOCK_SIZE);
+
+	for (i = 0; i < DI_MAXSTREAMS; i++)
+	{
+		cache_read[i].next = CACHE_FREE;
+		for (j = 0; j < CACHEPAGES; j++)
+		{
+			cache_read[i].page[j].block = CACHE_FREE;
+			cache_read[i].page[j].ptr = ptr;
+			ptr += BLOCK_SIZE * CACHEBLOCKS;
+		}
+	}
+	LWP_InitQueue(&cache_queue);
+}
+
+// Only one prefetch is outstanding; sync reads bypass IOS when we have AHBPROT, so they wait for it
+static void WaitDVDCache(void)
+{
+	u32 level;
+
+	_CPU_ISR_Disable(level);
+	while (cache_pending != NULL)
+		LWP_ThreadSleep(cache_queue);
+	_CPU_ISR_Restore(level);
+}
+
+static void InvalidateDVDCache(void)
+{
+	int i, j;
+
+	if (cache_read == NULL)
+		return;
+
+	WaitDVDCache();
+	for (i = 0; i < DI_MAXSTREAMS; i++)
+	{
+		cache_read[i].next = CACHE_FREE;
+		for (j = 0; j < CACHEPAGES; j++)
+			cache_read[i].page[j].block = CACHE_FREE;
+	}
+}
+
+static s32 PrefetchCallback(s32 result, void *usrdata)
+{
+	cache_page *page = (cache_page *) usrdata;
+	uint32_t i;
+
+	for (i = 0; i < cache_pending_pages; i++)
+	{
+		if (result != 1)
+			page[i].block = CACHE_FREE;
+		page[i].busy = false;
+	}
+	cache_pending = NULL;
+	LWP_ThreadBroadcast(cache_queue);
+	return 0;
+}
+
+// Fills npages windows following page, which lie back to back in memory within a stream
+static void PrefetchPage(cache_stream *stream, cache_page *page, uint32_t block, uint32_t npages)
+{
+	int ret;
+	u32 level;
+	uint32_t i, nblocks = npages * CACHEBLOCKS;
+
+	if (cache_pending != NULL)
+		return;
+	for (i = 0; i < npages; i++)
+	{
+		if (page[i].busy)
+			return;
+	}
+
+	if (DI_ReadDVDAsyncptr == _DI_ReadDVD_D0_Async)
+	{
+		pfdic[0] = DVD_READ << 24;
+		pfdic[1] = 0;
+		pfdic[2] = 0;
+		pfdic[3] = nblocks;
+		pfdic[4] = block;
+	}
+	else if (DI_ReadDVDAsyncptr == _DI_ReadDVD_A8_Async)
+	{
+		pfdic[0] = DVD_READ_UNENCRYPTED << 24;
+		pfdic[1] = nblocks << 11;
+		pfdic[2] = block << 9;
+	}
+	else
+		return; // read command not probed yet
+
+	_CPU_ISR_Disable(level);
+	for (i = 0; i < npages; i++)
+	{
+		page[i].block = block + i * CACHEBLOCKS;
+		page[i].busy = true;
+	}
+	cache_pending = page;
+	cache_pending_pages = npages;
+	_CPU_ISR_Restore(level);
+
+	ret = IOS_IoctlAsync(di_fd, pfdic[0] >> 24, pfdic, 0x20, page->ptr, nblocks << 11, PrefetchCallback, page);
+	if (ret < 0)
+	{
+		_CPU_ISR_Disable(level);
+		for (i = 0; i < npages; i++)
+		{
+			page[i].block = CACHE_FREE;
+			page[i].busy = false;
+		}
+		cache_pending = NULL;
+		_CPU_ISR_Restore(level);
+		return;
+	}
+	stream->stats.prefetches += npages;
+}
+
+static cache_page* LookupPage(uint32_t block, cache_stream **owner)
+{
+	int i, j;
+	cache_page *page;
+
+	for (i = 0; i < DI_MAXSTREAMS; i++)
+	{
+		for (j = 0; j < CACHEPAGES; j++)
+		{
+			page = &cache_read[i].page[j];
+			if (page->block == CACHE_FREE || block < page->block || block >= page->block + CACHEBLOCKS)
+				continue;
+
+			if (page->busy)
+				WaitDVDCache();
+			if (page->block == CACHE_FREE)
+				continue;
+
+			*owner = &cache_read[i];
+			return page;
+		}
+	}
+	return NULL;
+}
+
+static cache_stream* SelectStream(uint32_t block)
+{
+	int i;
+	cache_stream *stream = NULL;
+	cache_stream *owner;
+
+	for (i = 0; i < DI_MAXSTREAMS; i++)
+	{
+		if (cache_read[i].next == block)
+			return &cache_read[i];
+	}
+
+	if (LookupPage(block, &owner) != NULL)
+		return owner;
+
+	for (i = 0; i < DI_MAXSTREAMS; i++)
+	{
+		if (stream == NULL || cache_read[i].used < stream->used)
+			stream = &cache_read[i];
+	}
+	stream->next = CACHE_FREE;
+	return stream;
 }
 
 static int ReadBlockFromCache(void *buf, uint32_t len, uint32_t block)
 {
 	int retval;
+	uint32_t n, idx;
+	bool sequential, miss = false;
+	cache_stream *stream, *owner;
+	cache_page *page;
 
 	if (cache_read == NULL)
+	{
+		WaitDVDCache();
 		return DI_ReadDVDptr(buf, len, block);
+	}
+
+	stream = SelectStream(block);
+	sequential = (stream->next == block);
+	stream->used = ++cache_clock;
 
-	if ((block >= cache_read->block) && (block + len < (cache_read->block + CACHEBLOCKS)))
+	while (len > 0)
 	{
-		memcpy(buf, cache_read->ptr	+ ((block - cache_read->block) * BLOCK_SIZE), BLOCK_SIZE * len);
-		return 0;
+		page = LookupPage(block, &owner);
+		if (page == NULL)
+		{
+			miss = true;
+			WaitDVDCache();
+
+			// large aligned remainders go straight to the caller's buffer
+			if (len >= CACHEBLOCKS && !((uint32_t)buf & 0x1F))
+			{
+				retval = DI_ReadDVDptr(buf, len, block);
+				if (retval)
+					return retval;
+				block += len;
+				len = 0;
+				break;
+			}
+
+			idx = (stream->last + 1) % CACHEPAGES;
+			page = &stream->page[idx];
+			retval = DI_ReadDVDptr(page->ptr, CACHEBLOCKS, block);
+			if (retval)
+			{
+				page->block = CACHE_FREE;
+				stream->stats.misses++;
+				return retval;
+			}
+			page->block = block;
+			owner = stream;
+		}
+		if (owner == stream)
+			stream->last = page - stream->page;
+
+		n = page->block + CACHEBLOCKS - block;
+		if (n > len)
+			n = len;
+		memcpy(buf, page->ptr + ((block - page->block) * BLOCK_SIZE), n * BLOCK_SIZE);
+		buf += n * BLOCK_SIZE;
+		block += n;
+		len -= n;
 	}
 
-	if (len > CACHEBLOCKS)
-		return DI_ReadDVDptr(buf, len, block);
+	if (miss)
+		stream->stats.misses++;
+	else
+		stream->stats.hits++;
+	stream->next = block;
+	stream->stats.next = block;
 
-	retval = DI_ReadDVDptr(cache_read->ptr, CACHEBLOCKS, block);
-	if (retval)
+	// keep the window following the current one on its way for sequential readers
+	if (sequential || !miss)
 	{
-		cache_read->block = CACHE_FREE;
-		return retval;
+		page = &stream->page[stream->last];
+		if (page->block != CACHE_FREE && block > page->block && block <= page->block + CACHEBLOCKS)
+		{
+			idx = (stream->last + 1) % CACHEPAGES;
+			if (stream->page[idx].block != page->block + CACHEBLOCKS)
+				PrefetchPage(stream, &stream->page[idx], page->block + CACHEBLOCKS, 1);
+		}
 	}
 
-	cache_read->block = block;
-	memcpy(buf, cache_read->ptr, len * BLOCK_SIZE);
-
 	return 0;
 }
 
@@ -274,6 +514,8 @@ int DI_Init(void) {
 	if(use_dvd_cache)
 		CreateDVDCache();
 
+	DiscAsync_SetBackend(DEVICE_TYPE_WII_DVD, &diio_async);
+
 	return 0;
 }
 
@@ -304,14 +546,15 @@ void DI_Mount(void) {
 	state = DVD_INIT | DVD_NO_DISC;
 	_cover_callback(1, NULL);	// Initialize the callback chain.
 
-	if (cache_read != NULL)
-		cache_read->block = CACHE_FREE; // reset cache
+	InvalidateDVDCache(); // reset cache
 }
 
 void DI_Close(void) {
 	if(di_fd < 0)
 		return;
 
+	WaitDVDCache();
+
 	if (di_fd > 0)
 		IOS_Close(di_fd);
 
@@ -565,6 +808,78 @@ int DI_ReadDVDAsync(void* buf, uint32_t len, uint32_t lba,ipccallback ipc_cb){
 	return -1;
 }
 
+/*
+Hint that len blocks starting at lba will be read soon. Uncached blocks are fetched
+in the background, as many as fit in a stream's cache windows; sequential reads from
+there keep the read-ahead going.
+*/
+int DI_Prefetch(uint32_t lba, uint32_t len){
+	cache_stream *stream, *owner;
+	cache_page *page;
+	uint32_t n, npages;
+
+	if(di_fd < 0)
+		return -ENXIO;
+
+	if(!len)
+		return -EINVAL;
+
+	if(!cache_read || !DI_ReadDVDptr)
+		return -1;
+
+	LWP_MutexLock(bufferMutex);
+	// skip what is cached already
+	while((page = LookupPage(lba, &owner)) != NULL){
+		n = page->block + CACHEBLOCKS - lba;
+		if(n >= len){
+			LWP_MutexUnlock(bufferMutex);
+			return 0;
+		}
+		lba += n;
+		len -= n;
+	}
+
+	// a stream holds CACHEPAGES windows, more than one is read into all of them
+	npages = (len + CACHEBLOCKS - 1) / CACHEBLOCKS;
+	if(npages > CACHEPAGES)
+		npages = CACHEPAGES;
+
+	stream = SelectStream(lba);
+	stream->next = lba;
+	stream->used = ++cache_clock;
+	WaitDVDCache();
+	if(npages > 1)
+		PrefetchPage(stream, &stream->page[0], lba, npages);
+	else
+		PrefetchPage(stream, &stream->page[(stream->last + 1) % CACHEPAGES], lba, 1);
+	LWP_MutexUnlock(bufferMutex);
+	return 0;
+}
+
+int DI_GetStreamStats(DI_StreamStats *stats){
+	int i;
+
+	if(!stats)
+		return -EINVAL;
+
+	if(!cache_read)
+		return 0;
+
+	for(i = 0; i < DI_MAXSTREAMS; i++)
+		stats[i] = cache_read[i].stats;
+	return DI_MAXSTREAMS;
+}
+
+void DI_ResetStreamStats(void){
+	int i;
+
+	if(!cache_read)
+		return;
+
+	for(i = 0; i < DI_MAXSTREAMS; i++)
+		memset(&cache_read[i].stats, 0, sizeof(DI_StreamStats));
+}
+
 /*
 Unknown what this does as of now...
 */
@@ -974,6 +1289,26 @@ static bool diio_Shutdown(void)
 	return true;
 }
 
+static s32 diio_AsyncCallback(s32 result, void *usrdata)
+{
+	discasync_req *req = diio_asyncreq;
+
+	diio_asyncreq = NULL;
+	DiscAsync_Complete(req, (result == 1) ? DISCASYNC_OK : DISCASYNC_EIO);
+	return 0;
+}
+
+// Only one DI command can be outstanding, max_inflight keeps it that way
+static s32 diio_SubmitAsync(discasync_req *req)
+{
+	diio_asyncreq = req;
+	if(DI_ReadDVDAsync(req->buffer, req->count, req->sector, diio_AsyncCallback) != 0) {
+		diio_asyncreq = NULL;
+		return DISCASYNC_EIO;
+	}
+	return DISCASYNC_OK;
+}
+
 const DISC_INTERFACE __io_wiidvd = {
 	DEVICE_TYPE_WII_DVD,
 	FEATURE_MEDIUM_CANREAD | FEATURE_WII_DVD,
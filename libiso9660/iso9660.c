@@ -5,7 +5,9 @@
  * tipoloski, clava, shagkur, Tantric, joedj
  ****************************************************************************/
 
+#include <ctype.h>
 #include <errno.h>
+#include <malloc.h>
 #include <ogc/lwp_watchdog.h>
 #include <ogcsys.h>
 #include <stdio.h>
@@ -25,10 +27,19 @@
 
 #define SECTOR_SIZE			0x800
 #define BUFFER_SIZE			0x8000
+#define BUFFER_SECTORS		(BUFFER_SIZE / SECTOR_SIZE)
+#define CACHE_WINDOWS		4
+#define INDEX_MINBUCKETS	16
 
 #define DIR_SEPARATOR		'/'
 
 #define FLAG_DIR 2
+#define FLAG_MULTIEXTENT 0x80
+
+#define RR_MAXCONTINUE 8
+
+// Rock Ridge names run up to 255 bytes, ISO_MAXPATHLEN stays at 128 for existing users
+#define ISO_MAXNAMELEN 256
 
 struct pvd_s
 {
@@ -36,13 +47,13 @@ struct pvd_s
 	char system_id[32];
 	char volume_id[32];
 	char zero[8];
-	unsigned long total_sector_le, total_sect_be;
+	u32 total_sector_le, total_sect_be;
 	char zero2[32];
-	unsigned long volume_set_size, volume_seq_nr;
-	unsigned short sector_size_le, sector_size_be;
-	unsigned long path_table_len_le, path_table_len_be;
-	unsigned long path_table_le, path_table_2nd_le;
-	unsigned long path_table_be, path_table_2nd_be;
+	u32 volume_set_size, volume_seq_nr;
+	u16 sector_size_le, sector_size_be;
+	u32 path_table_len_le, path_table_len_be;
+	u32 path_table_le, path_table_2nd_le;
+	u32 path_table_be, path_table_2nd_be;
 	u8 root[34];
 	char volume_set_id[128], publisher_id[128], data_preparer_id[128], application_id[128];
 	char copyright_file_id[37], abstract_file_id[37], bibliographical_file_id[37];
@@ -54,36 +65,68 @@ typedef struct
 	u8 extended_sectors;
 	u32 sector;
 	u16 parent;
-	char name[ISO_MAXPATHLEN];
+	char name[ISO_MAXNAMELEN];
 }__attribute__((packed)) PATHTABLE_ENTRY;
 
+struct dindex_s;
+
 typedef struct pentry_s
 {
 	u16 index;
 	u32 childCount;
 	PATHTABLE_ENTRY table_entry;
 	struct pentry_s *children;
+	struct dindex_s *dir_index;
 } PATH_ENTRY;
 
-typedef struct dentry_s
+// Piece of a file recorded as several directory records
+typedef struct extent_s
 {
-	char name[ISO_MAXPATHLEN];
+	u64 offset;
 	u32 sector;
 	u32 size;
+} EXTENT;
+
+typedef struct dentry_s
+{
+	char name[ISO_MAXNAMELEN];
+	u32 sector;
+	u64 size;
 	u8 flags;
 	u32 fileCount;
+	u32 extentCount;
+	EXTENT *extents;	// NULL for single extent files, owned by the directory index
 	PATH_ENTRY *path_entry;
 	struct dentry_s *children;
 } DIR_ENTRY;
 
+// Contents of one directory, read once and looked up by name hash
+typedef struct dindex_s
+{
+	DIR_ENTRY dir;
+	u32 mask;
+	u32 *buckets;		// first child + 1 per bucket, 0 if empty
+	u32 *next;			// next child + 1 in the same bucket
+} DIR_INDEX;
+
+typedef struct cwindow_s
+{
+	u32 start;
+	u32 sectors;
+	u32 stamp;
+	u8 *buffer;
+} CACHE_WINDOW;
+
 typedef struct iso9660mount_s
 {
 	const DISC_INTERFACE *disc_interface;
-	u8 read_buffer[BUFFER_SIZE] __attribute__((aligned(32)));
 	u8 cluster_buffer[BUFFER_SIZE] __attribute__((aligned(32)));
-	u32 cache_start;
-	u32 cache_sectors;
+	CACHE_WINDOW cache[CACHE_WINDOWS];
+	u8 *cache_memory;
+	u32 cache_clock;
 	bool iso_unicode;
+	bool iso_rockridge;
+	u8 rr_skip;
 	PATH_ENTRY *iso_rootentry;
 	PATH_ENTRY *iso_currententry;
 	char volume_id[32];
@@ -105,36 +148,64 @@ typedef struct dstate_s
 } DIR_STATE_STRUCT;
 
 static MOUNT_DESCR* _ISO9660_getMountDescrFromPath(const char *path, devoptab_t **pdevops);
+static struct dindex_s* index_directory(MOUNT_DESCR *mdescr, PATH_ENTRY *path_entry);
 
 static __inline__ bool is_dir(DIR_ENTRY *entry)
 {
 	return entry->flags & FLAG_DIR;
 }
 
+// On-disc multi-byte fields are stored both-endian, use the big endian copy
+static __inline__ u32 read_be32(const u8 *buf)
+{
+	return ((u32) buf[0] << 24) | (buf[1] << 16) | (buf[2] << 8) | buf[3];
+}
+
+static __inline__ u16 read_be16(const u8 *buf)
+{
+	return (buf[0] << 8) | buf[1];
+}
+
 static int __read(MOUNT_DESCR *mdescr, void *ptr, u64 offset, size_t len)
 {
+	u32 i;
 	u32 sector = offset / SECTOR_SIZE;
-	u32 end_sector = (offset + len - 1) / SECTOR_SIZE;
-	u32 sectors = MIN(BUFFER_SIZE / SECTOR_SIZE, end_sector - sector + 1);
 	u32 sector_offset = offset % SECTOR_SIZE;
+	CACHE_WINDOW *window = NULL;
 	const DISC_INTERFACE *disc = mdescr->disc_interface;
 
-	len = MIN(BUFFER_SIZE - sector_offset, len);
-	if (mdescr->cache_sectors && sector >= mdescr->cache_start && (sector + sectors) <= (mdescr->cache_start + mdescr->cache_sectors))
+	for (i = 0; i < CACHE_WINDOWS; i++)
 	{
-		memcpy(ptr, mdescr->read_buffer + (sector - mdescr->cache_start) * SECTOR_SIZE + sector_offset, len);
-		return len;
+		CACHE_WINDOW *w = &mdescr->cache[i];
+		if (w->sectors && sector >= w->start && sector < (w->start + w->sectors))
+		{
+			window = w;
+			break;
+		}
 	}
 
-	if (!disc->readSectors(sector, BUFFER_SIZE / SECTOR_SIZE, mdescr->read_buffer))
+	if (!window)
 	{
-		mdescr->cache_sectors = 0;
-		return -1;
+		// replace the least recently used window
+		window = &mdescr->cache[0];
+		for (i = 1; i < CACHE_WINDOWS && window->sectors; i++)
+		{
+			if (!mdescr->cache[i].sectors || mdescr->cache[i].stamp < window->stamp)
+				window = &mdescr->cache[i];
+		}
+
+		if (!disc->readSectors(sector, BUFFER_SECTORS, window->buffer))
+		{
+			window->sectors = 0;
+			return -1;
+		}
+		window->start = sector;
+		window->sectors = BUFFER_SECTORS;
 	}
 
-	mdescr->cache_start = sector;
-	mdescr->cache_sectors = BUFFER_SIZE / SECTOR_SIZE;
-	memcpy(ptr, mdescr->read_buffer + sector_offset, len);
+	window->stamp = ++mdescr->cache_clock;
+	len = MIN((window->start + window->sectors - sector) * SECTOR_SIZE - sector_offset, len);
+	memcpy(ptr, window->buffer + (sector - window->start) * SECTOR_SIZE + sector_offset, len);
 
 	return len;
 }
@@ -145,6 +216,16 @@ static int _read(MOUNT_DESCR *mdescr, void *ptr, u64 offset, size_t len)
 	char *cptr = ptr;
 	while (read < len)
 	{
+		// large sector aligned runs go straight to the caller's buffer
+		if (!((offset + read) % SECTOR_SIZE) && (len - read) >= BUFFER_SIZE && !((u32)(cptr + read) & 0x1f))
+		{
+			u32 sectors = (len - read) / SECTOR_SIZE;
+			if (!mdescr->disc_interface->readSectors((offset + read) / SECTOR_SIZE, sectors, cptr + read))
+				return -1;
+			read += sectors * SECTOR_SIZE;
+			continue;
+		}
+
 		ret = __read(mdescr, cptr + read, offset + read, len - read);
 		if (ret > 0)
 			read += ret;
@@ -209,13 +290,88 @@ static char* dirname(char *path)
 	return result;
 }
 
+static bool add_extent(DIR_ENTRY *entry, u32 sector, u32 size)
+{
+	EXTENT *extents = realloc(entry->extents, sizeof(EXTENT) * (entry->extentCount + 1));
+	if (!extents)
+		return false;
+
+	if (!entry->extentCount)
+		entry->size = 0;
+	entry->extents = extents;
+	extents[entry->extentCount].offset = entry->size;
+	extents[entry->extentCount].sector = sector;
+	extents[entry->extentCount].size = size;
+	entry->extentCount++;
+	entry->size += size;
+	return true;
+}
+
+// Parse one System Use area, returns the continuation area length if a CE entry was found
+static u32 parse_susp(const u8 *su, s32 len, char *name, u32 *namelen, u32 *ce_sector, u32 *ce_offset)
+{
+	u32 ce_len = 0;
+
+	while (len >= 4)
+	{
+		u8 elen = su[2];
+		if (elen < 4 || elen > len)
+			break;
+
+		if (su[0] == 'N' && su[1] == 'M' && elen > 5 && !(su[4] & 0x06))
+		{
+			u32 n = MIN((u32) elen - 5, ISO_MAXNAMELEN - 1 - *namelen);
+			memcpy(name + *namelen, su + 5, n);
+			*namelen += n;
+		}
+		else if (su[0] == 'C' && su[1] == 'E' && elen >= 28)
+		{
+			*ce_sector = read_be32(su + 8);
+			*ce_offset = read_be32(su + 16);
+			ce_len = read_be32(su + 24);
+		}
+		else if (su[0] == 'S' && su[1] == 'T')
+			break;
+
+		su += elen;
+		len -= elen;
+	}
+	return ce_len;
+}
+
+static bool rockridge_name(MOUNT_DESCR *mdescr, const u8 *buf, char *name)
+{
+	u32 depth = 0, namelen = 0;
+	u32 ce_sector = 0, ce_offset = 0, ce_len;
+	u8 *ce = NULL;
+	u32 su_offset = OFFSET_NAME + buf[OFFSET_NAMELEN] + !(buf[OFFSET_NAMELEN] & 1) + mdescr->rr_skip;
+
+	if (su_offset >= *buf)
+		return false;
+
+	ce_len = parse_susp(buf + su_offset, *buf - su_offset, name, &namelen, &ce_sector, &ce_offset);
+	while (ce_len && ce_len <= SECTOR_SIZE && depth++ < RR_MAXCONTINUE)
+	{
+		if (!ce && !(ce = malloc(SECTOR_SIZE)))
+			break;
+		if (_read(mdescr, ce, (u64) ce_sector * SECTOR_SIZE + ce_offset, ce_len) != ce_len)
+			break;
+		ce_len = parse_susp(ce, ce_len, name, &namelen, &ce_sector, &ce_offset);
+	}
+	free(ce);
+
+	name[namelen] = '\x00';
+	return namelen > 0;
+}
+
 static s32 read_direntry(MOUNT_DESCR *mdescr, DIR_ENTRY *entry, u8 *buf)
 {
 	u8 extended_sectors = buf[OFFSET_EXTENDED];
-	u32 sector = *(u32 *) (buf + OFFSET_SECTOR) + extended_sectors;
-	u32 size = *(u32 *) (buf + OFFSET_SIZE);
+	u32 sector = read_be32(buf + OFFSET_SECTOR) + extended_sectors;
+	u32 size = read_be32(buf + OFFSET_SIZE);
 	u8 flags = buf[OFFSET_FLAGS];
 	u8 namelen = buf[OFFSET_NAMELEN];
+	char name[ISO_MAXNAMELEN];
 
 	if (namelen == 1 && buf[OFFSET_NAME] == 1 && mdescr->iso_rootentry->table_entry.sector == entry->sector)
 	{
@@ -229,37 +385,58 @@ static s32 read_direntry(MOUNT_DESCR *mdescr, DIR_ENTRY *entry, u8 *buf)
 	}
 	else
 	{
-		DIR_ENTRY *newChildren = realloc(entry->children, sizeof(DIR_ENTRY) * (entry->fileCount + 1));
-		if (!newChildren)
-			return -1;
-		memset(newChildren + entry->fileCount, 0, sizeof(DIR_ENTRY));
-		entry->children = newChildren;
-		DIR_ENTRY *child = &entry->children[entry->fileCount++];
-		child->sector = sector;
-		child->size = size;
-		child->flags = flags;
-		char *name = child->name;
-
 		if (namelen == 1 && buf[OFFSET_NAME] == 1)
 		{
 			// ..
 			sprintf(name, "..");
 		}
+		else if (mdescr->iso_rockridge && rockridge_name(mdescr, buf, name))
+		{
+			// Rock Ridge names are taken as is
+		}
 		else if (mdescr->iso_unicode)
 		{
 			u32 i;
-			for (i = 0; i < (namelen / 2); i++)
+			for (i = 0; i < (namelen / 2) && i < (ISO_MAXNAMELEN - 1); i++)
 				name[i] = buf[OFFSET_NAME + i * 2 + 1];
 			name[i] = '\x00';
 			namelen = i;
+			if (!(flags & FLAG_DIR) && namelen >= 2 && name[namelen - 2] == ';')
+				name[namelen - 2] = '\x00';
 		}
 		else
 		{
 			memcpy(name, buf + OFFSET_NAME, namelen);
 			name[namelen] = '\x00';
+			if (!(flags & FLAG_DIR) && namelen >= 2 && name[namelen - 2] == ';')
+				name[namelen - 2] = '\x00';
+		}
+
+		// following records of a multi-extent file extend the previous entry
+		if (entry->fileCount)
+		{
+			DIR_ENTRY *last = &entry->children[entry->fileCount - 1];
+			if ((last->flags & FLAG_MULTIEXTENT) && !strcmp(last->name, name))
+			{
+				if (!add_extent(last, sector, size))
+					return -1;
+				last->flags = flags;
+				return *buf;
+			}
 		}
-		if (!(flags & FLAG_DIR) && namelen >= 2 && name[namelen - 2] == ';')
-			name[namelen - 2] = '\x00';
+
+		DIR_ENTRY *newChildren = realloc(entry->children, sizeof(DIR_ENTRY) * (entry->fileCount + 1));
+		if (!newChildren)
+			return -1;
+		memset(newChildren + entry->fileCount, 0, sizeof(DIR_ENTRY));
+		entry->children = newChildren;
+		DIR_ENTRY *child = &entry->children[entry->fileCount++];
+		child->sector = sector;
+		child->size = size;
+		child->flags = flags;
+		strcpy(child->name, name);
+		if ((flags & FLAG_MULTIEXTENT) && !add_extent(child, sector, size))
+			return -1;
 	}
 
 	return *buf;
@@ -295,7 +472,7 @@ static bool read_directory(MOUNT_DESCR *mdescr, DIR_ENTRY *dir_entry, PATH_ENTRY
 	return true;
 }
 
-static bool path_entry_from_path(MOUNT_DESCR *mdescr, PATH_ENTRY *path_entry, const char *path)
+static bool path_entry_from_path(MOUNT_DESCR *mdescr, PATH_ENTRY **path_entry, const char *path)
 {
 	bool found = false;
 	bool notFound = false;
@@ -318,14 +495,18 @@ static bool path_entry_from_path(MOUNT_DESCR *mdescr, PATH_ENTRY *path_entry, co
 			dirnameLength = nextPathPosition - pathPosition;
 		else
 			dirnameLength = strlen(pathPosition);
-		if (dirnameLength >= ISO_MAXPATHLEN)
+		if (dirnameLength >= ISO_MAXNAMELEN)
 			return false;
 
+		// reading the directory puts the Rock Ridge names into the path table
+		if (mdescr->iso_rockridge)
+			index_directory(mdescr, dir);
+
 		u32 childIndex = 0;
 		while (childIndex < dir->childCount && !found && !notFound)
 		{
 			entry = &dir->children[childIndex];
-			if (dirnameLength == strnlen(entry->table_entry.name, ISO_MAXPATHLEN - 1) && !strncasecmp(pathPosition, entry->table_entry.name, dirnameLength))
+			if (dirnameLength == strnlen(entry->table_entry.name, ISO_MAXNAMELEN - 1) && !strncasecmp(pathPosition, entry->table_entry.name, dirnameLength))
 				found = true;
 			if (!found)
 				childIndex++;
@@ -354,33 +535,149 @@ static bool path_entry_from_path(MOUNT_DESCR *mdescr, PATH_ENTRY *path_entry, co
 	}
 
 	if (found)
-		memcpy(path_entry, entry, sizeof(PATH_ENTRY));
+		*path_entry = entry;
 	return found;
 }
 
+static u32 name_hash(const char *name, u32 len)
+{
+	u32 hash = 2166136261u;
+
+	while (len--)
+		hash = (hash ^ (u8) tolower((u8) *name++)) * 16777619u;
+	return hash;
+}
+
+static void free_extents(DIR_ENTRY *dir)
+{
+	u32 i;
+
+	for (i = 0; i < dir->fileCount; i++)
+		free(dir->children[i].extents);
+}
+
+static struct dindex_s* index_directory(MOUNT_DESCR *mdescr, PATH_ENTRY *path_entry)
+{
+	u32 i, bucket, count;
+	DIR_INDEX *index = path_entry->dir_index;
+
+	if (index)
+		return index;
+
+	index = malloc(sizeof(DIR_INDEX));
+	if (!index)
+		return NULL;
+	memset(index, 0, sizeof(DIR_INDEX));
+
+	if (!read_directory(mdescr, &index->dir, path_entry))
+		goto error;
+
+	count = INDEX_MINBUCKETS;
+	while (count < index->dir.fileCount)
+		count <<= 1;
+	index->mask = count - 1;
+	index->buckets = calloc(count, sizeof(u32));
+	index->next = malloc(sizeof(u32) * (index->dir.fileCount + 1));
+	if (!index->buckets || !index->next)
+		goto error;
+
+	// insert back to front so lookups find the first of duplicate names
+	for (i = index->dir.fileCount; i > 0; i--)
+	{
+		DIR_ENTRY *child = &index->dir.children[i - 1];
+		bucket = name_hash(child->name, strlen(child->name)) & index->mask;
+		index->next[i - 1] = index->buckets[bucket];
+		index->buckets[bucket] = i;
+	}
+
+	// path table names are plain ISO9660, use the Rock Ridge ones instead
+	if (mdescr->iso_rockridge)
+	{
+		for (i = 0; i < path_entry->childCount; i++)
+		{
+			PATH_ENTRY *dir = &path_entry->children[i];
+			for (bucket = 0; bucket < index->dir.fileCount; bucket++)
+			{
+				DIR_ENTRY *child = &index->dir.children[bucket];
+				if (is_dir(child) && child->sector == dir->table_entry.sector + dir->table_entry.extended_sectors && strcmp(child->name, ".."))
+				{
+					strcpy(dir->table_entry.name, child->name);
+					break;
+				}
+			}
+		}
+	}
+
+	path_entry->dir_index = index;
+	return index;
+
+error:
+	free_extents(&index->dir);
+	free(index->dir.children);
+	free(index->buckets);
+	free(index->next);
+	free(index);
+	return NULL;
+}
+
+static void free_index(DIR_INDEX *index)
+{
+	if (!index)
+		return;
+	free_extents(&index->dir);
+	free(index->dir.children);
+	free(index->buckets);
+	free(index->next);
+	free(index);
+}
+
+// Hand out a private copy, callers free entry->children
+static bool copy_directory(MOUNT_DESCR *mdescr, DIR_ENTRY *entry, PATH_ENTRY *path_entry)
+{
+	DIR_INDEX *index = index_directory(mdescr, path_entry);
+
+	if (!index)
+		return false;
+
+	memcpy(entry, &index->dir, sizeof(DIR_ENTRY));
+	entry->children = NULL;
+	if (entry->fileCount)
+	{
+		entry->children = malloc(sizeof(DIR_ENTRY) * entry->fileCount);
+		if (!entry->children)
+			return false;
+		memcpy(entry->children, index->dir.children, sizeof(DIR_ENTRY) * entry->fileCount);
+	}
+	return true;
+}
+
 static bool find_in_directory(MOUNT_DESCR *mdescr, DIR_ENTRY *entry, PATH_ENTRY *parent, const char *base)
 {
 	u32 childIdx;
 	u32 nl = strlen(base);
+	DIR_INDEX *index;
 
 	if (!nl)
-		return read_directory(mdescr, entry, parent);
+		return copy_directory(mdescr, entry, parent);
+
+	if (mdescr->iso_rockridge)
+		index_directory(mdescr, parent);
 
 	for (childIdx = 0; childIdx < parent->childCount; childIdx++)
 	{
 		PATH_ENTRY *child = parent->children + childIdx;
-		if (nl == strnlen(child->table_entry.name, ISO_MAXPATHLEN - 1) && !strncasecmp(base, child->table_entry.name, nl))
+		if (nl == strnlen(child->table_entry.name, ISO_MAXNAMELEN - 1) && !strncasecmp(base, child->table_entry.name, nl))
 		{
-			return read_directory(mdescr, entry, child);
+			return copy_directory(mdescr, entry, child);
 		}
 	}
 
-	if (!read_directory(mdescr, entry, parent))
+	if (!(index = index_directory(mdescr, parent)))
 		return false;
-	for (childIdx = 0; childIdx < entry->fileCount; childIdx++)
+	for (childIdx = index->buckets[name_hash(base, nl) & index->mask]; childIdx; childIdx = index->next[childIdx - 1])
 	{
-		DIR_ENTRY *child = entry->children + childIdx;
-		if (nl == strnlen(child->name, ISO_MAXPATHLEN - 1) && !strncasecmp(base, child->name, nl))
+		DIR_ENTRY *child = index->dir.children + childIdx - 1;
+		if (nl == strnlen(child->name, ISO_MAXNAMELEN - 1) && !strncasecmp(base, child->name, nl))
 		{
 			memcpy(entry, child, sizeof(DIR_ENTRY));
 			return true;
@@ -394,7 +691,7 @@ static bool entry_from_path(MOUNT_DESCR *mdescr, DIR_ENTRY *entry, const char *c
 	u32 len;
 	bool found = false;
 	char *path, *dir, *base;
-	PATH_ENTRY parent_entry;
+	PATH_ENTRY *parent_entry;
 
 	memset(entry, 0, sizeof(DIR_ENTRY));
 
@@ -411,7 +708,7 @@ static bool entry_from_path(MOUNT_DESCR *mdescr, DIR_ENTRY *entry, const char *c
 	if (!path_entry_from_path(mdescr, &parent_entry, dir))
 		goto done;
 
-	found = find_in_directory(mdescr, entry, &parent_entry, base);
+	found = find_in_directory(mdescr, entry, parent_entry, base);
 	if (!found && entry->children)
 		free(entry->children);
 
@@ -474,6 +771,39 @@ static int _ISO9660_open_r(struct _reent *r, void *fileStruct, const char *path,
 	return (int) file;
 }
 
+// Extent holding file offset pos. Apart from the last one the extents of a
+// file are all the same size in practice, so the index is computed directly
+// and only checked against the map.
+static const EXTENT* file_extent(DIR_ENTRY *entry, u64 pos, EXTENT *single)
+{
+	u32 lo, hi, i;
+	const EXTENT *extents = entry->extents;
+
+	if (!entry->extentCount)
+	{
+		single->offset = 0;
+		single->sector = entry->sector;
+		single->size = entry->size;
+		return single;
+	}
+
+	i = extents[0].size ? MIN(pos / extents[0].size, entry->extentCount - 1) : 0;
+	if (pos >= extents[i].offset && pos - extents[i].offset < extents[i].size)
+		return &extents[i];
+
+	lo = 0;
+	hi = entry->extentCount - 1;
+	while (lo < hi)
+	{
+		i = (lo + hi + 1) / 2;
+		if (extents[i].offset <= pos)
+			lo = i;
+		else
+			hi = i - 1;
+	}
+	return &extents[lo];
+}
+
 static int _ISO9660_close_r(struct _reent *r, void *fd)
 {
 	FILE_STRUCT *file = (FILE_STRUCT*) fd;
@@ -492,6 +822,8 @@ static ssize_t _ISO9660_read_r(struct _reent *r, void *fd, char *ptr, size_t len
 {
 	u64 offset;
 	int ret;
+	size_t done = 0;
+	EXTENT single;
 	FILE_STRUCT *file = (FILE_STRUCT*) fd;
 
 	if (!file->inUse)
@@ -515,16 +847,25 @@ static ssize_t _ISO9660_read_r(struct _reent *r, void *fd, char *ptr, size_t len
 	if (len == 0)
 		return 0;
 
-	offset = (u64) file->entry.sector * SECTOR_SIZE + file->offset;
-	if ((ret = _read(file->mdescr, ptr, offset, len)) < 0)
+	while (done < len)
 	{
-		r->_errno = EIO;
-		return -1;
-	}
+		const EXTENT *extent = file_extent(&file->entry, file->offset, &single);
+		u64 pos = file->offset - extent->offset;
+		size_t chunk = MIN(len - done, extent->size - pos);
 
-	len = (size_t)ret;
-	file->offset += len;
-	return len;
+		offset = (u64) extent->sector * SECTOR_SIZE + pos;
+		if ((ret = _read(file->mdescr, ptr + done, offset, chunk)) < 0)
+		{
+			r->_errno = EIO;
+			return -1;
+		}
+
+		done += ret;
+		file->offset += ret;
+		if (ret < chunk)
+			break;
+	}
+	return done;
 }
 
 static off_t _ISO9660_seek_r(struct _reent *r, void *fd, off_t pos, int dir)
@@ -699,7 +1040,7 @@ static int _ISO9660_dirnext_r(struct _reent *r, DIR_ITER *dirState, char *filena
 	}
 
 	entry = &state->entry.children[state->index++];
-	strncpy(filename, entry->name, ISO_MAXPATHLEN);
+	strncpy(filename, entry->name, ISO_MAXNAMELEN);
 	stat_entry(entry, st);
 	return 0;
 }
@@ -834,6 +1175,7 @@ static void cleanup_recursive(PATH_ENTRY *entry)
 		cleanup_recursive(&entry->children[i]);
 	if (entry->children)
 		free(entry->children);
+	free_index(entry->dir_index);
 }
 
 static struct pvd_s* read_volume_descriptor(MOUNT_DESCR *mdescr, u8 descriptor)
@@ -843,13 +1185,13 @@ static struct pvd_s* read_volume_descriptor(MOUNT_DESCR *mdescr, u8 descriptor)
 
 	for (sector = 16; sector < 32; sector++)
 	{
-		if (!disc->readSectors(sector, 1, mdescr->read_buffer))
+		if (!disc->readSectors(sector, 1, mdescr->cluster_buffer))
 			return NULL;
-		if (!memcmp(mdescr->read_buffer + 1, "CD001\1", 6))
+		if (!memcmp(mdescr->cluster_buffer + 1, "CD001\1", 6))
 		{
-			if (*mdescr->read_buffer == descriptor)
-				return (struct pvd_s*) mdescr->read_buffer;
-			else if (*mdescr->read_buffer == 0xff)
+			if (*mdescr->cluster_buffer == descriptor)
+				return (struct pvd_s*) mdescr->cluster_buffer;
+			else if (*mdescr->cluster_buffer == 0xff)
 				return NULL;
 		}
 	}
@@ -857,10 +1199,31 @@ static struct pvd_s* read_volume_descriptor(MOUNT_DESCR *mdescr, u8 descriptor)
 	return NULL;
 }
 
+// Rock Ridge volumes announce SUSP with an SP entry in the root's "." record
+static bool check_rockridge(MOUNT_DESCR *mdescr, struct pvd_s *volume)
+{
+	u8 record[256];
+	u8 *su = record + OFFSET_NAME + 1;
+	u32 sector = read_be32(volume->root + OFFSET_SECTOR);
+
+	if (_read(mdescr, record, (u64) sector * SECTOR_SIZE, sizeof(record)) != sizeof(record))
+		return false;
+	if (record[0] < OFFSET_NAME + 1 + 7 || record[OFFSET_NAMELEN] != 1)
+		return false;
+	if (su[0] != 'S' || su[1] != 'P' || su[4] != 0xbe || su[5] != 0xef)
+		return false;
+
+	mdescr->rr_skip = su[6];
+	return true;
+}
+
 static bool read_directories(MOUNT_DESCR *mdescr)
 {
-	struct pvd_s *volume = read_volume_descriptor(mdescr, 2);
-	if (volume)
+	// prefer Rock Ridge names over Joliet ones, they aren't limited to 64 characters
+	struct pvd_s *volume = read_volume_descriptor(mdescr, 1);
+	if (volume && check_rockridge(mdescr, volume))
+		mdescr->iso_rockridge = true;
+	else if ((volume = read_volume_descriptor(mdescr, 2)))
 		mdescr->iso_unicode = true;
 	else if (!(volume = read_volume_descriptor(mdescr, 1)))
 		return false;
@@ -870,7 +1233,7 @@ static bool read_directories(MOUNT_DESCR *mdescr)
 	memset(mdescr->iso_rootentry, 0, sizeof(PATH_ENTRY));
 	mdescr->iso_rootentry->table_entry.name_length = 1;
 	mdescr->iso_rootentry->table_entry.extended_sectors = volume->root[OFFSET_EXTENDED];
-	mdescr->iso_rootentry->table_entry.sector = *(u32 *) (volume->root + OFFSET_SECTOR);
+	mdescr->iso_rootentry->table_entry.sector = read_be32(volume->root + OFFSET_SECTOR);
 	mdescr->iso_rootentry->table_entry.parent = 0;
 	mdescr->iso_rootentry->table_entry.name[0] = '\x00';
 	mdescr->iso_rootentry->index = 1;
@@ -879,16 +1242,18 @@ static bool read_directories(MOUNT_DESCR *mdescr)
     strncpy(mdescr->volume_id, volume->volume_id, 32);
     mdescr->volume_id[31] = '\0';
 
-	u32 path_table = volume->path_table_be;
-	u32 path_table_len = volume->path_table_len_be;
+	u32 path_table = read_be32((u8 *) &volume->path_table_be);
+	u32 path_table_len = read_be32((u8 *) &volume->path_table_len_be);
 	u16 i = 1;
-	u64 offset = sizeof(PATHTABLE_ENTRY) - ISO_MAXPATHLEN + 2;
+	u64 offset = sizeof(PATHTABLE_ENTRY) - ISO_MAXNAMELEN + 2;
 	PATH_ENTRY *parent = mdescr->iso_rootentry;
 	while (i < 0xffff && offset < path_table_len)
 	{
 		PATHTABLE_ENTRY entry;
-		if (__read(mdescr, &entry, (u64) path_table * SECTOR_SIZE + offset, sizeof(PATHTABLE_ENTRY)) != sizeof(PATHTABLE_ENTRY))
+		if (_read(mdescr, &entry, (u64) path_table * SECTOR_SIZE + offset, sizeof(PATHTABLE_ENTRY)) != sizeof(PATHTABLE_ENTRY))
 			return false; // kinda dodgy - could be reading too far
+		entry.sector = read_be32((u8 *) &entry.sector);
+		entry.parent = read_be16((u8 *) &entry.parent);
 		if (parent->index != entry.parent)
 			parent = entry_from_index(mdescr->iso_rootentry, entry.parent);
 		if (!parent)
@@ -897,7 +1262,7 @@ static bool read_directories(MOUNT_DESCR *mdescr)
 		if (!child)
 			return false;
 		memcpy(&child->table_entry, &entry, sizeof(PATHTABLE_ENTRY));
-		offset += sizeof(PATHTABLE_ENTRY) - ISO_MAXPATHLEN + child->table_entry.name_length;
+		offset += sizeof(PATHTABLE_ENTRY) - ISO_MAXNAMELEN + child->table_entry.name_length;
 		if (child->table_entry.name_length % 2)
 			offset++;
 		child->index = ++i;
@@ -922,21 +1287,38 @@ static bool read_directories(MOUNT_DESCR *mdescr)
 
 static MOUNT_DESCR *_ISO9660_mdescr_constructor(const DISC_INTERFACE *disc_interface)
 {
+	u32 i;
 	MOUNT_DESCR *mdescr = NULL;
 
 	mdescr = malloc(sizeof(MOUNT_DESCR));
 	if (!mdescr)
 		return NULL;
 
+	mdescr->cache_memory = memalign(32, CACHE_WINDOWS * BUFFER_SIZE);
+	if (!mdescr->cache_memory)
+	{
+		free(mdescr);
+		return NULL;
+	}
+
+	for (i = 0; i < CACHE_WINDOWS; i++)
+	{
+		mdescr->cache[i].start = 0;
+		mdescr->cache[i].sectors = 0;
+		mdescr->cache[i].stamp = 0;
+		mdescr->cache[i].buffer = mdescr->cache_memory + i * BUFFER_SIZE;
+	}
+	mdescr->cache_clock = 0;
 	mdescr->disc_interface = disc_interface;
-	mdescr->cache_start = 0;
-	mdescr->cache_sectors = 0;
 	mdescr->iso_unicode = false;
+	mdescr->iso_rockridge = false;
+	mdescr->rr_skip = 0;
 	mdescr->iso_rootentry = NULL;
 	mdescr->iso_currententry = NULL;
 
 	if (!read_directories(mdescr))
 	{
+		free(mdescr->cache_memory);
 		free(mdescr);
 		return NULL;
 	}
@@ -986,6 +1368,7 @@ bool ISO9660_Mount(const char* name, const DISC_INTERFACE *disc_interface)
 
 	if (AddDevice(devops) < 0)
 	{
+		free(mdescr->cache_memory);
 		free(mdescr);
 		free(devops);
 		return false;
@@ -1016,6 +1399,7 @@ bool ISO9660_Unmount(const char* name)
 		free(mdescr->iso_rootentry);
 	}
 
+	free(mdescr->cache_memory);
 	free(mdescr);
 	free(devops);
 	return true;
@@ -203,6 +203,7 @@ static s32 updateWaveFormat(MODPlay *mod)
 	mod->soundBuf.freq = mod->playfreq;
 	mod->mod.freq = mod->playfreq;
 	mod->mod.bits = 16;
+	mod->mod.mixmode = mod->mixmode;
 	
 	if(p) {
 		mod->mod.samplescounter = 0;
@@ -363,6 +364,25 @@ void MODPlay_SetVolume(MODPlay *mod, s32 musicvolume, s32 sfxvolume)
 	mod->mod.sfxvolume = sfxvolume;
 }
 
+/* s32 MODPlay_SetMixMode(MODPlay *mod, u32 mode)
+
+Select the software mixer used for the MOD music and sfx channels
+
+mod: the MODPlay pointer
+
+mode: MOD_MIX_NEAREST (default), MOD_MIX_LINEAR or MOD_MIX_CUBIC
+
+*/
+
+s32 MODPlay_SetMixMode(MODPlay *mod,u32 mode)
+{
+	if(mode>MOD_MIX_CUBIC) return -1;
+
+	mod->mixmode = mode;
+	mod->mod.mixmode = mode;
+	return 0;
+}
+
 #ifdef _GCMOD_DEBUG
 u32 MODPlay_MixingTime()
 {
@@ -106,8 +106,15 @@ s32 mix_mono_16bit ( MOD * mod, s16 * buf, s32 numSamples )
           {
             u32 incval,noteidx;
 
-			noteidx = (mod->chanfreq[voice] - mod->chanfreq[voice]*2*(mod->instrument[mod->instnum[voice]].finetune-8)/256);
-			incval = mod->inctab[noteidx];
+			if (mod->chaninc[voice])
+			  incval = mod->chaninc[voice];
+			else
+			  {
+			    noteidx = (mod->chanfreq[voice] - mod->chanfreq[voice]*2*(mod->instrument[mod->instnum[voice]].finetune-8)/256);
+			    incval = mod->inctab[noteidx];
+			    if (mod->freq==32000 || mod->freq==48000)
+			      incval >>= 2;
+			  }
 
             s8 * data = mod->instrument[mod->instnum[voice]].data;
             union_dword playpos;
@@ -120,9 +127,6 @@ s32 mix_mono_16bit ( MOD * mod, s16 * buf, s32 numSamples )
             else
               volume = (volume*(s32)mod->sfxvolume)>>6;
 
-            if (mod->freq==32000 || mod->freq==48000)
-              incval >>= 2;
-
             for (j=i=0;j<numIterations;j++)
               {
                 MIX_SAMPLES;i++;
@@ -183,8 +187,15 @@ s32 mix_stereo_16bit ( MOD * mod, s16 * buf, s32 numSamples )
           {
             u32 incval,noteidx;
 
-			noteidx = (mod->chanfreq[voice] - mod->chanfreq[voice]*2*(mod->instrument[mod->instnum[voice]].finetune-8)/256);
-			incval = mod->inctab[noteidx];
+			if (mod->chaninc[voice])
+			  incval = mod->chaninc[voice];
+			else
+			  {
+			    noteidx = (mod->chanfreq[voice] - mod->chanfreq[voice]*2*(mod->instrument[mod->instnum[voice]].finetune-8)/256);
+			    incval = mod->inctab[noteidx];
+			    if (mod->freq==32000 || mod->freq==48000)
+			      incval >>= 2;
+			  }
 
             s8 * data = mod->instrument[mod->instnum[voice]].data;
             union_dword playpos;
@@ -196,9 +207,7 @@ s32 mix_stereo_16bit ( MOD * mod, s16 * buf, s32 numSamples )
             else
               volume = (volume*(s32)mod->sfxvolume)>>6;
 
-            playpos.adword = mod->playpos[voice];            
-            if (mod->freq==32000 || mod->freq==48000)
-              incval >>= 2;
+            playpos.adword = mod->playpos[voice];
             
             i = lrofs;
             for (j=0;j<numIterations;j++)
@@ -222,3 +231,230 @@ s32 mix_stereo_16bit ( MOD * mod, s16 * buf, s32 numSamples )
 
     return numSamples;
   }
+
+/* Interpolating mixer
+ *
+ * Voices are mixed in blocks that run up to the next point where the
+ * interpolation kernel would read past the loop end, so the inner loops
+ * carry no per-sample loop check. The few samples around a loop
+ * boundary go through the guarded path which fetches with wrap-around.
+ * Volume changes are ramped over MIX_RAMP_SAMPLES to avoid clicks.
+ */
+
+#define MIX_RAMP_SAMPLES	64
+#define MIX_VOL_FRAC		16
+
+static inline u32 __voice_incval ( MOD * mod, s32 voice )
+  {
+    u32 incval,noteidx;
+
+    if (mod->chaninc[voice])
+      return mod->chaninc[voice];
+
+    noteidx = (mod->chanfreq[voice] - mod->chanfreq[voice]*2*(mod->instrument[mod->instnum[voice]].finetune-8)/256);
+    incval = mod->inctab[noteidx];
+    if (mod->freq==32000 || mod->freq==48000)
+      incval >>= 2;
+
+    return incval;
+  }
+
+static inline s32 __sample_at ( const MOD_INSTR * ins, s32 idx )
+  {
+    if (idx<0)
+      return ins->data[0];
+    if (idx>=(s32)ins->loop_end)
+      {
+        if (!ins->looped || ins->loop_length==0)
+          return 0;
+        idx = ins->loop_start + (idx-ins->loop_end)%ins->loop_length;
+      }
+    return ins->data[idx];
+  }
+
+/* Returns the sample at 16.16 position pos scaled to 16 bits. */
+static inline s32 __interp_linear ( s32 p1, s32 p2, u32 pos )
+  {
+    return p1*256 + (p2-p1)*(s32)((pos&0xffff)>>8);
+  }
+
+/* Catmull-Rom spline through p0..p3, evaluated between p1 and p2. */
+static inline s32 __interp_cubic ( s32 p0, s32 p1, s32 p2, s32 p3, u32 pos )
+  {
+    s32 t = pos&0xffff;
+    s32 v;
+
+    v = -p0 + 3*p1 - 3*p2 + p3;
+    v = ((v*t)>>16) + 2*p0 - 5*p1 + 4*p2 - p3;
+    v = ((v*t)>>16) + p2 - p0;
+    v = (v*t)>>8;
+
+    return (v>>1) + p1*256;
+  }
+
+static inline void __mix_out ( s16 * b, s32 s, s32 vol, s32 shift )
+  {
+    s32 accum = (s32)*b + ((s*(vol>>(MIX_VOL_FRAC-6)))>>shift);
+
+    if (accum<-32768) accum = -32768;
+    if (accum>32767) accum = 32767;
+    *b = accum;
+  }
+
+static void __mix_block_linear ( s16 * b, s32 stride, const s8 * data, u32 * ppos, u32 incval, s32 n, s32 * pvol, s32 volinc, s32 shift )
+  {
+    u32 pos = *ppos;
+    s32 vol = *pvol;
+    const s8 * p;
+
+    while (n-->0)
+      {
+        p = &data[pos>>16];
+        __mix_out ( b, __interp_linear(p[0],p[1],pos), vol, shift );
+        b += stride;
+        pos += incval;
+        vol += volinc;
+      }
+    *ppos = pos;
+    *pvol = vol;
+  }
+
+static void __mix_block_cubic ( s16 * b, s32 stride, const s8 * data, u32 * ppos, u32 incval, s32 n, s32 * pvol, s32 volinc, s32 shift )
+  {
+    u32 pos = *ppos;
+    s32 vol = *pvol;
+    const s8 * p;
+
+    while (n-->0)
+      {
+        p = &data[pos>>16];
+        __mix_out ( b, __interp_cubic(p[-1],p[0],p[1],p[2],pos), vol, shift );
+        b += stride;
+        pos += incval;
+        vol += volinc;
+      }
+    *ppos = pos;
+    *pvol = vol;
+  }
+
+static void __mix_voice_interp ( MOD * mod, s32 voice, s16 * b, s32 stride, s32 numSamples, s32 shiftval )
+  {
+    MOD_INSTR * ins = &mod->instrument[mod->instnum[voice]];
+    u32 incval = __voice_incval ( mod, voice );
+    u32 pos = mod->playpos[voice];
+    u32 loop_end = ins->loop_end<<16;
+    u32 safe_end = ins->loop_end>3 ? (ins->loop_end-2)<<16 : 0;
+    s32 shift = 20 - shiftval;
+    s32 target, vol, volinc = 0, ramp = 0;
+    s32 n, s, idx;
+
+    target = mod->volume[voice];
+    if ( voice<mod->num_voices )
+      target = (target*(s32)mod->musicvolume)>>6;
+    else
+      target = (target*(s32)mod->sfxvolume)>>6;
+    target <<= MIX_VOL_FRAC;
+
+    vol = mod->rampvol[voice];
+    if (vol!=target)
+      {
+        ramp = MIX_RAMP_SAMPLES<numSamples ? MIX_RAMP_SAMPLES : numSamples;
+        volinc = (target-vol)/ramp;
+      }
+
+    while (numSamples>0)
+      {
+        if (pos>=(1<<16) && pos<safe_end)
+          {
+            n = incval ? (s32)((safe_end-1-pos)/incval)+1 : numSamples;
+            if (n>numSamples)
+              n = numSamples;
+            if (ramp>0 && n>ramp)
+              n = ramp;
+
+            if (mod->mixmode==MOD_MIX_CUBIC)
+              __mix_block_cubic ( b, stride, ins->data, &pos, incval, n, &vol, volinc, shift );
+            else
+              __mix_block_linear ( b, stride, ins->data, &pos, incval, n, &vol, volinc, shift );
+          }
+        else
+          {
+            n = 1;
+            idx = pos>>16;
+            if (mod->mixmode==MOD_MIX_CUBIC)
+              s = __interp_cubic ( __sample_at(ins,idx-1), __sample_at(ins,idx),
+                                   __sample_at(ins,idx+1), __sample_at(ins,idx+2), pos );
+            else
+              s = __interp_linear ( __sample_at(ins,idx), __sample_at(ins,idx+1), pos );
+            __mix_out ( b, s, vol, shift );
+            pos += incval;
+            vol += volinc;
+          }
+
+        b += n*stride;
+        numSamples -= n;
+        if (ramp>0)
+          {
+            ramp -= n;
+            if (ramp==0)
+              {
+                vol = target;
+                volinc = 0;
+              }
+          }
+
+        if (pos>=loop_end)
+          {
+            if (ins->looped && ins->loop_length!=0)
+              {
+                while (pos>=loop_end)
+                  pos -= ins->loop_length<<16;
+              }
+            else
+              {
+                pos = (ins->loop_end-1)<<16;
+                mod->channel_active[voice] = FALSE;
+                vol = 0;
+                break;
+              }
+          }
+      }
+
+    mod->playpos[voice] = pos;
+    mod->rampvol[voice] = vol;
+  }
+
+s32 mix_mono_16bit_interp ( MOD * mod, s16 * buf, s32 numSamples )
+  {
+    s32 voice, i;
+
+    for (i=0;i<numSamples;i++)
+      buf[i] = PREFILL_WORD;
+
+    for (voice=0;voice<mod->num_channels;++voice)
+      {
+        if (mod->instrument[mod->instnum[voice]].data != NULL && mod->channel_active[voice])
+          __mix_voice_interp ( mod, voice, buf, 1, numSamples, mod->shiftval );
+        else
+          mod->rampvol[voice] = 0;
+      }
+    return numSamples;
+  }
+
+s32 mix_stereo_16bit_interp ( MOD * mod, s16 * buf, s32 numSamples )
+  {
+    s32 voice, i;
+
+    for (i=0;i<(numSamples<<1);i++)
+      buf[i] = PREFILL_WORD;
+
+    for (voice=0;voice<mod->num_channels;++voice)
+      {
+        s32 lrofs = (((voice-1)>>1)&1)^1;
+        if (mod->instrument[mod->instnum[voice]].data != NULL && mod->channel_active[voice])
+          __mix_voice_interp ( mod, voice, &buf[lrofs], 2, numSamples, mod->shiftval+1 );
+        else
+          mod->rampvol[voice] = 0;
+      }
+    return numSamples;
+  }
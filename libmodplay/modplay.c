@@ -34,6 +34,7 @@ THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "freqtab.h"
 #include "modplay.h"
 #include "mixer.h"
+#include "tracker.h"
 #ifndef GEKKO
 #include "bpmtab.h"
 #include "inctab.h"
@@ -267,6 +268,7 @@ void MOD_Free ( MOD * mod )
   {
     mod->set = FALSE;
 
+    TRK_Free ( mod );
     if (!mod->loaded)
       return;
     
@@ -285,9 +287,20 @@ s32 MOD_SetMOD ( MOD * mod, u8 * mem )
     s32 ofs = 0;
 
     MEM_SET ( mod, 0, sizeof(MOD) );
+    mod->instrument = mod->modinstr;
     mod->modraw = mem;
     mod->musicvolume = mod->sfxvolume = 0x40;
 
+    /* S3M, XM and IT go through the shared pattern engine */
+    if (TRK_IsModule(mem))
+      {
+        if (TRK_SetModule(mod, mem)<0)
+          return -1;
+        MOD_AllocSFXChannels ( mod, 0 );
+        mod->set = TRUE;
+        return 0;
+      }
+
     /* ID */
     mod->num_instr = 31;
     MEM_CPY ( mod->id, &mem[1080], 4 );
@@ -1017,6 +1030,25 @@ u32 process ( MOD * mod )
     return retval;
   }
 
+static u32 tick ( MOD * mod )
+  {
+    u32 retval = 0;
+
+    if (mod->trk!=NULL)
+      return TRK_Tick(mod);
+
+    mod->speedcounter++;
+    if (mod->speedcounter>=(mod->speed+mod->patterndelay))
+      {
+        mod->patterndelay=0;
+        retval |= process(mod);
+        mod->speedcounter = 0;
+      }
+    retval |= effect_handler(mod);
+
+    return retval;
+  }
+
 void MOD_Start ( MOD * mod )
   {
     s32 i;
@@ -1036,6 +1068,7 @@ void MOD_Start ( MOD * mod )
         mod->trem_wave[i] = 0;
         mod->vib_wave[i] = 0;
         mod->channel_active[i] = FALSE;
+        mod->rampvol[i] = 0;
       }
 
     mod->songpos = 0;
@@ -1071,6 +1104,9 @@ void MOD_Start ( MOD * mod )
 
     mod->samplescounter = 0;
     mod->samplespertick = mod->bpmtab[125-32];
+
+    if (mod->trk!=NULL)
+      TRK_Start ( mod );
   }
 
 u32 MOD_Player ( MOD * mod )
@@ -1096,7 +1132,10 @@ u32 MOD_Player ( MOD * mod )
                 s32 tick_remain = mod->samplespertick - mod->samplescounter;
                 s32 res;
 
-                res = mix_mono_16bit ( mod, &buf[l], tick_remain<=remain ? tick_remain : remain );
+                if (mod->mixmode==MOD_MIX_NEAREST)
+                  res = mix_mono_16bit ( mod, &buf[l], tick_remain<=remain ? tick_remain : remain );
+                else
+                  res = mix_mono_16bit_interp ( mod, &buf[l], tick_remain<=remain ? tick_remain : remain );
                 l += res;
                 remain -= res;
 
@@ -1104,14 +1143,7 @@ u32 MOD_Player ( MOD * mod )
                 if ( mod->samplescounter >= mod->samplespertick )
                   {
                     mod->samplescounter -= mod->samplespertick;
-                    mod->speedcounter++;
-                    if (mod->speedcounter>=(mod->speed+mod->patterndelay))
-                      {
-                        mod->patterndelay=0;
-                        retval |= process(mod);
-                        mod->speedcounter = 0;
-                      }
-                    retval |= effect_handler(mod);
+                    retval |= tick(mod);
                   }
               } while ( remain>0 );
           } else
@@ -1126,7 +1158,10 @@ u32 MOD_Player ( MOD * mod )
                 s32 tick_remain = mod->samplespertick - mod->samplescounter;
                 s32 res;
 
-                res = mix_stereo_16bit ( mod, &buf[l<<1], tick_remain<=remain ? tick_remain : remain );
+                if (mod->mixmode==MOD_MIX_NEAREST)
+                  res = mix_stereo_16bit ( mod, &buf[l<<1], tick_remain<=remain ? tick_remain : remain );
+                else
+                  res = mix_stereo_16bit_interp ( mod, &buf[l<<1], tick_remain<=remain ? tick_remain : remain );
                 l += res;
                 remain -= res;
 
@@ -1134,14 +1169,7 @@ u32 MOD_Player ( MOD * mod )
                 if ( mod->samplescounter >= mod->samplespertick )
                   {
                     mod->samplescounter -= mod->samplespertick;
-                    mod->speedcounter++;
-                    if (mod->speedcounter>=(mod->speed+mod->patterndelay))
-                      {
-                        mod->patterndelay=0;
-                        retval |= process(mod);
-                        mod->speedcounter = 0;
-                      }
-                    retval |= effect_handler(mod);
+                    retval |= tick(mod);
                   }
               } while ( remain>0 );
           }
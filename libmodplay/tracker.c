@@ -0,0 +1,870 @@
+/*-------------------------------------------------------------
+
+tracker.c -- Shared S3M/XM/IT pattern engine
+
+Copyright (C) 2026
+
+This software is provided 'as-is', without any express or implied
+warranty.  In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1.	The origin of this software must not be misrepresented; you
+must not claim that you wrote the original software. If you use
+this software in a product, an acknowledgment in the product
+documentation would be appreciated but is not required.
+
+2.	Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3.	This notice may not be removed or altered from any source
+distribution.
+
+-------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "defines.h"
+#include "modplay.h"
+#include "tracker.h"
+
+#define AMIGA_CLOCK         14317456.0F
+#define LINEAR_C5           3840      /* Linear period of C-5, 64 units per semitone */
+
+#define PERIOD_MIN          1
+#define PERIOD_MAX          (0x7fff*4)
+
+extern s16 wavetab[4][64];
+
+static const f32 semitone_ratio[16] =
+  {
+    1.000000F, 1.059463F, 1.122462F, 1.189207F, 1.259921F, 1.334840F, 1.414214F, 1.498307F,
+    1.587401F, 1.681793F, 1.781797F, 1.887749F, 2.000000F, 2.118926F, 2.244924F, 2.378414F
+  };
+
+static s32 __trk_noteperiod ( TRACKER * trk, s32 note, u32 c5speed )
+  {
+    if (trk->linear)
+      return LINEAR_C5 + (60-note)*64;
+    return (s32)(AMIGA_CLOCK/((f32)c5speed*powf(2.0F,(f32)(note-60)/12.0F)));
+  }
+
+static f32 __trk_periodfreq ( TRACKER * trk, s32 period, u32 c5speed )
+  {
+    if (trk->linear)
+      return (f32)c5speed*powf(2.0F,(f32)(LINEAR_C5-period)/768.0F);
+    if (period<PERIOD_MIN)
+      period = PERIOD_MIN;
+    return AMIGA_CLOCK/(f32)period;
+  }
+
+static inline void __trk_setperiod ( TRK_CHAN * ch, s32 period )
+  {
+    if (period<PERIOD_MIN) period = PERIOD_MIN;
+    if (period>PERIOD_MAX) period = PERIOD_MAX;
+    ch->period = period;
+  }
+
+static inline void __trk_setvol ( TRK_CHAN * ch, s32 vol )
+  {
+    if (vol<0) vol = 0;
+    if (vol>64) vol = 64;
+    ch->vol = vol;
+  }
+
+static inline u8 __trk_slide ( s32 val, u8 param, s32 max )
+  {
+    if (param&0xf0)
+      val += param>>4;
+    else
+      val -= param&0x0f;
+    if (val<0) val = 0;
+    if (val>max) val = max;
+    return val;
+  }
+
+/* S3M/IT style fine slides: DxF slides up and DFx down once on the first tick */
+static inline BOOL __trk_isfine ( u8 param )
+  {
+    return ((param&0x0f)==0x0f && (param&0xf0)) || ((param&0xf0)==0xf0 && (param&0x0f));
+  }
+
+static inline u8 __trk_fineslide ( s32 val, u8 param, s32 max )
+  {
+    if ((param&0x0f)==0x0f)
+      val += param>>4;
+    else
+      val -= param&0x0f;
+    if (val<0) val = 0;
+    if (val>max) val = max;
+    return val;
+  }
+
+static void __trk_toneporta ( TRK_CHAN * ch )
+  {
+    s32 speed = ch->porta_speed<<2;
+
+    if (ch->period<ch->porta_target)
+      {
+        ch->period += speed;
+        if (ch->period>ch->porta_target)
+          ch->period = ch->porta_target;
+      } else
+    if (ch->period>ch->porta_target)
+      {
+        ch->period -= speed;
+        if (ch->period<ch->porta_target)
+          ch->period = ch->porta_target;
+      }
+  }
+
+static void __trk_vibrato ( TRK_CHAN * ch, s32 shift )
+  {
+    ch->vib_delta = ((s32)wavetab[ch->vib_wave&3][ch->vib_pos]*(s32)ch->vib_depth)>>shift;
+    ch->vib_pos = (ch->vib_pos+ch->vib_speed)&63;
+  }
+
+static void __trk_tremolo ( TRK_CHAN * ch )
+  {
+    ch->trem_delta = ((s32)wavetab[ch->trem_wave&3][ch->trem_pos]*(s32)ch->trem_depth)>>6;
+    ch->trem_pos = (ch->trem_pos+ch->trem_speed)&63;
+  }
+
+static void __trk_keyoff ( MOD * mod, s32 c )
+  {
+    TRACKER * trk = mod->trk;
+    TRK_CHAN * ch = &trk->chan[c];
+
+    ch->keyon = FALSE;
+    if (!trk->instmode || ch->instr==0)
+      {
+        ch->vol = 0;
+        mod->channel_active[c] = FALSE;
+      } else
+    if (!(trk->instr[ch->instr-1].volenv.flags&TRK_ENV_ON) && trk->format==TRK_FMT_XM)
+      ch->vol = 0;
+    else
+      ch->fading = TRUE;
+  }
+
+static void __trk_resetvoice ( TRK_CHAN * ch )
+  {
+    ch->keyon = TRUE;
+    ch->fading = FALSE;
+    ch->fadevol = 65536;
+    ch->env_pos = 0;
+  }
+
+static u32 __trk_trigger ( MOD * mod, s32 c, const TRK_EVENT * ev )
+  {
+    TRACKER * trk = mod->trk;
+    TRK_CHAN * ch = &trk->chan[c];
+    u32 retval = 0;
+    s32 note, s;
+    BOOL porta = (ev->fx==TRK_FX_TONEPORTA || ev->fx==TRK_FX_TONEPORTA_VOL || (ev->vol&0xf0)==TRK_VOL_TONEPORTA);
+
+    if (ev->instr!=0 && ev->instr<=(trk->instmode ? trk->num_instr : trk->num_samples))
+      ch->instr = ev->instr;
+
+    if (ev->note>=1 && ev->note<=120 && ch->instr!=0)
+      {
+        note = ev->note-1;
+        s = ch->instr;
+        if (trk->instmode)
+          {
+            s = trk->instr[ch->instr-1].sample[note];
+            note = trk->instr[ch->instr-1].note[note];
+          }
+
+        if (s==0 || s>trk->num_samples || trk->smp[s-1].data==NULL)
+          {
+            if (!porta)
+              mod->channel_active[c] = FALSE;
+          } else
+        if (porta && mod->channel_active[c])
+          {
+            ch->porta_target = __trk_noteperiod ( trk, note, trk->samples[ch->sample-1].c5speed );
+          } else
+          {
+            ch->note = note;
+            ch->sample = s;
+            ch->period = ch->porta_target = __trk_noteperiod ( trk, note, trk->samples[s-1].c5speed );
+            if (!(ch->vib_wave&4))
+              ch->vib_pos = 0;
+            if (!(ch->trem_wave&4))
+              ch->trem_pos = 0;
+            __trk_resetvoice ( ch );
+
+            mod->instnum[c] = s-1;
+            mod->playpos[c] = 0;
+            mod->channel_active[c] = TRUE;
+            retval = 1<<c;
+          }
+      }
+
+    if (ev->instr!=0 && ch->sample!=0)
+      {
+        ch->vol = trk->samples[ch->sample-1].volume;
+        __trk_resetvoice ( ch );
+      }
+
+    switch (ev->note)
+      {
+        case TRK_NOTE_OFF:
+          __trk_keyoff ( mod, c );
+          break;
+        case TRK_NOTE_CUT:
+          ch->vol = 0;
+          mod->channel_active[c] = FALSE;
+          break;
+        case TRK_NOTE_FADE:
+          ch->fading = TRUE;
+          break;
+      }
+
+    return retval;
+  }
+
+static void __trk_volcmd_row ( TRK_CHAN * ch )
+  {
+    u8 v = ch->volcmd;
+
+    if (v>=TRK_VOL_SET && v<=TRK_VOL_SET+64)
+      {
+        ch->vol = v-TRK_VOL_SET;
+        return;
+      }
+    switch (v&0xf0)
+      {
+        case TRK_VOL_FINEDOWN:
+          __trk_setvol ( ch, ch->vol-(v&0x0f) );
+          break;
+        case TRK_VOL_FINEUP:
+          __trk_setvol ( ch, ch->vol+(v&0x0f) );
+          break;
+        case TRK_VOL_VIBSPEED:
+          if (v&0x0f)
+            ch->vib_speed = v&0x0f;
+          break;
+        case TRK_VOL_VIBRATO:
+          if (v&0x0f)
+            ch->vib_depth = v&0x0f;
+          break;
+        case TRK_VOL_TONEPORTA:
+          if (v&0x0f)
+            ch->porta_speed = (v&0x0f)<<4;
+          break;
+      }
+  }
+
+static void __trk_volcmd_tick ( TRK_CHAN * ch )
+  {
+    u8 v = ch->volcmd;
+
+    switch (v&0xf0)
+      {
+        case TRK_VOL_SLIDEDOWN:
+          __trk_setvol ( ch, ch->vol-(v&0x0f) );
+          break;
+        case TRK_VOL_SLIDEUP:
+          __trk_setvol ( ch, ch->vol+(v&0x0f) );
+          break;
+        case TRK_VOL_VIBRATO:
+          __trk_vibrato ( ch, 5 );
+          break;
+        case TRK_VOL_TONEPORTA:
+          if (ch->fx!=TRK_FX_TONEPORTA && ch->fx!=TRK_FX_TONEPORTA_VOL)
+            __trk_toneporta ( ch );
+          break;
+      }
+  }
+
+/* Effects handled on the first tick of a row */
+static void __trk_fx_row ( MOD * mod, s32 c, BOOL noteon )
+  {
+    TRACKER * trk = mod->trk;
+    TRK_CHAN * ch = &trk->chan[c];
+    u8 p = ch->param;
+
+    switch (ch->fx)
+      {
+        case TRK_FX_ARPEGGIO:
+          if (p)
+            ch->mem_arp = p;
+          break;
+        case TRK_FX_PORTA_UP:
+        case TRK_FX_PORTA_DOWN:
+          if (p)
+            ch->mem_porta = p;
+          break;
+        case TRK_FX_S3M_PORTA_UP:
+        case TRK_FX_S3M_PORTA_DOWN:
+          if (p)
+            ch->mem_porta = p;
+          p = ch->mem_porta;
+          if (p>=0xe0)
+            {
+              s32 delta = (p>=0xf0) ? (p&0x0f)<<2 : (p&0x0f);
+              if (ch->fx==TRK_FX_S3M_PORTA_UP)
+                delta = -delta;
+              __trk_setperiod ( ch, ch->period+delta );
+            }
+          break;
+        case TRK_FX_FINE_PORTA_UP:
+        case TRK_FX_FINE_PORTA_DOWN:
+        case TRK_FX_XFINE_PORTA_UP:
+        case TRK_FX_XFINE_PORTA_DOWN:
+          {
+            s32 delta;
+
+            if (p&0x0f)
+              ch->mem_fineporta = p;
+            delta = ch->mem_fineporta&0x0f;
+            if (ch->fx==TRK_FX_FINE_PORTA_UP || ch->fx==TRK_FX_FINE_PORTA_DOWN)
+              delta <<= 2;
+            if (ch->fx==TRK_FX_FINE_PORTA_UP || ch->fx==TRK_FX_XFINE_PORTA_UP)
+              delta = -delta;
+            __trk_setperiod ( ch, ch->period+delta );
+          }
+          break;
+        case TRK_FX_TONEPORTA:
+          if (p)
+            ch->porta_speed = p;
+          break;
+        case TRK_FX_VIBRATO:
+        case TRK_FX_FINE_VIBRATO:
+          if (p&0xf0)
+            ch->vib_speed = p>>4;
+          if (p&0x0f)
+            ch->vib_depth = p&0x0f;
+          break;
+        case TRK_FX_TONEPORTA_VOL:
+        case TRK_FX_VIBRATO_VOL:
+        case TRK_FX_VOLSLIDE:
+          if (p)
+            ch->mem_volslide = p;
+          break;
+        case TRK_FX_S3M_VOLSLIDE:
+          if (p)
+            ch->mem_volslide = p;
+          if (__trk_isfine(ch->mem_volslide))
+            ch->vol = __trk_fineslide ( ch->vol, ch->mem_volslide, 64 );
+          break;
+        case TRK_FX_VIBWAVE:
+          ch->vib_wave = p&0x07;
+          break;
+        case TRK_FX_TREMWAVE:
+          ch->trem_wave = p&0x07;
+          break;
+        case TRK_FX_TREMOLO:
+          if (p&0xf0)
+            ch->trem_speed = p>>4;
+          if (p&0x0f)
+            ch->trem_depth = p&0x0f;
+          break;
+        case TRK_FX_OFFSET:
+          if (p)
+            ch->mem_offset = p;
+          if (noteon && ch->sample!=0)
+            {
+              u32 ofs = ch->mem_offset<<8;
+              if (ofs>=trk->smp[ch->sample-1].length)
+                ofs = trk->smp[ch->sample-1].length-1;
+              mod->playpos[c] = ofs<<16;
+            }
+          break;
+        case TRK_FX_FINE_VOL_UP:
+          __trk_setvol ( ch, ch->vol+(p&0x0f) );
+          break;
+        case TRK_FX_FINE_VOL_DOWN:
+          __trk_setvol ( ch, ch->vol-(p&0x0f) );
+          break;
+        case TRK_FX_SET_VOLUME:
+          __trk_setvol ( ch, p );
+          break;
+        case TRK_FX_CHANVOL:
+          ch->chanvol = p>64 ? 64 : p;
+          break;
+        case TRK_FX_CHANVOL_SLIDE:
+          if (p)
+            ch->mem_chanvol = p;
+          if (__trk_isfine(ch->mem_chanvol))
+            ch->chanvol = __trk_fineslide ( ch->chanvol, ch->mem_chanvol, 64 );
+          break;
+        case TRK_FX_GLOBALVOL:
+          trk->gvol = p>128 ? 128 : p;
+          break;
+        case TRK_FX_GLOBALVOL_SLIDE:
+          if (p)
+            ch->mem_gvol = p;
+          if (trk->format==TRK_FMT_IT && __trk_isfine(ch->mem_gvol))
+            trk->gvol = __trk_fineslide ( trk->gvol, ch->mem_gvol, 128 );
+          break;
+        case TRK_FX_JUMP:
+          trk->jump_order = p;
+          break;
+        case TRK_FX_BREAK:
+          trk->break_row = p;
+          break;
+        case TRK_FX_SPEED:
+          if (p)
+            mod->speed = p;
+          break;
+        case TRK_FX_TEMPO:
+          if (p>=32)
+            {
+              mod->bpm = p;
+              mod->samplespertick = mod->bpmtab[p-32];
+            }
+          break;
+        case TRK_FX_RETRIG:
+          if (p)
+            ch->mem_retrig = p;
+          ch->retrig_count = 0;
+          break;
+        case TRK_FX_KEYOFF:
+          if (p==0)
+            __trk_keyoff ( mod, c );
+          break;
+        case TRK_FX_PATLOOP:
+          if ((p&0x0f)==0)
+            ch->loop_row = mod->patternline;
+          else
+          if (ch->loop_count==0)
+            {
+              ch->loop_count = p&0x0f;
+              trk->loop_row = ch->loop_row;
+            } else
+          if (--ch->loop_count!=0)
+            trk->loop_row = ch->loop_row;
+          else
+            ch->loop_row = mod->patternline+1;
+          break;
+        case TRK_FX_NOTECUT:
+          if ((p&0x0f)==0)
+            ch->vol = 0;
+          break;
+        case TRK_FX_PATDELAY:
+          if (trk->patdelay==0)
+            trk->patdelay = p&0x0f;
+          break;
+      }
+  }
+
+/* Effects handled on every tick but the first of a row */
+static u32 __trk_fx_tick ( MOD * mod, s32 c, s32 tick )
+  {
+    TRACKER * trk = mod->trk;
+    TRK_CHAN * ch = &trk->chan[c];
+    u8 p = ch->param;
+    u32 retval = 0;
+
+    __trk_volcmd_tick ( ch );
+
+    switch (ch->fx)
+      {
+        case TRK_FX_ARPEGGIO:
+          switch (tick%3)
+            {
+              case 0: ch->arp_note = 0; break;
+              case 1: ch->arp_note = ch->mem_arp>>4; break;
+              case 2: ch->arp_note = ch->mem_arp&0x0f; break;
+            }
+          break;
+        case TRK_FX_PORTA_UP:
+          __trk_setperiod ( ch, ch->period-(ch->mem_porta<<2) );
+          break;
+        case TRK_FX_PORTA_DOWN:
+          __trk_setperiod ( ch, ch->period+(ch->mem_porta<<2) );
+          break;
+        case TRK_FX_S3M_PORTA_UP:
+          if (ch->mem_porta<0xe0)
+            __trk_setperiod ( ch, ch->period-(ch->mem_porta<<2) );
+          break;
+        case TRK_FX_S3M_PORTA_DOWN:
+          if (ch->mem_porta<0xe0)
+            __trk_setperiod ( ch, ch->period+(ch->mem_porta<<2) );
+          break;
+        case TRK_FX_TONEPORTA:
+          __trk_toneporta ( ch );
+          break;
+        case TRK_FX_TONEPORTA_VOL:
+          __trk_toneporta ( ch );
+          ch->vol = __trk_slide ( ch->vol, ch->mem_volslide, 64 );
+          break;
+        case TRK_FX_VIBRATO:
+          __trk_vibrato ( ch, 5 );
+          break;
+        case TRK_FX_FINE_VIBRATO:
+          __trk_vibrato ( ch, 7 );
+          break;
+        case TRK_FX_VIBRATO_VOL:
+          __trk_vibrato ( ch, 5 );
+          ch->vol = __trk_slide ( ch->vol, ch->mem_volslide, 64 );
+          break;
+        case TRK_FX_TREMOLO:
+          __trk_tremolo ( ch );
+          break;
+        case TRK_FX_VOLSLIDE:
+          ch->vol = __trk_slide ( ch->vol, ch->mem_volslide, 64 );
+          break;
+        case TRK_FX_S3M_VOLSLIDE:
+          if (!__trk_isfine(ch->mem_volslide))
+            ch->vol = __trk_slide ( ch->vol, ch->mem_volslide, 64 );
+          break;
+        case TRK_FX_CHANVOL_SLIDE:
+          if (!__trk_isfine(ch->mem_chanvol))
+            ch->chanvol = __trk_slide ( ch->chanvol, ch->mem_chanvol, 64 );
+          break;
+        case TRK_FX_GLOBALVOL_SLIDE:
+          if (trk->format!=TRK_FMT_IT || !__trk_isfine(ch->mem_gvol))
+            trk->gvol = __trk_slide ( trk->gvol, ch->mem_gvol, 128 );
+          break;
+        case TRK_FX_RETRIG:
+          if ((ch->mem_retrig&0x0f) && ++ch->retrig_count>=(ch->mem_retrig&0x0f))
+            {
+              static const s8 retrig_add[16] = { 0,-1,-2,-4,-8,-16,0,0,0,1,2,4,8,16,0,0 };
+              s32 v = ch->vol;
+
+              ch->retrig_count = 0;
+              switch (ch->mem_retrig>>4)
+                {
+                  case 0x6: v = (v*2)/3; break;
+                  case 0x7: v >>= 1; break;
+                  case 0xe: v = (v*3)/2; break;
+                  case 0xf: v <<= 1; break;
+                  default:  v += retrig_add[ch->mem_retrig>>4]; break;
+                }
+              __trk_setvol ( ch, v );
+              if (ch->sample!=0)
+                {
+                  mod->playpos[c] = 0;
+                  mod->channel_active[c] = TRUE;
+                  retval |= 1<<c;
+                }
+            }
+          break;
+        case TRK_FX_KEYOFF:
+          if (tick==p)
+            __trk_keyoff ( mod, c );
+          break;
+        case TRK_FX_NOTECUT:
+          if (tick==(p&0x0f))
+            ch->vol = 0;
+          break;
+        case TRK_FX_NOTEDELAY:
+          if (tick==(p&0x0f))
+            {
+              retval |= __trk_trigger ( mod, c, &ch->delayed );
+              if (ch->delayed.vol>=TRK_VOL_SET && ch->delayed.vol<=TRK_VOL_SET+64)
+                ch->vol = ch->delayed.vol-TRK_VOL_SET;
+            }
+          break;
+      }
+
+    return retval;
+  }
+
+static s32 __trk_envelope ( TRACKER * trk, TRK_CHAN * ch, const TRK_ENV * env )
+  {
+    u32 pos = ch->env_pos;
+    s32 i, val, dt;
+
+    if (env->num==0)
+      return 64;
+
+    for (i=0;i<env->num-1 && pos>=env->tick[i+1];i++);
+    if (i>=env->num-1)
+      val = env->value[env->num-1];
+    else
+      {
+        dt = env->tick[i+1]-env->tick[i];
+        val = env->value[i];
+        if (dt>0)
+          val += ((s32)env->value[i+1]-val)*(s32)(pos-env->tick[i])/dt;
+      }
+
+    pos++;
+    if ((env->flags&TRK_ENV_SUSTAIN) && ch->keyon)
+      {
+        if (pos>env->tick[env->sus_end])
+          pos = env->tick[env->sus_start];
+      } else
+    if (env->flags&TRK_ENV_LOOP)
+      {
+        if (pos>env->tick[env->loop_end])
+          pos = env->tick[env->loop_start];
+      } else
+    if (pos>env->tick[env->num-1])
+      {
+        pos = env->tick[env->num-1];
+        if (trk->format==TRK_FMT_IT)
+          ch->fading = TRUE;
+      }
+    ch->env_pos = pos;
+
+    return val;
+  }
+
+/* Turn the channel state into what the mixer consumes */
+static void __trk_update ( MOD * mod )
+  {
+    TRACKER * trk = mod->trk;
+    s32 c, vol;
+    f32 freq;
+    u32 inc;
+
+    for (c=0;c<trk->num_channels;c++)
+      {
+        TRK_CHAN * ch = &trk->chan[c];
+        TRK_SAMPLE * smp;
+
+        if (!mod->channel_active[c] || ch->sample==0)
+          {
+            mod->volume[c] = 0;
+            continue;
+          }
+        smp = &trk->samples[ch->sample-1];
+
+        vol = ch->vol + ch->trem_delta;
+        if (vol<0) vol = 0;
+        if (vol>64) vol = 64;
+
+        if (trk->instmode && ch->instr!=0)
+          {
+            TRK_INSTR * ins = &trk->instr[ch->instr-1];
+
+            if (ins->volenv.flags&TRK_ENV_ON)
+              vol = (vol*__trk_envelope(trk,ch,&ins->volenv))>>6;
+            if (ch->fading)
+              {
+                ch->fadevol -= ins->fadeout;
+                if (ch->fadevol<=0)
+                  {
+                    ch->fadevol = 0;
+                    mod->channel_active[c] = FALSE;
+                  }
+              }
+            vol = (vol*ch->fadevol)>>16;
+            vol = (vol*ins->gvol)>>6;
+          }
+        vol = (vol*smp->gvol)>>6;
+        vol = (vol*ch->chanvol)>>6;
+        vol = (vol*trk->gvol)>>7;
+        mod->volume[c] = vol;
+
+        freq = __trk_periodfreq ( trk, ch->period+ch->vib_delta, smp->c5speed );
+        if (ch->arp_note)
+          freq *= semitone_ratio[ch->arp_note];
+        inc = (u32)(freq*65536.0F/(f32)mod->freq);
+        mod->chaninc[c] = inc ? inc : 1;
+      }
+  }
+
+static u32 __trk_row ( MOD * mod )
+  {
+    TRACKER * trk = mod->trk;
+    TRK_PATTERN * pat = &trk->patterns[trk->orders[mod->songpos]];
+    const TRK_EVENT * ev = &pat->events[mod->patternline*trk->num_channels];
+    u32 retval = 0;
+    s32 c;
+
+    for (c=0;c<trk->num_channels;c++,ev++)
+      {
+        TRK_CHAN * ch = &trk->chan[c];
+
+        ch->fx = ev->fx;
+        ch->param = ev->param;
+        ch->volcmd = ev->vol;
+        ch->vib_delta = 0;
+        ch->trem_delta = 0;
+        ch->arp_note = 0;
+
+        if (ev->fx==TRK_FX_NOTEDELAY && (ev->param&0x0f))
+          ch->delayed = *ev;
+        else
+          {
+            retval |= __trk_trigger ( mod, c, ev );
+            __trk_volcmd_row ( ch );
+          }
+        __trk_fx_row ( mod, c, ev->note>=1 && ev->note<=120 );
+      }
+    return retval;
+  }
+
+static void __trk_setorder ( MOD * mod, s32 order )
+  {
+    TRACKER * trk = mod->trk;
+    s32 c;
+
+    if (order>=trk->num_orders || order<=mod->songpos)
+      {
+        if (mod->notify)
+          *mod->notify = TRUE;
+      }
+    if (order>=trk->num_orders)
+      order = trk->restart<trk->num_orders ? trk->restart : 0;
+    mod->songpos = order;
+    for (c=0;c<trk->num_channels;c++)
+      {
+        trk->chan[c].loop_row = 0;
+        trk->chan[c].loop_count = 0;
+      }
+  }
+
+static void __trk_nextrow ( MOD * mod )
+  {
+    TRACKER * trk = mod->trk;
+
+    if (trk->loop_row>=0)
+      mod->patternline = trk->loop_row;
+    else
+    if (trk->jump_order>=0 || trk->break_row>=0)
+      {
+        __trk_setorder ( mod, trk->jump_order>=0 ? trk->jump_order : mod->songpos+1 );
+        mod->patternline = trk->break_row>=0 ? trk->break_row : 0;
+        if (mod->patternline>=trk->patterns[trk->orders[mod->songpos]].rows)
+          mod->patternline = 0;
+      } else
+      {
+        mod->patternline++;
+        if (mod->patternline>=trk->patterns[trk->orders[mod->songpos]].rows)
+          {
+            __trk_setorder ( mod, mod->songpos+1 );
+            mod->patternline = 0;
+          }
+      }
+
+    trk->jump_order = -1;
+    trk->break_row = -1;
+    trk->loop_row = -1;
+  }
+
+u32 TRK_Tick ( MOD * mod )
+  {
+    TRACKER * trk = mod->trk;
+    u32 retval = 0;
+    s32 c, tick;
+
+    mod->speedcounter++;
+    if (mod->speedcounter>=mod->speed*(trk->patdelay+1))
+      {
+        mod->speedcounter = 0;
+        trk->patdelay = 0;
+        __trk_nextrow ( mod );
+        retval |= __trk_row ( mod );
+      } else
+      {
+        tick = mod->speedcounter%mod->speed;
+        if (tick!=0)
+          {
+            for (c=0;c<trk->num_channels;c++)
+              retval |= __trk_fx_tick ( mod, c, tick );
+          }
+      }
+    __trk_update ( mod );
+
+    return retval;
+  }
+
+void TRK_Start ( MOD * mod )
+  {
+    TRACKER * trk = mod->trk;
+    s32 c;
+
+    memset ( trk->chan, 0, sizeof(trk->chan) );
+    for (c=0;c<MAX_VOICES;c++)
+      {
+        trk->chan[c].chanvol = trk->init_chanvol[c];
+        mod->chaninc[c] = 0;
+      }
+
+    trk->gvol = trk->init_gvol;
+    trk->patdelay = 0;
+    trk->jump_order = -1;
+    trk->break_row = -1;
+    trk->loop_row = -1;
+
+    mod->speed = trk->init_speed;
+    mod->bpm = trk->init_tempo;
+    mod->samplespertick = mod->bpmtab[mod->bpm-32];
+    mod->songpos = 0;
+    mod->patternline = 0;
+    mod->speedcounter = 0;
+
+    __trk_row ( mod );
+    __trk_update ( mod );
+  }
+
+BOOL TRK_IsModule ( const u8 * mem )
+  {
+    return (memcmp(mem,"Extended Module: ",17)==0 ||
+            memcmp(mem,"IMPM",4)==0 ||
+            memcmp(&mem[0x2c],"SCRM",4)==0);
+  }
+
+static void __trk_release ( TRACKER * trk )
+  {
+    if (trk->patterns) free ( trk->patterns );
+    if (trk->eventdata) free ( trk->eventdata );
+    if (trk->instr) free ( trk->instr );
+    if (trk->samples) free ( trk->samples );
+    if (trk->smp) free ( trk->smp );
+    if (trk->sampledata) free ( trk->sampledata );
+    free ( trk );
+  }
+
+s32 TRK_SetModule ( MOD * mod, const u8 * mem )
+  {
+    TRACKER * trk;
+    s32 ret;
+
+    trk = (TRACKER*)calloc ( 1, sizeof(TRACKER) );
+    if (trk==NULL)
+      return -1;
+
+    if (memcmp(mem,"Extended Module: ",17)==0)
+      {
+        ret = TRK_LoadXM ( trk, mem );
+        memcpy ( mod->name, &mem[17], 20 );
+      } else
+    if (memcmp(mem,"IMPM",4)==0)
+      {
+        ret = TRK_LoadIT ( trk, mem );
+        memcpy ( mod->name, &mem[4], 20 );
+      } else
+      {
+        ret = TRK_LoadS3M ( trk, mem );
+        memcpy ( mod->name, mem, 20 );
+      }
+    mod->name[20] = '\0';
+
+    if (ret<0 || trk->num_channels==0 || trk->num_orders==0)
+      {
+        __trk_release ( trk );
+        return -1;
+      }
+
+    mod->trk = trk;
+    mod->instrument = trk->smp;
+    mod->num_instr = trk->num_samples;
+    mod->num_patterns = trk->num_patterns;
+    mod->song_length = trk->num_orders>255 ? 255 : trk->num_orders;
+    mod->num_voices = trk->num_channels;
+
+    return 0;
+  }
+
+void TRK_Free ( MOD * mod )
+  {
+    if (mod->trk==NULL)
+      return;
+
+    __trk_release ( mod->trk );
+    mod->trk = NULL;
+    mod->instrument = mod->modinstr;
+  }
@@ -0,0 +1,908 @@
+/*-------------------------------------------------------------
+
+trkload.c -- S3M, XM and IT loaders for the shared pattern engine
+
+Copyright (C) 2026
+
+This software is provided 'as-is', without any express or implied
+warranty.  In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1.	The origin of this software must not be misrepresented; you
+must not claim that you wrote the original software. If you use
+this software in a product, an acknowledgment in the product
+documentation would be appreciated but is not required.
+
+2.	Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3.	This notice may not be removed or altered from any source
+distribution.
+
+-------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "defines.h"
+#include "modplay.h"
+#include "tracker.h"
+
+#define EMPTY_ROWS      64
+
+typedef struct _itbits
+  {
+    const u8 * p;
+    const u8 * end;
+    u32 buf;
+    u32 num;
+  } ITBITS;
+
+static inline u16 __le16 ( const u8 * p )
+  {
+    return (u16)(p[0] | (p[1]<<8));
+  }
+
+static inline u32 __le32 ( const u8 * p )
+  {
+    return (u32)p[0] | ((u32)p[1]<<8) | ((u32)p[2]<<16) | ((u32)p[3]<<24);
+  }
+
+static void __trk_orders ( TRACKER * trk, const u8 * ord, s32 num, s32 numpat, BOOL markers )
+  {
+    s32 i;
+    u8 o;
+
+    trk->num_orders = 0;
+    for (i=0;i<num && trk->num_orders<256;i++)
+      {
+        o = ord[i];
+        if (markers)
+          {
+            if (o==255)
+              break;
+            if (o==254)
+              continue;
+          }
+        if (o>=numpat)
+          o = numpat;   /* The empty pattern */
+        trk->orders[trk->num_orders++] = o;
+      }
+  }
+
+static s32 __trk_alloc ( TRACKER * trk, u32 numevents, u32 numsmpdata )
+  {
+    u32 nsmp = trk->num_samples ? trk->num_samples : 1;
+    u32 nins = trk->num_instr ? trk->num_instr : 1;
+
+    trk->patterns = (TRK_PATTERN*)calloc ( trk->num_patterns+1, sizeof(TRK_PATTERN) );
+    trk->eventdata = (TRK_EVENT*)calloc ( numevents+EMPTY_ROWS*trk->num_channels, sizeof(TRK_EVENT) );
+    trk->samples = (TRK_SAMPLE*)calloc ( nsmp, sizeof(TRK_SAMPLE) );
+    trk->smp = (MOD_INSTR*)calloc ( nsmp, sizeof(MOD_INSTR) );
+    trk->sampledata = (s8*)malloc ( numsmpdata ? numsmpdata : 1 );
+    if (trk->instmode)
+      trk->instr = (TRK_INSTR*)calloc ( nins, sizeof(TRK_INSTR) );
+
+    if (trk->patterns==NULL || trk->eventdata==NULL || trk->samples==NULL ||
+        trk->smp==NULL || trk->sampledata==NULL || (trk->instmode && trk->instr==NULL))
+      return -1;
+
+    trk->patterns[trk->num_patterns].rows = EMPTY_ROWS;
+    trk->patterns[trk->num_patterns].events = &trk->eventdata[numevents];
+    return 0;
+  }
+
+static void __trk_setsample ( MOD_INSTR * mi, const u8 * name, s8 * data, u32 len, u32 ls, u32 le, BOOL loop )
+  {
+    memcpy ( mi->name, name, 22 );
+    mi->name[22] = '\0';
+    mi->data = len ? data : NULL;
+    mi->length = len;
+    mi->finetune = 8;
+    mi->volume = 64;
+
+    if (le>len)
+      le = len;
+    if (loop && ls+2<le)
+      {
+        mi->looped = TRUE;
+        mi->loop_start = ls;
+        mi->loop_end = le;
+      } else
+      {
+        mi->looped = FALSE;
+        mi->loop_start = mi->loop_end = len;
+      }
+    mi->loop_length = mi->loop_end - mi->loop_start;
+  }
+
+/* Converts PCM to the signed 8 bit format the mixer plays */
+static void __trk_convert ( s8 * dst, const u8 * src, u32 len, BOOL is16, BOOL issigned, BOOL delta )
+  {
+    s32 acc = 0, v;
+    u32 i;
+
+    for (i=0;i<len;i++)
+      {
+        if (is16)
+          {
+            v = issigned ? (s16)__le16(&src[i<<1]) : (s32)__le16(&src[i<<1])-32768;
+            if (delta)
+              v = acc = (s16)(acc+v);
+            dst[i] = v>>8;
+          } else
+          {
+            v = issigned ? (s8)src[i] : (s32)src[i]-128;
+            if (delta)
+              v = acc = (s8)(acc+v);
+            dst[i] = v;
+          }
+      }
+  }
+
+static u32 __c5speed ( s32 relnote, s32 finetune )
+  {
+    return (u32)(8363.0F*powf(2.0F,((f32)relnote+(f32)finetune/128.0F)/12.0F));
+  }
+
+/* S3M and IT share the letter commands, IT adds M, N and W */
+static void __trk_itfx ( TRK_EVENT * ev, u8 cmd, u8 info, BOOL it )
+  {
+    u8 fx = TRK_FX_NONE;
+
+    switch (cmd+'A'-1)
+      {
+        case 'A': fx = TRK_FX_SPEED; break;
+        case 'B': fx = TRK_FX_JUMP; break;
+        case 'C':
+          fx = TRK_FX_BREAK;
+          if (!it)
+            info = (info>>4)*10 + (info&0x0f);
+          break;
+        case 'D': fx = TRK_FX_S3M_VOLSLIDE; break;
+        case 'E': fx = TRK_FX_S3M_PORTA_DOWN; break;
+        case 'F': fx = TRK_FX_S3M_PORTA_UP; break;
+        case 'G': fx = TRK_FX_TONEPORTA; break;
+        case 'H': fx = TRK_FX_VIBRATO; break;
+        case 'J': fx = TRK_FX_ARPEGGIO; break;
+        case 'K': fx = TRK_FX_VIBRATO_VOL; break;
+        case 'L': fx = TRK_FX_TONEPORTA_VOL; break;
+        case 'M': if (it) fx = TRK_FX_CHANVOL; break;
+        case 'N': if (it) fx = TRK_FX_CHANVOL_SLIDE; break;
+        case 'O': fx = TRK_FX_OFFSET; break;
+        case 'Q': fx = TRK_FX_RETRIG; break;
+        case 'R': fx = TRK_FX_TREMOLO; break;
+        case 'S':
+          switch (info>>4)
+            {
+              case 0x3: fx = TRK_FX_VIBWAVE; break;
+              case 0x4: fx = TRK_FX_TREMWAVE; break;
+              case 0xb: fx = TRK_FX_PATLOOP; break;
+              case 0xc: fx = TRK_FX_NOTECUT; break;
+              case 0xd: fx = TRK_FX_NOTEDELAY; break;
+              case 0xe: fx = TRK_FX_PATDELAY; break;
+            }
+          info &= 0x0f;
+          break;
+        case 'T':
+          if (info>=0x20)
+            fx = TRK_FX_TEMPO;
+          break;
+        case 'U': fx = TRK_FX_FINE_VIBRATO; break;
+        case 'V':
+          fx = TRK_FX_GLOBALVOL;
+          if (!it)
+            info = info>64 ? 128 : info<<1;
+          break;
+        case 'W': if (it) fx = TRK_FX_GLOBALVOL_SLIDE; break;
+      }
+    ev->fx = fx;
+    ev->param = fx!=TRK_FX_NONE ? info : 0;
+  }
+
+static void __trk_xmfx ( TRK_EVENT * ev, u8 cmd, u8 param )
+  {
+    u8 fx = TRK_FX_NONE;
+
+    switch (cmd)
+      {
+        case 0x00: if (param) fx = TRK_FX_ARPEGGIO; break;
+        case 0x01: fx = TRK_FX_PORTA_UP; break;
+        case 0x02: fx = TRK_FX_PORTA_DOWN; break;
+        case 0x03: fx = TRK_FX_TONEPORTA; break;
+        case 0x04: fx = TRK_FX_VIBRATO; break;
+        case 0x05: fx = TRK_FX_TONEPORTA_VOL; break;
+        case 0x06: fx = TRK_FX_VIBRATO_VOL; break;
+        case 0x07: fx = TRK_FX_TREMOLO; break;
+        case 0x09: fx = TRK_FX_OFFSET; break;
+        case 0x0a: fx = TRK_FX_VOLSLIDE; break;
+        case 0x0b: fx = TRK_FX_JUMP; break;
+        case 0x0c: fx = TRK_FX_SET_VOLUME; break;
+        case 0x0d:
+          fx = TRK_FX_BREAK;
+          param = (param>>4)*10 + (param&0x0f);
+          break;
+        case 0x0e:
+          switch (param>>4)
+            {
+              case 0x1: fx = TRK_FX_FINE_PORTA_UP; break;
+              case 0x2: fx = TRK_FX_FINE_PORTA_DOWN; break;
+              case 0x4: fx = TRK_FX_VIBWAVE; break;
+              case 0x6: fx = TRK_FX_PATLOOP; break;
+              case 0x7: fx = TRK_FX_TREMWAVE; break;
+              case 0x9: fx = TRK_FX_RETRIG; break;
+              case 0xa: fx = TRK_FX_FINE_VOL_UP; break;
+              case 0xb: fx = TRK_FX_FINE_VOL_DOWN; break;
+              case 0xc: fx = TRK_FX_NOTECUT; break;
+              case 0xd: fx = TRK_FX_NOTEDELAY; break;
+              case 0xe: fx = TRK_FX_PATDELAY; break;
+            }
+          param &= 0x0f;
+          break;
+        case 0x0f:
+          fx = param<32 ? TRK_FX_SPEED : TRK_FX_TEMPO;
+          break;
+        case 0x10:    /* Gxx */
+          fx = TRK_FX_GLOBALVOL;
+          param = param>64 ? 128 : param<<1;
+          break;
+        case 0x11:    /* Hxy */
+          fx = TRK_FX_GLOBALVOL_SLIDE;
+          break;
+        case 0x14:    /* Kxx */
+          fx = TRK_FX_KEYOFF;
+          break;
+        case 0x1b:    /* Rxy */
+          fx = TRK_FX_RETRIG;
+          break;
+        case 0x21:    /* X1x, X2x */
+          if ((param>>4)==1)
+            fx = TRK_FX_XFINE_PORTA_UP;
+          else
+          if ((param>>4)==2)
+            fx = TRK_FX_XFINE_PORTA_DOWN;
+          param &= 0x0f;
+          break;
+      }
+    ev->fx = fx;
+    ev->param = fx!=TRK_FX_NONE ? param : 0;
+  }
+
+/* Maps the IT volume column onto the XM encoding used by the engine */
+static u8 __trk_itvol ( u8 v )
+  {
+    static const u8 porta[10] = { 0x0,0x1,0x1,0x1,0x1,0x2,0x4,0x6,0x8,0xf };
+
+    if (v<=64) return TRK_VOL_SET+v;
+    if (v<=74) return TRK_VOL_FINEUP|(v-65);
+    if (v<=84) return TRK_VOL_FINEDOWN|(v-75);
+    if (v<=94) return TRK_VOL_SLIDEUP|(v-85);
+    if (v<=104) return TRK_VOL_SLIDEDOWN|(v-95);
+    if (v>=193 && v<=202) return TRK_VOL_TONEPORTA|porta[v-193];
+    if (v>=203 && v<=212) return TRK_VOL_VIBRATO|(v-203);
+    return 0;
+  }
+
+s32 TRK_LoadS3M ( TRACKER * trk, const u8 * mem )
+  {
+    u16 ordnum = __le16(&mem[0x20]);
+    u16 insnum = __le16(&mem[0x22]);
+    u16 patnum = __le16(&mem[0x24]);
+    BOOL issigned = (__le16(&mem[0x2a])==1);
+    const u8 * inspara = &mem[0x60+ordnum];
+    const u8 * patpara = &inspara[insnum<<1];
+    u8 chmap[32];
+    u32 smptotal = 0, i;
+    s32 row;
+    s8 * sdata;
+    TRK_EVENT * events, dummy;
+
+    trk->format = TRK_FMT_S3M;
+    trk->linear = FALSE;
+    trk->instmode = FALSE;
+
+    trk->num_channels = 0;
+    for (i=0;i<32;i++)
+      {
+        if (mem[0x40+i]<16 && trk->num_channels<MAX_VOICES)
+          chmap[i] = trk->num_channels++;
+        else
+          chmap[i] = 0xff;
+      }
+    for (i=0;i<MAX_VOICES;i++)
+      trk->init_chanvol[i] = 64;
+
+    trk->num_samples = insnum;
+    trk->num_patterns = patnum;
+    trk->init_gvol = mem[0x30]>64 ? 128 : mem[0x30]<<1;
+    trk->init_speed = mem[0x31] ? mem[0x31] : 6;
+    trk->init_tempo = mem[0x32]>=32 ? mem[0x32] : 125;
+    __trk_orders ( trk, &mem[0x60], ordnum, patnum, TRUE );
+
+    for (i=0;i<insnum;i++)
+      {
+        const u8 * p = &mem[__le16(&inspara[i<<1])<<4];
+        if (p[0]==1)
+          smptotal += __le32(&p[0x10]);
+      }
+
+    if (__trk_alloc(trk,patnum*64*trk->num_channels,smptotal)<0)
+      return -1;
+
+    sdata = trk->sampledata;
+    for (i=0;i<insnum;i++)
+      {
+        const u8 * p = &mem[__le16(&inspara[i<<1])<<4];
+        u32 len = 0, ofs;
+        BOOL is16;
+
+        if (p[0]==1)
+          {
+            len = __le32(&p[0x10]);
+            is16 = (p[0x1f]&4)!=0;
+            ofs = (((u32)p[0x0d]<<16) | __le16(&p[0x0e]))<<4;
+            __trk_convert ( sdata, &mem[ofs], len, is16, issigned, FALSE );
+            trk->samples[i].c5speed = __le32(&p[0x20]);
+            trk->samples[i].volume = p[0x1c]>64 ? 64 : p[0x1c];
+          }
+        trk->samples[i].gvol = 64;
+        if (trk->samples[i].c5speed==0)
+          trk->samples[i].c5speed = 8363;
+        __trk_setsample ( &trk->smp[i], &p[0x30], sdata, len, __le32(&p[0x14]), __le32(&p[0x18]), (p[0x1f]&1)!=0 );
+        sdata += len;
+      }
+
+    events = trk->eventdata;
+    for (i=0;i<patnum;i++)
+      {
+        u16 para = __le16(&patpara[i<<1]);
+        const u8 * p = &mem[(para<<4)+2];
+
+        trk->patterns[i].rows = 64;
+        trk->patterns[i].events = events;
+        for (row=0;row<64 && para!=0;row++)
+          {
+            u8 b;
+
+            while ((b=*p++)!=0)
+              {
+                TRK_EVENT * ev = &dummy;
+
+                if (chmap[b&31]!=0xff)
+                  ev = &events[row*trk->num_channels + chmap[b&31]];
+                if (b&32)
+                  {
+                    u8 note = *p++;
+                    if (note==254)
+                      ev->note = TRK_NOTE_CUT;
+                    else
+                    if (note<0xa0 && (note&0x0f)<12)
+                      ev->note = (note>>4)*12 + (note&0x0f) + 12 + 1;
+                    ev->instr = *p++;
+                  }
+                if (b&64)
+                  {
+                    u8 v = *p++;
+                    if (v<=64)
+                      ev->vol = TRK_VOL_SET+v;
+                  }
+                if (b&128)
+                  {
+                    __trk_itfx ( ev, p[0], p[1], FALSE );
+                    p += 2;
+                  }
+              }
+          }
+        events += 64*trk->num_channels;
+      }
+
+    return 0;
+  }
+
+static void __trk_xmenv ( TRK_ENV * env, const u8 * pts, u8 num, u8 sus, u8 ls, u8 le, u8 type )
+  {
+    s32 i;
+
+    if (num>12)
+      num = 12;
+    env->num = num;
+    for (i=0;i<num;i++)
+      {
+        env->tick[i] = __le16(&pts[i<<2]);
+        env->value[i] = __le16(&pts[(i<<2)+2])>64 ? 64 : __le16(&pts[(i<<2)+2]);
+      }
+    env->flags = 0;
+    if ((type&1) && num>0)
+      env->flags |= TRK_ENV_ON;
+    if ((type&2) && sus<num)
+      env->flags |= TRK_ENV_SUSTAIN;
+    if ((type&4) && ls<=le && le<num)
+      env->flags |= TRK_ENV_LOOP;
+    env->sus_start = env->sus_end = sus;
+    env->loop_start = ls;
+    env->loop_end = le;
+  }
+
+/* Walks the XM instrument chunks. With fill cleared it only counts the
+ * samples and their data size, so the tables can be allocated in one go.
+ */
+static const u8 * __trk_xminstruments ( TRACKER * trk, const u8 * p, u16 nins, BOOL fill, u32 * smptotal )
+  {
+    u32 smpidx = 0, i, j, k;
+    s8 * sdata = trk->sampledata;
+
+    for (i=0;i<nins;i++)
+      {
+        u32 isize = __le32(p);
+        u16 nsmp = __le16(&p[27]);
+        u32 shsize = nsmp ? __le32(&p[29]) : 0;
+        const u8 * sh = &p[isize];
+        const u8 * data = &sh[nsmp*shsize];
+
+        if (fill)
+          {
+            TRK_INSTR * ins = &trk->instr[i];
+
+            ins->gvol = 64;
+            if (nsmp)
+              {
+                for (k=12;k<108;k++)
+                  {
+                    if (p[33+k-12]<nsmp)
+                      ins->sample[k] = smpidx + p[33+k-12] + 1;
+                    ins->note[k] = k;
+                  }
+                __trk_xmenv ( &ins->volenv, &p[129], p[225], p[227], p[228], p[229], p[233] );
+                ins->fadeout = __le16(&p[239])>0x7fff ? 0xffff : __le16(&p[239])<<1;
+              }
+          }
+
+        for (j=0;j<nsmp;j++,sh+=shsize)
+          {
+            u32 bytes = __le32(sh);
+            BOOL is16 = (sh[14]&0x10)!=0;
+            u32 len = is16 ? bytes>>1 : bytes;
+
+            if (fill)
+              {
+                u32 ls = __le32(&sh[4]), ll = __le32(&sh[8]);
+
+                if (is16)
+                  {
+                    ls >>= 1;
+                    ll >>= 1;
+                  }
+                __trk_convert ( sdata, data, len, is16, TRUE, TRUE );
+                __trk_setsample ( &trk->smp[smpidx], &sh[18], sdata, len, ls, ls+ll, (sh[14]&3)!=0 );
+                trk->samples[smpidx].volume = sh[12]>64 ? 64 : sh[12];
+                trk->samples[smpidx].gvol = 64;
+                trk->samples[smpidx].c5speed = __c5speed ( (s8)sh[16], (s8)sh[13] );
+                sdata += len;
+              } else
+              *smptotal += len;
+            data += bytes;
+            smpidx++;
+          }
+        p = data;
+      }
+
+    if (!fill)
+      trk->num_samples = smpidx;
+    return p;
+  }
+
+s32 TRK_LoadXM ( TRACKER * trk, const u8 * mem )
+  {
+    u16 songlen = __le16(&mem[64]);
+    u16 nch = __le16(&mem[68]);
+    u16 npat = __le16(&mem[70]);
+    u16 nins = __le16(&mem[72]);
+    const u8 * p = &mem[60+__le32(&mem[60])];
+    const u8 ** patdata;
+    u32 nevents = 0, smptotal = 0, i;
+    s32 row, c;
+    TRK_EVENT * events, dummy;
+
+    trk->format = TRK_FMT_XM;
+    trk->linear = (__le16(&mem[74])&1)!=0;
+    trk->instmode = TRUE;
+    trk->num_channels = nch>MAX_VOICES ? MAX_VOICES : nch;
+    trk->num_patterns = npat;
+    trk->num_instr = nins;
+    trk->restart = __le16(&mem[66]);
+    trk->init_gvol = 128;
+    /* The header fields are 16 bit, the engine keeps speed and tempo in u8 */
+    trk->init_speed = (__le16(&mem[76])>0 && __le16(&mem[76])<=255) ? __le16(&mem[76]) : 6;
+    trk->init_tempo = (__le16(&mem[78])>=32 && __le16(&mem[78])<=255) ? __le16(&mem[78]) : 125;
+    for (i=0;i<MAX_VOICES;i++)
+      trk->init_chanvol[i] = 64;
+    __trk_orders ( trk, &mem[80], songlen, npat, FALSE );
+
+    patdata = (const u8**)malloc ( (npat ? npat : 1)*sizeof(u8*) );
+    if (patdata==NULL)
+      return -1;
+
+    /* First pass over the patterns, then the instruments are counted */
+    for (i=0;i<npat;i++)
+      {
+        u16 rows = __le16(&p[5]);
+        patdata[i] = p;
+        if (rows==0 || rows>TRK_MAX_ROWS)
+          rows = 64;
+        nevents += rows*trk->num_channels;
+        p += __le32(p) + __le16(&p[7]);
+      }
+    __trk_xminstruments ( trk, p, nins, FALSE, &smptotal );
+
+    /* Sample numbers are kept in u8, like the MOD voice instrument numbers */
+    if (trk->num_samples>255 || __trk_alloc(trk,nevents,smptotal)<0)
+      {
+        free ( patdata );
+        return -1;
+      }
+
+    events = trk->eventdata;
+    for (i=0;i<npat;i++)
+      {
+        const u8 * ph = patdata[i];
+        u16 rows = __le16(&ph[5]);
+        u16 psize = __le16(&ph[7]);
+        const u8 * pd = &ph[__le32(ph)];
+
+        if (rows==0 || rows>TRK_MAX_ROWS)
+          rows = 64;
+        trk->patterns[i].rows = rows;
+        trk->patterns[i].events = events;
+        for (row=0;row<rows && psize!=0;row++)
+          {
+            for (c=0;c<nch;c++)
+              {
+                TRK_EVENT * ev = c<trk->num_channels ? &events[row*trk->num_channels+c] : &dummy;
+                u8 b = *pd++, note = 0, ins = 0, vol = 0, fx = 0, param = 0;
+
+                if (b&0x80)
+                  {
+                    if (b&0x01) note = *pd++;
+                    if (b&0x02) ins = *pd++;
+                    if (b&0x04) vol = *pd++;
+                    if (b&0x08) fx = *pd++;
+                    if (b&0x10) param = *pd++;
+                  } else
+                  {
+                    note = b;
+                    ins = *pd++;
+                    vol = *pd++;
+                    fx = *pd++;
+                    param = *pd++;
+                  }
+
+                if (note==97)
+                  ev->note = TRK_NOTE_OFF;
+                else
+                if (note>=1 && note<=96)
+                  ev->note = note+12;
+                ev->instr = ins;
+                ev->vol = vol;
+                __trk_xmfx ( ev, fx, param );
+              }
+          }
+        events += rows*trk->num_channels;
+      }
+    free ( patdata );
+
+    __trk_xminstruments ( trk, p, nins, TRUE, NULL );
+    return 0;
+  }
+
+static u32 __it_readbits ( ITBITS * b, s32 n )
+  {
+    u32 v = 0;
+    s32 i;
+
+    for (i=0;i<n;i++)
+      {
+        if (b->num==0)
+          {
+            b->buf = b->p<b->end ? *b->p++ : 0;
+            b->num = 8;
+          }
+        v |= (b->buf&1)<<i;
+        b->buf >>= 1;
+        b->num--;
+      }
+    return v;
+  }
+
+/* IT 2.14/2.15 sample decompression */
+static void __it_unpack ( s8 * dst, u32 len, const u8 * src, BOOL is16, BOOL it215 )
+  {
+    u32 blkmax = is16 ? 0x4000 : 0x8000;
+    u32 topwidth = is16 ? 17 : 9;
+    u32 blklen, i, v, width, border;
+    s32 d1, d2, sv, shift;
+    ITBITS bits;
+
+    while (len>0)
+      {
+        blklen = len<blkmax ? len : blkmax;
+        bits.p = &src[2];
+        bits.end = &src[2+__le16(src)];
+        bits.num = 0;
+        src = bits.end;
+
+        width = topwidth;
+        d1 = d2 = 0;
+        for (i=0;i<blklen;)
+          {
+            if (width==0 || width>topwidth)
+              break;
+
+            v = __it_readbits ( &bits, width );
+            if (width<7)
+              {
+                if (v==(1u<<(width-1)))
+                  {
+                    v = __it_readbits ( &bits, is16 ? 4 : 3 ) + 1;
+                    width = v<width ? v : v+1;
+                    continue;
+                  }
+              } else
+            if (width<topwidth)
+              {
+                border = is16 ? (0xffff>>(17-width))-8 : (0xff>>(9-width))-4;
+                if (v>border && v<=border+(is16 ? 16 : 8))
+                  {
+                    v -= border;
+                    width = v<width ? v : v+1;
+                    continue;
+                  }
+              } else
+              {
+                if (v&(1u<<(topwidth-1)))
+                  {
+                    width = (v+1)&0xff;
+                    continue;
+                  }
+              }
+
+            shift = 32 - width;
+            if (width<topwidth)
+              sv = ((s32)(v<<shift))>>shift;
+            else
+              sv = is16 ? (s16)v : (s8)v;
+
+            d1 += sv;
+            d2 += d1;
+            sv = it215 ? d2 : d1;
+            dst[i++] = is16 ? (s16)sv>>8 : (s8)sv;
+          }
+        for (;i<blklen;i++)
+          dst[i] = 0;
+
+        dst += blklen;
+        len -= blklen;
+      }
+  }
+
+static void __trk_itinstrument ( TRK_INSTR * ins, const u8 * p, u16 cmwt )
+  {
+    s32 k;
+
+    for (k=0;k<120;k++)
+      {
+        ins->note[k] = p[0x40+(k<<1)]<120 ? p[0x40+(k<<1)] : k;
+        ins->sample[k] = p[0x41+(k<<1)];
+      }
+
+    if (cmwt<0x200)
+      {
+        ins->fadeout = __le16(&p[0x18])>=0x100 ? 0xffff : __le16(&p[0x18])<<8;
+        ins->gvol = 64;
+        return;
+      }
+
+    ins->fadeout = __le16(&p[0x14])>=0x400 ? 0xffff : __le16(&p[0x14])<<6;
+    ins->gvol = p[0x18]>=128 ? 64 : p[0x18]>>1;
+
+    p += 0x130;
+    ins->volenv.flags = p[0]&(TRK_ENV_ON|TRK_ENV_LOOP|TRK_ENV_SUSTAIN);
+    ins->volenv.num = p[1]>TRK_MAX_ENVPOINTS ? TRK_MAX_ENVPOINTS : p[1];
+    ins->volenv.loop_start = p[2];
+    ins->volenv.loop_end = p[3];
+    ins->volenv.sus_start = p[4];
+    ins->volenv.sus_end = p[5];
+    for (k=0;k<ins->volenv.num;k++)
+      {
+        ins->volenv.value[k] = p[6+k*3]>64 ? 64 : p[6+k*3];
+        ins->volenv.tick[k] = __le16(&p[7+k*3]);
+      }
+    if (ins->volenv.num==0)
+      ins->volenv.flags = 0;
+    if (ins->volenv.loop_start>ins->volenv.loop_end || ins->volenv.loop_end>=ins->volenv.num)
+      ins->volenv.flags &= ~TRK_ENV_LOOP;
+    if (ins->volenv.sus_start>ins->volenv.sus_end || ins->volenv.sus_end>=ins->volenv.num)
+      ins->volenv.flags &= ~TRK_ENV_SUSTAIN;
+  }
+
+s32 TRK_LoadIT ( TRACKER * trk, const u8 * mem )
+  {
+    u16 ordnum = __le16(&mem[0x20]);
+    u16 insnum = __le16(&mem[0x22]);
+    u16 smpnum = __le16(&mem[0x24]);
+    u16 patnum = __le16(&mem[0x26]);
+    u16 cmwt = __le16(&mem[0x2a]);
+    u16 flags = __le16(&mem[0x2c]);
+    const u8 * insofs = &mem[0xc0+ordnum];
+    const u8 * smpofs = &insofs[insnum<<2];
+    const u8 * patofs = &smpofs[smpnum<<2];
+    u8 chmap[64];
+    u8 lastmask[64], lastnote[64], lastins[64], lastvol[64], lastcmd[64], lastparam[64];
+    u32 used[2] = { 0, 0 };
+    u32 nevents = 0, smptotal = 0, i;
+    s32 row;
+    s8 * sdata;
+    TRK_EVENT * events, dummy;
+
+    trk->format = TRK_FMT_IT;
+    trk->linear = (flags&8)!=0;
+    trk->instmode = (flags&4)!=0;
+    trk->num_patterns = patnum;
+    trk->num_samples = smpnum;
+    trk->num_instr = trk->instmode ? insnum : 0;
+    trk->init_gvol = mem[0x30]>128 ? 128 : mem[0x30];
+    trk->init_speed = mem[0x32] ? mem[0x32] : 6;
+    trk->init_tempo = mem[0x33]>=32 ? mem[0x33] : 125;
+    __trk_orders ( trk, &mem[0xc0], ordnum, patnum, TRUE );
+
+    /* Only channels that are enabled and actually used get a voice */
+    for (i=0;i<patnum;i++)
+      {
+        u32 ofs = __le32(&patofs[i<<2]);
+        const u8 * p;
+        u16 rows;
+
+        if (ofs==0)
+          {
+            nevents += EMPTY_ROWS;
+            continue;
+          }
+        p = &mem[ofs];
+        rows = __le16(&p[2]);
+        if (rows==0 || rows>TRK_MAX_ROWS)
+          {
+            nevents += EMPTY_ROWS;
+            continue;
+          }
+        nevents += rows;
+        p += 8;
+        memset ( lastmask, 0, sizeof(lastmask) );
+        for (row=0;row<rows;row++)
+          {
+            u8 cv, c, m;
+
+            while ((cv=*p++)!=0)
+              {
+                c = (cv-1)&63;
+                if (cv&128)
+                  lastmask[c] = *p++;
+                m = lastmask[c];
+                used[c>>5] |= 1u<<(c&31);
+                p += ((m&1)!=0) + ((m&2)!=0) + ((m&4)!=0) + ((m&8) ? 2 : 0);
+              }
+          }
+      }
+
+    trk->num_channels = 0;
+    for (i=0;i<64;i++)
+      {
+        chmap[i] = 0xff;
+        if ((used[i>>5]&(1u<<(i&31))) && !(mem[0x40+i]&128) && trk->num_channels<MAX_VOICES)
+          {
+            trk->init_chanvol[trk->num_channels] = mem[0x80+i]>64 ? 64 : mem[0x80+i];
+            chmap[i] = trk->num_channels++;
+          }
+      }
+
+    for (i=0;i<smpnum;i++)
+      {
+        const u8 * p = &mem[__le32(&smpofs[i<<2])];
+        if (__le32(&smpofs[i<<2])!=0 && (p[0x12]&1))
+          smptotal += __le32(&p[0x30]);
+      }
+
+    if (__trk_alloc(trk,nevents*trk->num_channels,smptotal)<0)
+      return -1;
+
+    for (i=0;i<trk->num_instr;i++)
+      __trk_itinstrument ( &trk->instr[i], &mem[__le32(&insofs[i<<2])], cmwt );
+
+    sdata = trk->sampledata;
+    for (i=0;i<smpnum;i++)
+      {
+        const u8 * p = &mem[__le32(&smpofs[i<<2])];
+        u8 flg = __le32(&smpofs[i<<2]) ? p[0x12] : 0;
+        u32 len = (flg&1) ? __le32(&p[0x30]) : 0;
+        const u8 * src = &mem[__le32(&p[0x48])];
+
+        if (len)
+          {
+            if (flg&8)
+              __it_unpack ( sdata, len, src, (flg&2)!=0, (p[0x2e]&4)!=0 );
+            else
+              __trk_convert ( sdata, src, len, (flg&2)!=0, (p[0x2e]&1)!=0, FALSE );
+          }
+        trk->samples[i].c5speed = __le32(&p[0x3c]) ? __le32(&p[0x3c]) : 8363;
+        trk->samples[i].volume = p[0x13]>64 ? 64 : p[0x13];
+        trk->samples[i].gvol = p[0x11]>64 ? 64 : p[0x11];
+        __trk_setsample ( &trk->smp[i], &p[0x14], sdata, len, __le32(&p[0x34]), __le32(&p[0x38]), (flg&0x10)!=0 );
+        sdata += len;
+      }
+
+    events = trk->eventdata;
+    for (i=0;i<patnum;i++)
+      {
+        u32 ofs = __le32(&patofs[i<<2]);
+        const u8 * p = &mem[ofs+8];
+        u16 rows = ofs ? __le16(&mem[ofs+2]) : 0;
+
+        if (rows==0 || rows>TRK_MAX_ROWS)
+          {
+            ofs = 0;
+            rows = EMPTY_ROWS;
+          }
+
+        trk->patterns[i].rows = rows;
+        trk->patterns[i].events = events;
+        memset ( lastmask, 0, sizeof(lastmask) );
+        memset ( lastnote, 0, sizeof(lastnote) );
+        memset ( lastins, 0, sizeof(lastins) );
+        memset ( lastvol, 0, sizeof(lastvol) );
+        memset ( lastcmd, 0, sizeof(lastcmd) );
+        memset ( lastparam, 0, sizeof(lastparam) );
+        for (row=0;row<rows && ofs!=0;row++)
+          {
+            u8 cv, c, m;
+
+            while ((cv=*p++)!=0)
+              {
+                TRK_EVENT * ev = &dummy;
+
+                c = (cv-1)&63;
+                if (cv&128)
+                  lastmask[c] = *p++;
+                m = lastmask[c];
+                if (m&1) lastnote[c] = *p++;
+                if (m&2) lastins[c] = *p++;
+                if (m&4) lastvol[c] = *p++;
+                if (m&8)
+                  {
+                    lastcmd[c] = *p++;
+                    lastparam[c] = *p++;
+                  }
+
+                if (chmap[c]!=0xff)
+                  ev = &events[row*trk->num_channels + chmap[c]];
+                if (m&(1|16))
+                  {
+                    if (lastnote[c]<120)
+                      ev->note = lastnote[c]+1;
+                    else
+                      ev->note = lastnote[c]==255 ? TRK_NOTE_OFF : lastnote[c]==254 ? TRK_NOTE_CUT : TRK_NOTE_FADE;
+                  }
+                if (m&(2|32))
+                  ev->instr = lastins[c];
+                if (m&(4|64))
+                  ev->vol = __trk_itvol ( lastvol[c] );
+                if (m&(8|128))
+                  __trk_itfx ( ev, lastcmd[c], lastparam[c], TRUE );
+              }
+          }
+        events += rows*trk->num_channels;
+      }
+
+    return 0;
+  }
@@ -83,6 +83,22 @@ static u8 *__OldStack __attribute__((used)) = NULL;
 
 static u64 bound_32KHz,bound_48KHz,min_wait,max_wait,buffer;
 
+// DMA timing statistics, all times in timebase ticks
+static u64 __AIDLastIrq = 0;
+static u32 __AIDLastPeriod = 0;
+static u32 __AIDMixPending = 0;
+static u32 __AIDMixSeen = 0;
+static u32 __AIDInterrupts = 0;
+static u32 __AIDPeriodMin = 0;
+static u32 __AIDPeriodMax = 0;
+static u32 __AIDPeriodAvg = 0;
+static u32 __AIDCallbackMax = 0;
+static u32 __AIDCallbackAvg = 0;
+static u32 __AIDMixMax = 0;
+static u32 __AIDMixAvg = 0;
+static s32 __AIDHeadroomMin = 0;
+static u32 __AIDLate = 0;
+
 #if defined(HW_DOL)
 static AISCallback __AIS_Callback;
 #endif
@@ -123,9 +139,42 @@ static void __AISHandler(u32 nIrq,void *pCtx)
 }
 #endif
 
+// running average with a weight of 1/16 for the new value
+static __inline__ u32 __AIDAverage(u32 avg,u32 val)
+{
+	if(!avg) return val;
+	return avg - (avg>>4) + (val>>4);
+}
+
+static void __AIDUpdateStats(u64 now)
+{
+	u32 period;
+
+	if(__AIDLastIrq) {
+		period = (u32)diff_ticks(__AIDLastIrq,now);
+		if(!__AIDPeriodMin || period<__AIDPeriodMin) __AIDPeriodMin = period;
+		if(period>__AIDPeriodMax) __AIDPeriodMax = period;
+		__AIDPeriodAvg = __AIDAverage(__AIDPeriodAvg,period);
+		__AIDLastPeriod = period;
+	}
+
+	// the mix started on the previous interrupt didn't finish before this one
+	if(__AIDMixPending && __AIDMixSeen) __AIDLate++;
+	__AIDMixPending = 1;
+
+	__AIDLastIrq = now;
+	__AIDInterrupts++;
+}
+
 static void __AIDHandler(u32 nIrq,void *pCtx)
 {
+	u64 start;
+	u32 elapsed;
+
 	_dspReg[5] = (_dspReg[5]&~(DSPCR_DSPINT|DSPCR_ARINT))|DSPCR_AIINT;
+
+	start = gettime();
+	__AIDUpdateStats(start);
 	if(__AID_Callback) {
 		if(!__AIActive) {
 			__AIActive = 1;
@@ -134,6 +183,10 @@ static void __AIDHandler(u32 nIrq,void *pCtx)
 			else
 				__AID_Callback();
 			__AIActive = 0;
+
+			elapsed = (u32)diff_ticks(start,gettime());
+			if(elapsed>__AIDCallbackMax) __AIDCallbackMax = elapsed;
+			__AIDCallbackAvg = __AIDAverage(__AIDCallbackAvg,elapsed);
 		}
 	}
 }
@@ -421,3 +474,64 @@ u32 AUDIO_GetDSPSampleRate(void)
 {
 	return (_SHIFTR(_aiReg[AI_CONTROL],6,1))^1;		//0^1(1) = 48Khz, 1^1(0) = 32Khz
 }
+
+void AUDIO_SignalMixDone(void)
+{
+	u32 level;
+	u32 mix;
+	s32 headroom;
+
+	_CPU_ISR_Disable(level);
+	if(__AIDMixPending) {
+		__AIDMixPending = 0;
+		__AIDMixSeen = 1;
+
+		mix = (u32)diff_ticks(__AIDLastIrq,gettime());
+		if(mix>__AIDMixMax) __AIDMixMax = mix;
+		__AIDMixAvg = __AIDAverage(__AIDMixAvg,mix);
+
+		if(__AIDLastPeriod) {
+			headroom = (s32)__AIDLastPeriod - (s32)mix;
+			if(headroom<__AIDHeadroomMin || __AIDHeadroomMin==0) __AIDHeadroomMin = headroom;
+		}
+	}
+	_CPU_ISR_Restore(level);
+}
+
+void AUDIO_GetDMAStats(aidmastats *stats)
+{
+	u32 level;
+
+	if(!stats) return;
+
+	_CPU_ISR_Disable(level);
+	stats->interrupts = __AIDInterrupts;
+	stats->period_min = ticks_to_microsecs(__AIDPeriodMin);
+	stats->period_max = ticks_to_microsecs(__AIDPeriodMax);
+	stats->period_avg = ticks_to_microsecs(__AIDPeriodAvg);
+	stats->callback_max = ticks_to_microsecs(__AIDCallbackMax);
+	stats->callback_avg = ticks_to_microsecs(__AIDCallbackAvg);
+	stats->mix_max = ticks_to_microsecs(__AIDMixMax);
+	stats->mix_avg = ticks_to_microsecs(__AIDMixAvg);
+	if(__AIDHeadroomMin<0)
+		stats->headroom_min = -(s32)ticks_to_microsecs(-__AIDHeadroomMin);
+	else
+		stats->headroom_min = ticks_to_microsecs(__AIDHeadroomMin);
+	stats->late = __AIDLate;
+	_CPU_ISR_Restore(level);
+}
+
+void AUDIO_ResetDMAStats(void)
+{
+	u32 level;
+
+	_CPU_ISR_Disable(level);
+	__AIDInterrupts = 0;
+	__AIDPeriodMin = __AIDPeriodMax = __AIDPeriodAvg = 0;
+	__AIDCallbackMax = __AIDCallbackAvg = 0;
+	__AIDMixMax = __AIDMixAvg = 0;
+	__AIDHeadroomMin = 0;
+	__AIDLate = 0;
+	__AIDMixSeen = 0;
+	_CPU_ISR_Restore(level);
+}
@@ -0,0 +1,488 @@
+/*-------------------------------------------------------------
+
+disc_async.c -- Asynchronous sector reads for DISC_INTERFACE devices
+
+Copyright (C) 2026
+
+This software is provided 'as-is', without any express or implied
+warranty.  In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1.	The origin of this software must not be misrepresented; you
+must not claim that you wrote the original software. If you use
+this software in a product, an acknowledgment in the product
+documentation would be appreciated but is not required.
+
+2.	Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3.	This notice may not be removed or altered from any source
+distribution.
+
+-------------------------------------------------------------*/
+#include <stdlib.h>
+#include <string.h>
+#include <gctypes.h>
+#include <ogc/lwp.h>
+#include <ogc/lwp_watchdog.h>
+#include <ogc/dvd.h>
+#include <ogc/disc_async.h>
+
+#include "processor.h"
+
+#define ASYNC_STACKSIZE			8192
+#define ASYNC_PRIORITY			72
+
+#define REQ_FREE				0
+#define REQ_QUEUED				1
+#define REQ_RUNNING				2
+#define REQ_DONE				3
+
+typedef struct _asyncchan {
+	const DISC_INTERFACE *disc;
+	const discasync_backend *backend;
+	discasync_req *head;
+	discasync_req *tail;
+	u32 queued;
+	u32 inflight;
+} asyncchan;
+
+typedef struct _asyncbackend {
+	u32 ioType;
+	const discasync_backend *backend;
+} asyncbackend;
+
+static discasync_req __da_reqs[DISCASYNC_MAXREQ];
+static asyncchan __da_chans[DISCASYNC_MAXDEVICES];
+static asyncbackend __da_backends[DISCASYNC_MAXBACKENDS];
+static discasync_stats __da_stats;
+static u32 __da_gen = 0;
+
+static bool __da_inited = false;
+static bool __da_kick = false;
+static discasync_req *__da_workhead = NULL;
+static discasync_req *__da_worktail = NULL;
+static lwp_t __da_thread = LWP_THREAD_NULL;
+static lwpq_t __da_workq;
+static lwpq_t __da_waitq;
+static u8 __da_stack[ASYNC_STACKSIZE] ATTRIBUTE_ALIGN(8);
+
+static s32 __da_worksubmit(discasync_req *req);
+static const discasync_backend __da_workbackend = { __da_worksubmit, 1 };
+
+#if defined(HW_DOL)
+static s32 __da_dvdsubmit(discasync_req *req);
+static const discasync_backend __da_dvdbackend = { __da_dvdsubmit, 4 };
+
+static dvdcmdblk __da_dvdblk[DISCASYNC_MAXREQ];
+#endif
+
+static __inline__ discasync_req* __da_lookup(s32 id)
+{
+	discasync_req *req;
+
+	if(id<=0 || (id&0xff)>=DISCASYNC_MAXREQ) return NULL;
+
+	req = &__da_reqs[id&0xff];
+	if(req->id!=(u32)id || req->state==REQ_FREE) return NULL;
+	return req;
+}
+
+static __inline__ asyncchan* __da_chan(discasync_req *req)
+{
+	u32 i;
+
+	for(i=0;i<DISCASYNC_MAXDEVICES;i++) {
+		if(__da_chans[i].disc==req->disc) return &__da_chans[i];
+	}
+	return NULL;
+}
+
+static void __da_release(discasync_req *req)
+{
+	u32 level;
+	asyncchan *chan;
+
+	_CPU_ISR_Disable(level);
+	chan = __da_chan(req);
+	if(chan && !chan->queued && !chan->inflight) chan->disc = NULL;
+
+	req->state = REQ_FREE;
+	req->id = 0;
+	_CPU_ISR_Restore(level);
+}
+
+// Pass queued requests to the backend, thread context only
+static void __da_dispatch(asyncchan *chan)
+{
+	s32 ret;
+	u32 level;
+	discasync_req *req;
+
+	while(1) {
+		_CPU_ISR_Disable(level);
+		req = chan->head;
+		if(!req || !chan->backend || chan->inflight>=chan->backend->max_inflight) {
+			_CPU_ISR_Restore(level);
+			return;
+		}
+		chan->head = req->next;
+		if(!chan->head) chan->tail = NULL;
+		chan->queued--;
+		chan->inflight++;
+		req->next = NULL;
+		req->state = REQ_RUNNING;
+		_CPU_ISR_Restore(level);
+
+		ret = chan->backend->submit(req);
+		if(ret<0) DiscAsync_Complete(req,ret);
+	}
+}
+
+static void* __da_threadfunc(void *arg)
+{
+	u32 i,level;
+	bool kick;
+	discasync_req *req;
+
+	while(1) {
+		_CPU_ISR_Disable(level);
+		while(!__da_workhead && !__da_kick)
+			LWP_ThreadSleep(__da_workq);
+
+		kick = __da_kick;
+		__da_kick = false;
+		req = __da_workhead;
+		if(req) {
+			__da_workhead = req->next;
+			if(!__da_workhead) __da_worktail = NULL;
+			req->next = NULL;
+		}
+		_CPU_ISR_Restore(level);
+
+		if(kick) {
+			for(i=0;i<DISCASYNC_MAXDEVICES;i++) {
+				if(__da_chans[i].disc) __da_dispatch(&__da_chans[i]);
+			}
+		}
+
+		if(req) {
+			if(req->disc->readSectors(req->sector,req->count,req->buffer))
+				DiscAsync_Complete(req,DISCASYNC_OK);
+			else
+				DiscAsync_Complete(req,DISCASYNC_EIO);
+		}
+	}
+	return NULL;
+}
+
+static s32 __da_worksubmit(discasync_req *req)
+{
+	u32 level;
+
+	_CPU_ISR_Disable(level);
+	if(__da_worktail) __da_worktail->next = req;
+	else __da_workhead = req;
+	__da_worktail = req;
+	LWP_ThreadSignal(__da_workq);
+	_CPU_ISR_Restore(level);
+
+	return DISCASYNC_OK;
+}
+
+#if defined(HW_DOL)
+static void __da_dvdcb(s32 result,dvdcmdblk *block)
+{
+	DiscAsync_Complete(&__da_reqs[block - __da_dvdblk],(result<0)?DISCASYNC_EIO:DISCASYNC_OK);
+}
+
+static s32 __da_dvdsubmit(discasync_req *req)
+{
+	dvdcmdblk *block = &__da_dvdblk[req - __da_reqs];
+
+	if(DVD_ReadAbsAsyncPrio(block,req->buffer,req->count<<11,(s64)req->sector<<11,__da_dvdcb,2)==0)
+		return DISCASYNC_EIO;
+
+	return DISCASYNC_OK;
+}
+#endif
+
+static const discasync_backend* __da_findbackend(const DISC_INTERFACE *disc)
+{
+	u32 i;
+
+	for(i=0;i<DISCASYNC_MAXBACKENDS;i++) {
+		if(__da_backends[i].backend && __da_backends[i].ioType==disc->ioType)
+			return __da_backends[i].backend;
+	}
+	return &__da_workbackend;
+}
+
+static s32 __da_init(void)
+{
+	if(__da_inited==true) return DISCASYNC_OK;
+
+	memset(__da_reqs,0,sizeof(__da_reqs));
+	memset(__da_chans,0,sizeof(__da_chans));
+	memset(&__da_stats,0,sizeof(__da_stats));
+
+	LWP_InitQueue(&__da_workq);
+	LWP_InitQueue(&__da_waitq);
+	if(LWP_CreateThread(&__da_thread,__da_threadfunc,NULL,__da_stack,ASYNC_STACKSIZE,ASYNC_PRIORITY)<0) {
+		LWP_CloseQueue(__da_workq);
+		LWP_CloseQueue(__da_waitq);
+		__da_thread = LWP_THREAD_NULL;
+		return DISCASYNC_ENOSLOT;
+	}
+
+#if defined(HW_DOL)
+	// the DVD queue takes reads directly, unless a backend was set already
+	if(__da_findbackend(&__io_gcdvd)==&__da_workbackend)
+		DiscAsync_SetBackend(DEVICE_TYPE_GAMECUBE_DVD,&__da_dvdbackend);
+#endif
+
+	__da_inited = true;
+	return DISCASYNC_OK;
+}
+
+void DiscAsync_Complete(discasync_req *req,s32 result)
+{
+	u32 level,us;
+	bool pending = false;
+	asyncchan *chan;
+
+	_CPU_ISR_Disable(level);
+	chan = __da_chan(req);
+	if(chan) {
+		chan->inflight--;
+		pending = (chan->head!=NULL);
+	}
+
+	us = ticks_to_microsecs(gettime() - req->submit_time);
+	if(result==DISCASYNC_OK) __da_stats.completed++;
+	else if(result==DISCASYNC_ECANCELED) __da_stats.canceled++;
+	else __da_stats.errors++;
+	__da_stats.depth--;
+	if(result!=DISCASYNC_ECANCELED) {
+		if(!__da_stats.latency_min || us<__da_stats.latency_min) __da_stats.latency_min = us;
+		if(us>__da_stats.latency_max) __da_stats.latency_max = us;
+		__da_stats.latency_avg = __da_stats.latency_avg ? (__da_stats.latency_avg - (__da_stats.latency_avg>>4) + (us>>4)) : us;
+	}
+
+	req->result = result;
+	req->state = REQ_DONE;
+	LWP_ThreadBroadcast(__da_waitq);
+
+	// the next request is started from the worker thread, backends may block
+	if(pending) {
+		__da_kick = true;
+		LWP_ThreadSignal(__da_workq);
+	}
+	_CPU_ISR_Restore(level);
+
+	if(req->cb) {
+		req->cb(result,req,req->usrdata);
+		__da_release(req);
+	}
+}
+
+s32 DiscAsync_Submit(const DISC_INTERFACE *disc,sec_t sector,sec_t numSectors,void *buffer,DiscAsyncCallback cb,void *usrdata)
+{
+	s32 ret;
+	u32 i,level;
+	asyncchan *chan = NULL;
+	discasync_req *req = NULL;
+
+	if(!disc || !buffer || !numSectors) return DISCASYNC_EINVAL;
+
+	ret = __da_init();
+	if(ret<0) return ret;
+
+	_CPU_ISR_Disable(level);
+	for(i=0;i<DISCASYNC_MAXREQ;i++) {
+		if(__da_reqs[i].state==REQ_FREE) {
+			req = &__da_reqs[i];
+			break;
+		}
+	}
+	if(!req) {
+		_CPU_ISR_Restore(level);
+		return DISCASYNC_ENOSLOT;
+	}
+
+	for(i=0;i<DISCASYNC_MAXDEVICES && !chan;i++) {
+		if(__da_chans[i].disc==disc) chan = &__da_chans[i];
+	}
+	for(i=0;i<DISCASYNC_MAXDEVICES && !chan;i++) {
+		if(!__da_chans[i].disc) {
+			chan = &__da_chans[i];
+			chan->disc = disc;
+			chan->backend = __da_findbackend(disc);
+			chan->head = chan->tail = NULL;
+			chan->queued = chan->inflight = 0;
+		}
+	}
+	if(!chan) {
+		_CPU_ISR_Restore(level);
+		return DISCASYNC_ENOSLOT;
+	}
+
+	__da_gen = (__da_gen + 1)&0x7fffff;
+	if(!__da_gen) __da_gen = 1;
+
+	req->next = NULL;
+	req->disc = disc;
+	req->sector = sector;
+	req->count = numSectors;
+	req->buffer = buffer;
+	req->cb = cb;
+	req->usrdata = usrdata;
+	req->id = (__da_gen<<8)|(req - __da_reqs);
+	req->state = REQ_QUEUED;
+	req->result = DISCASYNC_PENDING;
+	req->submit_time = gettime();
+
+	if(chan->tail) chan->tail->next = req;
+	else chan->head = req;
+	chan->tail = req;
+	chan->queued++;
+
+	__da_stats.submitted++;
+	if(++__da_stats.depth>__da_stats.max_depth) __da_stats.max_depth = __da_stats.depth;
+	ret = req->id;
+	_CPU_ISR_Restore(level);
+
+	__da_dispatch(chan);
+	return ret;
+}
+
+s32 DiscAsync_Poll(s32 id)
+{
+	s32 ret;
+	u32 level;
+	discasync_req *req;
+
+	_CPU_ISR_Disable(level);
+	req = __da_lookup(id);
+	if(!req || req->cb) {
+		_CPU_ISR_Restore(level);
+		return DISCASYNC_EINVAL;
+	}
+	if(req->state!=REQ_DONE) {
+		_CPU_ISR_Restore(level);
+		return DISCASYNC_PENDING;
+	}
+	ret = req->result;
+	_CPU_ISR_Restore(level);
+
+	__da_release(req);
+	return ret;
+}
+
+s32 DiscAsync_Wait(s32 id)
+{
+	s32 ret;
+	u32 level;
+	discasync_req *req;
+
+	_CPU_ISR_Disable(level);
+	req = __da_lookup(id);
+	if(!req || req->cb) {
+		_CPU_ISR_Restore(level);
+		return DISCASYNC_EINVAL;
+	}
+	while(req->state!=REQ_DONE)
+		LWP_ThreadSleep(__da_waitq);
+	ret = req->result;
+	_CPU_ISR_Restore(level);
+
+	__da_release(req);
+	return ret;
+}
+
+s32 DiscAsync_Cancel(s32 id)
+{
+	u32 level;
+	asyncchan *chan;
+	discasync_req *req,*prev;
+
+	_CPU_ISR_Disable(level);
+	req = __da_lookup(id);
+	if(!req) {
+		_CPU_ISR_Restore(level);
+		return DISCASYNC_EINVAL;
+	}
+	if(req->state!=REQ_QUEUED) {
+		_CPU_ISR_Restore(level);
+		return (req->state==REQ_DONE) ? DISCASYNC_OK : DISCASYNC_EBUSY;
+	}
+
+	chan = __da_chan(req);
+	prev = NULL;
+	if(chan->head!=req) {
+		for(prev=chan->head;prev->next!=req;prev=prev->next);
+	}
+	if(prev) prev->next = req->next;
+	else chan->head = req->next;
+	if(chan->tail==req) chan->tail = prev;
+	chan->queued--;
+	chan->inflight++;			// balanced by DiscAsync_Complete
+	req->next = NULL;
+	_CPU_ISR_Restore(level);
+
+	DiscAsync_Complete(req,DISCASYNC_ECANCELED);
+	return DISCASYNC_OK;
+}
+
+void DiscAsync_GetStats(discasync_stats *stats)
+{
+	u32 level;
+
+	if(!stats) return;
+
+	_CPU_ISR_Disable(level);
+	memcpy(stats,&__da_stats,sizeof(discasync_stats));
+	_CPU_ISR_Restore(level);
+}
+
+void DiscAsync_ResetStats(void)
+{
+	u32 level,depth;
+
+	_CPU_ISR_Disable(level);
+	depth = __da_stats.depth;
+	memset(&__da_stats,0,sizeof(discasync_stats));
+	__da_stats.depth = depth;
+	__da_stats.max_depth = depth;
+	_CPU_ISR_Restore(level);
+}
+
+s32 DiscAsync_SetBackend(u32 ioType,const discasync_backend *backend)
+{
+	u32 i,level;
+	s32 ret = DISCASYNC_ENOSLOT;
+
+	_CPU_ISR_Disable(level);
+	for(i=0;i<DISCASYNC_MAXBACKENDS;i++) {
+		if(__da_backends[i].backend && __da_backends[i].ioType==ioType) {
+			__da_backends[i].backend = backend;
+			ret = DISCASYNC_OK;
+			break;
+		}
+	}
+	for(i=0;i<DISCASYNC_MAXBACKENDS && ret<0 && backend;i++) {
+		if(!__da_backends[i].backend) {
+			__da_backends[i].ioType = ioType;
+			__da_backends[i].backend = backend;
+			ret = DISCASYNC_OK;
+		}
+	}
+	if(!backend) ret = DISCASYNC_OK;
+	_CPU_ISR_Restore(level);
+
+	return ret;
+}
@@ -0,0 +1,538 @@
+/*-------------------------------------------------------------
+
+disc_cache.c -- Set-associative sector cache for DISC_INTERFACE devices
+
+Copyright (C) 2026
+
+This software is provided 'as-is', without any express or implied
+warranty.  In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1.	The origin of this software must not be misrepresented; you
+must not claim that you wrote the original software. If you use
+this software in a product, an acknowledgment in the product
+documentation would be appreciated but is not required.
+
+2.	Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3.	This notice may not be removed or altered from any source
+distribution.
+
+-------------------------------------------------------------*/
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <gctypes.h>
+#include <ogc/mutex.h>
+#include <ogc/disc_cache.h>
+
+#define MAX_RUN_PAGES			16			// pages fetched with one device read
+#define DEFAULT_READAHEAD		8
+
+#define PAGE_FREE				0
+#define PAGE_A1					1			// 2Q probation FIFO
+#define PAGE_AM					2			// main LRU queue
+
+typedef struct _cachepage {
+	sec_t page;
+	u32 stamp;
+	u8 state;
+	u8 dirty;
+	u8 *data;
+} cachepage;
+
+typedef struct _disccache {
+	const DISC_INTERFACE *disc;
+	DISC_INTERFACE iface;
+	mutex_t lock;
+
+	u32 sector_size;
+	u32 page_sectors;
+	u32 page_size;
+	u32 sets;
+	u32 ways;
+	u32 policy;
+	u32 kin;					// 2Q: A1 pages per set before A1 is evicted first
+	u32 ghosts;					// 2Q: remembered A1 evictions per set
+
+	cachepage *pages;
+	sec_t *ghost;
+	u32 *ghostpos;
+	u8 *data;
+	u8 *bounce;
+
+	u32 stamp;
+	sec_t last_page;
+	u32 ra_pages;
+	u32 ra_max;
+
+	disccache_stats stats;
+} disccache;
+
+static disccache *__dc_caches[DISCCACHE_MAX];
+
+static __inline__ cachepage* __dc_set(disccache *c,sec_t page)
+{
+	return &c->pages[(page%c->sets)*c->ways];
+}
+
+static cachepage* __dc_lookup(disccache *c,sec_t page,bool touch)
+{
+	u32 i;
+	cachepage *set = __dc_set(c,page);
+
+	for(i=0;i<c->ways;i++) {
+		if(set[i].state!=PAGE_FREE && set[i].page==page) {
+			// A1 is a FIFO, only pages in the main queue are refreshed
+			if(touch==true && set[i].state==PAGE_AM) set[i].stamp = ++c->stamp;
+			return &set[i];
+		}
+	}
+	return NULL;
+}
+
+static bool __dc_writeback(disccache *c,cachepage *e)
+{
+	if(!e->dirty) return true;
+	if(!c->disc->writeSectors(e->page*c->page_sectors,c->page_sectors,e->data)) return false;
+
+	e->dirty = 0;
+	c->stats.writebacks++;
+	c->stats.bytes_written += c->page_size;
+	return true;
+}
+
+static bool __dc_inghost(disccache *c,sec_t page)
+{
+	u32 i,set = page%c->sets;
+	sec_t *ghost = &c->ghost[set*c->ghosts];
+
+	for(i=0;i<c->ghosts;i++) {
+		if(ghost[i]==page) {
+			ghost[i] = (sec_t)-1;
+			return true;
+		}
+	}
+	return false;
+}
+
+static void __dc_addghost(disccache *c,sec_t page)
+{
+	u32 set = page%c->sets;
+
+	c->ghost[set*c->ghosts + c->ghostpos[set]] = page;
+	c->ghostpos[set] = (c->ghostpos[set] + 1)%c->ghosts;
+}
+
+static cachepage* __dc_victim(disccache *c,sec_t page)
+{
+	u32 i,a1cnt;
+	cachepage *set = __dc_set(c,page);
+	cachepage *lru = NULL,*fifo = NULL,*e;
+
+	a1cnt = 0;
+	for(i=0;i<c->ways;i++) {
+		if(set[i].state==PAGE_FREE) return &set[i];
+		if(set[i].state==PAGE_A1) {
+			a1cnt++;
+			if(!fifo || set[i].stamp<fifo->stamp) fifo = &set[i];
+		} else if(!lru || set[i].stamp<lru->stamp)
+			lru = &set[i];
+	}
+
+	if(c->policy==DISCCACHE_POLICY_2Q && fifo && (a1cnt>c->kin || !lru))
+		e = fifo;
+	else
+		e = lru ? lru : fifo;
+
+	if(!__dc_writeback(c,e)) return NULL;
+	if(e->state==PAGE_A1) __dc_addghost(c,e->page);
+
+	e->state = PAGE_FREE;
+	c->stats.evictions++;
+	return e;
+}
+
+static cachepage* __dc_insert(disccache *c,sec_t page,const void *src)
+{
+	cachepage *e = __dc_victim(c,page);
+
+	if(!e) return NULL;
+
+	e->page = page;
+	e->dirty = 0;
+	e->stamp = ++c->stamp;
+	if(c->policy==DISCCACHE_POLICY_2Q && !__dc_inghost(c,page))
+		e->state = PAGE_A1;
+	else
+		e->state = PAGE_AM;
+
+	if(src) memcpy(e->data,src,c->page_size);
+	return e;
+}
+
+// fetch up to run pages starting at page into the cache, stops at the first page already cached.
+// pages beyond need are accounted as read-ahead, the count of pages inserted is returned in fetched
+static cachepage* __dc_fetch(disccache *c,sec_t page,u32 run,u32 need,u32 *fetched)
+{
+	u32 i;
+	cachepage *e,*first;
+
+	if(run>MAX_RUN_PAGES) run = MAX_RUN_PAGES;
+	// consecutive pages map to consecutive sets, a longer run would wrap
+	// around and evict its own first pages
+	if(run>c->sets) run = c->sets;
+	for(i=1;i<run;i++) {
+		if(__dc_lookup(c,page + i,false)) break;
+	}
+	run = i;
+
+	if(!c->disc->readSectors(page*c->page_sectors,run*c->page_sectors,c->bounce)) {
+		// the run may reach beyond the end of the medium
+		if(run==1) return NULL;
+		run = 1;
+		if(!c->disc->readSectors(page*c->page_sectors,c->page_sectors,c->bounce)) return NULL;
+	}
+	c->stats.bytes_read += run*c->page_size;
+
+	first = __dc_insert(c,page,c->bounce);
+	if(!first) return NULL;
+
+	for(i=1;i<run;i++) {
+		e = __dc_insert(c,page + i,c->bounce + i*c->page_size);
+		if(!e) break;
+		if(i>=need)
+			c->stats.readahead++;
+		else
+			c->stats.read_misses++;
+	}
+	if(fetched) *fetched = i;
+	return first;
+}
+
+static bool __dc_read(disccache *c,sec_t sector,sec_t numSectors,void *buffer)
+{
+	u8 *src,*dst = buffer;
+	u32 off,cnt,need,run,fetched;
+	sec_t page,fetched_end = 0;
+	cachepage *e;
+
+	LWP_MutexLock(c->lock);
+	while(numSectors>0) {
+		page = sector/c->page_sectors;
+		off = sector%c->page_sectors;
+		cnt = c->page_sectors - off;
+		if(cnt>numSectors) cnt = numSectors;
+
+		e = __dc_lookup(c,page,true);
+		if(e) {
+			// pages fetched for this request earlier on are no hits
+			if(page>=fetched_end) c->stats.read_hits++;
+			src = e->data;
+		} else {
+
+			// grow the read-ahead window while the reader stays sequential
+			if(page==c->last_page + 1 && c->ra_max) {
+				c->ra_pages = c->ra_pages ? (c->ra_pages<<1) : 1;
+				if(c->ra_pages>c->ra_max) c->ra_pages = c->ra_max;
+			} else
+				c->ra_pages = 0;
+
+			need = (off + numSectors + c->page_sectors - 1)/c->page_sectors;
+			if(need>MAX_RUN_PAGES) need = MAX_RUN_PAGES;
+			run = need + c->ra_pages;
+
+			c->stats.read_misses++;
+			e = __dc_fetch(c,page,run,need,&fetched);
+			if(!e) {
+				// uncached fallback for sectors a whole page can't be read for
+				if(!c->disc->readSectors(sector,cnt,dst)) {
+					LWP_MutexUnlock(c->lock);
+					return false;
+				}
+				c->stats.bytes_read += cnt*c->sector_size;
+				goto next;
+			}
+			fetched_end = page + (fetched<need ? fetched : need);
+
+			// copy from the bounce buffer, the run's own inserts may have recycled e
+			src = c->bounce;
+		}
+		memcpy(dst,src + off*c->sector_size,cnt*c->sector_size);
+
+next:
+		c->last_page = page;
+		dst += cnt*c->sector_size;
+		sector += cnt;
+		numSectors -= cnt;
+	}
+	LWP_MutexUnlock(c->lock);
+	return true;
+}
+
+static bool __dc_write(disccache *c,sec_t sector,sec_t numSectors,const void *buffer)
+{
+	const u8 *src = buffer;
+	u32 off,cnt;
+	sec_t page;
+	cachepage *e;
+
+	LWP_MutexLock(c->lock);
+	while(numSectors>0) {
+		page = sector/c->page_sectors;
+		off = sector%c->page_sectors;
+		cnt = c->page_sectors - off;
+		if(cnt>numSectors) cnt = numSectors;
+
+		e = __dc_lookup(c,page,true);
+		if(e) {
+			c->stats.write_hits++;
+		} else {
+			c->stats.write_misses++;
+			if(cnt<c->page_sectors)
+				e = __dc_fetch(c,page,1,1,NULL);
+			else
+				e = __dc_insert(c,page,NULL);
+
+			if(!e) {
+				if(!c->disc->writeSectors(sector,cnt,src)) {
+					LWP_MutexUnlock(c->lock);
+					return false;
+				}
+				c->stats.bytes_written += cnt*c->sector_size;
+				goto next;
+			}
+		}
+		memcpy(e->data + off*c->sector_size,src,cnt*c->sector_size);
+		e->dirty = 1;
+
+next:
+		src += cnt*c->sector_size;
+		sector += cnt;
+		numSectors -= cnt;
+	}
+	LWP_MutexUnlock(c->lock);
+	return true;
+}
+
+static bool __dc_flush(disccache *c)
+{
+	u32 i;
+	bool ret = true;
+
+	for(i=0;i<(c->sets*c->ways);i++) {
+		if(c->pages[i].state!=PAGE_FREE && !__dc_writeback(c,&c->pages[i])) ret = false;
+	}
+	return ret;
+}
+
+static bool __dc_startup(disccache *c)
+{
+	return c->disc->startup();
+}
+
+static bool __dc_isInserted(disccache *c)
+{
+	return c->disc->isInserted();
+}
+
+static bool __dc_clearStatus(disccache *c)
+{
+	return c->disc->clearStatus();
+}
+
+static bool __dc_shutdown(disccache *c)
+{
+	LWP_MutexLock(c->lock);
+	__dc_flush(c);
+	LWP_MutexUnlock(c->lock);
+	return c->disc->shutdown();
+}
+
+#define DISCCACHE_SLOT(n)																		\
+static bool __dc_startup##n(void) { return __dc_startup(__dc_caches[n]); }						\
+static bool __dc_isInserted##n(void) { return __dc_isInserted(__dc_caches[n]); }				\
+static bool __dc_readSectors##n(sec_t sector,sec_t numSectors,void *buffer)					\
+	{ return __dc_read(__dc_caches[n],sector,numSectors,buffer); }								\
+static bool __dc_writeSectors##n(sec_t sector,sec_t numSectors,const void *buffer)				\
+	{ return __dc_write(__dc_caches[n],sector,numSectors,buffer); }							\
+static bool __dc_clearStatus##n(void) { return __dc_clearStatus(__dc_caches[n]); }				\
+static bool __dc_shutdown##n(void) { return __dc_shutdown(__dc_caches[n]); }
+
+DISCCACHE_SLOT(0)
+DISCCACHE_SLOT(1)
+DISCCACHE_SLOT(2)
+DISCCACHE_SLOT(3)
+
+#define DISCCACHE_FUNCS(n)	{ 0,0,__dc_startup##n,__dc_isInserted##n,__dc_readSectors##n,__dc_writeSectors##n,__dc_clearStatus##n,__dc_shutdown##n }
+
+static const DISC_INTERFACE __dc_funcs[DISCCACHE_MAX] = {
+	DISCCACHE_FUNCS(0),
+	DISCCACHE_FUNCS(1),
+	DISCCACHE_FUNCS(2),
+	DISCCACHE_FUNCS(3)
+};
+
+static disccache* __dc_find(const DISC_INTERFACE *cached)
+{
+	u32 i;
+
+	for(i=0;i<DISCCACHE_MAX;i++) {
+		if(__dc_caches[i] && &__dc_caches[i]->iface==cached) return __dc_caches[i];
+	}
+	return NULL;
+}
+
+static void __dc_free(disccache *c)
+{
+	if(c->pages) free(c->pages);
+	if(c->ghost) free(c->ghost);
+	if(c->ghostpos) free(c->ghostpos);
+	if(c->data) free(c->data);
+	if(c->bounce) free(c->bounce);
+	free(c);
+}
+
+const DISC_INTERFACE* DiscCache_Create(const DISC_INTERFACE *disc,u32 sector_size,u32 page_sectors,u32 pages,u32 ways,u32 policy)
+{
+	u32 i,slot;
+	disccache *c;
+
+	if(!disc || !sector_size || !page_sectors || !ways || pages<ways) return NULL;
+
+	for(slot=0;slot<DISCCACHE_MAX;slot++) {
+		if(!__dc_caches[slot]) break;
+	}
+	if(slot>=DISCCACHE_MAX) return NULL;
+
+	c = calloc(1,sizeof(disccache));
+	if(!c) return NULL;
+
+	c->disc = disc;
+	c->sector_size = sector_size;
+	c->page_sectors = page_sectors;
+	c->page_size = sector_size*page_sectors;
+	c->ways = ways;
+	c->sets = pages/ways;
+	c->policy = policy;
+	c->kin = (ways>>2) ? (ways>>2) : 1;
+	c->ghosts = (ways>>1) ? (ways>>1) : 1;
+	c->last_page = (sec_t)-2;
+	c->ra_max = DEFAULT_READAHEAD;
+
+	c->pages = calloc(c->sets*c->ways,sizeof(cachepage));
+	c->ghost = malloc(c->sets*c->ghosts*sizeof(sec_t));
+	c->ghostpos = calloc(c->sets,sizeof(u32));
+	c->data = memalign(32,c->sets*c->ways*c->page_size);
+	c->bounce = memalign(32,MAX_RUN_PAGES*c->page_size);
+	if(!c->pages || !c->ghost || !c->ghostpos || !c->data || !c->bounce) {
+		__dc_free(c);
+		return NULL;
+	}
+
+	memset(c->ghost,0xff,c->sets*c->ghosts*sizeof(sec_t));
+	for(i=0;i<(c->sets*c->ways);i++) c->pages[i].data = c->data + i*c->page_size;
+
+	LWP_MutexInit(&c->lock,false);
+
+	c->iface = __dc_funcs[slot];
+	c->iface.ioType = disc->ioType;
+	c->iface.features = disc->features;
+	__dc_caches[slot] = c;
+
+	return &c->iface;
+}
+
+bool DiscCache_Destroy(const DISC_INTERFACE *cached)
+{
+	u32 i;
+	bool ret;
+	disccache *c = __dc_find(cached);
+
+	if(!c) return false;
+
+	LWP_MutexLock(c->lock);
+	ret = __dc_flush(c);
+	LWP_MutexUnlock(c->lock);
+
+	for(i=0;i<DISCCACHE_MAX;i++) {
+		if(__dc_caches[i]==c) __dc_caches[i] = NULL;
+	}
+	LWP_MutexDestroy(c->lock);
+	__dc_free(c);
+
+	return ret;
+}
+
+bool DiscCache_Flush(const DISC_INTERFACE *cached)
+{
+	bool ret;
+	disccache *c = __dc_find(cached);
+
+	if(!c) return false;
+
+	LWP_MutexLock(c->lock);
+	ret = __dc_flush(c);
+	LWP_MutexUnlock(c->lock);
+
+	return ret;
+}
+
+void DiscCache_Invalidate(const DISC_INTERFACE *cached)
+{
+	u32 i;
+	disccache *c = __dc_find(cached);
+
+	if(!c) return;
+
+	LWP_MutexLock(c->lock);
+	for(i=0;i<(c->sets*c->ways);i++) {
+		c->pages[i].state = PAGE_FREE;
+		c->pages[i].dirty = 0;
+	}
+	memset(c->ghost,0xff,c->sets*c->ghosts*sizeof(sec_t));
+	c->last_page = (sec_t)-2;
+	c->ra_pages = 0;
+	LWP_MutexUnlock(c->lock);
+}
+
+void DiscCache_SetReadAhead(const DISC_INTERFACE *cached,u32 max_pages)
+{
+	disccache *c = __dc_find(cached);
+
+	if(!c) return;
+
+	if(max_pages>(MAX_RUN_PAGES - 1)) max_pages = MAX_RUN_PAGES - 1;
+
+	LWP_MutexLock(c->lock);
+	c->ra_max = max_pages;
+	c->ra_pages = 0;
+	LWP_MutexUnlock(c->lock);
+}
+
+void DiscCache_GetStats(const DISC_INTERFACE *cached,disccache_stats *stats)
+{
+	disccache *c = __dc_find(cached);
+
+	if(!c || !stats) return;
+
+	LWP_MutexLock(c->lock);
+	memcpy(stats,&c->stats,sizeof(disccache_stats));
+	LWP_MutexUnlock(c->lock);
+}
+
+void DiscCache_ResetStats(const DISC_INTERFACE *cached)
+{
+	disccache *c = __dc_find(cached);
+
+	if(!c) return;
+
+	LWP_MutexLock(c->lock);
+	memset(&c->stats,0,sizeof(disccache_stats));
+	LWP_MutexUnlock(c->lock);
+}
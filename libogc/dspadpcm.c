@@ -0,0 +1,356 @@
+/*-------------------------------------------------------------
+
+dspadpcm.c -- DSP-ADPCM encoder and decoder
+
+Copyright (C) 2026
+
+This software is provided 'as-is', without any express or implied
+warranty.  In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1.	The origin of this software must not be misrepresented; you
+must not claim that you wrote the original software. If you use
+this software in a product, an acknowledgment in the product
+documentation would be appreciated but is not required.
+
+2.	Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3.	This notice may not be removed or altered from any source
+distribution.
+
+-------------------------------------------------------------*/
+#include <string.h>
+#include <gctypes.h>
+#include <dspadpcm.h>
+
+#define COEF_PAIRS			8
+#define TRAIN_PASSES		8
+#define MAX_SCALE			12
+
+typedef struct _lpcstats {
+	f64 r0;				// sum x[n]^2
+	f64 r1,r2;			// sum x[n]*x[n-1], x[n]*x[n-2]
+	f64 r11,r12,r22;	// sum x[n-1]^2, x[n-1]*x[n-2], x[n-2]^2
+} lpcstats;
+
+static __inline__ s32 __dspadpcm_clamp16(s32 val)
+{
+	if(val<-32768) return -32768;
+	if(val>32767) return 32767;
+	return val;
+}
+
+static __inline__ s32 __dspadpcm_nibble(const u8 *frame,u32 i)
+{
+	s32 nib = frame[1 + (i>>1)];
+	nib = (i&1) ? (nib&0x0f) : (nib>>4);
+	return (nib^8) - 8;
+}
+
+static void __dspadpcm_blockstats(const s16 *src,u32 pos,u32 len,lpcstats *st)
+{
+	u32 i;
+	f64 x0,x1,x2;
+
+	x1 = (pos>0) ? src[pos-1] : 0;
+	x2 = (pos>1) ? src[pos-2] : 0;
+	memset(st,0,sizeof(lpcstats));
+	for(i=0;i<len;i++) {
+		x0 = src[pos + i];
+		st->r0 += x0*x0;
+		st->r1 += x0*x1;
+		st->r2 += x0*x2;
+		st->r11 += x1*x1;
+		st->r12 += x1*x2;
+		st->r22 += x2*x2;
+		x2 = x1;
+		x1 = x0;
+	}
+}
+
+static __inline__ void __dspadpcm_addstats(lpcstats *dst,const lpcstats *src)
+{
+	dst->r0 += src->r0;
+	dst->r1 += src->r1;
+	dst->r2 += src->r2;
+	dst->r11 += src->r11;
+	dst->r12 += src->r12;
+	dst->r22 += src->r22;
+}
+
+// prediction error energy of the predictor (c1,c2) over a block
+static __inline__ f64 __dspadpcm_error(const lpcstats *st,f64 c1,f64 c2)
+{
+	return st->r0 - 2.0*(c1*st->r1 + c2*st->r2) + c1*c1*st->r11 + 2.0*c1*c2*st->r12 + c2*c2*st->r22;
+}
+
+// least squares 2nd order predictor, clamped to a stable and representable range
+static void __dspadpcm_solve(const lpcstats *st,f64 *c1,f64 *c2)
+{
+	f64 det = st->r11*st->r22 - st->r12*st->r12;
+
+	if(det>(1e-9*st->r11*st->r22) && det>0.0) {
+		*c1 = (st->r1*st->r22 - st->r2*st->r12)/det;
+		*c2 = (st->r2*st->r11 - st->r1*st->r12)/det;
+	} else if(st->r11>0.0) {
+		*c1 = st->r1/st->r11;
+		*c2 = 0.0;
+	} else {
+		*c1 = 0.0;
+		*c2 = 0.0;
+	}
+
+	if(*c2>0.999) *c2 = 0.999;
+	if(*c2<-0.999) *c2 = -0.999;
+	if(*c1>(1.0 - *c2)*0.999 + 1.0) *c1 = (1.0 - *c2)*0.999 + 1.0;
+	if(*c1>1.999) *c1 = 1.999;
+	if(*c1<-1.999) *c1 = -1.999;
+}
+
+u32 DSPADPCM_GetEncodedSize(u32 samples)
+{
+	return ((samples + DSPADPCM_FRAME_SAMPLES - 1)/DSPADPCM_FRAME_SAMPLES)*DSPADPCM_FRAME_BYTES;
+}
+
+u32 DSPADPCM_SampleToNibble(u32 sample)
+{
+	return (sample/DSPADPCM_FRAME_SAMPLES)*DSPADPCM_FRAME_NIBBLES + (sample%DSPADPCM_FRAME_SAMPLES) + 2;
+}
+
+void DSPADPCM_FindCoefficients(const s16 *src,u32 samples,s16 *coef)
+{
+	u32 i,k,n,pos,len,pass,best,pairs;
+	f64 c1[COEF_PAIRS],c2[COEF_PAIRS];
+	f64 err,besterr;
+	lpcstats acc[COEF_PAIRS];
+	lpcstats st;
+
+	// LBG: start from the global predictor, split every centroid and refine
+	// with Lloyd passes until all 8 pairs are in use
+	memset(acc,0,sizeof(acc));
+	for(pos=0;pos<samples;pos+=DSPADPCM_FRAME_SAMPLES) {
+		len = samples - pos;
+		if(len>DSPADPCM_FRAME_SAMPLES) len = DSPADPCM_FRAME_SAMPLES;
+		__dspadpcm_blockstats(src,pos,len,&st);
+		__dspadpcm_addstats(&acc[0],&st);
+	}
+	__dspadpcm_solve(&acc[0],&c1[0],&c2[0]);
+
+	for(pairs=1;pairs<COEF_PAIRS;pairs<<=1) {
+		for(k=0;k<pairs;k++) {
+			c1[pairs + k] = c1[k]*0.99 + 0.01;
+			c2[pairs + k] = c2[k]*0.99 - 0.01;
+			c1[k] = c1[k]*1.01 - 0.01;
+			c2[k] = c2[k]*1.01 + 0.01;
+		}
+
+		for(pass=0;pass<TRAIN_PASSES;pass++) {
+			memset(acc,0,sizeof(acc));
+			for(pos=0;pos<samples;pos+=DSPADPCM_FRAME_SAMPLES) {
+				len = samples - pos;
+				if(len>DSPADPCM_FRAME_SAMPLES) len = DSPADPCM_FRAME_SAMPLES;
+				__dspadpcm_blockstats(src,pos,len,&st);
+				if(st.r0<1.0) continue;
+
+				best = 0;
+				besterr = __dspadpcm_error(&st,c1[0],c2[0]);
+				for(k=1;k<(pairs<<1);k++) {
+					err = __dspadpcm_error(&st,c1[k],c2[k]);
+					if(err<besterr) {
+						besterr = err;
+						best = k;
+					}
+				}
+				__dspadpcm_addstats(&acc[best],&st);
+			}
+
+			for(k=0;k<(pairs<<1);k++) {
+				if(acc[k].r11>0.0) __dspadpcm_solve(&acc[k],&c1[k],&c2[k]);
+			}
+		}
+	}
+
+	for(i=0,n=0;i<COEF_PAIRS;i++) {
+		s32 v1 = (s32)(c1[i]*2048.0 + (c1[i]<0.0 ? -0.5 : 0.5));
+		s32 v2 = (s32)(c2[i]*2048.0 + (c2[i]<0.0 ? -0.5 : 0.5));
+		coef[n++] = (s16)__dspadpcm_clamp16(v1);
+		coef[n++] = (s16)__dspadpcm_clamp16(v2);
+	}
+}
+
+// quantize one frame with a given predictor and scale, returns the squared error
+static u64 __dspadpcm_quantize(const s16 *src,u32 len,s32 c1,s32 c2,s32 scale,s32 yn1,s32 yn2,s8 *nibbles,s32 *hist)
+{
+	u32 i;
+	s32 pred,diff,q,out,step;
+	u64 err = 0;
+
+	step = 2048<<scale;
+	for(i=0;i<len;i++) {
+		pred = c1*yn1 + c2*yn2;
+		diff = src[i]*2048 - pred;
+		if(diff>=0)
+			q = (diff + (step>>1))/step;
+		else
+			q = -((-diff + (step>>1))/step);
+		if(q>7) q = 7;
+		if(q<-8) q = -8;
+
+		out = __dspadpcm_clamp16((q*step + pred + 1024)>>11);
+		err += (u64)((s64)(src[i] - out)*(src[i] - out));
+
+		nibbles[i] = (s8)q;
+		yn2 = yn1;
+		yn1 = out;
+	}
+	hist[0] = yn1;
+	hist[1] = yn2;
+	return err;
+}
+
+void DSPADPCM_Encode(dspadpcm_context *ctx,const s16 *src,u8 *dst,u32 samples)
+{
+	u32 i,k,len;
+	s32 s,scale,c1,c2,pred,dist,maxdist;
+	s32 hist[2],besthist[2];
+	s8 nibbles[DSPADPCM_FRAME_SAMPLES],bestnib[DSPADPCM_FRAME_SAMPLES];
+	u64 err,besterr;
+	u8 bestps;
+
+	while(samples>0) {
+		len = (samples>DSPADPCM_FRAME_SAMPLES) ? DSPADPCM_FRAME_SAMPLES : samples;
+
+		besterr = ~0ULL;
+		bestps = 0;
+		besthist[0] = ctx->yn1;
+		besthist[1] = ctx->yn2;
+		for(k=0;k<COEF_PAIRS;k++) {
+			c1 = ctx->coef[k*2];
+			c2 = ctx->coef[k*2 + 1];
+
+			// estimate the scale from the open loop residual, then try it and the next one
+			maxdist = 0;
+			for(i=0;i<len;i++) {
+				s32 x1 = (i>0) ? src[i-1] : ctx->yn1;
+				s32 x2 = (i>1) ? src[i-2] : ((i>0) ? ctx->yn1 : ctx->yn2);
+				pred = (c1*x1 + c2*x2 + 1024)>>11;
+				dist = src[i] - pred;
+				if(dist<0) dist = -dist;
+				if(dist>maxdist) maxdist = dist;
+			}
+			scale = 0;
+			while(scale<MAX_SCALE && maxdist>(7<<scale)) scale++;
+
+			for(s=(scale>0 ? scale-1 : 0);s<=scale+1 && s<=MAX_SCALE;s++) {
+				err = __dspadpcm_quantize(src,len,c1,c2,s,ctx->yn1,ctx->yn2,nibbles,hist);
+				if(err<besterr) {
+					besterr = err;
+					bestps = (u8)((k<<4)|s);
+					besthist[0] = hist[0];
+					besthist[1] = hist[1];
+					memcpy(bestnib,nibbles,len);
+				}
+			}
+		}
+
+		memset(dst,0,DSPADPCM_FRAME_BYTES);
+		dst[0] = bestps;
+		for(i=0;i<len;i++) {
+			if(i&1)
+				dst[1 + (i>>1)] |= (bestnib[i]&0x0f);
+			else
+				dst[1 + (i>>1)] |= (bestnib[i]&0x0f)<<4;
+		}
+
+		ctx->pred_scale = bestps;
+		ctx->yn1 = (s16)besthist[0];
+		ctx->yn2 = (s16)besthist[1];
+
+		src += len;
+		dst += DSPADPCM_FRAME_BYTES;
+		samples -= len;
+	}
+}
+
+void DSPADPCM_Decode(dspadpcm_context *ctx,const u8 *src,s16 *dst,u32 samples)
+{
+	u32 i,len;
+	s32 c1,c2,step,yn1,yn2,out;
+
+	yn1 = ctx->yn1;
+	yn2 = ctx->yn2;
+	while(samples>0) {
+		len = (samples>DSPADPCM_FRAME_SAMPLES) ? DSPADPCM_FRAME_SAMPLES : samples;
+
+		ctx->pred_scale = src[0];
+		c1 = ctx->coef[(src[0]>>4)*2];
+		c2 = ctx->coef[(src[0]>>4)*2 + 1];
+		step = 2048<<(src[0]&0x0f);
+		for(i=0;i<len;i++) {
+			out = __dspadpcm_nibble(src,i)*step + c1*yn1 + c2*yn2 + 1024;
+			out = __dspadpcm_clamp16(out>>11);
+			*dst++ = (s16)out;
+			yn2 = yn1;
+			yn1 = out;
+		}
+
+		src += DSPADPCM_FRAME_BYTES;
+		samples -= len;
+	}
+	ctx->yn1 = (s16)yn1;
+	ctx->yn2 = (s16)yn2;
+}
+
+void DSPADPCM_GetLoopContext(const dspadpcm_context *ctx,const u8 *src,u32 loop_start,u16 *pred_scale,s16 *yn1,s16 *yn2)
+{
+	dspadpcm_context dec;
+	s16 pcm[DSPADPCM_FRAME_SAMPLES];
+	u32 frame,pos;
+
+	memcpy(&dec,ctx,sizeof(dspadpcm_context));
+	frame = loop_start/DSPADPCM_FRAME_SAMPLES;
+	*pred_scale = src[frame*DSPADPCM_FRAME_BYTES];
+
+	// decode whole frames up to the loop frame, then the part before loop_start
+	for(pos=0;pos<frame;pos++)
+		DSPADPCM_Decode(&dec,src + pos*DSPADPCM_FRAME_BYTES,pcm,DSPADPCM_FRAME_SAMPLES);
+	if(loop_start%DSPADPCM_FRAME_SAMPLES)
+		DSPADPCM_Decode(&dec,src + frame*DSPADPCM_FRAME_BYTES,pcm,loop_start%DSPADPCM_FRAME_SAMPLES);
+
+	*yn1 = dec.yn1;
+	*yn2 = dec.yn2;
+}
+
+void DSPADPCM_EncodeSound(const s16 *src,u32 samples,u32 rate,s32 loop_start,s32 loop_end,u8 *dst,dspadpcm_header *hdr)
+{
+	dspadpcm_context ctx;
+
+	// nothing to encode, and no frame to take pred_scale or loop_end from
+	memset(hdr,0,sizeof(dspadpcm_header));
+	if(samples==0) return;
+
+	memset(&ctx,0,sizeof(dspadpcm_context));
+	DSPADPCM_FindCoefficients(src,samples,ctx.coef);
+	DSPADPCM_Encode(&ctx,src,dst,samples);
+
+	hdr->num_samples = samples;
+	hdr->num_nibbles = DSPADPCM_SampleToNibble(samples);
+	hdr->sample_rate = rate;
+	hdr->curr_addr = 2;
+	memcpy(hdr->coef,ctx.coef,sizeof(hdr->coef));
+	hdr->pred_scale = dst[0];
+
+	if(loop_start>=0 && loop_end>loop_start && (u32)loop_end<samples) {
+		ctx.yn1 = ctx.yn2 = 0;
+		hdr->loop_flag = 1;
+		hdr->loop_start = DSPADPCM_SampleToNibble(loop_start);
+		hdr->loop_end = DSPADPCM_SampleToNibble(loop_end);
+		DSPADPCM_GetLoopContext(&ctx,dst,loop_start,&hdr->loop_pred_scale,&hdr->loop_yn1,&hdr->loop_yn2);
+	} else
+		hdr->loop_end = DSPADPCM_SampleToNibble(samples - 1);
+}
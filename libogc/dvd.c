@@ -47,6 +47,7 @@ distribution.
 #include "dvd.h"
 
 #include "lwp_queue.inl"
+#include "dvd_sched.h"
 
 //#define _DVD_DEBUG
 
@@ -201,6 +202,16 @@ static void *__dvd_usrdata = NULL;
 static dvddiskid *__dvd_diskID = (dvddiskid*)0x80000000;
 
 static lwp_queue __dvd_waitingqueue[4];
+
+static u32 __dvd_schedmode = DVD_SCHED_FIFO;
+static s64 __dvd_headpos = 0;
+static u32 __dvd_schedlen = 0;
+static u32 __dvd_schedcnt = 0;
+static u64 __dvd_schedstart = 0;
+static u64 __dvd_schedbusy = 0;			// usecs
+static dvdcbcallback __dvd_schedusrcb = NULL;
+static dvdcmdblk *__dvd_schedmerged[DVD_SCHED_MAXMERGE];
+static dvdschedstats __dvd_schedstats;
 static dvdcmdl __dvd_cmdlist[4];
 static dvdcmds __dvd_cmd_curr,__dvd_cmd_prev;
 
@@ -393,7 +404,9 @@ static s32 DVD_LowSetGCMOffset(s64 offset,dvdcallbacklow cb);
 static s32 DVD_LowSetOffset(s64 offset,dvdcallbacklow cb);
 
 extern void udelay(int us);
+extern u64 gettime(void);
 extern u32 diff_msec(unsigned long long start,unsigned long long end);
+extern u32 diff_usec(unsigned long long start,unsigned long long end);
 extern void __MaskIrq(u32);
 extern void __UnmaskIrq(u32);
 extern syssramex* __SYS_LockSramEx(void);
@@ -476,6 +489,81 @@ static dvdcmdblk* __dvd_popwaitingqueueprio(s32 prio)
 	return ret;
 }
 
+// Splits the result of a (possibly merged) read command among its requests
+static void __dvd_schedcb(s32 result,dvdcmdblk *block)
+{
+	u32 i,cnt;
+	u8 *src;
+	dvdcmdblk *blk;
+	dvdcmdblk *merged[DVD_SCHED_MAXMERGE];
+
+	cnt = __dvd_schedcnt;
+	for(i=0;i<cnt;i++) merged[i] = __dvd_schedmerged[i];
+	__dvd_schedcnt = 0;
+
+	__dvd_schedbusy += diff_usec(__dvd_schedstart,gettime());
+	__dvd_schedstats.bytes += block->txdsize;
+
+	block->cb = __dvd_schedusrcb;
+	block->len = __dvd_schedlen;
+	if(result>=0) {
+		__dvd_schedstats.requests += 1+cnt;
+		block->txdsize = block->len;
+		result = block->len;
+
+		for(i=0;i<cnt;i++) {
+			blk = merged[i];
+			src = (u8*)block->buf + (blk->offset - block->offset);
+			if(blk->buf!=src) {
+				memcpy(blk->buf,src,blk->len);
+				DCFlushRange(blk->buf,blk->len);
+			}
+		}
+	}
+	if(block->cb) block->cb(result,block);
+
+	for(i=0;i<cnt;i++) {
+		blk = merged[i];
+		if(result>=0) {
+			blk->txdsize = blk->len;
+			blk->state = 0;
+			if(blk->cb) blk->cb(blk->len,blk);
+		} else {
+			blk->state = block->state;
+			if(blk->cb) blk->cb(result,blk);
+		}
+	}
+}
+
+static void __dvd_schedbegin(dvdcmdblk *block,lwp_queue *queue)
+{
+	u32 i,len;
+	s64 dist;
+
+	if(block->cmd!=DVD_SCHED_READCMD) return;
+
+	__dvd_schedcnt = 0;
+	__dvd_schedlen = block->len;
+	if(__dvd_schedmode==DVD_SCHED_CSCAN) {
+		__dvd_schedcnt = __dvd_schedmerge(queue,block,__dvd_schedmerged,DVD_SCHED_MAXMERGE,&len);
+		for(i=0;i<__dvd_schedcnt;i++) __dvd_schedmerged[i]->state = 1;
+		__dvd_schedstats.merged += __dvd_schedcnt;
+		block->len = len;
+	}
+
+	if(block->offset!=__dvd_headpos) {
+		dist = block->offset - __dvd_headpos;
+		__dvd_schedstats.seeks++;
+		__dvd_schedstats.seekdist += (dist<0)?-dist:dist;
+	}
+	__dvd_schedstats.commands++;
+	__dvd_headpos = block->offset + block->len;
+
+	__dvd_schedusrcb = block->cb;
+	block->cb = __dvd_schedcb;
+	__dvd_schedstart = gettime();
+}
+
 static dvdcmdblk* __dvd_popwaitingqueue(void)
 {
 	u32 i,level;
@@ -486,8 +574,12 @@ static dvdcmdblk* __dvd_popwaitingqueue(void)
 	_CPU_ISR_Disable(level);
 	for(i=0;i<4;i++) {
 		if(!__lwp_queue_isempty(&__dvd_waitingqueue[i])) {
+			if(__dvd_schedmode==DVD_SCHED_CSCAN)
+				ret = __dvd_schedpick(&__dvd_waitingqueue[i],__dvd_headpos);
+			else
+				ret = __dvd_popwaitingqueueprio(i);
+			__dvd_schedbegin(ret,&__dvd_waitingqueue[i]);
 			_CPU_ISR_Restore(level);
-			ret = __dvd_popwaitingqueueprio(i);
 			return ret;
 		}
 	}
@@ -2342,6 +2434,42 @@ s32 DVD_SeekPrio(dvdcmdblk *block,s64 offset,s32 prio)
 	return -1;
 }
 
+u32 DVD_SetScheduler(u32 mode)
+{
+	u32 level,old;
+
+	_CPU_ISR_Disable(level);
+	old = __dvd_schedmode;
+	__dvd_schedmode = mode;
+	_CPU_ISR_Restore(level);
+	return old;
+}
+
+void DVD_GetSchedStats(dvdschedstats *stats)
+{
+	u32 level;
+	u64 busy;
+
+	if(!stats) return;
+
+	_CPU_ISR_Disable(level);
+	*stats = __dvd_schedstats;
+	busy = __dvd_schedbusy;
+	_CPU_ISR_Restore(level);
+
+	stats->throughput = busy ? (u32)((stats->bytes*1000000ULL)/(busy<<10)) : 0;
+}
+
+void DVD_ResetSchedStats(void)
+{
+	u32 level;
+
+	_CPU_ISR_Disable(level);
+	memset(&__dvd_schedstats,0,sizeof(dvdschedstats));
+	__dvd_schedbusy = 0;
+	_CPU_ISR_Restore(level);
+}
+
 s32 DVD_CancelAllAsync(dvdcbcallback cb)
 {
 	u32 level;
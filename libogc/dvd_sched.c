@@ -0,0 +1,93 @@
+/*-------------------------------------------------------------
+
+dvd_sched.c -- DVD read scheduler
+
+Copyright (C) 2026
+
+This software is provided 'as-is', without any express or implied
+warranty.  In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1.	The origin of this software must not be misrepresented; you
+must not claim that you wrote the original software. If you use
+this software in a product, an acknowledgment in the product
+documentation would be appreciated but is not required.
+
+2.	Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3.	This notice may not be removed or altered from any source
+distribution.
+
+-------------------------------------------------------------*/
+#include <gctypes.h>
+#include <ogc/dvd.h>
+
+#include "lwp_queue.inl"
+#include "dvd_sched.h"
+
+// C-SCAN: the lowest offset at or past the head, else wrap to the lowest offset
+dvdcmdblk* __dvd_schedpick(lwp_queue *queue,s64 headpos)
+{
+	lwp_node *node;
+	dvdcmdblk *block,*ahead = NULL,*lowest = NULL;
+
+	if(__lwp_queue_isempty(queue)) return NULL;
+
+	for(node=queue->first;!__lwp_queue_istail(queue,node);node=node->next) {
+		block = (dvdcmdblk*)node;
+		if(block->cmd!=DVD_SCHED_READCMD) break;
+
+		if(block->offset>=headpos && (!ahead || block->offset<ahead->offset)) ahead = block;
+		if(!lowest || block->offset<lowest->offset) lowest = block;
+	}
+
+	if(ahead) block = ahead;
+	else if(lowest) block = lowest;
+	else block = (dvdcmdblk*)queue->first;
+
+	__lwp_queue_extractI(&block->node);
+	return block;
+}
+
+/* Pull reads that the lead's drive command can serve as well: reads that
+ * continue it both on disc and in memory extend the command, reads lying
+ * completely inside it are copied out of the lead's buffer on completion.
+ */
+u32 __dvd_schedmerge(lwp_queue *queue,dvdcmdblk *lead,dvdcmdblk **merged,u32 max,u32 *len)
+{
+	u32 cnt = 0;
+	u32 found;
+	s64 end;
+	lwp_node *node,*next;
+	dvdcmdblk *block;
+
+	*len = lead->len;
+	do {
+		found = 0;
+		for(node=queue->first;!__lwp_queue_istail(queue,node) && cnt<max;node=next) {
+			next = node->next;
+			block = (dvdcmdblk*)node;
+			if(block->cmd!=DVD_SCHED_READCMD) break;
+
+			end = lead->offset + *len;
+			if(block->offset>=lead->offset && (block->offset+block->len)<=end) {
+				;
+			} else if(block->offset==end && block->buf==((u8*)lead->buf + *len)
+				&& (*len + block->len)<=DVD_SCHED_MAXMERGELEN) {
+				*len += block->len;
+			} else
+				continue;
+
+			__lwp_queue_extractI(node);
+			merged[cnt++] = block;
+			found = 1;
+		}
+	} while(found && cnt<max);
+
+	return cnt;
+}
@@ -0,0 +1,44 @@
+/*-------------------------------------------------------------
+
+dvd_sched.h -- DVD read scheduler
+
+Copyright (C) 2026
+
+This software is provided 'as-is', without any express or implied
+warranty.  In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1.	The origin of this software must not be misrepresented; you
+must not claim that you wrote the original software. If you use
+this software in a product, an acknowledgment in the product
+documentation would be appreciated but is not required.
+
+2.	Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3.	This notice may not be removed or altered from any source
+distribution.
+
+-------------------------------------------------------------*/
+#ifndef __DVD_SCHED_H__
+#define __DVD_SCHED_H__
+
+#include <gctypes.h>
+#include <ogc/dvd.h>
+
+#define DVD_SCHED_READCMD				0x0001
+#define DVD_SCHED_MAXMERGE				8
+#define DVD_SCHED_MAXMERGELEN			0x100000
+
+/* Both helpers only look at the leading run of read commands in a queue,
+ * so reads are never moved across a seek, stream or inquiry command.
+ * They touch nothing but the queue and the blocks, callers provide the locking.
+ */
+dvdcmdblk* __dvd_schedpick(lwp_queue *queue,s64 headpos);
+u32 __dvd_schedmerge(lwp_queue *queue,dvdcmdblk *lead,dvdcmdblk **merged,u32 max,u32 *len);
+
+#endif
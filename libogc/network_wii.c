@@ -70,6 +70,8 @@ distribution.
 
 #define NET_UNKNOWN_ERROR_OFFSET	-10000
 
+#define NET_BATCH_INFLIGHT			8		// IPC queues at most 16 requests, leave room for others
+
 enum {
 	IOCTL_SO_ACCEPT	= 1,
 	IOCTL_SO_BIND,
@@ -152,6 +154,45 @@ struct setsockopt_params {
 	u8 optval[20];
 };
 
+enum {
+	NETREQ_SENDTO = NET_OP_SENDTO,
+	NETREQ_RECVFROM = NET_OP_RECVFROM,
+	NETREQ_POLL
+};
+
+// what IOS reads or writes sits in cache lines of its own, the reply
+// invalidates them
+struct netreq {
+	union {
+		struct sendto_params sendto;
+		u32 recvfrom[2];
+		u64 poll;
+	} params ATTRIBUTE_ALIGN(32);
+	u8 addr[28] ATTRIBUTE_ALIGN(32);
+	ioctlv vec[3] ATTRIBUTE_ALIGN(32);
+
+	u32 type ATTRIBUTE_ALIGN(32);
+	u8 *buf;
+	void *mem;
+	s32 len;
+	struct sockaddr *from;
+	socklen_t *fromlen;
+	s32 *result;
+	netcallback cb;
+	void *usrdata;
+};
+
+struct netbatch {
+	struct net_op *ops;
+	s32 nops;
+	s32 next;
+	s32 inflight;
+	vu32 done;
+	lwpq_t queue;
+	netcallback cb;
+	void *usrdata;
+};
+
 // 0 means we don't know what this error code means
 // I sense a pattern here...
 static u8 _net_error_code_map[] = {
@@ -1106,6 +1147,323 @@ s32 net_poll(struct pollsd *sds,s32 nsds,s32 timeout)
 	return ret;
 }
 
+static s32 __net_req_done(s32 result, void *usrdata)
+{
+	struct netreq *req = (struct netreq *)usrdata;
+	netcallback cb = req->cb;
+	void *cbdata = req->usrdata;
+
+	result = _net_convert_error(result);
+	switch (req->type) {
+		case NETREQ_RECVFROM:
+			if (result > 0) {
+				if (result > req->len)
+					result = -EOVERFLOW;
+				else
+					memcpy(req->mem, req->buf, result);
+			}
+			if (req->from) {
+				memcpy(req->from, req->addr, *req->fromlen);
+				*req->fromlen = req->from->sa_len;
+			}
+			break;
+		case NETREQ_POLL:
+			memcpy(req->mem, req->buf, req->len);
+			break;
+	}
+	if (req->result) *req->result = result;
+
+	debug_printf("net request %d done=%d\n", req->type, result);
+
+	if (req->buf) net_free(req->buf);
+	net_free(req);
+
+	if (cb) cb(result, cbdata);
+	return 0;
+}
+
+static struct netreq * __net_req_alloc(u32 type, s32 len)
+{
+	struct netreq *req;
+
+	req = net_malloc(sizeof(struct netreq));
+	if (req == NULL) return NULL;
+
+	memset(req, 0, sizeof(struct netreq));
+	req->type = type;
+	if (len > 0) {
+		req->buf = net_malloc(len);
+		if (req->buf == NULL) {
+			net_free(req);
+			return NULL;
+		}
+	}
+	return req;
+}
+
+static s32 __net_req_failed(struct netreq *req, s32 ret)
+{
+	if (req->buf) net_free(req->buf);
+	net_free(req);
+
+	if (ret == IPC_EQUEUEFULL) return -EAGAIN;
+	return _net_convert_error(ret);
+}
+
+static s32 __net_sendto_req(s32 s, const void *data, s32 len, u32 flags, struct sockaddr *to, socklen_t tolen, s32 *result, netcallback cb, void *usrdata)
+{
+	s32 ret;
+	struct netreq *req;
+
+	if (net_ip_top_fd < 0) return -ENXIO;
+	if (len < 0) return -EINVAL;
+	if (tolen > 28) return -EOVERFLOW;
+
+	req = __net_req_alloc(NETREQ_SENDTO, len);
+	if (req == NULL) {
+		debug_printf("net_sendto_async: failed to alloc %d bytes\n", len);
+		return -ENOMEM;
+	}
+
+	if (to && to->sa_len != tolen) to->sa_len = tolen;
+
+	if (len > 0) memcpy(req->buf, data, len);
+	req->params.sendto.socket = s;
+	req->params.sendto.flags = flags;
+	if (to) {
+		req->params.sendto.has_destaddr = 1;
+		memcpy(req->params.sendto.destaddr, to, to->sa_len);
+	}
+	req->vec[0].data = req->buf;
+	req->vec[0].len = len;
+	req->vec[1].data = &req->params.sendto;
+	req->vec[1].len = sizeof(struct sendto_params);
+
+	req->result = result;
+	req->cb = cb;
+	req->usrdata = usrdata;
+
+	ret = IOS_IoctlvAsync(net_ip_top_fd, IOCTLV_SO_SENDTO, 2, 0, req->vec, __net_req_done, req);
+	if (ret < 0) return __net_req_failed(req, ret);
+	return 0;
+}
+
+static s32 __net_recvfrom_req(s32 s, void *mem, s32 len, u32 flags, struct sockaddr *from, socklen_t *fromlen, s32 *result, netcallback cb, void *usrdata)
+{
+	s32 ret;
+	struct netreq *req;
+
+	if (net_ip_top_fd < 0) return -ENXIO;
+	if (len <= 0) return -EINVAL;
+	if (from && fromlen && *fromlen > 28) return -EOVERFLOW;
+
+	req = __net_req_alloc(NETREQ_RECVFROM, len);
+	if (req == NULL) {
+		debug_printf("net_recvfrom_async: failed to alloc %d bytes\n", len);
+		return -ENOMEM;
+	}
+
+	req->mem = mem;
+	req->len = len;
+	req->params.recvfrom[0] = s;
+	req->params.recvfrom[1] = flags;
+	req->vec[0].data = req->params.recvfrom;
+	req->vec[0].len = 8;
+	req->vec[1].data = req->buf;
+	req->vec[1].len = len;
+	if (from && fromlen) {
+		from->sa_len = *fromlen;
+		memcpy(req->addr, from, *fromlen);
+		req->from = from;
+		req->fromlen = fromlen;
+		req->vec[2].data = req->addr;
+		req->vec[2].len = *fromlen;
+	}
+
+	req->result = result;
+	req->cb = cb;
+	req->usrdata = usrdata;
+
+	ret = IOS_IoctlvAsync(net_ip_top_fd, IOCTLV_SO_RECVFROM, 1, 2, req->vec, __net_req_done, req);
+	if (ret < 0) return __net_req_failed(req, ret);
+	return 0;
+}
+
+s32 net_sendto_async(s32 s, const void *data, s32 len, u32 flags, struct sockaddr *to, socklen_t tolen, netcallback cb, void *usrdata)
+{
+	return __net_sendto_req(s, data, len, flags, to, tolen, NULL, cb, usrdata);
+}
+
+s32 net_recvfrom_async(s32 s, void *mem, s32 len, u32 flags, struct sockaddr *from, socklen_t *fromlen, netcallback cb, void *usrdata)
+{
+	return __net_recvfrom_req(s, mem, len, flags, from, fromlen, NULL, cb, usrdata);
+}
+
+s32 net_poll_async(struct pollsd *sds, s32 nsds, s32 timeout, netcallback cb, void *usrdata)
+{
+	union ullc {
+		u64 ull;
+		u32 ul[2];
+	};
+
+	s32 ret, len;
+	union ullc outv;
+	struct netreq *req;
+
+	if (net_ip_top_fd < 0) return -ENXIO;
+	if (sds == NULL || nsds <= 0) return -EINVAL;
+
+	len = nsds * sizeof(struct pollsd);
+	req = __net_req_alloc(NETREQ_POLL, len);
+	if (req == NULL) {
+		debug_printf("net_poll_async: failed to alloc %d bytes\n", len);
+		return -ENOMEM;
+	}
+
+	outv.ul[0] = 0;
+	outv.ul[1] = timeout;
+	req->params.poll = outv.ull;
+	memcpy(req->buf, sds, len);
+	req->mem = sds;
+	req->len = len;
+	req->cb = cb;
+	req->usrdata = usrdata;
+
+	ret = IOS_IoctlAsync(net_ip_top_fd, IOCTL_SO_POLL, &req->params.poll, 8, req->buf, len, __net_req_done, req);
+	if (ret < 0) return __net_req_failed(req, ret);
+	return 0;
+}
+
+static s32 __net_batch_cb(s32 result, void *usrdata);
+
+static void __net_batch_finish(struct netbatch *batch)
+{
+	s32 i, ok = 0;
+	netcallback cb = batch->cb;
+	void *cbdata = batch->usrdata;
+
+	for (i = 0; i < batch->nops; i++) {
+		if (batch->ops[i].result >= 0) ok++;
+	}
+
+	debug_printf("net_batch(%d)=%d\n", batch->nops, ok);
+
+	if (cb) {
+		net_free(batch);
+		cb(ok, cbdata);
+		return;
+	}
+
+	batch->done = ok + 1;
+	LWP_ThreadBroadcast(batch->queue);
+}
+
+// keep up to NET_BATCH_INFLIGHT ops with IOS, called with interrupts off
+static void __net_batch_fill(struct netbatch *batch)
+{
+	s32 ret;
+	struct net_op *op;
+
+	while (batch->inflight < NET_BATCH_INFLIGHT && batch->next < batch->nops) {
+		op = &batch->ops[batch->next];
+		switch (op->op) {
+			case NET_OP_SENDTO:
+				ret = __net_sendto_req(op->s, op->data, op->len, op->flags, op->addr, op->addrlen, &op->result, __net_batch_cb, batch);
+				break;
+			case NET_OP_RECVFROM:
+				ret = __net_recvfrom_req(op->s, op->data, op->len, op->flags, op->addr, op->addr ? &op->addrlen : NULL, &op->result, __net_batch_cb, batch);
+				break;
+			default:
+				ret = -EINVAL;
+				break;
+		}
+
+		// out of IPC slots or heap: retry once one of ours has completed
+		if ((ret == -EAGAIN || ret == -ENOMEM) && batch->inflight > 0)
+			break;
+
+		batch->next++;
+		if (ret < 0)
+			op->result = ret;
+		else
+			batch->inflight++;
+	}
+
+	if (batch->inflight == 0 && batch->next == batch->nops)
+		__net_batch_finish(batch);
+}
+
+static s32 __net_batch_cb(s32 result, void *usrdata)
+{
+	u32 level;
+	struct netbatch *batch = (struct netbatch *)usrdata;
+
+	_CPU_ISR_Disable(level);
+	batch->inflight--;
+	__net_batch_fill(batch);
+	_CPU_ISR_Restore(level);
+
+	return 0;
+}
+
+static s32 __net_batch_start(struct netbatch *batch, struct net_op *ops, s32 nops)
+{
+	s32 i;
+	u32 level;
+
+	batch->ops = ops;
+	batch->nops = nops;
+	batch->next = 0;
+	batch->inflight = 0;
+	batch->done = 0;
+	for (i = 0; i < nops; i++) ops[i].result = -EINPROGRESS;
+
+	_CPU_ISR_Disable(level);
+	__net_batch_fill(batch);
+	_CPU_ISR_Restore(level);
+
+	return 0;
+}
+
+s32 net_batch_async(struct net_op *ops, s32 nops, netcallback cb, void *usrdata)
+{
+	struct netbatch *batch;
+
+	if (net_ip_top_fd < 0) return -ENXIO;
+	if (ops == NULL || nops <= 0 || cb == NULL) return -EINVAL;
+
+	batch = net_malloc(sizeof(struct netbatch));
+	if (batch == NULL) return -ENOMEM;
+
+	memset(batch, 0, sizeof(struct netbatch));
+	batch->cb = cb;
+	batch->usrdata = usrdata;
+
+	return __net_batch_start(batch, ops, nops);
+}
+
+s32 net_batch(struct net_op *ops, s32 nops)
+{
+	u32 level;
+	struct netbatch batch;
+
+	if (net_ip_top_fd < 0) return -ENXIO;
+	if (ops == NULL || nops <= 0) return -EINVAL;
+
+	memset(&batch, 0, sizeof(struct netbatch));
+	LWP_InitQueue(&batch.queue);
+
+	__net_batch_start(&batch, ops, nops);
+
+	_CPU_ISR_Disable(level);
+	while (!batch.done)
+		LWP_ThreadSleep(batch.queue);
+	_CPU_ISR_Restore(level);
+
+	LWP_CloseQueue(batch.queue);
+	return batch.done - 1;
+}
+
 s32 if_config(char *local_ip, char *netmask, char *gateway,bool use_dhcp, int max_retries)
 {
 	s32 i,ret;
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <string.h>
+#include <gcutil.h>
 
 #include "card_cmn.h"
 #include "card_buf.h"
@@ -10,11 +11,11 @@
 
 typedef struct _buf_node {
 	struct _buf_node *next;
-	u8 data[SECTOR_SIZE+2];
+	u8 data[SECTOR_SIZE+2] ATTRIBUTE_ALIGN(32);		// EXI DMA needs aligned blocks
 	
 } BufNode;
 
-static BufNode s_buf[BUF_POOL_CNT];
+static BufNode s_buf[BUF_POOL_CNT] ATTRIBUTE_ALIGN(32);
 static BufNode *s_freepool;
 
 void sdgecko_initBufferPool(void)
@@ -13,6 +13,8 @@
 #include "card_cmn.h"
 //#include "card_fat.h"
 #include "card_io.h"
+#include "card_buf.h"
+#include "card_crc.h"
 
 //#define _CARDIO_DEBUG
 #ifdef _CARDIO_DEBUG
@@ -74,10 +76,10 @@ static u32 _ioPageSize[MAX_DRIVE];
 static u32 _ioFlag[MAX_DRIVE];
 static u32 _ioError[MAX_DRIVE];
 static bool _ioCardInserted[MAX_DRIVE];
+static bool _ioDMA[MAX_DRIVE];
+static sdgecko_stats _ioStats[MAX_DRIVE];
 
 static u8 _ioResponse[MAX_DRIVE][128];
-static u8 _ioCrc7Table[256];
-static u16 _ioCrc16Table[256];
 
 // SDHC support
 static u32 _initType[MAX_DRIVE];
@@ -102,143 +104,6 @@ static __inline__ u32 __check_response(s32 drv_no,u8 res)
 	return ((_ioError[drv_no]&CARDIO_OP_IOERR_FATAL)?CARDIO_ERROR_INTERNAL:CARDIO_ERROR_READY);
 }
 
-static void __init_crc7(void)
-{
-	s32 i,j;
-	u8 c,crc7;
-
-	crc7 = 0;
-	for(i=0;i<256;i++) {
-		c = i;
-		crc7 = 0;
-		for(j=0;j<8;j++) {
-			crc7 <<= 1;
-			if((crc7^c)&0x80) crc7 ^= 0x09;
-			c <<= 1;
-		}
-		crc7 &= 0x7f;
-		_ioCrc7Table[i] = crc7;
-	}
-}
-
-static u8 __make_crc7(void *buffer,u32 len)
-{
-	s32 i;
-	u8 crc7;
-	u8 *ptr;
-
-	crc7 = 0;
-	ptr = buffer;
-	for(i=0;i<len;i++)
-		crc7 = _ioCrc7Table[(u8)((crc7<<1)^ptr[i])];
-
-	return ((crc7<<1)|1);
-}
-
-/* Old way, realtime
-static u8 __make_crc7(void *buffer,u32 len)
-{
-	u32 mask,cnt,bcnt;
-	u32 res,val;
-	u8 *ptr = (u8*)buffer;
-
-	cnt = 0;
-	res = 0;
-	while(cnt<len) {
-		bcnt = 0;
-		mask = 0x80;
-		while(bcnt<8) {
-			res <<= 1;
-			val = *ptr^((res>>bcnt)&0xff);
-			if(mask&val) {
-				res |= 0x01;
-				if(!(res&0x0008)) res |= 0x0008;
-				else res &= ~0x0008;
-				
-			} else if(res&0x0008) res |= 0x0008;
-			else res &= ~0x0008;
-			
-			mask >>= 1;
-			bcnt++;
-		}
-		ptr++;
-		cnt++;
-	}
-	return (res<<1)&0xff;
-}
-*/
-static void __init_crc16(void)
-{
-	s32 i,j;
-	u16 crc16,c;
-
-	for(i=0;i<256;i++) {
-		crc16 = 0;
-		c = ((u16)i)<<8;
-		for(j=0;j<8;j++) {
-			if((crc16^c)&0x8000) crc16 = (crc16<<1)^0x1021;
-			else crc16 <<= 1;
-
-			c <<= 1;
-		}
-
-		_ioCrc16Table[i] = crc16;
-	}
-}
-
-static u16 __make_crc16(void *buffer,u32 len)
-{
-	s32 i;
-	u8 *ptr;
-	u16 crc16;
-
-	crc16 = 0;
-	ptr = buffer;
-	for(i=0;i<len;i++)
-		crc16 = (crc16<<8)^_ioCrc16Table[((crc16>>8)^(u16)(ptr[i]))];
-
-	return crc16;
-}
-
-/* Old way, realtime
-static u16 __make_crc16(void *buffer,u32 len)
-{
-	u32 mask,cnt,bcnt;
-	u32 res,val,tmp;
-	u8 *ptr = (u8*)buffer;
-
-	cnt = 0;
-	res = 0;
-	while(cnt<len) {
-		bcnt = 0;
-		mask = 0x80;
-		val = *ptr;
-		while(bcnt<8) {
-			tmp = val^((res>>(bcnt+8))&0xff);
-			if(mask&tmp) {
-				res = (res<<1)|0x0001;
-				if(!(res&0x0020)) res |= 0x0020;
-				else res &= ~0x0020;
-				if(!(res&0x1000)) res |= 0x1000;
-				else res &= ~0x1000;
-			} else {
-				res = (res<<1)&~0x0001;
-				if(res&0x0020) res |= 0x0020;
-				else res &= ~0x0020;
-				if(res&0x1000) res |= 0x1000;
-				else res &= ~0x1000;
-			}
-			mask >>= 1;
-			bcnt++;
-		}
-		ptr++;
-		cnt++;
-	}
-	
-	return (res&0xffff);
-}
-*/
-
 static u32 __card_checktimeout(s32 drv_no,u32 startT,u32 timeout)
 {
 	u32 endT,diff;
@@ -257,6 +122,29 @@ static u32 __card_checktimeout(s32 drv_no,u32 startT,u32 timeout)
 	return 1;
 }
 
+static s32 __card_xfer(s32 drv_no,void *buf,u32 len,u32 mode)
+{
+	u32 cnt;
+	u8 *ptr = buf;
+
+	// DMA moves whole cache lines only. On reads the EXI drives the
+	// data line high, so it can't be used while the lines are inverted.
+	if(_ioDMA[drv_no] && !((u32)buf&0x1f) && !(len&0x1f)
+		&& (mode==EXI_WRITE || _ioClrFlag==0xff)) {
+		if(mode==EXI_WRITE) DCFlushRange(buf,len);
+		else DCInvalidateRange(buf,len);
+
+		if(EXI_Dma(drv_no,buf,len,mode,NULL)==0) return 0;
+		return EXI_Sync(drv_no);
+	}
+
+	if(mode==EXI_READ) {
+		for(cnt=0;cnt<len;cnt++) ptr[cnt] = _ioClrFlag;
+		mode = EXI_READWRITE;
+	}
+	return EXI_ImmEx(drv_no,buf,len,mode);
+}
+
 static s32 __exi_unlock(s32 chn,s32 dev)
 {
 	LWP_ThreadBroadcast(_ioEXILock[chn]);
@@ -292,7 +180,7 @@ static s32 __card_writecmd0(s32 drv_no)
 
 	_ioClrFlag = 0xff;
 	cmd[0] = 0x40;
-	crc = __make_crc7(cmd,5);
+	crc = sdgecko_crc7(cmd,5);
 
 	if(_ioWPFlag) {
 		_ioClrFlag = 0x00;
@@ -357,7 +245,7 @@ static s32 __card_writecmd(s32 drv_no,void *buf,s32 len)
 
 	ptr = buf;
 	ptr[0] |= 0x40;
-	crc = __make_crc7(buf,len);
+	crc = sdgecko_crc7(buf,len);
 
 	if(_ioWPFlag) {
 		for(cnt=0;cnt<len;cnt++) ptr[cnt] ^= -1;
@@ -659,7 +547,6 @@ static s32 __card_dataresponse(s32 drv_no)
 static s32 __card_dataread(s32 drv_no,void *buf,u32 len)
 {
 	u8 *ptr;
-	u32 cnt;
 	u8 res[2];
 	u16 crc,crc_org;
 	s32 startT,ret;
@@ -675,7 +562,7 @@ static s32 __card_dataread(s32 drv_no,void *buf,u32 len)
 
 	ret = CARDIO_ERROR_READY;
 	ptr = buf;
-	for(cnt=0;cnt<len;cnt++) ptr[cnt] = _ioClrFlag;
+	*ptr = _ioClrFlag;
 	if(EXI_ImmEx(drv_no,ptr,1,EXI_READWRITE)==0) {
 		EXI_Deselect(drv_no);
 		EXI_Unlock(drv_no);
@@ -712,8 +599,7 @@ static s32 __card_dataread(s32 drv_no,void *buf,u32 len)
 		}
 	}
 
-	*ptr = _ioClrFlag;
-	if(EXI_ImmEx(drv_no,ptr,len,EXI_READWRITE)==0) {
+	if(__card_xfer(drv_no,ptr,len,EXI_READ)==0) {
 		EXI_Deselect(drv_no);
 		EXI_Unlock(drv_no);
 		return CARDIO_ERROR_IOERROR;
@@ -736,7 +622,7 @@ static s32 __card_dataread(s32 drv_no,void *buf,u32 len)
 	EXI_Deselect(drv_no);
 	EXI_Unlock(drv_no);
 
-	crc = __make_crc16(buf,len);
+	crc = sdgecko_crc16(buf,len);
 	if(crc!=crc_org) ret = CARDIO_OP_IOERR_CRC;
 #ifdef _CARDIO_DEBUG
 	printf("crc ok: %04x : %04x\n",crc_org,crc);
@@ -754,7 +640,7 @@ static s32 __card_multidatawrite(s32 drv_no,void *buf,u32 len)
 	if(drv_no<0 || drv_no>=MAX_DRIVE) return CARDIO_ERROR_NOCARD;
 
 	for(cnt=0;cnt<32;cnt++) dummy[cnt] = _ioClrFlag;
-	crc = __make_crc16(buf,len);
+	crc = sdgecko_crc16(buf,len);
 	
 	__exi_wait(drv_no);
 
@@ -770,7 +656,7 @@ static s32 __card_multidatawrite(s32 drv_no,void *buf,u32 len)
 		return CARDIO_ERROR_IOERROR;
 	}
 
-	if(EXI_ImmEx(drv_no,buf,len,EXI_WRITE)==0) {
+	if(__card_xfer(drv_no,buf,len,EXI_WRITE)==0) {
 		EXI_Deselect(drv_no);
 		EXI_Unlock(drv_no);
 		return CARDIO_ERROR_IOERROR;
@@ -1191,8 +1077,7 @@ void sdgecko_initIODefault(void)
 #ifdef _CARDIO_DEBUG	
 	printf("card_initIODefault()\n");
 #endif
-	__init_crc7();
-	__init_crc16();
+	sdgecko_initCRC();
 	for(i=0;i<MAX_DRIVE;++i) {
 		_ioRetryCnt = 0;
 		_ioError[i] = 0;
@@ -1329,7 +1214,9 @@ s32 sdgecko_readSectors(s32 drv_no,u32 sector_no,u32 num_sectors,void *buf)
 {
 	u32 i;
 	s32 ret;
+	u32 start;
 	u8 arg[4] = {0};
+	u8 *bounce = NULL;
 	char *ptr = (char*)buf;
 
 	if(drv_no<0 || drv_no>=MAX_DRIVE) return CARDIO_ERROR_NOCARD;
@@ -1352,23 +1239,38 @@ s32 sdgecko_readSectors(s32 drv_no,u32 sector_no,u32 num_sectors,void *buf)
 	// SDHC support fix
 	__convert_sector(drv_no,sector_no,arg);
 
+	start = gettick();
 	if((ret=__card_sendcmd(drv_no,0x12,arg))!=0) return ret;
 	if((ret=__card_response1(drv_no))!=0) return ret;
 
+	// keep unaligned buffers on the DMA path through a pool buffer
+	if(_ioDMA[drv_no] && ((u32)ptr&0x1f)) bounce = sdgecko_allocBuffer();
+
 	for(i=0;i<num_sectors;i++) {
-		if((ret=__card_dataread(drv_no,ptr,_ioPageSize[drv_no]))!=0) return ret;
+		if(bounce) {
+			if((ret=__card_dataread(drv_no,bounce,_ioPageSize[drv_no]))!=0) break;
+			memcpy(ptr,bounce,_ioPageSize[drv_no]);
+		} else if((ret=__card_dataread(drv_no,ptr,_ioPageSize[drv_no]))!=0) break;
 		ptr += _ioPageSize[drv_no];
 	}
+	sdgecko_freeBuffer(bounce);
+	if(ret!=0) return ret;
 
 	if((ret=__card_sendcmd(drv_no,0x0C,NULL))!=0) return ret;
-	return __card_stopresponse(drv_no);
+	if((ret=__card_stopresponse(drv_no))!=0) return ret;
+
+	_ioStats[drv_no].sectors_read += num_sectors;
+	_ioStats[drv_no].read_ticks += (u32)(gettick() - start);
+	return CARDIO_ERROR_READY;
 }
 
 s32 sdgecko_writeSectors(s32 drv_no,u32 sector_no,u32 num_sectors,const void *buf)
 {
 	u32 i;
 	s32 ret;
+	u32 start;
 	u8 arg[4];
+	u8 *bounce = NULL;
 	char *ptr = (char*)buf;
 
 	if(drv_no<0 || drv_no>=MAX_DRIVE) return CARDIO_ERROR_NOCARD;
@@ -1387,6 +1289,7 @@ s32 sdgecko_writeSectors(s32 drv_no,u32 sector_no,u32 num_sectors,const void *bu
 		if((ret=__card_setblocklen(drv_no,_ioPageSize[drv_no]))!=0) return ret;
 	}
 
+	start = gettick();
 	// send SET_WRITE_BLK_ERASE_CNT cmd
 	arg[0] = (num_sectors>>24)&0xff;
 	arg[1] = (num_sectors>>16)&0xff;
@@ -1402,18 +1305,28 @@ s32 sdgecko_writeSectors(s32 drv_no,u32 sector_no,u32 num_sectors,const void *bu
 	if((ret=__card_sendcmd(drv_no,0x19,arg))!=0) return ret;
 	if((ret=__card_response1(drv_no))!=0) return ret;
 
+	if(_ioDMA[drv_no] && ((u32)ptr&0x1f)) bounce = sdgecko_allocBuffer();
+
 	for(i=0;i<num_sectors;i++) {
-		if((ret=__card_multidatawrite(drv_no,ptr,_ioPageSize[drv_no]))!=0) return ret;
+		if(bounce) memcpy(bounce,ptr,_ioPageSize[drv_no]);
+		if((ret=__card_multidatawrite(drv_no,bounce?bounce:(u8*)ptr,_ioPageSize[drv_no]))!=0) break;
 		if((ret=__card_dataresponse(drv_no))!=0) {
+			sdgecko_freeBuffer(bounce);
 			if((ret=__card_sendcmd(drv_no,0x0C,arg))!=0) return ret;
 			return __card_stopresponse(drv_no);
 		}
 		ptr += _ioPageSize[drv_no];
 	}
+	sdgecko_freeBuffer(bounce);
+	if(ret!=0) return ret;
 
 	if((ret=__card_multiwritestop(drv_no))!=0) return ret;
 	if((ret=__card_sendcmd(drv_no,0x0D,NULL))!=0) return ret;
-	return __card_response2(drv_no);
+	if((ret=__card_response2(drv_no))!=0) return ret;
+
+	_ioStats[drv_no].sectors_written += num_sectors;
+	_ioStats[drv_no].write_ticks += (u32)(gettick() - start);
+	return CARDIO_ERROR_READY;
 }
 
 s32 sdgecko_doUnmount(s32 drv_no)
@@ -1470,6 +1383,32 @@ s32 sdgecko_setPageSize(s32 drv_no, u32 size)
 	return __card_setblocklen(drv_no, _ioPageSize[drv_no]);
 }
 
+void sdgecko_setDMA(s32 drv_no, bool enable)
+{
+	if(drv_no<0 || drv_no>=MAX_DRIVE) return;
+	_ioDMA[drv_no] = enable;
+}
+
+void sdgecko_getStats(s32 drv_no, sdgecko_stats *stats)
+{
+	u64 ms;
+
+	if(drv_no<0 || drv_no>=MAX_DRIVE || stats==NULL) return;
+
+	memcpy(stats,&_ioStats[drv_no],sizeof(sdgecko_stats));
+
+	ms = stats->read_ticks/TB_TIMER_CLOCK;
+	stats->read_sps = ms ? (u32)((stats->sectors_read*1000)/ms) : 0;
+	ms = stats->write_ticks/TB_TIMER_CLOCK;
+	stats->write_sps = ms ? (u32)((stats->sectors_written*1000)/ms) : 0;
+}
+
+void sdgecko_resetStats(s32 drv_no)
+{
+	if(drv_no<0 || drv_no>=MAX_DRIVE) return;
+	memset(&_ioStats[drv_no],0,sizeof(sdgecko_stats));
+}
+
 card_addressing_type_t sdgecko_getAddressingType(s32 drv_no)
 {
 	return _ioAddressingType[drv_no];
@@ -46,7 +46,7 @@ distribution.
 
 #define ROUNDDOWN32(v)				(((u32)(v)-0x1f)&~0x1f)
 
-#define	HEAP_SIZE					(18*1024)
+#define	HEAP_SIZE					((18 + 16*(USBSTORAGE_PIPE_DEPTH - 1))*1024)
 #define	TAG_START					0x0BADC0DE
 
 #define	CBW_SIZE					31
@@ -196,6 +196,7 @@ static s32 __USB_CtrlMsgTimeout(usbstorage_handle *dev, u8 bmRequestType, u8 bmR
 
 static u8 *arena_ptr=NULL;
 static u8 *cbw_buffer=NULL;
+static u8 *csw_buffer=NULL;
 
 s32 USBStorage_Initialize(void)
 {
@@ -215,16 +216,68 @@ s32 USBStorage_Initialize(void)
 		SYS_SetArena2Hi(arena_ptr);
 	}
 	__lwp_heap_init(&__heap, arena_ptr, HEAP_SIZE, 32);
-	cbw_buffer=(u8*)__lwp_heap_allocate(&__heap, 32);
+	cbw_buffer=(u8*)__lwp_heap_allocate(&__heap, 64);
+	csw_buffer=cbw_buffer + 32;
 	__inited = true;
 	_CPU_ISR_Restore(level);
 	return IPC_OK;
 }
 
-static s32 __send_cbw(usbstorage_handle *dev, u8 lun, u32 len, u8 flags, const u8 *cb, u8 cbLen)
+static s32 __usb_pipe_cb(s32 retval, void *arg)
 {
-	s32 retval = USBSTORAGE_OK;
+	*(vs32*)arg = retval;
+	LWP_ThreadBroadcast(__usbstorage_waitq);
+	return 0;
+}
+
+static s32 __usb_pipe_wait(usbstorage_handle *dev, vs32 *slot, u32 timeout)
+{
+	u32 level;
+	s32 retval;
+
+	__usb_settimeout(dev, timeout);
+
+	_CPU_ISR_Disable(level);
+	while(*slot==USBSTORAGE_PROCESSING && dev->retval!=USBSTORAGE_ETIMEDOUT)
+		LWP_ThreadSleep(__usbstorage_waitq);
+	retval = *slot;
+	_CPU_ISR_Restore(level);
+
+	SYS_CancelAlarm(dev->alarm);
+	if(retval==USBSTORAGE_PROCESSING) return USBSTORAGE_ETIMEDOUT;
+	return retval;
+}
+
+static s32 __usb_pipe_submit(usbstorage_handle *dev, vs32 *slot, u8 ep, u32 len, void *buffer)
+{
+	s32 retval;
+
+	*slot = USBSTORAGE_PROCESSING;
+	retval = USB_WriteBlkMsgAsync(dev->usb_fd, ep, len, buffer, __usb_pipe_cb, (void*)slot);
+	if(retval < 0) *slot = retval;
 
+	return retval;
+}
+
+/* Wait until IOS has answered a request that may still be queued. A pipe
+ * wait that timed out leaves dev->retval at USBSTORAGE_ETIMEDOUT, so it is
+ * re-armed for every round, and the endpoints are cancelled again while
+ * the request is held. Only then may its buffer and retval slot be reused.
+ */
+static void __usb_pipe_flush(usbstorage_handle *dev, vs32 *slot)
+{
+	while(*slot==USBSTORAGE_PROCESSING) {
+		dev->retval = USBSTORAGE_PROCESSING;
+		__usb_pipe_wait(dev, slot, usbtimeout);
+		if(*slot!=USBSTORAGE_PROCESSING) break;
+
+		USB_ClearHalt(dev->usb_fd, dev->ep_in);
+		USB_ClearHalt(dev->usb_fd, dev->ep_out);
+	}
+}
+
+static s32 __send_cbw(usbstorage_handle *dev, u8 lun, u32 len, u8 flags, const u8 *cb, u8 cbLen)
+{
 	if(cbLen == 0 || cbLen > 16)
 		return IPC_EINVAL;
 
@@ -245,12 +298,7 @@ static s32 __send_cbw(usbstorage_handle *dev, u8 lun, u32 len, u8 flags, const u
 		dev->suspended = 0;
 	}
 
-	retval = __USB_BlkMsgTimeout(dev, dev->ep_out, CBW_SIZE, (void *)cbw_buffer, usbtimeout);
-
-	if(retval == CBW_SIZE) return USBSTORAGE_OK;
-	else if(retval > 0) return USBSTORAGE_ESHORTWRITE;
-
-	return retval;
+	return __usb_pipe_submit(dev, &dev->cbw_retval, dev->ep_out, CBW_SIZE, cbw_buffer);
 }
 
 static s32 __read_csw(usbstorage_handle *dev, u8 *status, u32 *dataResidue, u32 timeout)
@@ -258,16 +306,14 @@ static s32 __read_csw(usbstorage_handle *dev, u8 *status, u32 *dataResidue, u32
 	s32 retval = USBSTORAGE_OK;
 	u32 signature, tag, _dataResidue, _status;
 
-	memset(cbw_buffer, 0, CSW_SIZE);
-
-	retval = __USB_BlkMsgTimeout(dev, dev->ep_in, CSW_SIZE, cbw_buffer, timeout);
+	retval = __usb_pipe_wait(dev, &dev->csw_retval, timeout);
 	if(retval > 0 && retval != CSW_SIZE) return USBSTORAGE_ESHORTREAD;
 	else if(retval < 0) return retval;
 
-	signature = __lwbrx(cbw_buffer, 0);
-	tag = __lwbrx(cbw_buffer, 4);
-	_dataResidue = __lwbrx(cbw_buffer, 8);
-	_status = cbw_buffer[12];
+	signature = __lwbrx(csw_buffer, 0);
+	tag = __lwbrx(csw_buffer, 4);
+	_dataResidue = __lwbrx(csw_buffer, 8);
+	_status = csw_buffer[12];
 
 	if(signature != CSW_SIGNATURE) return USBSTORAGE_ESIGNATURE;
 
@@ -281,6 +327,35 @@ static s32 __read_csw(usbstorage_handle *dev, u8 *status, u32 *dataResidue, u32
 	return USBSTORAGE_OK;
 }
 
+static void __update_stats(usbstorage_handle *dev, u32 len, u8 write, u64 ticks, s32 retval)
+{
+	u32 us = ticks_to_microsecs(ticks);
+	usbstorage_stats *st = &dev->stats;
+
+	st->commands++;
+	if(retval < 0) {
+		st->errors++;
+		return;
+	}
+
+	if(write) {
+		st->bytes_written += len;
+		st->write_ticks += ticks;
+	} else {
+		st->bytes_read += len;
+		st->read_ticks += ticks;
+	}
+
+	if(!st->latency_min || us < st->latency_min) st->latency_min = us;
+	if(us > st->latency_max) st->latency_max = us;
+	st->latency_avg = st->latency_avg ? (st->latency_avg - (st->latency_avg>>4) + (us>>4)) : us;
+}
+
+/* CBW, all data chunks and the CSW are queued to IOS back to back, up to
+ * USBSTORAGE_PIPE_DEPTH data chunks in flight. Chunks that can't be DMA'd
+ * directly (unaligned or outside MEM2) go through their own staging buffer
+ * so they pipeline as well.
+ */
 static s32 __cycle(usbstorage_handle *dev, u8 lun, u8 *buffer, u32 len, u8 *cb, u8 cbLen, u8 write, u8 *_status, u32 *_dataResidue)
 {
 	s32 retval = USBSTORAGE_OK;
@@ -290,53 +365,97 @@ static s32 __cycle(usbstorage_handle *dev, u8 lun, u8 *buffer, u32 len, u8 *cb,
 	u16 max_size;
 	u8 ep = write ? dev->ep_out : dev->ep_in;
 	s8 retries = USBSTORAGE_CYCLE_RETRIES + 1;
-	
+	u64 start;
+
 	if(usb2_mode)
 		max_size=MAX_TRANSFER_SIZE_V5;
 	else
 		max_size=MAX_TRANSFER_SIZE_V0;
 
 	LWP_MutexLock(dev->lock);
+	start = gettime();
 	do
 	{
 		u8 *_buffer = buffer;
 		u32 _len = len;
+		u32 issued = 0, done = 0, pending;
+		bool csw_queued = false;
+		usbstorage_xfer *x;
 		retries--;
 
 		if(retval == USBSTORAGE_ETIMEDOUT)
 			break;
 
+		dev->retval = USBSTORAGE_PROCESSING;
 		retval = __send_cbw(dev, lun, len, (write ? CBW_OUT:CBW_IN), cb, cbLen);
 
-		while(_len > 0 && retval >= 0)
+		while(retval >= 0)
 		{
-			u32 thisLen = _len > max_size ? max_size : _len;
-
-			if ((u32)_buffer&0x1F || !((u32)_buffer&0x10000000)) {
-				if (write) memcpy(dev->buffer, _buffer, thisLen);
-				retval = __USB_BlkMsgTimeout(dev, ep, thisLen, dev->buffer, usbtimeout);
-				if (!write && retval > 0)
-					memcpy(_buffer, dev->buffer, retval);
-			} else
-				retval = __USB_BlkMsgTimeout(dev, ep, thisLen, _buffer, usbtimeout);
-
-			if (retval == thisLen) {
-				_len -= retval;
-				_buffer += retval;
+			// keep the pipe filled
+			while(_len > 0 && (issued - done) < USBSTORAGE_PIPE_DEPTH)
+			{
+				u32 thisLen = _len > max_size ? max_size : _len;
+
+				x = &dev->xfer[issued%USBSTORAGE_PIPE_DEPTH];
+				x->len = thisLen;
+				x->dst = _buffer;
+				x->stage = NULL;
+				if ((u32)_buffer&0x1F || !((u32)_buffer&0x10000000)) {
+					x->stage = dev->pool[issued%USBSTORAGE_PIPE_DEPTH];
+					if (write) memcpy(x->stage, _buffer, thisLen);
+					dev->stats.staged++;
+				}
+
+				retval = __usb_pipe_submit(dev, &x->retval, ep, thisLen, x->stage ? x->stage : _buffer);
+				if (retval < 0) break;
+
+				issued++;
+				_len -= thisLen;
+				_buffer += thisLen;
+			}
+
+			if (retval >= 0 && _len == 0 && !csw_queued) {
+				memset(csw_buffer, 0, CSW_SIZE);
+				retval = __usb_pipe_submit(dev, &dev->csw_retval, dev->ep_in, CSW_SIZE, csw_buffer);
+				if (retval < 0) break;
+				csw_queued = true;
+			}
+
+			if (done == issued) break;
+
+			x = &dev->xfer[done%USBSTORAGE_PIPE_DEPTH];
+			retval = __usb_pipe_wait(dev, &x->retval, usbtimeout);
+			done++;
+			if (retval == x->len) {
+				if (!write && x->stage) memcpy(x->dst, x->stage, x->len);
 			}
 			else if (retval != USBSTORAGE_ETIMEDOUT)
 				retval = USBSTORAGE_EDATARESIDUE;
 		}
 
+		if (retval >= 0) {
+			retval = __usb_pipe_wait(dev, &dev->cbw_retval, usbtimeout);
+			if (retval > 0 && retval != CBW_SIZE) retval = USBSTORAGE_ESHORTWRITE;
+		}
+
 		if (retval >= 0)
 			retval = __read_csw(dev, &status, &dataResidue, usbtimeout);
 
 		if (retval < 0) {
+			// nothing may still target our buffers or slots once we retry or leave
+			USB_ClearHalt(dev->usb_fd, dev->ep_in);
+			USB_ClearHalt(dev->usb_fd, dev->ep_out);
+			for (pending = 0; pending < USBSTORAGE_PIPE_DEPTH; pending++)
+				__usb_pipe_flush(dev, &dev->xfer[pending].retval);
+			__usb_pipe_flush(dev, &dev->csw_retval);
+			__usb_pipe_flush(dev, &dev->cbw_retval);
+
 			if (__usbstorage_reset(dev) == USBSTORAGE_ETIMEDOUT)
 				retval = USBSTORAGE_ETIMEDOUT;
 		}
 	} while (retval < 0 && retries > 0);
 
+	__update_stats(dev, len, write, gettime() - start, retval);
 	LWP_MutexUnlock(dev->lock);
 
 	if(_status != NULL)
@@ -525,10 +644,15 @@ found:
 	//USB_ClearHalt(dev->usb_fd, dev->ep_in);
 	//USB_ClearHalt(dev->usb_fd, dev->ep_out);
 
-	if(!dev->buffer)
-		dev->buffer = __lwp_heap_allocate(&__heap, MAX_TRANSFER_SIZE_V5);
+	for (iEp = 0; iEp < USBSTORAGE_PIPE_DEPTH; iEp++) {
+		if(!dev->pool[iEp])
+			dev->pool[iEp] = __lwp_heap_allocate(&__heap, MAX_TRANSFER_SIZE_V5);
+		if(!dev->pool[iEp])
+			break;
+	}
+	dev->buffer = dev->pool[0];
 
-	if(!dev->buffer) {
+	if(iEp < USBSTORAGE_PIPE_DEPTH) {
 		retval = IPC_ENOMEM;
 	} else {
 		USB_DeviceRemovalNotifyAsync(dev->usb_fd,__usb_deviceremoved_cb,dev);
@@ -549,6 +673,8 @@ free_and_return:
 
 s32 USBStorage_Close(usbstorage_handle *dev)
 {
+	u32 i;
+
 	__mounted = false;
 	__lun = 0;
 	__vid = 0;
@@ -563,8 +689,10 @@ s32 USBStorage_Close(usbstorage_handle *dev)
 	if(dev->sector_size)
 		free(dev->sector_size);
 
-	if (dev->buffer)
-		__lwp_heap_free(&__heap, dev->buffer);
+	for (i = 0; i < USBSTORAGE_PIPE_DEPTH; i++) {
+		if (dev->pool[i])
+			__lwp_heap_free(&__heap, dev->pool[i]);
+	}
 
 	memset(dev, 0, sizeof(*dev));
 	dev->usb_fd = -1;
@@ -792,6 +920,31 @@ s32 USBStorage_Write(usbstorage_handle *dev, u8 lun, u32 sector, u16 n_sectors,
 	return retval;
 }
 
+void USBStorage_GetStats(usbstorage_handle *dev, usbstorage_stats *stats)
+{
+	u32 us;
+
+	if(!dev || !stats) return;
+
+	LWP_MutexLock(dev->lock);
+	memcpy(stats, &dev->stats, sizeof(usbstorage_stats));
+	LWP_MutexUnlock(dev->lock);
+
+	us = ticks_to_microsecs(stats->read_ticks);
+	stats->read_mbps = us ? (f32)stats->bytes_read/us : 0.0f;
+	us = ticks_to_microsecs(stats->write_ticks);
+	stats->write_mbps = us ? (f32)stats->bytes_written/us : 0.0f;
+}
+
+void USBStorage_ResetStats(usbstorage_handle *dev)
+{
+	if(!dev) return;
+
+	LWP_MutexLock(dev->lock);
+	memset(&dev->stats, 0, sizeof(usbstorage_stats));
+	LWP_MutexUnlock(dev->lock);
+}
+
 s32 USBStorage_Suspend(usbstorage_handle *dev)
 {
 	if(dev->suspended == 1)
@@ -923,25 +1076,48 @@ static bool __usbstorage_IsInserted(void)
 static bool __usbstorage_ReadSectors(sec_t sector, sec_t numSectors, void *buffer)
 {
 	s32 retval;
+	u16 count;
+	u8 *ptr = buffer;
 
 	if (!__mounted)
 		return false;
 
-	retval = USBStorage_Read(&__usbfd, __lun, sector, numSectors, buffer);
+	// READ(10) carries a 16 bit sector count
+	while (numSectors > 0) {
+		count = numSectors > 0xffff ? 0xffff : numSectors;
+		retval = USBStorage_Read(&__usbfd, __lun, sector, count, ptr);
+		if (retval < 0)
+			return false;
+
+		sector += count;
+		numSectors -= count;
+		ptr += count * __usbfd.sector_size[__lun];
+	}
 
-	return retval >= 0;
+	return true;
 }
 
 static bool __usbstorage_WriteSectors(sec_t sector, sec_t numSectors, const void *buffer)
 {
 	s32 retval;
+	u16 count;
+	const u8 *ptr = buffer;
 
 	if (!__mounted)
 		return false;
 
-	retval = USBStorage_Write(&__usbfd, __lun, sector, numSectors, buffer);
+	while (numSectors > 0) {
+		count = numSectors > 0xffff ? 0xffff : numSectors;
+		retval = USBStorage_Write(&__usbfd, __lun, sector, count, ptr);
+		if (retval < 0)
+			return false;
 
-	return retval >= 0;
+		sector += count;
+		numSectors -= count;
+		ptr += count * __usbfd.sector_size[__lun];
+	}
+
+	return true;
 }
 
 static bool __usbstorage_ClearStatus(void)
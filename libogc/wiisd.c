@@ -42,6 +42,7 @@
 #include <unistd.h>
 #include <ogc/disc_io.h>
 #include <sdcard/wiisd_io.h>
+#include <ogc/lwp_watchdog.h>
 
 #include <asm.h>
 #include <processor.h>
@@ -118,6 +119,9 @@
 #define WRITE_BL_LEN				((u8)(((__sd0_csd[12]&0x03)<<2)|((__sd0_csd[13]>>6)&0x03)))
 
 static u8 *rw_buffer = NULL;
+static u8 *bounce_pool = NULL;
+static u32 bounce_secs = WIISD_BOUNCE_DEFAULT;
+static wiisd_stats __sd0_stats;
 
 struct _sdiorequest
 {
@@ -547,82 +551,148 @@ static bool sdio_Shutdown(void)
 	return true;
 }
 
+static s32 __sd0_rwcommand(u32 cmd,sec_t sector,u32 cnt,void *buffer)
+{
+	s32 ret;
+
+	if(__sd0_sdhc == 0) sector *= PAGE_SIZE512;
+	ret = __sdio_sendcommand(cmd,SDIOCMD_TYPE_AC,SDIO_RESPONSE_R1,sector,cnt,PAGE_SIZE512,buffer,NULL,0);
+
+	__sd0_stats.commands++;
+	if(ret<0) __sd0_stats.errors++;
+	return ret;
+}
+
+static u8* __sd0_bouncebuffer(void)
+{
+	if(bounce_pool) return bounce_pool;
+	return rw_buffer;
+}
+
 static bool sdio_ReadSectors(sec_t sector, sec_t numSectors,void* buffer)
 {
 	s32 ret;
 	u8 *ptr;
-	sec_t blk_off;
+	u32 off,cnt;
+	u64 start;
  
 	if(buffer==NULL) return false;
  
 	ret = __sd0_select();
 	if(ret<0) return false;
 
-	if((u32)buffer & 0x1F) {
-		ptr = (u8*)buffer;
-		int secs_to_read;
-		while(numSectors>0) {
-			if(__sd0_sdhc == 0) blk_off = (sector*PAGE_SIZE512);
-			else blk_off = sector;
-			if(numSectors > 8)secs_to_read = 8;
-			else secs_to_read = numSectors;
-			ret = __sdio_sendcommand(SDIO_CMD_READMULTIBLOCK,SDIOCMD_TYPE_AC,SDIO_RESPONSE_R1,blk_off,secs_to_read,PAGE_SIZE512,rw_buffer,NULL,0);
-			if(ret>=0) {
-				memcpy(ptr,rw_buffer,PAGE_SIZE512*secs_to_read);
-				ptr += PAGE_SIZE512*secs_to_read;
-				sector+=secs_to_read;
-				numSectors-=secs_to_read;
-			} else
-				break;
+	start = gettime();
+	ptr = (u8*)buffer;
+	off = (u32)buffer&0x1F;
+	if(off && numSectors>1) {
+		// DMA all but the last sector to the first aligned address inside
+		// the caller's buffer and slide it down, the tail is bounced.
+		cnt = numSectors - 1;
+		ret = __sd0_rwcommand(SDIO_CMD_READMULTIBLOCK,sector,cnt,ptr + (32 - off));
+		if(ret>=0) {
+			memmove(ptr,ptr + (32 - off),cnt*PAGE_SIZE512);
+			ptr += cnt*PAGE_SIZE512;
+			sector += cnt;
+			numSectors -= cnt;
 		}
-	} else {
-		if(__sd0_sdhc == 0) sector *= PAGE_SIZE512;
-		ret = __sdio_sendcommand(SDIO_CMD_READMULTIBLOCK,SDIOCMD_TYPE_AC,SDIO_RESPONSE_R1,sector,numSectors,PAGE_SIZE512,buffer,NULL,0);
 	}
 
+	if(ret>=0 && off) {
+		ret = __sd0_rwcommand(SDIO_CMD_READMULTIBLOCK,sector,numSectors,rw_buffer);
+		if(ret>=0) {
+			memcpy(ptr,rw_buffer,PAGE_SIZE512*numSectors);
+			__sd0_stats.bytes_bounced += PAGE_SIZE512*numSectors;
+		}
+	} else if(ret>=0)
+		ret = __sd0_rwcommand(SDIO_CMD_READMULTIBLOCK,sector,numSectors,ptr);
+
 	__sd0_deselect();
- 
+
+	if(ret>=0) {
+		__sd0_stats.bytes_read += (u64)((ptr - (u8*)buffer) + numSectors*PAGE_SIZE512);
+		__sd0_stats.read_ticks += gettime() - start;
+	}
 	return (ret>=0);
 }
 
 static bool sdio_WriteSectors(sec_t sector, sec_t numSectors,const void* buffer)
 {
 	s32 ret;
-	u8 *ptr;
-	u32 blk_off;
+	const u8 *ptr;
+	u8 *bounce;
+	u32 secs_to_write;
+	u64 start;
+	sec_t total = numSectors;
  
 	if(buffer==NULL) return false;
  
 	ret = __sd0_select();
 	if(ret<0) return false;
 
+	start = gettime();
 	if((u32)buffer & 0x1F) {
-		ptr = (u8*)buffer;
-		int secs_to_write;
+		ptr = (const u8*)buffer;
+		bounce = __sd0_bouncebuffer();
 		while(numSectors>0) {
-			if(__sd0_sdhc == 0) blk_off = (sector*PAGE_SIZE512);
-			else blk_off = sector;
-			if(numSectors > 8)secs_to_write = 8;
+			if(numSectors > bounce_secs) secs_to_write = bounce_secs;
 			else secs_to_write = numSectors;
-			memcpy(rw_buffer,ptr,PAGE_SIZE512*secs_to_write);
-			ret = __sdio_sendcommand(SDIO_CMD_WRITEMULTIBLOCK,SDIOCMD_TYPE_AC,SDIO_RESPONSE_R1,blk_off,secs_to_write,PAGE_SIZE512,rw_buffer,NULL,0);
+			memcpy(bounce,ptr,PAGE_SIZE512*secs_to_write);
+			ret = __sd0_rwcommand(SDIO_CMD_WRITEMULTIBLOCK,sector,secs_to_write,bounce);
 			if(ret>=0) {
+				__sd0_stats.bytes_bounced += PAGE_SIZE512*secs_to_write;
 				ptr += PAGE_SIZE512*secs_to_write;
 				sector+=secs_to_write;
 				numSectors-=secs_to_write;
 			} else
 				break;
 		}
-	} else {
-		if(__sd0_sdhc == 0) sector *= PAGE_SIZE512;
-		ret = __sdio_sendcommand(SDIO_CMD_WRITEMULTIBLOCK,SDIOCMD_TYPE_AC,SDIO_RESPONSE_R1,sector,numSectors,PAGE_SIZE512,(char *)buffer,NULL,0);
-	}
+	} else
+		ret = __sd0_rwcommand(SDIO_CMD_WRITEMULTIBLOCK,sector,numSectors,(void*)buffer);
 
 	__sd0_deselect();
- 
+
+	if(ret>=0) {
+		__sd0_stats.bytes_written += (u64)total*PAGE_SIZE512;
+		__sd0_stats.write_ticks += gettime() - start;
+	}
 	return (ret>=0);
 }
 
+bool WIISD_SetBouncePool(u32 sectors)
+{
+	u8 *pool = NULL;
+
+	if(sectors>WIISD_BOUNCE_DEFAULT) {
+		pool = memalign(32,sectors*PAGE_SIZE512);
+		if(pool==NULL) return false;
+	} else
+		sectors = WIISD_BOUNCE_DEFAULT;
+
+	if(bounce_pool) free(bounce_pool);
+	bounce_pool = pool;
+	bounce_secs = sectors;
+	return true;
+}
+
+void WIISD_GetStats(wiisd_stats *stats)
+{
+	u32 us;
+
+	if(stats==NULL) return;
+
+	memcpy(stats,&__sd0_stats,sizeof(wiisd_stats));
+
+	us = ticks_to_microsecs(stats->read_ticks);
+	stats->read_mbps = us ? (f32)stats->bytes_read/us : 0.0f;
+	us = ticks_to_microsecs(stats->write_ticks);
+	stats->write_mbps = us ? (f32)stats->bytes_written/us : 0.0f;
+}
+
+void WIISD_ResetStats(void)
+{
+	memset(&__sd0_stats,0,sizeof(wiisd_stats));
+}
+
 static bool sdio_ClearStatus(void)
 {
 	return true;
@@ -0,0 +1,274 @@
+/****************************************************************************
+ * TinySMB
+ * Nintendo Wii/GameCube SMB implementation
+ *
+ * MD5 message digest and HMAC-MD5
+ ****************************************************************************/
+
+#include <stdint.h>
+#include <string.h>
+
+/* Structure to save state of computation between the single steps.  */
+struct md5_ctx
+{
+	uint32_t A;
+	uint32_t B;
+	uint32_t C;
+	uint32_t D;
+
+	uint32_t total[2];
+	uint32_t buflen;
+	unsigned char buffer[64];
+};
+
+# define MD5_DIGEST_SIZE 16
+# define MD5_BLOCK_SIZE 64
+
+/* Round functions.  */
+#define F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define G(x, y, z) F(z, x, y)
+#define H(x, y, z) ((x) ^ (y) ^ (z))
+#define I(x, y, z) ((y) ^ ((x) | ~(z)))
+#define rol(x, n) (((x) << (n)) | ((uint32_t) (x) >> (32 - (n))))
+#define STEP(f,a,b,c,d,k,s,t) a=b+rol(a+f(b,c,d)+x[k]+t,s);
+
+/* This array contains the bytes used to pad the buffer to the next
+ 64-byte boundary.  (RFC 1321, 3.1: Step 1)  */
+static const unsigned char fillbuf[64] =
+{ 0x80, 0 /* , 0, 0, ...  */};
+
+static inline uint32_t get_uint32le(const unsigned char *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void set_uint32le(unsigned char *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+/* Initialize structure containing state of computation.
+ (RFC 1321, 3.3: Step 3)  */
+static void md5_init_ctx(struct md5_ctx *ctx)
+{
+	ctx->A = 0x67452301;
+	ctx->B = 0xefcdab89;
+	ctx->C = 0x98badcfe;
+	ctx->D = 0x10325476;
+
+	ctx->total[0] = ctx->total[1] = 0;
+	ctx->buflen = 0;
+}
+
+/* Process one 64 byte block. The words are always read little endian,
+ so this works regardless of the host byte order.  */
+static void md5_process_block(const unsigned char *block, struct md5_ctx *ctx)
+{
+	uint32_t x[16];
+	uint32_t A = ctx->A;
+	uint32_t B = ctx->B;
+	uint32_t C = ctx->C;
+	uint32_t D = ctx->D;
+	int i;
+
+	for (i = 0; i < 16; i++)
+		x[i] = get_uint32le(&block[i * 4]);
+
+	/* Round 1.  */
+	STEP(F, A, B, C, D, 0, 7, 0xd76aa478)
+	STEP(F, D, A, B, C, 1, 12, 0xe8c7b756)
+	STEP(F, C, D, A, B, 2, 17, 0x242070db)
+	STEP(F, B, C, D, A, 3, 22, 0xc1bdceee)
+	STEP(F, A, B, C, D, 4, 7, 0xf57c0faf)
+	STEP(F, D, A, B, C, 5, 12, 0x4787c62a)
+	STEP(F, C, D, A, B, 6, 17, 0xa8304613)
+	STEP(F, B, C, D, A, 7, 22, 0xfd469501)
+	STEP(F, A, B, C, D, 8, 7, 0x698098d8)
+	STEP(F, D, A, B, C, 9, 12, 0x8b44f7af)
+	STEP(F, C, D, A, B, 10, 17, 0xffff5bb1)
+	STEP(F, B, C, D, A, 11, 22, 0x895cd7be)
+	STEP(F, A, B, C, D, 12, 7, 0x6b901122)
+	STEP(F, D, A, B, C, 13, 12, 0xfd987193)
+	STEP(F, C, D, A, B, 14, 17, 0xa679438e)
+	STEP(F, B, C, D, A, 15, 22, 0x49b40821)
+
+	/* Round 2.  */
+	STEP(G, A, B, C, D, 1, 5, 0xf61e2562)
+	STEP(G, D, A, B, C, 6, 9, 0xc040b340)
+	STEP(G, C, D, A, B, 11, 14, 0x265e5a51)
+	STEP(G, B, C, D, A, 0, 20, 0xe9b6c7aa)
+	STEP(G, A, B, C, D, 5, 5, 0xd62f105d)
+	STEP(G, D, A, B, C, 10, 9, 0x02441453)
+	STEP(G, C, D, A, B, 15, 14, 0xd8a1e681)
+	STEP(G, B, C, D, A, 4, 20, 0xe7d3fbc8)
+	STEP(G, A, B, C, D, 9, 5, 0x21e1cde6)
+	STEP(G, D, A, B, C, 14, 9, 0xc33707d6)
+	STEP(G, C, D, A, B, 3, 14, 0xf4d50d87)
+	STEP(G, B, C, D, A, 8, 20, 0x455a14ed)
+	STEP(G, A, B, C, D, 13, 5, 0xa9e3e905)
+	STEP(G, D, A, B, C, 2, 9, 0xfcefa3f8)
+	STEP(G, C, D, A, B, 7, 14, 0x676f02d9)
+	STEP(G, B, C, D, A, 12, 20, 0x8d2a4c8a)
+
+	/* Round 3.  */
+	STEP(H, A, B, C, D, 5, 4, 0xfffa3942)
+	STEP(H, D, A, B, C, 8, 11, 0x8771f681)
+	STEP(H, C, D, A, B, 11, 16, 0x6d9d6122)
+	STEP(H, B, C, D, A, 14, 23, 0xfde5380c)
+	STEP(H, A, B, C, D, 1, 4, 0xa4beea44)
+	STEP(H, D, A, B, C, 4, 11, 0x4bdecfa9)
+	STEP(H, C, D, A, B, 7, 16, 0xf6bb4b60)
+	STEP(H, B, C, D, A, 10, 23, 0xbebfbc70)
+	STEP(H, A, B, C, D, 13, 4, 0x289b7ec6)
+	STEP(H, D, A, B, C, 0, 11, 0xeaa127fa)
+	STEP(H, C, D, A, B, 3, 16, 0xd4ef3085)
+	STEP(H, B, C, D, A, 6, 23, 0x04881d05)
+	STEP(H, A, B, C, D, 9, 4, 0xd9d4d039)
+	STEP(H, D, A, B, C, 12, 11, 0xe6db99e5)
+	STEP(H, C, D, A, B, 15, 16, 0x1fa27cf8)
+	STEP(H, B, C, D, A, 2, 23, 0xc4ac5665)
+
+	/* Round 4.  */
+	STEP(I, A, B, C, D, 0, 6, 0xf4292244)
+	STEP(I, D, A, B, C, 7, 10, 0x432aff97)
+	STEP(I, C, D, A, B, 14, 15, 0xab9423a7)
+	STEP(I, B, C, D, A, 5, 21, 0xfc93a039)
+	STEP(I, A, B, C, D, 12, 6, 0x655b59c3)
+	STEP(I, D, A, B, C, 3, 10, 0x8f0ccc92)
+	STEP(I, C, D, A, B, 10, 15, 0xffeff47d)
+	STEP(I, B, C, D, A, 1, 21, 0x85845dd1)
+	STEP(I, A, B, C, D, 8, 6, 0x6fa87e4f)
+	STEP(I, D, A, B, C, 15, 10, 0xfe2ce6e0)
+	STEP(I, C, D, A, B, 6, 15, 0xa3014314)
+	STEP(I, B, C, D, A, 13, 21, 0x4e0811a1)
+	STEP(I, A, B, C, D, 4, 6, 0xf7537e82)
+	STEP(I, D, A, B, C, 11, 10, 0xbd3af235)
+	STEP(I, C, D, A, B, 2, 15, 0x2ad7d2bb)
+	STEP(I, B, C, D, A, 9, 21, 0xeb86d391)
+
+	ctx->A += A;
+	ctx->B += B;
+	ctx->C += C;
+	ctx->D += D;
+}
+
+static void md5_process_bytes(const void *buffer, size_t len, struct md5_ctx *ctx)
+{
+	const unsigned char *p = buffer;
+	size_t add;
+
+	/* Update the 64 bit byte counter.  */
+	ctx->total[0] += len;
+	if (ctx->total[0] < len)
+		++ctx->total[1];
+
+	if (ctx->buflen != 0)
+	{
+		add = MD5_BLOCK_SIZE - ctx->buflen;
+		if (add > len)
+			add = len;
+
+		memcpy(&ctx->buffer[ctx->buflen], p, add);
+		ctx->buflen += add;
+		p += add;
+		len -= add;
+
+		if (ctx->buflen < MD5_BLOCK_SIZE)
+			return;
+
+		md5_process_block(ctx->buffer, ctx);
+		ctx->buflen = 0;
+	}
+
+	while (len >= MD5_BLOCK_SIZE)
+	{
+		md5_process_block(p, ctx);
+		p += MD5_BLOCK_SIZE;
+		len -= MD5_BLOCK_SIZE;
+	}
+
+	if (len > 0)
+	{
+		memcpy(ctx->buffer, p, len);
+		ctx->buflen = len;
+	}
+}
+
+/* Process the remaining bytes in the internal buffer and write the
+ result, in little endian byte order, to RESBUF.  */
+static void *md5_finish_ctx(struct md5_ctx *ctx, void *resbuf)
+{
+	unsigned char *r = resbuf;
+	unsigned char bits[8];
+	uint32_t pad;
+
+	set_uint32le(&bits[0], ctx->total[0] << 3);
+	set_uint32le(&bits[4], (ctx->total[1] << 3) | (ctx->total[0] >> 29));
+
+	pad = (ctx->buflen < 56) ? (56 - ctx->buflen) : (120 - ctx->buflen);
+	md5_process_bytes(fillbuf, pad, ctx);
+	md5_process_bytes(bits, 8, ctx);
+
+	set_uint32le(r + 0, ctx->A);
+	set_uint32le(r + 4, ctx->B);
+	set_uint32le(r + 8, ctx->C);
+	set_uint32le(r + 12, ctx->D);
+
+	return resbuf;
+}
+
+/* Compute MD5 message digest for LEN bytes beginning at BUFFER.  The
+ result is always in little endian byte order, so that a byte-wise
+ output yields to the wanted ASCII representation of the message
+ digest.  */
+void *md5_buffer(const char *buffer, size_t len, void *resblock)
+{
+	struct md5_ctx ctx;
+
+	md5_init_ctx(&ctx);
+	md5_process_bytes(buffer, len, &ctx);
+	return md5_finish_ctx(&ctx, resblock);
+}
+
+/* HMAC-MD5 as described in RFC 2104. RESBUF receives 16 bytes.  */
+void hmac_md5(const unsigned char *key, size_t keylen, const unsigned char *data, size_t len, unsigned char *resbuf)
+{
+	struct md5_ctx ctx;
+	unsigned char keyhash[MD5_DIGEST_SIZE];
+	unsigned char pad[MD5_BLOCK_SIZE];
+	unsigned char inner[MD5_DIGEST_SIZE];
+	size_t i;
+
+	if (keylen > MD5_BLOCK_SIZE)
+	{
+		md5_buffer((const char *) key, keylen, keyhash);
+		key = keyhash;
+		keylen = MD5_DIGEST_SIZE;
+	}
+
+	memset(pad, 0x36, sizeof(pad));
+	for (i = 0; i < keylen; i++)
+		pad[i] ^= key[i];
+
+	md5_init_ctx(&ctx);
+	md5_process_bytes(pad, MD5_BLOCK_SIZE, &ctx);
+	md5_process_bytes(data, len, &ctx);
+	md5_finish_ctx(&ctx, inner);
+
+	memset(pad, 0x5c, sizeof(pad));
+	for (i = 0; i < keylen; i++)
+		pad[i] ^= key[i];
+
+	md5_init_ctx(&ctx);
+	md5_process_bytes(pad, MD5_BLOCK_SIZE, &ctx);
+	md5_process_bytes(inner, MD5_DIGEST_SIZE, &ctx);
+	md5_finish_ctx(&ctx, resbuf);
+
+	/* with security is best be pedantic */
+	memset(pad, 0, sizeof(pad));
+	memset(inner, 0, sizeof(inner));
+	memset(keyhash, 0, sizeof(keyhash));
+}
@@ -7,6 +7,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include <unistd.h>
 #include <ogc/machine/processor.h>
 #include <stdint.h>
@@ -18,6 +19,7 @@ typedef struct
 } gl_des_ctx;
 
 extern void *md4_buffer(const char *buffer, size_t len, void *resblock);
+extern void hmac_md5(const unsigned char *key, size_t keylen, const unsigned char *data, size_t len, unsigned char *resbuf);
 extern void gl_des_setkey(gl_des_ctx *ctx, const char * key);
 extern void gl_des_ecb_encrypt(gl_des_ctx *ctx, const char * from, char * to);
 
@@ -95,3 +97,59 @@ void ntlm_smb_nt_encrypt(const char *passwd, const u8 * challenge, u8 * answer)
 	memset(hash, 0, sizeof(hash));
 	memset(nt_pw, 0, sizeof(nt_pw));
 }
+
+/*
+ * NTLMv2 response as used by NTLMSSP: HMAC-MD5 of the server challenge
+ * and the client blob, keyed with NTOWFv2, followed by the blob itself.
+ * answer must hold 16+bloblen bytes.
+ */
+void ntlm_smb_ntlmv2_encrypt(const char *user, const char *domain, const char *passwd,
+		const u8 * challenge, const u8 * blob, size_t bloblen, u8 * answer)
+{
+	size_t len, i, j;
+	unsigned char hash[16];
+	unsigned char ntowf[16];
+	unsigned char nt_pw[256];
+	unsigned char *buf;
+
+	/* NTOWFv2 = HMAC-MD5(MD4(password), UPPER(user) + domain) */
+	len = strlen(passwd);
+	if (len > 128)
+		len = 128;
+	for (i = 0; i < len; ++i)
+	{
+		nt_pw[2 * i] = passwd[i];
+		nt_pw[2 * i + 1] = 0;
+	}
+	md4_buffer((const char *) nt_pw, len * 2, hash);
+
+	for (i = 0, j = 0; user[i] != 0 && j < sizeof(nt_pw) - 2; ++i)
+	{
+		nt_pw[j++] = toupper((int) to_uchar(user[i]));
+		nt_pw[j++] = 0;
+	}
+	for (i = 0; domain[i] != 0 && j < sizeof(nt_pw) - 2; ++i)
+	{
+		nt_pw[j++] = domain[i];
+		nt_pw[j++] = 0;
+	}
+	hmac_md5(hash, 16, nt_pw, j, ntowf);
+
+	/* NTProofStr = HMAC-MD5(NTOWFv2, challenge + blob) */
+	buf = malloc(8 + bloblen);
+	if (buf)
+	{
+		memcpy(buf, challenge, 8);
+		memcpy(buf + 8, blob, bloblen);
+		hmac_md5(ntowf, 16, buf, 8 + bloblen, answer);
+		free(buf);
+	}
+	else
+		memset(answer, 0, 16);
+	memcpy(answer + 16, blob, bloblen);
+
+	/* with security is best be pedantic */
+	memset(hash, 0, sizeof(hash));
+	memset(ntowf, 0, sizeof(ntowf));
+	memset(nt_pw, 0, sizeof(nt_pw));
+}
@@ -50,6 +50,7 @@
 #include <sys/statvfs.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <time.h>
 #include <smb.h>
 
 #define IOS_O_NONBLOCK				0x04
@@ -137,15 +138,124 @@
 #define T2_SUB_CMD				    (T2_SSETUP_CNT+2)
 #define T2_BYTE_CNT				    (T2_SUB_CMD+2)
 
+/**
+ * SMB2
+ */
+#define SMB2_PROTO					0x424d53fe
+#define SMB2_HEADER_SIZE			64
+#define SMB2_OFFSET_CREDITCHARGE	6
+#define SMB2_OFFSET_STATUS			8
+#define SMB2_OFFSET_CMD				12
+#define SMB2_OFFSET_CREDITS			14
+#define SMB2_OFFSET_FLAGS			16
+#define SMB2_OFFSET_NEXTCMD			20
+#define SMB2_OFFSET_MID				24
+#define SMB2_OFFSET_PID				32
+#define SMB2_OFFSET_TID				36
+#define SMB2_OFFSET_SESSID			40
+
+#define SMB2_NEGOTIATE				0x00
+#define SMB2_SESSION_SETUP			0x01
+#define SMB2_TREE_CONNECT			0x03
+#define SMB2_CREATE					0x05
+#define SMB2_CLOSE					0x06
+#define SMB2_READ					0x08
+#define SMB2_WRITE					0x09
+#define SMB2_QUERY_DIRECTORY		0x0e
+#define SMB2_QUERY_INFO				0x10
+#define SMB2_SET_INFO				0x11
+
+#define SMB2_FLAGS_ASYNC			0x00000002
+#define SMB2_FLAGS_RELATED			0x00000004
+
+#define SMB2_DIALECT_0202			0x0202
+#define SMB2_DIALECT_0210			0x0210
+#define SMB2_DIALECT_WILDCARD		0x02ff
+#define SMB2_CAP_LARGE_MTU			0x00000004
+#define SMB2_SIGNING_REQUIRED		0x0002
+
+#define STATUS_PENDING				0x00000103
+#define STATUS_NO_MORE_FILES		0x80000006
+#define STATUS_END_OF_FILE			0xc0000011
+#define STATUS_MORE_PROCESSING		0xc0000016
+
+#define SMB2_CREDITS_MAX			128		// stop asking for more once we hold this many
+#define SMB2_CREDITS_EXTRA			8
+#define SMB2_CREDIT_SIZE			65536
+#define SMB2_MAX_IO_SIZE			(256*1024)
+#define SMB2_DIRBUF_SIZE			(SMB_MAX_TRANSMIT_SIZE-SMB2_HEADER_SIZE-8)
+#define SMB2_CREATE_RESP_SIZE		160		// CREATE response without contexts, padded for the next one
+#define SMB2_CLOSE_RESP_SIZE		(SMB2_HEADER_SIZE+60)
+#define SMB2_COMPOUND_READ_MAX		(SMB_MAX_TRANSMIT_SIZE-SMB2_CREATE_RESP_SIZE-SMB2_HEADER_SIZE-16-8-SMB2_CLOSE_RESP_SIZE)
+
+/**
+ * SMB2 CREATE parameters
+ */
+#define FILE_READ_DATA				0x00000001
+#define FILE_LIST_DIRECTORY			0x00000001
+#define FILE_READ_ATTRIBUTES		0x00000080
+#define DELETE_ACCESS				0x00010000
+#define GENERIC_WRITE				0x40000000
+#define GENERIC_READ				0x80000000
+
+#define FILE_SHARE_READ				0x00000001
+#define FILE_SHARE_WRITE			0x00000002
+#define FILE_SHARE_DELETE			0x00000004
+
+#define FILE_OPEN					1
+#define FILE_CREATE					2
+#define FILE_OPEN_IF				3
+#define FILE_OVERWRITE				4
+#define FILE_OVERWRITE_IF			5
+
+#define FILE_DIRECTORY_FILE			0x00000001
+#define FILE_NON_DIRECTORY_FILE		0x00000040
+#define FILE_DELETE_ON_CLOSE		0x00001000
+
+#define FILE_ATTRIBUTE_NORMAL		0x00000080
+
+#define SMB2_0_INFO_FILE			1
+#define SMB2_0_INFO_FILESYSTEM		2
+#define FILE_BOTH_DIRECTORY_INFO	3
+#define FILE_RENAME_INFO			10
+#define FILE_FS_FULL_SIZE_INFO		7
+#define SMB2_RESTART_SCANS			0x01
+
+/**
+ * NTLMSSP
+ */
+#define NTLMSSP_NEGOTIATE_UNICODE	0x00000001
+#define NTLMSSP_REQUEST_TARGET		0x00000004
+#define NTLMSSP_NEGOTIATE_NTLM		0x00000200
+#define NTLMSSP_NEGOTIATE_ANONYMOUS	0x00000800
+#define NTLMSSP_NEGOTIATE_ALWAYS_SIGN	0x00008000
+#define NTLMSSP_NEGOTIATE_EXTENDED	0x00080000
+#define NTLMSSP_NEGOTIATE_TARGET_INFO	0x00800000
+#define NTLMSSP_NEGOTIATE_128		0x20000000
+#define NTLMSSP_NEGOTIATE_56		0x80000000
+#define NTLMSSP_FLAGS				(NTLMSSP_NEGOTIATE_UNICODE|NTLMSSP_REQUEST_TARGET|NTLMSSP_NEGOTIATE_NTLM| \
+									 NTLMSSP_NEGOTIATE_ALWAYS_SIGN|NTLMSSP_NEGOTIATE_EXTENDED|NTLMSSP_NEGOTIATE_TARGET_INFO| \
+									 NTLMSSP_NEGOTIATE_128|NTLMSSP_NEGOTIATE_56)
+#define NTLMSSP_AV_TIMESTAMP		7
+
 
 #define SMB_PROTO					0x424d53ff
 #define SMB_HANDLE_NULL				0xffffffff
 #define SMB_MAX_NET_READ_SIZE		(16*1024) // see smb_recv
 #define SMB_MAX_NET_WRITE_SIZE		4096 // see smb_sendv
 #define SMB_MAX_TRANSMIT_SIZE		65472
+#define SMB_MAX_LARGE_READ_SIZE		(120*1024) // NBT length is limited to 17 bits
+#define SMB_MAX_LARGE_WRITE_SIZE	(120*1024)
+#define SMB_PIPELINE_DEPTH			4
+#define SMB_PIPELINE_MAX			8
+
+#define READX_REPLY_SIZE			(SMB_HEADER_SIZE+27)
+#define WRITEX_REQUEST_SIZE			(SMB_HEADER_SIZE+31)
 
 #define CAP_LARGE_FILES				0x00000008  // 64-bit file sizes and offsets supported
 #define CAP_UNICODE					0x00000004  // Unicode supported
+#define CAP_LARGE_READX				0x00004000  // READ_ANDX may return more than MaxBuffer
+#define CAP_LARGE_WRITEX			0x00008000  // WRITE_ANDX may carry more than MaxBuffer
 #define	CIFS_FLAGS1					0x08 // Paths are caseless
 #define CIFS_FLAGS2_UNICODE			0x8001 // Server may return long components in paths in the response - use 0x8001 for Unicode support
 #define CIFS_FLAGS2					0x0001 // Server may return long components in paths in the response - use 0x0001 for ASCII support
@@ -175,6 +285,11 @@ struct _smbfile
 	lwp_node node;
 	u16 sfid;
 	SMBCONN conn;
+	u8 fileid[16];		// SMB2 file handle
+	u8 *dirbuf;			// SMB2 search, entries of the last QUERY_DIRECTORY
+	u32 dirlen;
+	u32 dirpos;
+	char *pattern;
 };
 
 /**
@@ -209,6 +324,14 @@ typedef struct _smbsession
   u16 eos;
   bool challengeUsed;
   u8 securityLevel;
+  u16 dialect;          // SMB2 dialect, 0 for NT LM 0.12
+  u32 TreeId;
+  u64 SessionId;
+  u64 MessageId;
+  u32 credits;          // SMB2 credits granted by the server
+  u32 MaxRead;
+  u32 MaxWrite;
+  bool largeMTU;
 } SMBSESSION;
 
 typedef struct _smbhandle
@@ -224,16 +347,32 @@ typedef struct _smbhandle
 	SMBSESSION session;
 	NBTSMB message;
 	bool unicode;
+	u32 depth;
+	SMBSTATS stats;
 } SMBHANDLE;
 
-static u32 smb_dialectcnt = 1;
+/**
+ * Request of a pipelined READ_ANDX/WRITE_ANDX sequence
+ */
+typedef struct _smbpipeslot
+{
+	bool busy;
+	u64 mid;
+	u8 *buffer;
+	u32 len;
+	off_t offset;
+} SMBPIPESLOT;
+
+static u32 smb_dialectcnt = 3;
 static bool smb_inited = false;
 static lwp_objinfo smb_handle_objects;
 static lwp_queue smb_filehandle_queue;
 static struct _smbfile smb_filehandles[SMB_FILEHANDLES_MAX];
-static const char *smb_dialects[] = {"NT LM 0.12",NULL};
+static const char *smb_dialects[] = {"NT LM 0.12","SMB 2.002","SMB 2.???",NULL};
 
 extern void ntlm_smb_nt_encrypt(const char *passwd, const u8 * challenge, u8 * answer);
+extern void ntlm_smb_ntlmv2_encrypt(const char *user, const char *domain, const char *passwd,
+		const u8 * challenge, const u8 * blob, size_t bloblen, u8 * answer);
 
 // UTF conversion functions
 size_t utf16_to_utf8(char* dst, char* src, size_t len)
@@ -374,6 +513,13 @@ static __inline__ u64 getULongLong(u8 *buffer,u32 offset)
 	return (u64)(getUInt(buffer, offset) | (u64)getUInt(buffer, offset+4) << 32);
 }
 
+/*** set unsigned long long ***/
+static __inline__ void setULongLong(u8 *buffer,u32 offset,u64 value)
+{
+	setUInt(buffer, offset, value&0xffffffff);
+	setUInt(buffer, offset+4, value>>32);
+}
+
 static __inline__ SMBHANDLE* __smb_handle_open(SMBCONN smbhndl)
 {
 	u32 level;
@@ -419,6 +565,8 @@ static SMBHANDLE* __smb_allocate_handle()
 		handle->share_name = NULL;
 		handle->sck_server = INVALID_SOCKET;
 		handle->conn_valid = false;
+		handle->depth = SMB_PIPELINE_DEPTH;
+		memset(&handle->stats,0,sizeof(SMBSTATS));
 		__lwp_objmgr_open(&smb_handle_objects,&handle->object);
 	}
 	_CPU_ISR_Restore(level);
@@ -518,7 +666,6 @@ static inline s32 smb_send(s32 s,const void *data,s32 size)
 			if(len==0) return size;
 			t1=ticks_to_millisecs(gettime());
 		}
-		usleep(100);
 	}
 	return size;
 }
@@ -549,14 +696,15 @@ static s32 smb_recv(s32 s,void *mem,s32 len)
 			readtotal+=ret;
 			len-=ret;
 			if(len==0) return readtotal;
+			t1=ticks_to_millisecs(gettime());
 		}
 		else
 		{
 			if(ret!=-EAGAIN) return ret;
 			t2=ticks_to_millisecs(gettime());
 			if( (t2 - t1) > RECV_TIMEOUT) return -1;
+			usleep(1000);
 		}
-		usleep(1000);
 	}
 	return readtotal;
 }
@@ -577,14 +725,12 @@ static void clear_network(s32 s,u8 *ptr)
 }
 
 /**
- * SMBCheck
+ * SMBRecvMessage
  *
- * Do very basic checking on the return SMB
- * Read <readlen> bytes
- * if <readlen>==0 then read a single SMB packet
+ * Read a single SMB packet into the message buffer,
  * discard any non NBT_SESSISON_MSG packets along the way.
  */
-static s32 SMBCheck(u8 command,SMBHANDLE *handle)
+static s32 SMBRecvMessage(SMBHANDLE *handle)
 {
 	s32 ret;
 	u8 *ptr = handle->message.smb;
@@ -619,11 +765,30 @@ static s32 SMBCheck(u8 command,SMBHANDLE *handle)
 
 	/* obtain required length from NBT header if readlen==0*/
 	readlen=(u32)((nbt->length_high<<16)|nbt->length);
+	if(readlen>sizeof(nbt->smb)) goto failed;
 
 	// Get server message block
 	ret=smb_recv(handle->sck_server, ptr, readlen);
 	if(readlen!=ret) goto failed;
 
+	return SMB_SUCCESS;
+failed:
+	clear_network(handle->sck_server,ptr);
+	return SMB_ERROR;
+}
+
+/**
+ * SMBCheck
+ *
+ * Do very basic checking on the return SMB
+ */
+static s32 SMBCheck(u8 command,SMBHANDLE *handle)
+{
+	s32 ret;
+	u8 *ptr = handle->message.smb;
+
+	if(SMBRecvMessage(handle)!=SMB_SUCCESS) return SMB_ERROR;
+
 	/*** Do basic SMB Header checks ***/
 	ret = getUInt(ptr,SMB_OFFSET_PROTO);
 	if(ret!=SMB_PROTO) goto failed;
@@ -640,6 +805,29 @@ failed:
     return SMB_ERROR;
 }
 
+/**
+ * SMB_NextMID
+ *
+ * Every request in flight needs its own multiplex id to match the reply
+ */
+static __inline__ u16 SMB_NextMID(SMBHANDLE *handle)
+{
+	SMBSESSION *sess = &handle->session;
+
+	if(++sess->MID==0xffff) sess->MID = 1;
+	return sess->MID;
+}
+
+static s32 SMB_FindPipeSlot(SMBPIPESLOT *slots,u32 depth,u64 mid)
+{
+	u32 i;
+
+	for(i=0;i<depth;i++) {
+		if(slots[i].busy && slots[i].mid==mid) return i;
+	}
+	return -1;
+}
+
 /**
  * SMB_SetupAndX
  *
@@ -766,87 +954,1307 @@ static s32 SMB_SetupAndX(SMBHANDLE *handle)
 		sess->UID = getUShort(handle->message.smb,SMB_OFFSET_UID);
 		return SMB_SUCCESS;
 	}
-	return ret;
+	return ret;
+}
+
+/**
+ * SMB_TreeAndX
+ *
+ * Finally, net_connect to the remote share
+ */
+static s32 SMB_TreeAndX(SMBHANDLE *handle)
+{
+	s32 pos, bcpos, ret;
+	char path[512];
+	u8 *ptr = handle->message.smb;
+	SMBSESSION *sess = &handle->session;
+
+	if(handle->sck_server == INVALID_SOCKET) return SMB_ERROR;
+
+	MakeSMBHeader(SMB_TREEC_ANDX,CIFS_FLAGS1,handle->unicode?CIFS_FLAGS2_UNICODE:CIFS_FLAGS2,handle);
+	pos = SMB_HEADER_SIZE;
+
+	setUChar(ptr,pos,4);
+	pos++;				    /*** Word Count ***/
+	setUChar(ptr,pos,0xff);
+	pos++;				    /*** Next AndX ***/
+	pos++;   /*** Reserved ***/
+	pos += 2; /*** Next AndX Offset ***/
+	pos += 2; /*** Flags ***/
+	setUShort(ptr,pos,1);
+	pos += 2;				    /*** Password Length ***/
+	bcpos = pos;
+	pos += 2;
+	pos++;    /*** NULL Password ***/
+
+	/*** Build server share path ***/
+	strcpy ((char*)path, "\\\\");
+	strcat ((char*)path, handle->server_name);
+	strcat ((char*)path, "\\");
+	strcat ((char*)path, handle->share_name);
+
+	for(ret=0;ret<strlen((const char*)path);ret++)
+        path[ret] = (char)toupper((int)path[ret]);
+
+	if(handle->unicode)
+	{
+        pos += utf8_to_utf16((char*)&ptr[pos],path,SMB_MAXPATH-2);
+        pos += 2;
+	}
+	else
+	{
+        memcpy(&ptr[pos],path,strlen((const char*)path));
+        pos += strlen((const char*)path)+1;
+	}
+
+	/*** Service ***/
+	strcpy((char*)path,"?????");
+	memcpy(&ptr[pos],path,strlen((const char*)path));
+	pos += strlen((const char*)path)+1;
+
+
+	/*** Update byte count ***/
+	setUShort(ptr,bcpos,(pos-bcpos)-2);
+
+	handle->message.msg = NBT_SESSISON_MSG;
+	handle->message.length = htons (pos);
+	pos += 4;
+
+	ret = smb_send(handle->sck_server,(char *)&handle->message,pos);
+	if(ret<=0) return SMB_ERROR;
+
+	if((ret=SMBCheck(SMB_TREEC_ANDX,handle))==SMB_SUCCESS) {
+		/*** Collect Tree ID ***/
+		sess->TID = getUShort(handle->message.smb,SMB_OFFSET_TID);
+		return SMB_SUCCESS;
+	}
+	return ret;
+}
+
+/****************************************************************************
+ * SMB2
+ *
+ * Servers that know SMB2 answer the multi-protocol negotiate with an SMB2
+ * NEGOTIATE response, from then on the connection only talks SMB2.
+ * Dialects 2.0.2 and 2.1 are supported, without signing.
+ ****************************************************************************/
+
+/**
+ * SMB2_AddCredits
+ *
+ * Account the credits granted by every response of a chain
+ */
+static void SMB2_AddCredits(SMBHANDLE *handle,u8 *ptr,u32 len)
+{
+	u32 pos = 0, next;
+
+	while(pos+SMB2_HEADER_SIZE<=len) {
+		handle->session.credits += getUShort(ptr,pos+SMB2_OFFSET_CREDITS);
+
+		next = getUInt(ptr,pos+SMB2_OFFSET_NEXTCMD);
+		if(next==0) break;
+		pos += next;
+	}
+}
+
+/**
+ * SMB2_Credits
+ *
+ * Trim a READ/WRITE length to the credits we hold, returns false
+ * if no request can be sent before a reply comes in
+ */
+static bool SMB2_Credits(SMBHANDLE *handle,u32 *len)
+{
+	SMBSESSION *sess = &handle->session;
+
+	if(sess->credits==0) return false;
+	if(sess->largeMTU && *len>sess->credits*SMB2_CREDIT_SIZE)
+		*len = sess->credits*SMB2_CREDIT_SIZE;
+	return true;
+}
+
+/**
+ * MakeSMB2Header
+ *
+ * Header of a request at <pos> of the message buffer. Requests past the
+ * start of the buffer are chained to the previous one as related
+ * operations. <payload> is the size of a READ/WRITE, it decides the
+ * credit charge. Returns the MessageId.
+ */
+static u64 MakeSMB2Header(u16 command,u32 payload,u32 pos,u32 prev,SMBHANDLE *handle)
+{
+	u8 *ptr = handle->message.smb;
+	SMBSESSION *sess = &handle->session;
+	u16 charge = 1;
+	u64 mid;
+
+	if(sess->largeMTU && payload>0)
+		charge = (payload+SMB2_CREDIT_SIZE-1)/SMB2_CREDIT_SIZE;
+
+	memset(&ptr[pos],0,SMB2_HEADER_SIZE);
+	setUInt(ptr,pos,SMB2_PROTO);
+	setUShort(ptr,pos+4,SMB2_HEADER_SIZE);
+	if(sess->largeMTU)
+		setUShort(ptr,pos+SMB2_OFFSET_CREDITCHARGE,charge);
+	setUShort(ptr,pos+SMB2_OFFSET_CMD,command);
+	setUShort(ptr,pos+SMB2_OFFSET_CREDITS,(sess->credits<SMB2_CREDITS_MAX)?(charge+SMB2_CREDITS_EXTRA):charge);
+	if(pos>0) {
+		setUInt(ptr,pos+SMB2_OFFSET_FLAGS,SMB2_FLAGS_RELATED);
+		setUInt(ptr,prev+SMB2_OFFSET_NEXTCMD,pos-prev);
+	}
+
+	mid = sess->MessageId;
+	setULongLong(ptr,pos+SMB2_OFFSET_MID,mid);
+	setUInt(ptr,pos+SMB2_OFFSET_PID,0xfeff);
+	setUInt(ptr,pos+SMB2_OFFSET_TID,sess->TreeId);
+	setULongLong(ptr,pos+SMB2_OFFSET_SESSID,sess->SessionId);
+
+	sess->MessageId += charge;
+	if(sess->credits>=charge)
+		sess->credits -= charge;
+	else
+		sess->credits = 0;
+	return mid;
+}
+
+/**
+ * SMB2_Align
+ *
+ * Compounded requests start on 8 byte boundaries
+ */
+static __inline__ u32 SMB2_Align(SMBHANDLE *handle,u32 pos)
+{
+	while(pos&7) handle->message.smb[pos++] = 0;
+	return pos;
+}
+
+static s32 SMB2Send(SMBHANDLE *handle,u32 len)
+{
+	handle->message.msg = NBT_SESSISON_MSG;
+	handle->message.length_high = (len>>16)&0xff;
+	handle->message.length = htons(len&0xffff);
+
+	return smb_send(handle->sck_server,(char*)&handle->message,len+4);
+}
+
+/**
+ * SMB2Recv
+ *
+ * Read one SMB2 response (or compound chain) into the message buffer.
+ * Interim STATUS_PENDING responses are skipped. Returns the length.
+ */
+static s32 SMB2Recv(SMBHANDLE *handle)
+{
+	s32 ret;
+	u8 *ptr = handle->message.smb;
+
+	while(1) {
+		if(SMBRecvMessage(handle)!=SMB_SUCCESS) return SMB_ERROR;
+
+		ret = (handle->message.length_high<<16)|handle->message.length;
+		if(ret<SMB2_HEADER_SIZE || getUInt(ptr,SMB_OFFSET_PROTO)!=SMB2_PROTO) {
+			clear_network(handle->sck_server,ptr);
+			return SMB_ERROR;
+		}
+		SMB2_AddCredits(handle,ptr,ret);
+
+		if((getUInt(ptr,SMB2_OFFSET_FLAGS)&SMB2_FLAGS_ASYNC) && getUInt(ptr,SMB2_OFFSET_STATUS)==STATUS_PENDING)
+			continue;
+		return ret;
+	}
+}
+
+/**
+ * SMB2Check
+ *
+ * Receive a response and check command and status of every part of the
+ * chain up to <count> responses.
+ */
+static s32 SMB2Check(u16 command,u32 count,SMBHANDLE *handle)
+{
+	s32 len;
+	u32 pos = 0, next;
+	u8 *ptr = handle->message.smb;
+
+	len = SMB2Recv(handle);
+	if(len<0) {
+		handle->conn_valid = false;
+		return SMB_ERROR;
+	}
+
+	if(getUShort(ptr,SMB2_OFFSET_CMD)!=command) return SMB_ERROR;
+
+	while(count-->0) {
+		if(pos+SMB2_HEADER_SIZE>len) return SMB_ERROR;
+		if(getUInt(ptr,pos+SMB2_OFFSET_STATUS)!=0) return SMB_ERROR;
+
+		next = getUInt(ptr,pos+SMB2_OFFSET_NEXTCMD);
+		if(next==0) break;
+		pos += next;
+	}
+	return SMB_SUCCESS;
+}
+
+/**
+ * SMB2_Response
+ *
+ * Offset of the <index>th response of a compound chain
+ */
+static s32 SMB2_Response(SMBHANDLE *handle,u32 index)
+{
+	u32 pos = 0, next;
+	u8 *ptr = handle->message.smb;
+
+	while(index-->0) {
+		next = getUInt(ptr,pos+SMB2_OFFSET_NEXTCMD);
+		if(next==0) return SMB_ERROR;
+		pos += next;
+	}
+	return pos;
+}
+
+/**
+ * SMB2_PutPath
+ *
+ * SMB2 paths are relative to the share and carry no leading backslash
+ */
+static u32 SMB2_PutPath(u8 *dst,const char *path)
+{
+	s32 len;
+
+	while(*path=='\\') path++;
+	if(*path=='\0') return 0;
+
+	len = utf8_to_utf16((char*)dst,(char*)path,SMB_MAXPATH-2);
+	if(len<0) return 0;
+	return len;
+}
+
+static u32 SMB2_AddCreate(SMBHANDLE *handle,u32 pos,u32 prev,const char *path,u32 access,u32 share,u32 disposition,u32 options)
+{
+	u32 len;
+	u8 *ptr = handle->message.smb;
+
+	MakeSMB2Header(SMB2_CREATE,0,pos,prev,handle);
+	pos += SMB2_HEADER_SIZE;
+	memset(&ptr[pos],0,56);
+
+	setUShort(ptr,pos,57);					/*** StructureSize ***/
+	setUInt(ptr,pos+4,2);					/*** ImpersonationLevel ***/
+	setUInt(ptr,pos+24,access);				/*** DesiredAccess ***/
+	setUInt(ptr,pos+28,FILE_ATTRIBUTE_NORMAL);
+	setUInt(ptr,pos+32,share);				/*** ShareAccess ***/
+	setUInt(ptr,pos+36,disposition);		/*** CreateDisposition ***/
+	setUInt(ptr,pos+40,options);			/*** CreateOptions ***/
+	setUShort(ptr,pos+44,SMB2_HEADER_SIZE+56);	/*** NameOffset ***/
+
+	len = SMB2_PutPath(&ptr[pos+56],path);
+	setUShort(ptr,pos+46,len);				/*** NameLength ***/
+	if(len==0) {
+		ptr[pos+56] = 0;					/*** Buffer can't be empty ***/
+		len = 1;
+	}
+	return pos+56+len;
+}
+
+static u32 SMB2_AddClose(SMBHANDLE *handle,u32 pos,u32 prev,const u8 *fileid)
+{
+	u8 *ptr = handle->message.smb;
+
+	MakeSMB2Header(SMB2_CLOSE,0,pos,prev,handle);
+	pos += SMB2_HEADER_SIZE;
+	memset(&ptr[pos],0,24);
+
+	setUShort(ptr,pos,24);					/*** StructureSize ***/
+	if(fileid)
+		memcpy(&ptr[pos+8],fileid,16);
+	else
+		memset(&ptr[pos+8],0xff,16);		/*** FileId of the related CREATE ***/
+	return pos+24;
+}
+
+static u32 SMB2_AddQueryDirectory(SMBHANDLE *handle,u32 pos,u32 prev,const u8 *fileid,const char *pattern,u8 flags,u32 outlen)
+{
+	u32 len;
+	u8 *ptr = handle->message.smb;
+
+	MakeSMB2Header(SMB2_QUERY_DIRECTORY,outlen,pos,prev,handle);
+	pos += SMB2_HEADER_SIZE;
+	memset(&ptr[pos],0,32);
+
+	setUShort(ptr,pos,33);					/*** StructureSize ***/
+	setUChar(ptr,pos+2,FILE_BOTH_DIRECTORY_INFO);
+	setUChar(ptr,pos+3,flags);
+	if(fileid)
+		memcpy(&ptr[pos+8],fileid,16);
+	else
+		memset(&ptr[pos+8],0xff,16);
+	setUShort(ptr,pos+24,SMB2_HEADER_SIZE+32);	/*** FileNameOffset ***/
+
+	len = utf8_to_utf16((char*)&ptr[pos+32],(char*)pattern,SMB_MAXPATH-2);
+	setUShort(ptr,pos+26,len);
+	setUInt(ptr,pos+28,outlen);				/*** OutputBufferLength ***/
+	return pos+32+len;
+}
+
+/**
+ * SMB2_NegotiateProtocol
+ *
+ * Called with the SMB2 NEGOTIATE response to the multi-protocol negotiate
+ * in the message buffer. A wildcard answer means the server wants a real
+ * SMB2 NEGOTIATE to pick a dialect above 2.0.2.
+ */
+static s32 SMB2_NegotiateProtocol(SMBHANDLE *handle)
+{
+	s32 pos, ret;
+	u8 *ptr = handle->message.smb;
+	SMBSESSION *sess = &handle->session;
+	u32 servcap;
+
+	sess->credits = 0;
+	SMB2_AddCredits(handle,ptr,SMB2_HEADER_SIZE);
+	sess->MessageId = 1;
+
+	if(getUInt(ptr,SMB2_OFFSET_STATUS)!=0) return SMB_PROTO_FAIL;
+
+	sess->dialect = getUShort(ptr,SMB2_HEADER_SIZE+4);
+	if(sess->dialect==SMB2_DIALECT_WILDCARD)
+	{
+		pos = SMB2_HEADER_SIZE;
+		MakeSMB2Header(SMB2_NEGOTIATE,0,0,0,handle);
+		memset(&ptr[pos],0,36);
+		setUShort(ptr,pos,36);				/*** StructureSize ***/
+		setUShort(ptr,pos+2,2);				/*** DialectCount ***/
+		setUShort(ptr,pos+4,1);				/*** SecurityMode: signing enabled ***/
+		setUInt(ptr,pos+12,0x74696e79);		/*** ClientGuid ***/
+		setUInt(ptr,pos+16,(u32)gettime());
+		pos += 36;
+		setUShort(ptr,pos,SMB2_DIALECT_0202);
+		pos += 2;
+		setUShort(ptr,pos,SMB2_DIALECT_0210);
+		pos += 2;
+
+		ret = SMB2Send(handle,pos);
+		if(ret<=0) return SMB_ERROR;
+
+		if(SMB2Check(SMB2_NEGOTIATE,1,handle)!=SMB_SUCCESS) return SMB_PROTO_FAIL;
+		sess->dialect = getUShort(ptr,SMB2_HEADER_SIZE+4);
+	}
+	if(sess->dialect!=SMB2_DIALECT_0202 && sess->dialect!=SMB2_DIALECT_0210) return SMB_PROTO_FAIL;
+
+	// messages can't be signed
+	if(getUShort(ptr,SMB2_HEADER_SIZE+2)&SMB2_SIGNING_REQUIRED) return SMB_PROTO_FAIL;
+
+	servcap = getUInt(ptr,SMB2_HEADER_SIZE+24);
+	sess->largeMTU = (sess->dialect>=SMB2_DIALECT_0210 && (servcap&SMB2_CAP_LARGE_MTU));
+
+	sess->MaxRead = getUInt(ptr,SMB2_HEADER_SIZE+32);
+	sess->MaxWrite = getUInt(ptr,SMB2_HEADER_SIZE+36);
+	if(sess->MaxRead>SMB2_MAX_IO_SIZE) sess->MaxRead = SMB2_MAX_IO_SIZE;
+	if(sess->MaxWrite>SMB2_MAX_IO_SIZE) sess->MaxWrite = SMB2_MAX_IO_SIZE;
+	if(!sess->largeMTU) {
+		if(sess->MaxRead>SMB2_CREDIT_SIZE) sess->MaxRead = SMB2_CREDIT_SIZE;
+		if(sess->MaxWrite>SMB2_CREDIT_SIZE) sess->MaxWrite = SMB2_CREDIT_SIZE;
+	}
+
+	handle->unicode = true;
+	return SMB_SUCCESS;
+}
+
+static u32 SMB2_PutNTLMField(u8 *ntlm,u32 field,u32 *ofs,const void *data,u32 len)
+{
+	setUShort(ntlm,field,len);
+	setUShort(ntlm,field+2,len);
+	setUInt(ntlm,field+4,*ofs);
+	if(len>0) memcpy(&ntlm[*ofs],data,len);
+	*ofs += len;
+	return len;
+}
+
+static u32 SMB2_PutUTF16(u8 *dst,const char *src)
+{
+	u32 len = 0;
+
+	while(*src) {
+		dst[len++] = *src++;
+		dst[len++] = 0;
+	}
+	return len;
+}
+
+/**
+ * SMB2_SessionSetup
+ *
+ * NTLMSSP with an NTLMv2 response, sent without a SPNEGO wrapper
+ */
+static s32 SMB2_SessionSetup(SMBHANDLE *handle)
+{
+	s32 ret;
+	u32 pos, ofs, i, len, flags, tilen;
+	u8 *ptr = handle->message.smb;
+	u8 *ntlm;
+	SMBSESSION *sess = &handle->session;
+	u8 challenge[8];
+	u8 targetinfo[512];
+	u8 blob[28+512+4];
+	u8 ntresp[16+sizeof(blob)];
+	u8 name[128];
+	u64 timestamp = 0;
+
+	if(handle->sck_server == INVALID_SOCKET) return SMB_ERROR;
+
+	/*** NEGOTIATE_MESSAGE ***/
+	pos = SMB2_HEADER_SIZE;
+	MakeSMB2Header(SMB2_SESSION_SETUP,0,0,0,handle);
+	memset(&ptr[pos],0,24);
+	setUShort(ptr,pos,25);					/*** StructureSize ***/
+	setUChar(ptr,pos+3,1);					/*** SecurityMode: signing enabled ***/
+	setUShort(ptr,pos+12,SMB2_HEADER_SIZE+24);	/*** SecurityBufferOffset ***/
+	setUShort(ptr,pos+14,32);				/*** SecurityBufferLength ***/
+	pos += 24;
+
+	ntlm = &ptr[pos];
+	memset(ntlm,0,32);
+	memcpy(ntlm,"NTLMSSP",8);
+	setUInt(ntlm,8,1);
+	setUInt(ntlm,12,NTLMSSP_FLAGS);
+	pos += 32;
+
+	ret = SMB2Send(handle,pos);
+	if(ret<=0) return SMB_ERROR;
+
+	ret = SMB2Recv(handle);
+	if(ret<0) return SMB_ERROR;
+	if(getUShort(ptr,SMB2_OFFSET_CMD)!=SMB2_SESSION_SETUP ||
+	   getUInt(ptr,SMB2_OFFSET_STATUS)!=STATUS_MORE_PROCESSING) return SMB_NOT_USER;
+
+	sess->SessionId = getULongLong(ptr,SMB2_OFFSET_SESSID);
+
+	/*** CHALLENGE_MESSAGE ***/
+	ofs = getUShort(ptr,SMB2_HEADER_SIZE+4);
+	len = getUShort(ptr,SMB2_HEADER_SIZE+6);
+	if(len<48 || ofs+len>ret) return SMB_PROTO_FAIL;
+
+	ntlm = &ptr[ofs];
+	if(memcmp(ntlm,"NTLMSSP",8)!=0 || getUInt(ntlm,8)!=2) return SMB_PROTO_FAIL;
+
+	flags = getUInt(ntlm,20)&NTLMSSP_FLAGS;
+	memcpy(challenge,&ntlm[24],8);
+
+	/*** Target name is the domain to authenticate against ***/
+	i = getUShort(ntlm,12);
+	pos = getUInt(ntlm,16);
+	if(pos+i>len) return SMB_PROTO_FAIL;
+	for(ofs=0;ofs<i/2 && ofs<sizeof(sess->p_domain)-1;ofs++)
+		sess->p_domain[ofs] = ntlm[pos+ofs*2];
+	sess->p_domain[ofs] = '\0';
+
+	tilen = getUShort(ntlm,40);
+	pos = getUInt(ntlm,44);
+	if(tilen>sizeof(targetinfo) || pos+tilen>len) return SMB_PROTO_FAIL;
+	memcpy(targetinfo,&ntlm[pos],tilen);
+
+	/*** Use the server's clock if it sent one ***/
+	for(pos=0;pos+4<=tilen;pos+=4+getUShort(targetinfo,pos+2)) {
+		if(getUShort(targetinfo,pos)==0) break;
+		if(getUShort(targetinfo,pos)==NTLMSSP_AV_TIMESTAMP && getUShort(targetinfo,pos+2)==8 && pos+12<=tilen)
+			timestamp = getULongLong(targetinfo,pos+4);
+	}
+	if(timestamp==0)
+		timestamp = ((u64)time(NULL)+11644473600ULL)*10000000ULL;
+
+	/*** NTLMv2 client blob ***/
+	memset(blob,0,sizeof(blob));
+	setUShort(blob,0,0x0101);
+	setULongLong(blob,8,timestamp);
+	setULongLong(blob,16,gettime()^((u64)rand()<<32)^(u32)handle->sck_server);	/*** client challenge ***/
+	memcpy(&blob[28],targetinfo,tilen);
+	len = 28+tilen+4;
+
+	/*** AUTHENTICATE_MESSAGE ***/
+	pos = SMB2_HEADER_SIZE;
+	MakeSMB2Header(SMB2_SESSION_SETUP,0,0,0,handle);
+	memset(&ptr[pos],0,24);
+	setUShort(ptr,pos,25);
+	setUChar(ptr,pos+3,1);
+	setUShort(ptr,pos+12,SMB2_HEADER_SIZE+24);
+	pos += 24;
+
+	ntlm = &ptr[pos];
+	memset(ntlm,0,64);
+	memcpy(ntlm,"NTLMSSP",8);
+	setUInt(ntlm,8,3);
+
+	ofs = 64;
+	if(handle->user[0]=='\0')
+	{
+		/*** Anonymous logon ***/
+		flags |= NTLMSSP_NEGOTIATE_ANONYMOUS;
+		sess->p_domain[0] = '\0';
+		memset(name,0,1);
+		SMB2_PutNTLMField(ntlm,12,&ofs,name,1);
+		SMB2_PutNTLMField(ntlm,20,&ofs,NULL,0);
+	}
+	else
+	{
+		ntlm_smb_ntlmv2_encrypt(handle->user,(const char*)sess->p_domain,handle->pwd,challenge,blob,len,ntresp);
+		memset(name,0,24);
+		SMB2_PutNTLMField(ntlm,12,&ofs,name,24);
+		SMB2_PutNTLMField(ntlm,20,&ofs,ntresp,16+len);
+	}
+	SMB2_PutNTLMField(ntlm,28,&ofs,name,SMB2_PutUTF16(name,(const char*)sess->p_domain));
+	SMB2_PutNTLMField(ntlm,36,&ofs,name,SMB2_PutUTF16(name,handle->user));
+	SMB2_PutNTLMField(ntlm,44,&ofs,name,SMB2_PutUTF16(name,"WII"));
+	SMB2_PutNTLMField(ntlm,52,&ofs,NULL,0);
+	setUInt(ntlm,60,flags);
+
+	setUShort(ptr,SMB2_HEADER_SIZE+14,ofs);	/*** SecurityBufferLength ***/
+	pos += ofs;
+
+	memset(ntresp,0,sizeof(ntresp));
+
+	ret = SMB2Send(handle,pos);
+	if(ret<=0) return SMB_ERROR;
+
+	if(SMB2Check(SMB2_SESSION_SETUP,1,handle)!=SMB_SUCCESS) return SMB_NOT_USER;
+	return SMB_SUCCESS;
+}
+
+/**
+ * SMB2_TreeConnect
+ */
+static s32 SMB2_TreeConnect(SMBHANDLE *handle)
+{
+	s32 pos, len, ret;
+	char path[512];
+	u8 *ptr = handle->message.smb;
+
+	if(handle->sck_server == INVALID_SOCKET) return SMB_ERROR;
+
+	pos = SMB2_HEADER_SIZE;
+	MakeSMB2Header(SMB2_TREE_CONNECT,0,0,0,handle);
+	memset(&ptr[pos],0,8);
+	setUShort(ptr,pos,9);					/*** StructureSize ***/
+	setUShort(ptr,pos+4,SMB2_HEADER_SIZE+8);	/*** PathOffset ***/
+	pos += 8;
+
+	strcpy(path,"\\\\");
+	strcat(path,handle->server_name);
+	strcat(path,"\\");
+	strcat(path,handle->share_name);
+
+	len = utf8_to_utf16((char*)&ptr[pos],path,SMB_MAXPATH-2);
+	if(len<0) return SMB_ERROR;
+	setUShort(ptr,SMB2_HEADER_SIZE+6,len);	/*** PathLength ***/
+	pos += len;
+
+	ret = SMB2Send(handle,pos);
+	if(ret<=0) return SMB_ERROR;
+
+	if(SMB2Check(SMB2_TREE_CONNECT,1,handle)!=SMB_SUCCESS) return SMB_ERROR;
+
+	handle->session.TreeId = getUInt(ptr,SMB2_OFFSET_TID);
+	return SMB_SUCCESS;
+}
+
+static SMBFILE SMB2_OpenFile(const char *filename,u16 access,u16 creation,SMBCONN smbhndl,SMBHANDLE *handle)
+{
+	u32 pos, desired, share, disposition;
+	struct _smbfile *fid = NULL;
+
+	switch(access&0x03) {
+		case SMB_OPEN_WRITING:
+			desired = GENERIC_WRITE;
+			break;
+		case SMB_OPEN_READWRITE:
+			desired = GENERIC_READ|GENERIC_WRITE;
+			break;
+		default:
+			desired = GENERIC_READ;
+			break;
+	}
+	switch(access&0x70) {
+		case SMB_DENY_READWRITE:
+			share = 0;
+			break;
+		case SMB_DENY_WRITE:
+			share = FILE_SHARE_READ;
+			break;
+		case SMB_DENY_READ:
+			share = FILE_SHARE_WRITE;
+			break;
+		default:
+			share = FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE;
+			break;
+	}
+	switch(creation) {
+		case SMB_OF_CREATE:
+			disposition = FILE_CREATE;
+			break;
+		case SMB_OF_CREATE|SMB_OF_OPEN:
+			disposition = FILE_OPEN_IF;
+			break;
+		case SMB_OF_TRUNCATE:
+			disposition = FILE_OVERWRITE;
+			break;
+		case SMB_OF_CREATE|SMB_OF_TRUNCATE:
+			disposition = FILE_OVERWRITE_IF;
+			break;
+		default:
+			disposition = FILE_OPEN;
+			break;
+	}
+
+	pos = SMB2_AddCreate(handle,0,0,filename,desired,share,disposition,FILE_NON_DIRECTORY_FILE);
+	if(SMB2Send(handle,pos)<0) goto failed;
+
+	if(SMB2Check(SMB2_CREATE,1,handle)==SMB_SUCCESS) {
+		fid = (struct _smbfile*)__lwp_queue_get(&smb_filehandle_queue);
+		if(fid) {
+			fid->conn = smbhndl;
+			fid->sfid = 0;
+			memcpy(fid->fileid,&handle->message.smb[SMB2_HEADER_SIZE+64],16);
+		}
+	}
+	return (SMBFILE)fid;
+
+failed:
+	handle->conn_valid = false;
+	return NULL;
+}
+
+static void SMB2_CloseFile(struct _smbfile *fid,SMBHANDLE *handle)
+{
+	u32 pos;
+
+	pos = SMB2_AddClose(handle,0,0,fid->fileid);
+	if(SMB2Send(handle,pos)<0) handle->conn_valid = false;
+	else SMB2Check(SMB2_CLOSE,1,handle);
+}
+
+/**
+ * SMB2_Compound
+ *
+ * CREATE + <command> + CLOSE in one round trip. <build> appends the
+ * middle request, which works on the FileId of the CREATE.
+ */
+static s32 SMB2_Compound(SMBHANDLE *handle,const char *path,u32 access,u32 disposition,u32 options,
+						 u32 (*build)(SMBHANDLE*,u32,u32,void*),void *arg)
+{
+	u32 pos, prev, count = 2;
+
+	pos = SMB2_AddCreate(handle,0,0,path,access,FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,disposition,options);
+	prev = 0;
+	if(build) {
+		pos = SMB2_Align(handle,pos);
+		prev = pos;
+		pos = build(handle,pos,0,arg);
+		count++;
+	}
+	pos = SMB2_Align(handle,pos);
+	pos = SMB2_AddClose(handle,pos,prev,NULL);
+
+	if(SMB2Send(handle,pos)<0) {
+		handle->conn_valid = false;
+		return SMB_ERROR;
+	}
+	return SMB2Check(SMB2_CREATE,count,handle);
+}
+
+static s32 SMB2_PathInfo(const char *filename,SMBDIRENTRY *sdir,SMBHANDLE *handle)
+{
+	u8 *ptr = handle->message.smb;
+
+	if(SMB2_Compound(handle,filename,FILE_READ_ATTRIBUTES,FILE_OPEN,0,NULL,NULL)!=SMB_SUCCESS)
+		return SMB_ERROR;
+
+	sdir->name[0] = '\0';
+	if(filename[0]!='\\')
+		strcpy(sdir->name,"\\");
+	strncat(sdir->name,filename,sizeof(sdir->name)-2);
+
+	sdir->ctime = getULongLong(ptr,SMB2_HEADER_SIZE+8);
+	sdir->atime = getULongLong(ptr,SMB2_HEADER_SIZE+16);
+	sdir->mtime = getULongLong(ptr,SMB2_HEADER_SIZE+24);
+	sdir->size = getULongLong(ptr,SMB2_HEADER_SIZE+48);
+	sdir->attributes = getUInt(ptr,SMB2_HEADER_SIZE+56);
+	return SMB_SUCCESS;
+}
+
+static u32 SMB2_BuildRename(SMBHANDLE *handle,u32 pos,u32 prev,void *arg)
+{
+	u32 len;
+	u8 *ptr = handle->message.smb;
+
+	MakeSMB2Header(SMB2_SET_INFO,0,pos,prev,handle);
+	pos += SMB2_HEADER_SIZE;
+	memset(&ptr[pos],0,32+20);
+
+	setUShort(ptr,pos,33);					/*** StructureSize ***/
+	setUChar(ptr,pos+2,SMB2_0_INFO_FILE);
+	setUChar(ptr,pos+3,FILE_RENAME_INFO);
+	setUShort(ptr,pos+8,SMB2_HEADER_SIZE+32);	/*** BufferOffset ***/
+	memset(&ptr[pos+16],0xff,16);			/*** FileId of the related CREATE ***/
+
+	len = SMB2_PutPath(&ptr[pos+32+20],(const char*)arg);
+	setUInt(ptr,pos+32+16,len);				/*** FileNameLength ***/
+	setUInt(ptr,pos+4,20+len);				/*** BufferLength ***/
+	return pos+32+20+len;
+}
+
+static u32 SMB2_BuildFsInfo(SMBHANDLE *handle,u32 pos,u32 prev,void *arg)
+{
+	u8 *ptr = handle->message.smb;
+
+	MakeSMB2Header(SMB2_QUERY_INFO,0,pos,prev,handle);
+	pos += SMB2_HEADER_SIZE;
+	memset(&ptr[pos],0,40);
+
+	setUShort(ptr,pos,41);					/*** StructureSize ***/
+	setUChar(ptr,pos+2,SMB2_0_INFO_FILESYSTEM);
+	setUChar(ptr,pos+3,FILE_FS_FULL_SIZE_INFO);
+	setUInt(ptr,pos+4,32);					/*** OutputBufferLength ***/
+	memset(&ptr[pos+24],0xff,16);
+	ptr[pos+40] = 0;
+	return pos+41;
+}
+
+static s32 SMB2_DiskInformation(struct statvfs *buf,SMBHANDLE *handle)
+{
+	s32 pos;
+	u32 unitsize;
+	u8 *ptr = handle->message.smb;
+
+	if(SMB2_Compound(handle,"",FILE_READ_ATTRIBUTES,FILE_OPEN,FILE_DIRECTORY_FILE,SMB2_BuildFsInfo,NULL)!=SMB_SUCCESS)
+		return SMB_ERROR;
+
+	pos = SMB2_Response(handle,1);
+	if(pos<0) return SMB_ERROR;
+	pos += getUShort(ptr,pos+SMB2_HEADER_SIZE+2);	/*** OutputBufferOffset ***/
+
+	// FILE_FS_FULL_SIZE_INFORMATION
+	unitsize = getUInt(ptr,pos+24)*getUInt(ptr,pos+28);
+
+	buf->f_bsize = (unsigned long) unitsize;
+	buf->f_frsize = (unsigned long) unitsize;
+	buf->f_blocks = (fsblkcnt_t) getULongLong(ptr,pos);
+	buf->f_bfree = (fsblkcnt_t) getULongLong(ptr,pos+16);
+	buf->f_bavail = (fsblkcnt_t) getULongLong(ptr,pos+8);
+	buf->f_files = 0;
+	buf->f_ffree = 0;
+	buf->f_favail = 0;
+	buf->f_fsid = 0;
+	buf->f_flag = 0;
+	buf->f_namemax = SMB_MAXPATH;
+	return SMB_SUCCESS;
+}
+
+/**
+ * SMB2_DirEntry
+ *
+ * Return the next FILE_BOTH_DIR_INFORMATION entry of the batch
+ */
+static s32 SMB2_DirEntry(struct _smbfile *fid,SMBDIRENTRY *sdir)
+{
+	u8 *ptr = fid->dirbuf;
+	u32 pos = fid->dirpos, next, len;
+
+	if(pos+94>fid->dirlen) return SMB_ERROR;
+
+	next = getUInt(ptr,pos);
+	sdir->ctime = getULongLong(ptr,pos+8);
+	sdir->atime = getULongLong(ptr,pos+16);
+	sdir->mtime = getULongLong(ptr,pos+24);
+	sdir->size = getULongLong(ptr,pos+40);
+	sdir->attributes = getUInt(ptr,pos+56);
+	len = getUInt(ptr,pos+60);
+	if(pos+94+len>fid->dirlen || len>=sizeof(sdir->name)/2) return SMB_ERROR;
+	utf16_to_utf8(sdir->name,(char*)&ptr[pos+94],len);
+
+	fid->dirpos = (next==0) ? fid->dirlen : pos+next;
+	return SMB_SUCCESS;
+}
+
+/**
+ * SMB2_DirFill
+ *
+ * Copy the output of the QUERY_DIRECTORY response at <pos> into the
+ * search buffer
+ */
+static s32 SMB2_DirFill(struct _smbfile *fid,SMBHANDLE *handle,s32 pos)
+{
+	u32 ofs, len;
+	u8 *ptr = handle->message.smb;
+
+	if(pos<0 || getUInt(ptr,pos+SMB2_OFFSET_STATUS)!=0) return SMB_ERROR;
+
+	ofs = getUShort(ptr,pos+SMB2_HEADER_SIZE+2);
+	len = getUInt(ptr,pos+SMB2_HEADER_SIZE+4);
+	if(len>SMB2_DIRBUF_SIZE || pos+ofs+len>sizeof(handle->message.smb)) return SMB_ERROR;
+
+	memcpy(fid->dirbuf,&ptr[pos+ofs],len);
+	fid->dirlen = len;
+	fid->dirpos = 0;
+	return SMB_SUCCESS;
+}
+
+static void SMB2_FreeSearch(struct _smbfile *fid)
+{
+	if(fid->dirbuf) free(fid->dirbuf);
+	if(fid->pattern) free(fid->pattern);
+	fid->dirbuf = NULL;
+	fid->pattern = NULL;
+	__lwp_queue_append(&smb_filehandle_queue,&fid->node);
+}
+
+/**
+ * SMB2_FindFirst
+ *
+ * CREATE of the directory and the first QUERY_DIRECTORY go out as one
+ * compound, the reply carries as many entries as fit the buffer
+ */
+static s32 SMB2_FindFirst(const char *filename,SMBDIRENTRY *sdir,SMBHANDLE *handle)
+{
+	u32 pos;
+	char dir[SMB_MAXPATH];
+	char *pattern;
+	struct _smbfile *fid;
+	u8 *ptr = handle->message.smb;
+
+	strncpy(dir,filename,sizeof(dir)-1);
+	dir[sizeof(dir)-1] = '\0';
+	pattern = strrchr(dir,'\\');
+	if(pattern) *pattern++ = '\0';
+	else pattern = dir;
+	if(*pattern=='\0') pattern = "*";
+
+	fid = (struct _smbfile*)__lwp_queue_get(&smb_filehandle_queue);
+	if(!fid) return SMB_ERROR;
+
+	fid->dirbuf = malloc(SMB2_DIRBUF_SIZE);
+	fid->pattern = strdup(pattern);
+	if(!fid->dirbuf || !fid->pattern) {
+		SMB2_FreeSearch(fid);
+		return SMB_ERROR;
+	}
+
+	pos = SMB2_AddCreate(handle,0,0,(pattern==dir)?"":dir,FILE_LIST_DIRECTORY|FILE_READ_ATTRIBUTES,
+						 FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,FILE_OPEN,FILE_DIRECTORY_FILE);
+	pos = SMB2_Align(handle,pos);
+	// the CREATE response shares the message buffer with the entries
+	pos = SMB2_AddQueryDirectory(handle,pos,0,NULL,fid->pattern,SMB2_RESTART_SCANS,SMB2_DIRBUF_SIZE-SMB2_CREATE_RESP_SIZE);
+
+	if(SMB2Send(handle,pos)<0) {
+		handle->conn_valid = false;
+		SMB2_FreeSearch(fid);
+		return SMB_ERROR;
+	}
+	if(SMB2Check(SMB2_CREATE,1,handle)!=SMB_SUCCESS) {
+		SMB2_FreeSearch(fid);
+		return SMB_ERROR;
+	}
+	memcpy(fid->fileid,&ptr[SMB2_HEADER_SIZE+64],16);
+
+	if(SMB2_DirFill(fid,handle,SMB2_Response(handle,1))!=SMB_SUCCESS ||
+	   SMB2_DirEntry(fid,sdir)!=SMB_SUCCESS) {
+		SMB2_CloseFile(fid,handle);
+		SMB2_FreeSearch(fid);
+		return SMB_ERROR;
+	}
+
+	fid->conn = SMB_HANDLE_NULL;
+	sdir->sid = (fid-smb_filehandles)+1;
+	return SMB_SUCCESS;
+}
+
+static struct _smbfile* SMB2_FindSearch(SMBDIRENTRY *sdir)
+{
+	struct _smbfile *fid;
+
+	if(sdir->sid==0 || sdir->sid>SMB_FILEHANDLES_MAX) return NULL;
+
+	fid = &smb_filehandles[sdir->sid-1];
+	if(!fid->dirbuf) return NULL;
+	return fid;
+}
+
+static s32 SMB2_FindNext(SMBDIRENTRY *sdir,SMBHANDLE *handle)
+{
+	u32 pos;
+	struct _smbfile *fid = SMB2_FindSearch(sdir);
+
+	if(!fid) return SMB_ERROR;
+
+	if(fid->dirpos>=fid->dirlen) {
+		pos = SMB2_AddQueryDirectory(handle,0,0,fid->fileid,fid->pattern,0,SMB2_DIRBUF_SIZE);
+		if(SMB2Send(handle,pos)<0) {
+			handle->conn_valid = false;
+			return SMB_ERROR;
+		}
+		if(SMB2Check(SMB2_QUERY_DIRECTORY,1,handle)!=SMB_SUCCESS) {
+			// STATUS_NO_MORE_FILES ends the search
+			if(handle->conn_valid && getUInt(handle->message.smb,SMB2_OFFSET_STATUS)==STATUS_NO_MORE_FILES)
+				return SMB_NO_MORE_FILES;
+			return SMB_ERROR;
+		}
+		if(SMB2_DirFill(fid,handle,0)!=SMB_SUCCESS) return SMB_ERROR;
+	}
+	return SMB2_DirEntry(fid,sdir);
+}
+
+static s32 SMB2_FindClose(SMBDIRENTRY *sdir,SMBHANDLE *handle)
+{
+	struct _smbfile *fid = SMB2_FindSearch(sdir);
+
+	if(!fid) return SMB_ERROR;
+
+	SMB2_CloseFile(fid,handle);
+	SMB2_FreeSearch(fid);
+	sdir->sid = 0;
+	return SMB_SUCCESS;
+}
+
+/**
+ * SMB2RecvRead
+ *
+ * Receive one READ response, the payload goes straight to the buffer of
+ * the request the MessageId belongs to. Errors other than end of file
+ * fail the whole transfer.
+ */
+static s32 SMB2RecvRead(SMBHANDLE *handle,SMBPIPESLOT *slots,u32 depth,u32 *length)
+{
+	s32 ret,slot;
+	u8 *ptr = handle->message.smb;
+	NBTSMB *nbt = &handle->message;
+	u32 readlen,ofs,rest,status;
+
+	if(handle->sck_server == INVALID_SOCKET) return SMB_ERROR;
+
+	while(1) {
+		do {
+			ret=smb_recv(handle->sck_server, (u8*)nbt, 4);
+			if(ret!=4) goto failed;
+
+			readlen=(u32)((nbt->length_high<<16)|nbt->length);
+			if(nbt->msg!=NBT_SESSISON_MSG && readlen>0 && readlen<=sizeof(nbt->smb))
+				smb_recv(handle->sck_server, ptr, readlen); //clear unexpected NBT message
+		} while(nbt->msg!=NBT_SESSISON_MSG);
+
+		if(readlen<SMB2_HEADER_SIZE) goto failed;
+		ret=smb_recv(handle->sck_server, ptr, SMB2_HEADER_SIZE);
+		if(ret!=SMB2_HEADER_SIZE) goto failed;
+		if(getUInt(ptr,SMB_OFFSET_PROTO)!=SMB2_PROTO) goto failed;
+
+		SMB2_AddCredits(handle,ptr,SMB2_HEADER_SIZE);
+		status = getUInt(ptr,SMB2_OFFSET_STATUS);
+		if(status==0 && getUShort(ptr,SMB2_OFFSET_CMD)==SMB2_READ) break;
+
+		/*** Error or interim response, small enough for the message buffer ***/
+		rest = readlen-SMB2_HEADER_SIZE;
+		if(rest>sizeof(nbt->smb)-SMB2_HEADER_SIZE) goto failed;
+		if(rest>0) {
+			ret=smb_recv(handle->sck_server, &ptr[SMB2_HEADER_SIZE], rest);
+			if(ret!=rest) goto failed;
+		}
+		if(status==STATUS_PENDING && (getUInt(ptr,SMB2_OFFSET_FLAGS)&SMB2_FLAGS_ASYNC)) continue;
+
+		slot = SMB_FindPipeSlot(slots,depth,getULongLong(ptr,SMB2_OFFSET_MID));
+		if(slot<0 || status!=STATUS_END_OF_FILE) return SMB_ERROR;
+
+		*length = 0;
+		return slot;
+	}
+
+	ret=smb_recv(handle->sck_server, &ptr[SMB2_HEADER_SIZE], 16);
+	if(ret!=16) goto failed;
+
+	slot = SMB_FindPipeSlot(slots,depth,getULongLong(ptr,SMB2_OFFSET_MID));
+	if(slot<0) goto failed;
+
+	ofs = getUChar(ptr,SMB2_HEADER_SIZE+2);
+	*length = getUInt(ptr,SMB2_HEADER_SIZE+4);
+	if(*length>slots[slot].len || ofs<SMB2_HEADER_SIZE+16 || (ofs+*length)>readlen) goto failed;
+
+	// padding up to the data offset
+	if(ofs>SMB2_HEADER_SIZE+16) {
+		ret=smb_recv(handle->sck_server, &ptr[SMB2_HEADER_SIZE+16], ofs-(SMB2_HEADER_SIZE+16));
+		if(ret!=(ofs-(SMB2_HEADER_SIZE+16))) goto failed;
+	}
+	if(*length>0) {
+		ret=smb_recv(handle->sck_server, slots[slot].buffer, *length);
+		if(ret!=*length) goto failed;
+	}
+	rest = readlen-ofs-*length;
+	if(rest>SMB_MAX_TRANSMIT_SIZE) goto failed;
+	if(rest>0) {
+		ret=smb_recv(handle->sck_server, ptr, rest);
+		if(ret!=rest) goto failed;
+	}
+	return slot;
+
+failed:
+	clear_network(handle->sck_server,ptr);
+	handle->conn_valid = false;
+	return SMB_ERROR;
+}
+
+static s32 SMB2_SendRead(SMBHANDLE *handle,struct _smbfile *fid,SMBPIPESLOT *slot)
+{
+	u32 pos;
+	u8 *ptr = handle->message.smb;
+
+	slot->mid = MakeSMB2Header(SMB2_READ,slot->len,0,0,handle);
+	pos = SMB2_HEADER_SIZE;
+	memset(&ptr[pos],0,49);
+
+	setUShort(ptr,pos,49);					/*** StructureSize ***/
+	setUChar(ptr,pos+2,SMB2_HEADER_SIZE+16);	/*** Padding ***/
+	setUInt(ptr,pos+4,slot->len);			/*** Length ***/
+	setULongLong(ptr,pos+8,slot->offset);	/*** Offset ***/
+	memcpy(&ptr[pos+16],fid->fileid,16);
+	pos += 49;
+
+	return SMB2Send(handle,pos);
+}
+
+/**
+ * SMB2_ReadFile
+ *
+ * Same pipeline as READ_ANDX, additionally bounded by the credits
+ * the server granted
+ */
+static s32 SMB2_ReadFile(char *buffer,size_t size,off_t offset,struct _smbfile *fid,SMBHANDLE *handle)
+{
+	s32 ret,slot;
+	u32 i,length,depth,nextread,inflight = 0;
+	u64 t1;
+	size_t totalread=0,issued=0;
+	bool eof = false;
+	SMBPIPESLOT slots[SMB_PIPELINE_MAX];
+
+	depth = handle->depth;
+	for(i=0;i<depth;i++) slots[i].busy = false;
+
+	t1 = gettime();
+	while(issued < size || inflight > 0)
+	{
+		for(i=0;i<depth && inflight<depth && issued<size && !eof;i++)
+		{
+			if(slots[i].busy) continue;
+
+			nextread = size-issued;
+			if(nextread > handle->session.MaxRead) nextread = handle->session.MaxRead;
+			if(!SMB2_Credits(handle,&nextread)) break;
+
+			slots[i].buffer = (u8*)&buffer[issued];
+			slots[i].len = nextread;
+			slots[i].offset = offset+issued;
+			ret = SMB2_SendRead(handle,fid,&slots[i]);
+			if(ret<0) goto failed;
+
+			slots[i].busy = true;
+			issued += nextread;
+			inflight++;
+		}
+		if(inflight==0) {
+			if(issued<size && !eof) goto failed;	// no credits left
+			break;
+		}
+
+		/*** Wait for any reply ***/
+		slot = SMB2RecvRead(handle,slots,depth,&length);
+		if(slot<0) goto failed;
+
+		slots[slot].busy = false;
+		inflight--;
+		totalread += length;
+
+		if(length==0)
+			eof = true;
+		else if(length<slots[slot].len && !eof)
+		{
+			// short read, ask for the rest with the same slot
+			nextread = slots[slot].len-length;
+			if(!SMB2_Credits(handle,&nextread)) {
+				eof = true;
+				continue;
+			}
+			slots[slot].buffer += length;
+			slots[slot].len = nextread;
+			slots[slot].offset += length;
+			ret = SMB2_SendRead(handle,fid,&slots[slot]);
+			if(ret<0) goto failed;
+
+			slots[slot].busy = true;
+			inflight++;
+		}
+	}
+	handle->stats.read_bytes += totalread;
+	handle->stats.read_usecs += diff_usec(t1,gettime());
+	return totalread;
+
+failed:
+	handle->conn_valid = false;
+	return SMB_ERROR;
+}
+
+static u32 SMB2_BuildRead(SMBHANDLE *handle,u32 pos,u32 prev,void *arg)
+{
+	SMBPIPESLOT *slot = (SMBPIPESLOT*)arg;
+	u8 *ptr = handle->message.smb;
+
+	MakeSMB2Header(SMB2_READ,slot->len,pos,prev,handle);
+	pos += SMB2_HEADER_SIZE;
+	memset(&ptr[pos],0,49);
+
+	setUShort(ptr,pos,49);					/*** StructureSize ***/
+	setUChar(ptr,pos+2,SMB2_HEADER_SIZE+16);	/*** Padding ***/
+	setUInt(ptr,pos+4,slot->len);			/*** Length ***/
+	setULongLong(ptr,pos+8,slot->offset);	/*** Offset ***/
+	memset(&ptr[pos+16],0xff,16);			/*** FileId of the related CREATE ***/
+	return pos+49;
+}
+
+/**
+ * SMB2_ReadPath
+ *
+ * CREATE + READ + CLOSE in one round trip, the whole reply has to fit
+ * the message buffer
+ */
+static s32 SMB2_ReadPath(const char *filename,char *buffer,size_t size,off_t offset,SMBHANDLE *handle)
+{
+	s32 pos;
+	u32 ofs,len;
+	u64 t1;
+	SMBPIPESLOT slot;
+	u8 *ptr = handle->message.smb;
+
+	slot.len = size;
+	slot.offset = offset;
+
+	t1 = gettime();
+	if(SMB2_Compound(handle,filename,FILE_READ_DATA|FILE_READ_ATTRIBUTES,FILE_OPEN,FILE_NON_DIRECTORY_FILE,SMB2_BuildRead,&slot)!=SMB_SUCCESS) {
+		// reading at or past the end of the file is no error
+		if(!handle->conn_valid || getUInt(ptr,SMB2_OFFSET_STATUS)!=0) return SMB_ERROR;
+		pos = SMB2_Response(handle,1);
+		if(pos<0 || getUInt(ptr,pos+SMB2_OFFSET_STATUS)!=STATUS_END_OF_FILE) return SMB_ERROR;
+		return 0;
+	}
+
+	pos = SMB2_Response(handle,1);
+	if(pos<0) return SMB_ERROR;
+
+	ofs = getUChar(ptr,pos+SMB2_HEADER_SIZE+2);
+	len = getUInt(ptr,pos+SMB2_HEADER_SIZE+4);
+	if(len>size || pos+ofs+len>sizeof(handle->message.smb)) return SMB_ERROR;
+
+	memcpy(buffer,&ptr[pos+ofs],len);
+	handle->stats.read_bytes += len;
+	handle->stats.read_usecs += diff_usec(t1,gettime());
+	return len;
 }
 
-/**
- * SMB_TreeAndX
- *
- * Finally, net_connect to the remote share
- */
-static s32 SMB_TreeAndX(SMBHANDLE *handle)
+static s32 SMB2_SendWrite(SMBHANDLE *handle,struct _smbfile *fid,const u8 *src,off_t offset,SMBPIPESLOT *slot)
 {
-	s32 pos, bcpos, ret;
-	char path[512];
+	s32 ret;
+	u32 pos;
 	u8 *ptr = handle->message.smb;
-	SMBSESSION *sess = &handle->session;
 
-	if(handle->sck_server == INVALID_SOCKET) return SMB_ERROR;
+	slot->mid = MakeSMB2Header(SMB2_WRITE,slot->len,0,0,handle);
+	pos = SMB2_HEADER_SIZE;
+	memset(&ptr[pos],0,48);
 
-	MakeSMBHeader(SMB_TREEC_ANDX,CIFS_FLAGS1,handle->unicode?CIFS_FLAGS2_UNICODE:CIFS_FLAGS2,handle);
-	pos = SMB_HEADER_SIZE;
+	setUShort(ptr,pos,49);					/*** StructureSize ***/
+	setUShort(ptr,pos+2,SMB2_HEADER_SIZE+48);	/*** DataOffset ***/
+	setUInt(ptr,pos+4,slot->len);			/*** Length ***/
+	setULongLong(ptr,pos+8,offset);			/*** Offset ***/
+	memcpy(&ptr[pos+16],fid->fileid,16);
+	pos += 48;
 
-	setUChar(ptr,pos,4);
-	pos++;				    /*** Word Count ***/
-	setUChar(ptr,pos,0xff);
-	pos++;				    /*** Next AndX ***/
-	pos++;   /*** Reserved ***/
-	pos += 2; /*** Next AndX Offset ***/
-	pos += 2; /*** Flags ***/
-	setUShort(ptr,pos,1);
-	pos += 2;				    /*** Password Length ***/
-	bcpos = pos;
-	pos += 2;
-	pos++;    /*** NULL Password ***/
+	handle->message.msg = NBT_SESSISON_MSG;
+	handle->message.length_high = ((pos+slot->len)>>16)&0xff;
+	handle->message.length = htons((pos+slot->len)&0xffff);
 
-	/*** Build server share path ***/
-	strcpy ((char*)path, "\\\\");
-	strcat ((char*)path, handle->server_name);
-	strcat ((char*)path, "\\");
-	strcat ((char*)path, handle->share_name);
+	/*** Send Header Information ***/
+	ret = smb_send(handle->sck_server,(char*)&handle->message,pos+4);
+	if(ret<0) return ret;
 
-	for(ret=0;ret<strlen((const char*)path);ret++)
-        path[ret] = (char)toupper((int)path[ret]);
+	/*** Send the data straight from the caller's buffer ***/
+	return smb_send(handle->sck_server,src,slot->len);
+}
 
-	if(handle->unicode)
-	{
-        pos += utf8_to_utf16((char*)&ptr[pos],path,SMB_MAXPATH-2);
-        pos += 2;
-	}
-	else
+static s32 SMB2_WriteFile(const char *buffer,size_t size,off_t offset,struct _smbfile *fid,SMBHANDLE *handle)
+{
+	u8 *ptr;
+	s32 slot;
+	u32 i,count,depth,nextwrite,inflight = 0;
+	u64 t1;
+	size_t written, issued = 0, hole = size;
+	bool stop = false;
+	SMBPIPESLOT slots[SMB_PIPELINE_MAX];
+
+	depth = handle->depth;
+	for(i=0;i<depth;i++) slots[i].busy = false;
+
+	t1 = gettime();
+	while(issued < size || inflight > 0)
 	{
-        memcpy(&ptr[pos],path,strlen((const char*)path));
-        pos += strlen((const char*)path)+1;
-	}
+		for(i=0;i<depth && inflight<depth && issued<size && !stop;i++)
+		{
+			if(slots[i].busy) continue;
 
-	/*** Service ***/
-	strcpy((char*)path,"?????");
-	memcpy(&ptr[pos],path,strlen((const char*)path));
-	pos += strlen((const char*)path)+1;
+			nextwrite = size-issued;
+			if(nextwrite > handle->session.MaxWrite) nextwrite = handle->session.MaxWrite;
+			if(!SMB2_Credits(handle,&nextwrite)) break;
 
+			slots[i].len = nextwrite;
+			slots[i].offset = issued;
+			if(SMB2_SendWrite(handle,fid,(const u8*)&buffer[issued],offset+issued,&slots[i])<0) goto failed;
 
-	/*** Update byte count ***/
-	setUShort(ptr,bcpos,(pos-bcpos)-2);
+			slots[i].busy = true;
+			issued += nextwrite;
+			inflight++;
+		}
+		if(inflight==0) {
+			if(issued<size && !stop) goto failed;	// no credits left
+			break;
+		}
 
-	handle->message.msg = NBT_SESSISON_MSG;
-	handle->message.length = htons (pos);
-	pos += 4;
+		if(SMB2Recv(handle)<0) goto failed;
 
-	ret = smb_send(handle->sck_server,(char *)&handle->message,pos);
-	if(ret<=0) return SMB_ERROR;
+		ptr = handle->message.smb;
+		slot = SMB_FindPipeSlot(slots,depth,getULongLong(ptr,SMB2_OFFSET_MID));
+		if(slot<0) goto failed;
 
-	if((ret=SMBCheck(SMB_TREEC_ANDX,handle))==SMB_SUCCESS) {
-		/*** Collect Tree ID ***/
-		sess->TID = getUShort(handle->message.smb,SMB_OFFSET_TID);
-		return SMB_SUCCESS;
+		count = 0;
+		if(getUInt(ptr,SMB2_OFFSET_STATUS)==0)
+			count = getUInt(ptr,SMB2_HEADER_SIZE+4);
+
+		slots[slot].busy = false;
+		inflight--;
+
+		// after a short write the file has a hole, replies may come in any
+		// order so only the data in front of the first hole counts
+		if(count<slots[slot].len) {
+			if((size_t)slots[slot].offset+count<hole) hole = slots[slot].offset+count;
+			stop = true;
+		}
 	}
-	return ret;
+	written = (issued<hole) ? issued : hole;
+	handle->stats.write_bytes += written;
+	handle->stats.write_usecs += diff_usec(t1,gettime());
+	return written;
+
+failed:
+	handle->conn_valid = false;
+	return SMB_ERROR;
 }
 
 /**
  * SMB_NegotiateProtocol
  *
- * The only protocol we admit to is 'NT LM 0.12'
+ * Offers 'NT LM 0.12' and the SMB2 dialects, a server that picks SMB2
+ * answers with an SMB2 NEGOTIATE response
  */
 static s32 SMB_NegotiateProtocol(const char *dialects[],int dialectc,SMBHANDLE *handle)
 {
@@ -892,16 +2300,23 @@ static s32 SMB_NegotiateProtocol(const char *dialects[],int dialectc,SMBHANDLE *
 	if(ret<=0) return SMB_ERROR;
 
 	/*** Check response ***/
-	if((ret=SMBCheck(SMB_NEG_PROTOCOL,handle))==SMB_SUCCESS)
+	if(SMBRecvMessage(handle)!=SMB_SUCCESS) return SMB_ERROR;
+
+	ptr = handle->message.smb;
+	if(getUInt(ptr,SMB_OFFSET_PROTO)==SMB2_PROTO)
+		return SMB2_NegotiateProtocol(handle);
+
+	ret = SMB_ERROR;
+	if(getUInt(ptr,SMB_OFFSET_PROTO)==SMB_PROTO && getUChar(ptr,SMB_OFFSET_CMD)==SMB_NEG_PROTOCOL &&
+	   getUInt(ptr,SMB_OFFSET_NTSTATUS)==0)
 	{
 		pos = SMB_HEADER_SIZE;
-		ptr = handle->message.smb;
 
 		/*** Collect information ***/
 		if(getUChar(ptr,pos)!=17) return SMB_PROTO_FAIL;	// UCHAR WordCount; Count of parameter words = 17
 
 		pos++;
-		if(getUShort(ptr,pos)!=0) return SMB_PROTO_FAIL;	// USHORT DialectIndex; Index of selected dialect - should always be 0 since we only supplied 1!
+		if(getUShort(ptr,pos)!=0) return SMB_PROTO_FAIL;	// USHORT DialectIndex; Index of selected dialect - the others are SMB2
 
 		pos += 2;
 		if(getUChar(ptr,pos) & 1)
@@ -985,6 +2400,15 @@ static s32 SMB_NegotiateProtocol(const char *dialects[],int dialectc,SMBHANDLE *
 			handle->unicode = true;
 		}
 
+		// replies larger than MaxBuffer go straight to the caller's buffer
+		if(servcap & CAP_LARGE_READX)
+			sess->capabilities |= CAP_LARGE_READX;
+		if(servcap & CAP_LARGE_WRITEX)
+			sess->capabilities |= CAP_LARGE_WRITEX;
+
+		if(sess->MaxMpx>0 && handle->depth>sess->MaxMpx)
+			handle->depth = sess->MaxMpx;
+
 		return SMB_SUCCESS;
 	}
 	return ret;
@@ -1047,7 +2471,10 @@ static s32 do_smbconnect(SMBHANDLE *handle)
 		return -1;
 	}
 
-	ret = SMB_SetupAndX(handle);
+	if(handle->session.dialect)
+		ret = SMB2_SessionSetup(handle);
+	else
+		ret = SMB_SetupAndX(handle);
 	if(ret!=SMB_SUCCESS)
 	{
 		net_close(handle->sck_server);
@@ -1055,7 +2482,10 @@ static s32 do_smbconnect(SMBHANDLE *handle)
 		return -1;
 	}
 
-	ret = SMB_TreeAndX(handle);
+	if(handle->session.dialect)
+		ret = SMB2_TreeConnect(handle);
+	else
+		ret = SMB_TreeAndX(handle);
 	if(ret!=SMB_SUCCESS)
 	{
 		net_close(handle->sck_server);
@@ -1369,6 +2799,9 @@ SMBFILE SMB_OpenFile(const char *filename, u16 access, u16 creation,SMBCONN smbh
 	handle = __smb_handle_open(smbhndl);
 	if(!handle) return NULL;
 
+	if(handle->session.dialect)
+		return SMB2_OpenFile(filename,access,creation,smbhndl,handle);
+
 	MakeSMBHeader(SMB_OPEN_ANDX,CIFS_FLAGS1,handle->unicode?CIFS_FLAGS2_UNICODE:CIFS_FLAGS2,handle);
 
 	pos = SMB_HEADER_SIZE;
@@ -1454,6 +2887,13 @@ void SMB_CloseFile(SMBFILE sfid)
 	handle = __smb_handle_open(fid->conn);
 	if(!handle) return;
 
+	if(handle->session.dialect)
+	{
+		SMB2_CloseFile(fid,handle);
+		__lwp_queue_append(&smb_filehandle_queue,&fid->node);
+		return;
+	}
+
 	MakeSMBHeader(SMB_CLOSE,CIFS_FLAGS1,handle->unicode?CIFS_FLAGS2_UNICODE:CIFS_FLAGS2,handle);
 
 	pos = SMB_HEADER_SIZE;
@@ -1495,6 +2935,9 @@ s32 SMB_CreateDirectory(const char *dirname, SMBCONN smbhndl)
 	handle = __smb_handle_open(smbhndl);
 	if(!handle) return -1;
 
+	if(handle->session.dialect)
+		return SMB2_Compound(handle,dirname,FILE_READ_ATTRIBUTES,FILE_CREATE,FILE_DIRECTORY_FILE,NULL,NULL);
+
 	MakeSMBHeader(SMB_COM_CREATE_DIRECTORY,CIFS_FLAGS1, handle->unicode?CIFS_FLAGS2_UNICODE:CIFS_FLAGS2,handle);
 
 	pos = SMB_HEADER_SIZE;
@@ -1558,6 +3001,9 @@ s32 SMB_DeleteDirectory(const char *dirname, SMBCONN smbhndl)
 	handle = __smb_handle_open(smbhndl);
 	if(!handle) return -1;
 
+	if(handle->session.dialect)
+		return SMB2_Compound(handle,dirname,DELETE_ACCESS|FILE_READ_ATTRIBUTES,FILE_OPEN,FILE_DIRECTORY_FILE|FILE_DELETE_ON_CLOSE,NULL,NULL);
+
 	MakeSMBHeader(SMB_COM_DELETE_DIRECTORY,CIFS_FLAGS1, handle->unicode?CIFS_FLAGS2_UNICODE:CIFS_FLAGS2,handle);
 
 	pos = SMB_HEADER_SIZE;
@@ -1621,6 +3067,9 @@ s32 SMB_DeleteFile(const char *filename, SMBCONN smbhndl)
 	handle = __smb_handle_open(smbhndl);
 	if(!handle) return -1;
 
+	if(handle->session.dialect)
+		return SMB2_Compound(handle,filename,DELETE_ACCESS|FILE_READ_ATTRIBUTES,FILE_OPEN,FILE_NON_DIRECTORY_FILE|FILE_DELETE_ON_CLOSE,NULL,NULL);
+
 	MakeSMBHeader(SMB_COM_DELETE,CIFS_FLAGS1, handle->unicode?CIFS_FLAGS2_UNICODE:CIFS_FLAGS2,handle);
 
 	pos = SMB_HEADER_SIZE;
@@ -1688,6 +3137,9 @@ s32 SMB_Rename(const char *filename, const char * newfilename, SMBCONN smbhndl)
 	handle = __smb_handle_open(smbhndl);
 	if(!handle) return -1;
 
+	if(handle->session.dialect)
+		return SMB2_Compound(handle,filename,DELETE_ACCESS|FILE_READ_ATTRIBUTES,FILE_OPEN,0,SMB2_BuildRename,(void*)newfilename);
+
 	MakeSMBHeader(SMB_COM_RENAME,CIFS_FLAGS1, handle->unicode?CIFS_FLAGS2_UNICODE:CIFS_FLAGS2,handle);
 
 	pos = SMB_HEADER_SIZE;
@@ -1770,6 +3222,9 @@ s32 SMB_DiskInformation(struct statvfs *buf, SMBCONN smbhndl)
 	handle = __smb_handle_open(smbhndl);
 	if(!handle) return -1;
 
+	if(handle->session.dialect)
+		return SMB2_DiskInformation(buf,handle);
+
 	MakeSMBHeader(SMB_COM_QUERY_INFORMATION_DISK,CIFS_FLAGS1, handle->unicode?CIFS_FLAGS2_UNICODE:CIFS_FLAGS2,handle);
 
 	pos = SMB_HEADER_SIZE;
@@ -1825,16 +3280,164 @@ failed:
 	return ret;
 }
 
+/**
+ * SMB_SetPipelineDepth
+ *
+ * Number of READ_ANDX/WRITE_ANDX requests kept in flight, bounded
+ * by the server's MaxMpxCount
+ */
+s32 SMB_SetPipelineDepth(SMBCONN smbhndl, u32 depth)
+{
+	SMBHANDLE *handle;
+
+	handle = __smb_handle_open(smbhndl);
+	if(!handle) return SMB_ERROR;
+
+	if(depth<1) depth = 1;
+	if(depth>SMB_PIPELINE_MAX) depth = SMB_PIPELINE_MAX;
+	if(handle->session.MaxMpx>0 && depth>handle->session.MaxMpx) depth = handle->session.MaxMpx;
+	handle->depth = depth;
+
+	return SMB_SUCCESS;
+}
+
+/**
+ * SMB_GetStats
+ */
+s32 SMB_GetStats(SMBCONN smbhndl, SMBSTATS *stats)
+{
+	SMBHANDLE *handle;
+
+	if(!stats) return SMB_ERROR;
+
+	handle = __smb_handle_open(smbhndl);
+	if(!handle) return SMB_ERROR;
+
+	memcpy(stats,&handle->stats,sizeof(SMBSTATS));
+	return SMB_SUCCESS;
+}
+
+/**
+ * SMBRecvReadX
+ *
+ * Receive one READ_ANDX reply. Header and parameter words go to the
+ * message buffer, the payload goes straight to the buffer of the
+ * request the reply's MID belongs to.
+ */
+static s32 SMBRecvReadX(SMBHANDLE *handle,SMBPIPESLOT *slots,u32 depth,u32 *length)
+{
+	s32 ret,slot;
+	u8 *ptr = handle->message.smb;
+	NBTSMB *nbt = &handle->message;
+	u32 readlen,hdrlen,ofs,rest;
+
+	if(handle->sck_server == INVALID_SOCKET) return SMB_ERROR;
+
+	do {
+		ret=smb_recv(handle->sck_server, (u8*)nbt, 4);
+		if(ret!=4) goto failed;
+
+		readlen=(u32)((nbt->length_high<<16)|nbt->length);
+		if(nbt->msg!=NBT_SESSISON_MSG && readlen>0)
+			smb_recv(handle->sck_server, ptr, readlen); //clear unexpected NBT message
+	} while(nbt->msg!=NBT_SESSISON_MSG);
+
+	hdrlen = (readlen<READX_REPLY_SIZE) ? readlen : READX_REPLY_SIZE;
+	ret=smb_recv(handle->sck_server, ptr, hdrlen);
+	if(ret!=hdrlen) goto failed;
+
+	if(getUInt(ptr,SMB_OFFSET_PROTO)!=SMB_PROTO) goto failed;
+	if(getUChar(ptr,SMB_OFFSET_CMD)!=SMB_READ_ANDX) goto failed;
+	if(getUInt(ptr,SMB_OFFSET_NTSTATUS)) goto failed;
+	if(hdrlen<READX_REPLY_SIZE) goto failed;
+
+	slot = SMB_FindPipeSlot(slots,depth,getUShort(ptr,SMB_OFFSET_MID));
+	if(slot<0) goto failed;
+
+	*length = getUShort(ptr,(SMB_HEADER_SIZE+11));
+	if(handle->session.capabilities&CAP_LARGE_READX)
+		*length |= getUShort(ptr,(SMB_HEADER_SIZE+15))<<16;
+	ofs = getUShort(ptr,(SMB_HEADER_SIZE+13));
+	if(*length>slots[slot].len || ofs<hdrlen || ofs>SMB_MAX_TRANSMIT_SIZE || (ofs+*length)>readlen) goto failed;
+
+	// padding up to the data offset
+	if(ofs>hdrlen) {
+		ret=smb_recv(handle->sck_server, &ptr[hdrlen], ofs-hdrlen);
+		if(ret!=(ofs-hdrlen)) goto failed;
+	}
+	if(*length>0) {
+		ret=smb_recv(handle->sck_server, slots[slot].buffer, *length);
+		if(ret!=*length) goto failed;
+	}
+	rest = readlen-ofs-*length;
+	if(rest>SMB_MAX_TRANSMIT_SIZE) goto failed;
+	if(rest>0) {
+		ret=smb_recv(handle->sck_server, ptr, rest);
+		if(ret!=rest) goto failed;
+	}
+	return slot;
+
+failed:
+	clear_network(handle->sck_server,ptr);
+	return SMB_ERROR;
+}
+
+static s32 SMB_SendReadX(SMBHANDLE *handle,struct _smbfile *fid,off_t offset,u32 len,u16 mid)
+{
+	u8 *ptr;
+	u32 pos;
+
+	MakeSMBHeader(SMB_READ_ANDX,CIFS_FLAGS1,handle->unicode?CIFS_FLAGS2_UNICODE:CIFS_FLAGS2,handle);
+
+	pos = SMB_HEADER_SIZE;
+	ptr = handle->message.smb;
+	setUShort(ptr, SMB_OFFSET_MID, mid);
+	setUChar(ptr, pos, 12);
+	pos++;				      /*** Word count ***/
+	setUChar(ptr, pos, 0xff);
+	pos++;
+	setUChar(ptr, pos, 0);
+	pos++;          /*** Reserved must be 0 ***/
+	pos += 2;	    /*** Next AndX Offset ***/
+	setUShort(ptr, pos, fid->sfid);
+	pos += 2;					    /*** FID ***/
+	setUInt(ptr, pos, offset & 0xffffffff);
+	pos += 4;						 /*** Offset ***/
+
+	setUShort(ptr, pos, len & 0xffff);
+	pos += 2;	    /*** MaxCount ***/
+	setUShort(ptr, pos, len & 0xffff);
+	pos += 2;	    /*** MinCount ***/
+	setUInt(ptr, pos, len >> 16);
+	pos += 4;       /*** MaxCountHigh, only non-zero with CAP_LARGE_READX ***/
+	setUShort(ptr, pos, len & 0xffff);
+	pos += 2;	    /*** Remaining ***/
+	setUInt(ptr, pos, (u64)offset >> 32);  // offset high
+	pos += 4;       /*** OffsetHIGH ***/
+	pos += 2;	    /*** Byte count ***/
+
+	handle->message.msg = NBT_SESSISON_MSG;
+	handle->message.length = htons(pos);
+
+	pos += 4;
+
+	return smb_send(handle->sck_server,(char*)&handle->message, pos);
+}
+
 /**
  * SMB_Read
+ *
+ * Keeps up to handle->depth READ_ANDX requests in flight
  */
 s32 SMB_ReadFile(char *buffer, size_t size, off_t offset, SMBFILE sfid)
 {
-	u8 *ptr;
-	u32 pos, ret, ofs;
-	u16 length = 0;
+	s32 ret,slot;
+	u32 i,length,depth,chunk,inflight = 0;
+	u64 t1;
 	SMBHANDLE *handle;
-	size_t totalread=0,nextread;
+	size_t totalread=0,nextread,issued=0;
+	bool eof = false;
+	SMBPIPESLOT slots[SMB_PIPELINE_MAX];
 	struct _smbfile *fid = (struct _smbfile*)sfid;
 
 	if(!fid) return -1;
@@ -1845,65 +3448,63 @@ s32 SMB_ReadFile(char *buffer, size_t size, off_t offset, SMBFILE sfid)
 	handle = __smb_handle_open(fid->conn);
 	if(!handle) return -1;
 
-	while(totalread < size)
-	{
-		if((size-totalread) > SMB_MAX_TRANSMIT_SIZE)
-			nextread=SMB_MAX_TRANSMIT_SIZE;
-		else
-			nextread=size-totalread;
+	if(handle->session.dialect)
+		return SMB2_ReadFile(buffer,size,offset,fid,handle);
 
-		MakeSMBHeader(SMB_READ_ANDX,CIFS_FLAGS1,handle->unicode?CIFS_FLAGS2_UNICODE:CIFS_FLAGS2,handle);
+	depth = handle->depth;
+	chunk = (handle->session.capabilities&CAP_LARGE_READX) ? SMB_MAX_LARGE_READ_SIZE : SMB_MAX_TRANSMIT_SIZE;
+	for(i=0;i<depth;i++) slots[i].busy = false;
 
-		pos = SMB_HEADER_SIZE;
-		ptr = handle->message.smb;
-		setUChar(ptr, pos, 12);
-		pos++;				      /*** Word count ***/
-		setUChar(ptr, pos, 0xff);
-		pos++;
-		setUChar(ptr, pos, 0);
-		pos++;          /*** Reserved must be 0 ***/
-		pos += 2;	    /*** Next AndX Offset ***/
-		setUShort(ptr, pos, fid->sfid);
-		pos += 2;					    /*** FID ***/
-		setUInt(ptr, pos, (offset+totalread) & 0xffffffff);
-		pos += 4;						 /*** Offset ***/
-
-		setUShort(ptr, pos, nextread & 0xffff);
-		pos += 2;
-		setUShort(ptr, pos, nextread & 0xffff);
-		pos += 2;
-		setUInt(ptr, pos, 0);
-		pos += 4;       /*** Reserved must be 0 ***/
-		setUShort(ptr, pos, nextread & 0xffff);
-		pos += 2;	    /*** Remaining ***/
-		setUInt(ptr, pos, (offset+totalread) >> 32);  // offset high
-		pos += 4;       /*** OffsetHIGH ***/
-		pos += 2;	    /*** Byte count ***/
+	t1 = gettime();
+	while(issued < size || inflight > 0)
+	{
+		for(i=0;i<depth && inflight<depth && issued<size && !eof;i++)
+		{
+			if(slots[i].busy) continue;
 
-		handle->message.msg = NBT_SESSISON_MSG;
-		handle->message.length = htons(pos);
+			nextread = size-issued;
+			if(nextread > chunk) nextread = chunk;
 
-		pos += 4;
+			slots[i].mid = SMB_NextMID(handle);
+			slots[i].buffer = (u8*)&buffer[issued];
+			slots[i].len = nextread;
+			slots[i].offset = offset+issued;
+			ret = SMB_SendReadX(handle,fid,slots[i].offset,nextread,slots[i].mid);
+			if(ret<0) goto failed;
 
-		ret = smb_send(handle->sck_server,(char*)&handle->message, pos);
-		if(ret<0) goto failed;
+			slots[i].busy = true;
+			issued += nextread;
+			inflight++;
+		}
+		if(inflight==0) break;
 
-		/*** SMBCheck  ***/
-		if(SMBCheck(SMB_READ_ANDX,handle)!=SMB_SUCCESS) goto failed;
+		/*** Wait for any reply ***/
+		slot = SMBRecvReadX(handle,slots,depth,&length);
+		if(slot<0) goto failed;
 
-		ptr = handle->message.smb;
-		// Retrieve data length for this packet
-		length = getUShort(ptr,(SMB_HEADER_SIZE+11));
+		slots[slot].busy = false;
+		inflight--;
+		totalread += length;
 
 		if(length==0)
-			break;
-
-		// Retrieve offset to data
-		ofs = getUShort(ptr,(SMB_HEADER_SIZE+13));
-		memcpy(&buffer[totalread],&ptr[ofs],length);
-		totalread+=length;
+			eof = true;
+		else if(length<slots[slot].len && !eof)
+		{
+			// short read, ask for the rest with the same slot
+			slots[slot].mid = SMB_NextMID(handle);
+			slots[slot].buffer += length;
+			slots[slot].len -= length;
+			slots[slot].offset += length;
+			ret = SMB_SendReadX(handle,fid,slots[slot].offset,slots[slot].len,slots[slot].mid);
+			if(ret<0) goto failed;
+
+			slots[slot].busy = true;
+			inflight++;
+		}
 	}
-	return size;
+	handle->stats.read_bytes += totalread;
+	handle->stats.read_usecs += diff_usec(t1,gettime());
+	return totalread;
 
 failed:
 	handle->conn_valid = false;
@@ -1911,27 +3512,47 @@ failed:
 }
 
 /**
- * SMB_Write
+ * SMB_ReadPath
+ *
+ * Read from a file without keeping it open. SMB2 sends open, read and
+ * close as one compound when the data fits a single reply.
  */
-s32 SMB_WriteFile(const char *buffer, size_t size, off_t offset, SMBFILE sfid)
+s32 SMB_ReadPath(const char *filename, char *buffer, size_t size, off_t offset, SMBCONN smbhndl)
 {
-	u8 *ptr,*src;
-	s32 pos, ret;
-	s32 blocks64;
-	u32 copy_len;
+	s32 ret;
+	SMBFILE sfid;
 	SMBHANDLE *handle;
-	struct _smbfile *fid = (struct _smbfile*)sfid;
 
-	if(!fid) return -1;
+	if(filename == NULL || size == 0)
+		return SMB_ERROR;
 
-	handle = __smb_handle_open(fid->conn);
-	if(!handle) return -1;
+	if(SMB_Reconnect(&smbhndl,true)!=SMB_SUCCESS) return SMB_ERROR;
 
-	MakeSMBHeader(SMB_WRITE_ANDX,CIFS_FLAGS1,handle->unicode?CIFS_FLAGS2_UNICODE:CIFS_FLAGS2,handle);
+	handle = __smb_handle_open(smbhndl);
+	if(!handle) return SMB_ERROR;
+
+	if(handle->session.dialect && size<=SMB2_COMPOUND_READ_MAX)
+		return SMB2_ReadPath(filename,buffer,size,offset,handle);
+
+	sfid = SMB_OpenFile(filename,SMB_OPEN_READING,SMB_OF_OPEN,smbhndl);
+	if(!sfid) return SMB_ERROR;
+
+	ret = SMB_ReadFile(buffer,size,offset,sfid);
+	SMB_CloseFile(sfid);
+	return ret;
+}
+
+static s32 SMB_SendWriteX(SMBHANDLE *handle,struct _smbfile *fid,const u8 *src,off_t offset,u32 len,u16 mid)
+{
+	u8 *ptr;
+	s32 pos, ret;
+	u32 msglen;
 
+	MakeSMBHeader(SMB_WRITE_ANDX,CIFS_FLAGS1,handle->unicode?CIFS_FLAGS2_UNICODE:CIFS_FLAGS2,handle);
 
 	pos = SMB_HEADER_SIZE;
 	ptr = handle->message.smb;
+	setUShort(ptr, SMB_OFFSET_MID, mid);
 	setUChar(ptr, pos, 14);
 	pos++;				  /*** Word Count ***/
 	setUChar(ptr, pos, 0xff);
@@ -1948,56 +3569,111 @@ s32 SMB_WriteFile(const char *buffer, size_t size, off_t offset, SMBFILE sfid)
 	pos += 2;
 	pos += 2; /*** Remaining ***/
 
-	blocks64 = size >> 16;
-
-	setUShort(ptr, pos, blocks64);
+	setUShort(ptr, pos, len >> 16);
 	pos += 2;				       /*** Length High ***/
-	setUShort(ptr, pos, size & 0xffff);
+	setUShort(ptr, pos, len & 0xffff);
 	pos += 2;					    /*** Length Low ***/
-	setUShort(ptr, pos, 63);
+	setUShort(ptr, pos, WRITEX_REQUEST_SIZE);
 	pos += 2;				 /*** Data Offset ***/
-	setUInt(ptr, pos, offset >> 32);  /*** OffsetHigh ***/
+	setUInt(ptr, pos, (u64)offset >> 32);  /*** OffsetHigh ***/
 	pos += 4;
-	setUShort(ptr, pos, size & 0xffff);
+	setUShort(ptr, pos, len & 0xffff);
 	pos += 2;					    /*** Data Byte Count ***/
 
+	msglen = pos+len;
 	handle->message.msg = NBT_SESSISON_MSG;
-	handle->message.length = htons(pos+size);
-
-	src = (u8*)buffer;
-	copy_len = size;
-
-	if((copy_len+pos)>SMB_MAX_TRANSMIT_SIZE)
-		copy_len = (SMB_MAX_TRANSMIT_SIZE-pos);
-
-	memcpy(&ptr[pos],src,copy_len);
-	size -= copy_len;
-	src += copy_len;
-	pos += copy_len;
+	handle->message.length_high = (msglen >> 16) & 0xff;
+	handle->message.length = htons(msglen & 0xffff);
 
 	pos += 4;
 
 	/*** Send Header Information ***/
 	ret = smb_send(handle->sck_server,(char*)&handle->message,pos);
-	if(ret<0) goto failed;
+	if(ret<0) return ret;
 
-	if(size>0) {
-		/*** Send the data ***/
-		ret = smb_send(handle->sck_server,src,size);
-		if(ret<0) goto failed;
-	}
+	/*** Send the data straight from the caller's buffer ***/
+	return smb_send(handle->sck_server,src,len);
+}
+
+/**
+ * SMB_Write
+ *
+ * Keeps up to handle->depth WRITE_ANDX requests in flight
+ */
+s32 SMB_WriteFile(const char *buffer, size_t size, off_t offset, SMBFILE sfid)
+{
+	u8 *ptr;
+	s32 ret, slot;
+	u32 i, count, depth, chunk, inflight = 0;
+	u64 t1;
+	SMBHANDLE *handle;
+	size_t written, issued = 0, hole = size, nextwrite;
+	bool stop = false;
+	SMBPIPESLOT slots[SMB_PIPELINE_MAX];
+	struct _smbfile *fid = (struct _smbfile*)sfid;
+
+	if(!fid) return -1;
+
+	handle = __smb_handle_open(fid->conn);
+	if(!handle) return -1;
+
+	if(handle->session.dialect)
+		return SMB2_WriteFile(buffer,size,offset,fid,handle);
+
+	depth = handle->depth;
+	chunk = (handle->session.capabilities&CAP_LARGE_WRITEX) ? SMB_MAX_LARGE_WRITE_SIZE : (SMB_MAX_TRANSMIT_SIZE-WRITEX_REQUEST_SIZE);
+	for(i=0;i<depth;i++) slots[i].busy = false;
+
+	t1 = gettime();
+	while(issued < size || inflight > 0)
+	{
+		for(i=0;i<depth && inflight<depth && issued<size && !stop;i++)
+		{
+			if(slots[i].busy) continue;
+
+			nextwrite = size-issued;
+			if(nextwrite > chunk) nextwrite = chunk;
+
+			slots[i].mid = SMB_NextMID(handle);
+			slots[i].len = nextwrite;
+			slots[i].offset = issued;
+			ret = SMB_SendWriteX(handle,fid,(const u8*)&buffer[issued],offset+issued,nextwrite,slots[i].mid);
+			if(ret<0) goto failed;
+
+			slots[i].busy = true;
+			issued += nextwrite;
+			inflight++;
+		}
+		if(inflight==0) break;
+
+		if(SMBCheck(SMB_WRITE_ANDX,handle)!=SMB_SUCCESS) goto failed;
 
-	ret = 0;
-	if(SMBCheck(SMB_WRITE_ANDX,handle)==SMB_SUCCESS) {
 		ptr = handle->message.smb;
-		ret = getUShort(ptr,(SMB_HEADER_SIZE+5));
-	}
+		slot = SMB_FindPipeSlot(slots,depth,getUShort(ptr,SMB_OFFSET_MID));
+		if(slot<0) goto failed;
 
-	return ret;
+		count = getUShort(ptr,(SMB_HEADER_SIZE+5));
+		if(handle->session.capabilities&CAP_LARGE_WRITEX)
+			count |= getUShort(ptr,(SMB_HEADER_SIZE+9))<<16;
+
+		slots[slot].busy = false;
+		inflight--;
+
+		// after a short write the file has a hole, replies may come in any
+		// order so only the data in front of the first hole counts
+		if(count<slots[slot].len) {
+			if((size_t)slots[slot].offset+count<hole) hole = slots[slot].offset+count;
+			stop = true;
+		}
+	}
+	written = (issued<hole) ? issued : hole;
+	handle->stats.write_bytes += written;
+	handle->stats.write_usecs += diff_usec(t1,gettime());
+	return written;
 
 failed:
 	handle->conn_valid = false;
-	return ret;
+	return SMB_ERROR;
 }
 
 /**
@@ -2019,6 +3695,9 @@ s32 SMB_PathInfo(const char *filename, SMBDIRENTRY *sdir, SMBCONN smbhndl)
 	handle = __smb_handle_open(smbhndl);
 	if (!handle) return SMB_ERROR;
 
+	if(handle->session.dialect)
+		return SMB2_PathInfo(filename,sdir,handle);
+
 	MakeSMBHeader(SMB_TRANS2, CIFS_FLAGS1, handle->unicode?CIFS_FLAGS2_UNICODE:CIFS_FLAGS2, handle);
 	MakeTRANS2Header(SMB_QUERY_PATH_INFO, handle);
 
@@ -2117,6 +3796,9 @@ s32 SMB_FindFirst(const char *filename, unsigned short flags, SMBDIRENTRY *sdir,
 	handle = __smb_handle_open(smbhndl);
 	if(!handle) return SMB_ERROR;
 
+	if(handle->session.dialect)
+		return SMB2_FindFirst(filename,sdir,handle);
+
 	sess = &handle->session;
 	MakeSMBHeader(SMB_TRANS2,CIFS_FLAGS1,handle->unicode?CIFS_FLAGS2_UNICODE:CIFS_FLAGS2,handle);
 	MakeTRANS2Header(SMB_FIND_FIRST2,handle);
@@ -2218,8 +3900,12 @@ s32 SMB_FindNext(SMBDIRENTRY *sdir,SMBCONN smbhndl)
 	handle = __smb_handle_open(smbhndl);
 	if(!handle) return SMB_ERROR;
 
+	if(handle->session.dialect)
+		return SMB2_FindNext(sdir,handle);
+
 	sess = &handle->session;
-	if(sess->eos || sdir->sid==0) return SMB_ERROR;
+	if(sdir->sid==0) return SMB_ERROR;
+	if(sess->eos) return SMB_NO_MORE_FILES;
 
 	MakeSMBHeader(SMB_TRANS2,CIFS_FLAGS1,handle->unicode?CIFS_FLAGS2_UNICODE:CIFS_FLAGS2,handle);
 	MakeTRANS2Header(SMB_FIND_NEXT2,handle);
@@ -2286,7 +3972,11 @@ s32 SMB_FindNext(SMBDIRENTRY *sdir,SMBCONN smbhndl)
 
 			ret = SMB_SUCCESS;
 		}
+		else if (sess->eos)
+			ret = SMB_NO_MORE_FILES;
 	}
+	else if (getUInt(ptr,SMB_OFFSET_NTSTATUS)==STATUS_NO_MORE_FILES)
+		ret = SMB_NO_MORE_FILES;
 	return ret;
 
 failed:
@@ -2307,6 +3997,9 @@ s32 SMB_FindClose(SMBDIRENTRY *sdir,SMBCONN smbhndl)
 	handle = __smb_handle_open(smbhndl);
 	if(!handle) return SMB_ERROR;
 
+	if(handle->session.dialect)
+		return SMB2_FindClose(sdir,handle);
+
 	if(sdir->sid==0) return SMB_ERROR;
 
 	MakeSMBHeader(SMB_FIND_CLOSE2,CIFS_FLAGS1,handle->unicode?CIFS_FLAGS2_UNICODE:CIFS_FLAGS2,handle);
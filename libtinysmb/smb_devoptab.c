@@ -10,21 +10,24 @@
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <strings.h>
+#include <ctype.h>
 #include <stdio.h>
 #include <dirent.h>
 
 #include <ogc/lwp.h>
 #include <ogc/lwp_watchdog.h>
 #include <ogc/mutex.h>
+#include <ogc/cond.h>
 
 #include "smb.h"
 
 #define MAX_SMB_MOUNTED 10
 
 static lwp_t cache_thread = LWP_THREAD_NULL;
-static SMBDIRENTRY last_dentry;
-static int last_env=-1;
-static char last_path[SMB_MAXPATH];
+static mutex_t cache_mutex = LWP_MUTEX_NULL;
+static cond_t cache_cond = LWP_COND_NULL;
+static bool cache_pending = false;
 
 
 typedef struct
@@ -36,6 +39,8 @@ typedef struct
 	unsigned short access;
 	int env;
 	u32 attributes;
+	off_t ra_next;
+	u32 ra_window;
 } SMBFILESTRUCT;
 
 typedef struct
@@ -43,6 +48,8 @@ typedef struct
 	SMBDIRENTRY smbdir;
 	int env;
 	char dir[SMB_MAXPATH];
+	u32 attr_gen;
+	u64 attr_started;
 } SMBDIRSTATESTRUCT;
 
 static bool smbInited = false;
@@ -53,13 +60,25 @@ static unsigned short smbFlags = SMB_SRCH_DIRECTORY | SMB_SRCH_READONLY;
 ///////////////////////////////////////////
 #define SMB_READ_BUFFERSIZE				65472
 #define SMB_WRITE_BUFFERSIZE			(60*1024)
+#define SMB_CACHE_HASHSIZE				32
+#define SMB_RA_QUEUESIZE				16
+#define SMB_ATTR_HASHSIZE				64
+#define SMB_ATTR_ENTRIES				512
+#define SMB_ATTR_TTL					2000 // msecs
 
-typedef struct
+// listings made with these flags hold every entry of the directory
+#define SMB_SRCH_ALL					(SMB_SRCH_HIDDEN | SMB_SRCH_SYSTEM | SMB_SRCH_DIRECTORY)
+
+typedef struct _smb_cache_page
 {
 	off_t offset;
-	u64 last_used;
+	size_t len;
 	SMBFILESTRUCT *file;
 	void *ptr;
+	bool prefetched;
+	struct _smb_cache_page *hash_next;
+	struct _smb_cache_page *lru_prev;
+	struct _smb_cache_page *lru_next;
 } smb_cache_page;
 
 typedef struct
@@ -70,6 +89,29 @@ typedef struct
 	void *ptr;
 } smb_write_cache;
 
+typedef struct
+{
+	SMBFILESTRUCT *file;
+	off_t page;
+} smb_ra_request;
+
+typedef struct _smb_attr_entry
+{
+	char *path;
+	u32 key;
+	u64 fetched;		// when the attributes were read, 0 = unknown
+	u64 listed;			// when the directory was listed completely, 0 = never
+	u32 listgen;		// changes whenever a child leaves the cache
+	u64 size;
+	u64 ctime;
+	u64 atime;
+	u64 mtime;
+	u32 attributes;
+	struct _smb_attr_entry *hash_next;
+	struct _smb_attr_entry *lru_prev;
+	struct _smb_attr_entry *lru_next;
+} smb_attr_entry;
+
 static void DestroySMBReadAheadCache(const char *name);
 static void SMBEnableReadAhead(const char *name, u32 pages);
 static int ReadSMBFromCache(void *buf, size_t len, SMBFILESTRUCT *file);
@@ -95,6 +137,21 @@ typedef struct
 	smb_write_cache SMBWriteCache;
 	smb_cache_page *SMBReadAheadCache;
 	int SMB_RA_pages;
+	smb_cache_page *SMBCacheHash[SMB_CACHE_HASHSIZE];
+	smb_cache_page *SMBCacheMRU;
+	smb_cache_page *SMBCacheLRU;
+	smb_ra_request SMBReadAheadQueue[SMB_RA_QUEUESIZE];
+	int SMB_RA_head;
+	int SMB_RA_count;
+	smb_cache_stats SMBCacheStats;
+
+	smb_attr_entry *SMBAttrCache;
+	int SMB_attr_entries;
+	u64 SMBAttrTTL;
+	u32 SMBAttrGen;
+	smb_attr_entry *SMBAttrHash[SMB_ATTR_HASHSIZE];
+	smb_attr_entry *SMBAttrMRU;
+	smb_attr_entry *SMBAttrLRU;
 
 	mutex_t _SMB_mutex;
 } smb_env;
@@ -189,6 +246,11 @@ static void DestroySMBReadAheadCache(const char *name)
 		env->SMBReadAheadCache = NULL;
 		env->SMB_RA_pages = 0;
 	}
+	memset(env->SMBCacheHash, 0, sizeof(env->SMBCacheHash));
+	env->SMBCacheMRU = NULL;
+	env->SMBCacheLRU = NULL;
+	env->SMB_RA_head = 0;
+	env->SMB_RA_count = 0;
 	FlushWriteSMBCache(env->name);
 
 	if(env->SMBWriteCache.ptr)
@@ -200,11 +262,178 @@ static void DestroySMBReadAheadCache(const char *name)
 	env->SMBWriteCache.ptr = NULL;
 }
 
+static inline u32 SMBCacheHashKey(SMBFILESTRUCT *file, off_t page)
+{
+	return ((((u32)file) >> 4) ^ (u32)page) & (SMB_CACHE_HASHSIZE - 1);
+}
+
+static smb_cache_page* SMBCacheLookup(smb_env *env, SMBFILESTRUCT *file, off_t page)
+{
+	smb_cache_page *p;
+	off_t offset = page * SMB_READ_BUFFERSIZE;
+
+	for (p = env->SMBCacheHash[SMBCacheHashKey(file, page)]; p != NULL; p = p->hash_next)
+	{
+		if (p->file == file && p->offset == offset)
+			return p;
+	}
+	return NULL;
+}
+
+static void SMBCacheUnlinkLRU(smb_env *env, smb_cache_page *p)
+{
+	if (p->lru_prev == NULL && env->SMBCacheMRU != p)
+		return; // not linked yet
+
+	if (p->lru_prev) p->lru_prev->lru_next = p->lru_next;
+	else env->SMBCacheMRU = p->lru_next;
+	if (p->lru_next) p->lru_next->lru_prev = p->lru_prev;
+	else env->SMBCacheLRU = p->lru_prev;
+	p->lru_prev = p->lru_next = NULL;
+}
+
+// most recently used pages at the head, free pages at the tail
+static void SMBCacheTouch(smb_env *env, smb_cache_page *p, bool used)
+{
+	SMBCacheUnlinkLRU(env, p);
+	if (used)
+	{
+		p->lru_next = env->SMBCacheMRU;
+		if (env->SMBCacheMRU) env->SMBCacheMRU->lru_prev = p;
+		else env->SMBCacheLRU = p;
+		env->SMBCacheMRU = p;
+	}
+	else
+	{
+		p->lru_prev = env->SMBCacheLRU;
+		if (env->SMBCacheLRU) env->SMBCacheLRU->lru_next = p;
+		else env->SMBCacheMRU = p;
+		env->SMBCacheLRU = p;
+	}
+}
+
+static void SMBCacheRemove(smb_env *env, smb_cache_page *p)
+{
+	smb_cache_page **link;
+
+	if (p->file == NULL)
+		return;
+
+	link = &env->SMBCacheHash[SMBCacheHashKey(p->file, p->offset / SMB_READ_BUFFERSIZE)];
+	while (*link != p)
+		link = &(*link)->hash_next;
+	*link = p->hash_next;
+
+	p->hash_next = NULL;
+	p->file = NULL;
+	p->prefetched = false;
+	SMBCacheTouch(env, p, false);
+}
+
+// read a whole page of the file into the least recently used page
+static smb_cache_page* SMBCacheFill(smb_env *env, SMBFILESTRUCT *file, off_t page, bool prefetch)
+{
+	smb_cache_page *p;
+	u32 key;
+	off_t offset = page * SMB_READ_BUFFERSIZE;
+	off_t to_read;
+	int read = 0, readed;
+
+	to_read = file->len - offset;
+	if (to_read <= 0)
+		return NULL;
+	if (to_read > SMB_READ_BUFFERSIZE)
+		to_read = SMB_READ_BUFFERSIZE;
+
+	p = env->SMBCacheLRU;
+	if (prefetch && p->prefetched)
+		return NULL; // the cache is full of read-ahead nobody consumed yet
+	if (p->file != NULL)
+	{
+		env->SMBCacheStats.evictions++;
+		SMBCacheRemove(env, p);
+	}
+
+	while (read < to_read)
+	{
+		readed = SMB_ReadFile(p->ptr + read, to_read - read, offset + read, file->handle);
+		if (readed <= 0)
+			return NULL;
+		read += readed;
+	}
+
+	key = SMBCacheHashKey(file, page);
+	p->file = file;
+	p->offset = offset;
+	p->len = read;
+	p->prefetched = prefetch;
+	p->hash_next = env->SMBCacheHash[key];
+	env->SMBCacheHash[key] = p;
+	SMBCacheTouch(env, p, true);
+	if (prefetch)
+		env->SMBCacheStats.prefetched++;
+	return p;
+}
+
+static void QueueSMBReadAhead(smb_env *env, SMBFILESTRUCT *file, off_t page)
+{
+	int i;
+
+	if (page * SMB_READ_BUFFERSIZE >= file->len || SMBCacheLookup(env, file, page))
+		return;
+
+	for (i = 0; i < env->SMB_RA_count; i++)
+	{
+		smb_ra_request *req = &env->SMBReadAheadQueue[(env->SMB_RA_head + i) % SMB_RA_QUEUESIZE];
+		if (req->file == file && req->page == page)
+			return;
+	}
+	if (env->SMB_RA_count == SMB_RA_QUEUESIZE)
+		return;
+
+	env->SMBReadAheadQueue[(env->SMB_RA_head + env->SMB_RA_count) % SMB_RA_QUEUESIZE].file = file;
+	env->SMBReadAheadQueue[(env->SMB_RA_head + env->SMB_RA_count) % SMB_RA_QUEUESIZE].page = page;
+	env->SMB_RA_count++;
+}
+
+// one page per lock round, so a reader never waits for more than a single fetch
+static void ProcessSMBReadAhead(int i)
+{
+	smb_ra_request req;
+
+	while (1)
+	{
+		_SMB_lock(i);
+		if (SMBEnv[i].SMB_RA_count == 0 || SMBEnv[i].SMBReadAheadCache == NULL)
+		{
+			_SMB_unlock(i);
+			return;
+		}
+		req = SMBEnv[i].SMBReadAheadQueue[SMBEnv[i].SMB_RA_head];
+		SMBEnv[i].SMB_RA_head = (SMBEnv[i].SMB_RA_head + 1) % SMB_RA_QUEUESIZE;
+		SMBEnv[i].SMB_RA_count--;
+
+		if (req.file != NULL && !SMBCacheLookup(&SMBEnv[i], req.file, req.page))
+			SMBCacheFill(&SMBEnv[i], req.file, req.page, true);
+		_SMB_unlock(i);
+	}
+}
+
 static void *process_cache_thread(void *ptr)
 {
 	int i;
+	struct timespec tb;
+
+	tb.tv_sec = 0;
+	tb.tv_nsec = 10000000;
 	while (1)
 	{
+		LWP_MutexLock(cache_mutex);
+		if (!cache_pending)
+			LWP_CondTimedWait(cache_cond, cache_mutex, &tb);
+		cache_pending = false;
+		LWP_MutexUnlock(cache_mutex);
+
 		for(i=0;i<MAX_SMB_MOUNTED ;i++)
 		{
 			if(SMBEnv[i].SMBCONNECTED)
@@ -218,13 +447,21 @@ static void *process_cache_thread(void *ptr)
 						_SMB_unlock(i);
 					}
 				}
+				ProcessSMBReadAhead(i);
 			}
 		}
-		usleep(10000);
 	}
 	return NULL;
 }
 
+static void WakeSMBCacheThread(void)
+{
+	LWP_MutexLock(cache_mutex);
+	cache_pending = true;
+	LWP_CondSignal(cache_cond);
+	LWP_MutexUnlock(cache_mutex);
+}
+
 static void SMBEnableReadAhead(const char *name, u32 pages)
 {
 	s32 i, j;
@@ -250,9 +487,7 @@ static void SMBEnableReadAhead(const char *name, u32 pages)
 		return;
 	for (i = 0; i < env->SMB_RA_pages; i++)
 	{
-		env->SMBReadAheadCache[i].offset = 0;
-		env->SMBReadAheadCache[i].last_used = 0;
-		env->SMBReadAheadCache[i].file = NULL;
+		memset(&env->SMBReadAheadCache[i], 0, sizeof(smb_cache_page));
 		env->SMBReadAheadCache[i].ptr = memalign(32, SMB_READ_BUFFERSIZE);
 		if (env->SMBReadAheadCache[i].ptr == NULL)
 		{
@@ -265,6 +500,7 @@ static void SMBEnableReadAhead(const char *name, u32 pages)
 			return;
 		}
 		memset(env->SMBReadAheadCache[i].ptr, 0, SMB_READ_BUFFERSIZE);
+		SMBCacheTouch(env, &env->SMBReadAheadCache[i], false);
 	}
 }
 
@@ -278,19 +514,25 @@ static void ClearSMBFileCache(SMBFILESTRUCT *file)
 	for (i = 0; i < SMBEnv[j].SMB_RA_pages; i++)
 	{
 		if (SMBEnv[j].SMBReadAheadCache[i].file == file)
-		{
-			SMBEnv[j].SMBReadAheadCache[i].offset = 0;
-			SMBEnv[j].SMBReadAheadCache[i].last_used = 0;
-			SMBEnv[j].SMBReadAheadCache[i].file = NULL;
-			memset(SMBEnv[j].SMBReadAheadCache[i].ptr, 0, SMB_READ_BUFFERSIZE);
-		}
+			SMBCacheRemove(&SMBEnv[j], &SMBEnv[j].SMBReadAheadCache[i]);
 	}
+	for (i = 0; i < SMBEnv[j].SMB_RA_count; i++)
+	{
+		smb_ra_request *req = &SMBEnv[j].SMBReadAheadQueue[(SMBEnv[j].SMB_RA_head + i) % SMB_RA_QUEUESIZE];
+		if (req->file == file)
+			req->file = NULL;
+	}
+	file->ra_next = -1;
+	file->ra_window = 0;
 }
 
 static int ReadSMBFromCache(void *buf, size_t len, SMBFILESTRUCT *file)
 {
-	int i,j, leastUsed;
-	off_t new_offset, rest;
+	int j;
+	off_t new_offset, rest, page, buffer_used;
+	smb_cache_page *p;
+	bool sequential;
+	u32 k, maxwindow;
 	j=file->env;
 
 	if ( len == 0 ) return 0;
@@ -306,89 +548,60 @@ static int ReadSMBFromCache(void *buf, size_t len, SMBFILESTRUCT *file)
 
 	new_offset = file->offset;
 	rest = len;
+	page = new_offset / SMB_READ_BUFFERSIZE;
+	sequential = (file->ra_next == new_offset);
 
-continue_read:
-
-	for (i = 0; i < SMBEnv[j].SMB_RA_pages; i++)
+	while (rest > 0)
 	{
-		if (SMBEnv[j].SMBReadAheadCache[i].file == file)
+		page = new_offset / SMB_READ_BUFFERSIZE;
+		p = SMBCacheLookup(&SMBEnv[j], file, page);
+		if (p != NULL)
 		{
-			if ((new_offset >= SMBEnv[j].SMBReadAheadCache[i].offset) &&
-				(new_offset < (SMBEnv[j].SMBReadAheadCache[i].offset + SMB_READ_BUFFERSIZE)))
+			SMBEnv[j].SMBCacheStats.hits++;
+			if (p->prefetched)
 			{
-				//we hit the page
-				//copy as much as we can
-				SMBEnv[j].SMBReadAheadCache[i].last_used = gettime();
-
-				off_t buffer_used = (SMBEnv[j].SMBReadAheadCache[i].offset + SMB_READ_BUFFERSIZE) - new_offset;
-				if (buffer_used > rest) buffer_used = rest;
-				memcpy(buf, SMBEnv[j].SMBReadAheadCache[i].ptr + (new_offset - SMBEnv[j].SMBReadAheadCache[i].offset), buffer_used);
-				buf += buffer_used;
-				rest -= buffer_used;
-				new_offset += buffer_used;
-
-				if (rest == 0)
-				{
-					return 0;
-				}
-				goto continue_read;
+				SMBEnv[j].SMBCacheStats.prefetch_hits++;
+				p->prefetched = false;
 			}
 		}
-	}
-
-	leastUsed = 0;
-	for ( i = 1; i < SMBEnv[j].SMB_RA_pages; i++)
-	{
-		if ((SMBEnv[j].SMBReadAheadCache[i].last_used < SMBEnv[j].SMBReadAheadCache[leastUsed].last_used))
-			leastUsed = i;
-	}
-
-	//fill least used page with new data
-
-	off_t cache_offset = new_offset;
-
-	//do not interset with existing pages
-	for (i = 0; i < SMBEnv[j].SMB_RA_pages; i++)
-	{
-		if ( i == leastUsed ) continue;
-		if ( SMBEnv[j].SMBReadAheadCache[i].file != file ) continue;
-
-		if ( (cache_offset < SMBEnv[j].SMBReadAheadCache[i].offset ) && (cache_offset + SMB_READ_BUFFERSIZE > SMBEnv[j].SMBReadAheadCache[i].offset) )
-		{
-			//tail of new page intersects with some cache block, clear page
-			SMBEnv[j].SMBReadAheadCache[i].file = NULL;
-		}
-
-		if ( (cache_offset >= SMBEnv[j].SMBReadAheadCache[i].offset ) && (cache_offset < SMBEnv[j].SMBReadAheadCache[i].offset + SMB_READ_BUFFERSIZE ) )
+		else
 		{
-			//head of new page intersects with some cache block, clear page
-			SMBEnv[j].SMBReadAheadCache[i].file = NULL;
+			SMBEnv[j].SMBCacheStats.misses++;
+			p = SMBCacheFill(&SMBEnv[j], file, page, false);
+			if (p == NULL)
+				return -1;
 		}
-	}
-
-	off_t cache_to_read = file->len - cache_offset;
-	if ( cache_to_read > SMB_READ_BUFFERSIZE )
-	{
-		cache_to_read = SMB_READ_BUFFERSIZE;
-	}
+		SMBCacheTouch(&SMBEnv[j], p, true);
 
-	int read=0, readed;
-	while(read<cache_to_read)
-	{
-		readed = SMB_ReadFile(SMBEnv[j].SMBReadAheadCache[leastUsed].ptr+read, cache_to_read-read, cache_offset+read, file->handle);
-		if ( readed <=0 )
-		{
-			SMBEnv[j].SMBReadAheadCache[leastUsed].file = NULL;
+		//copy as much as we can
+		buffer_used = (p->offset + p->len) - new_offset;
+		if (buffer_used <= 0)
 			return -1;
-		}
-		read += readed;
+		if (buffer_used > rest) buffer_used = rest;
+		memcpy(buf, p->ptr + (new_offset - p->offset), buffer_used);
+		buf += buffer_used;
+		rest -= buffer_used;
+		new_offset += buffer_used;
+	}
+	file->ra_next = new_offset;
+
+	// grow the read-ahead window while the file is read sequentially
+	maxwindow = SMBEnv[j].SMB_RA_pages / 4;
+	if (!sequential)
+		file->ra_window = 0;
+	else if (file->ra_window < maxwindow)
+		file->ra_window = file->ra_window ? file->ra_window * 2 : 1;
+	if (file->ra_window > maxwindow)
+		file->ra_window = maxwindow;
+
+	if (file->ra_window > 0)
+	{
+		for (k = 1; k <= file->ra_window; k++)
+			QueueSMBReadAhead(&SMBEnv[j], file, page + k);
+		if (SMBEnv[j].SMB_RA_count > 0)
+			WakeSMBCacheThread();
 	}
-	SMBEnv[j].SMBReadAheadCache[leastUsed].last_used = gettime();
-
-	SMBEnv[j].SMBReadAheadCache[leastUsed].offset = cache_offset;
-	SMBEnv[j].SMBReadAheadCache[leastUsed].file = file;
-
-	goto continue_read;
+	return 0;
 }
 
 static int WriteSMBUsingCache(const char *buf, size_t len, SMBFILESTRUCT *file)
@@ -398,6 +611,10 @@ static int WriteSMBUsingCache(const char *buf, size_t len, SMBFILESTRUCT *file)
 		return -1;
 	int j;
 	j=file->env;
+
+	// pages read before this write would go stale
+	ClearSMBFileCache(file);
+
 	if (SMBEnv[j].SMBWriteCache.file != NULL)
 	{
 		if (strcmp(SMBEnv[j].SMBWriteCache.file->filename, file->filename) != 0)
@@ -453,6 +670,315 @@ failed:
 	return -1;
 }
 
+// metadata cache, keyed by the absolute path without device and trailing
+// backslash; SMB names are case insensitive, so are the keys
+static void SMBAttrKey(const char *path, char *key)
+{
+	int l;
+
+	strcpy(key, path);
+	l = strlen(key);
+	while (l > 1 && key[l - 1] == '\\')
+		key[--l] = '\0';
+	if (l == 0)
+		strcpy(key, "\\");
+}
+
+static u32 SMBAttrHashKey(const char *key)
+{
+	u32 h = 0;
+
+	while (*key)
+		h = h * 31 + tolower((unsigned char)*key++);
+	return h;
+}
+
+static smb_attr_entry* SMBAttrFind(smb_env *env, const char *key)
+{
+	smb_attr_entry *e;
+	u32 h = SMBAttrHashKey(key);
+
+	for (e = env->SMBAttrHash[h & (SMB_ATTR_HASHSIZE - 1)]; e != NULL; e = e->hash_next)
+	{
+		if (e->key == h && strcasecmp(e->path, key) == 0)
+			return e;
+	}
+	return NULL;
+}
+
+static void SMBAttrTouch(smb_env *env, smb_attr_entry *e, bool used)
+{
+	if (e->lru_prev != NULL || env->SMBAttrMRU == e)
+	{
+		if (e->lru_prev) e->lru_prev->lru_next = e->lru_next;
+		else env->SMBAttrMRU = e->lru_next;
+		if (e->lru_next) e->lru_next->lru_prev = e->lru_prev;
+		else env->SMBAttrLRU = e->lru_prev;
+		e->lru_prev = e->lru_next = NULL;
+	}
+	if (used)
+	{
+		e->lru_next = env->SMBAttrMRU;
+		if (env->SMBAttrMRU) env->SMBAttrMRU->lru_prev = e;
+		else env->SMBAttrLRU = e;
+		env->SMBAttrMRU = e;
+	}
+	else
+	{
+		e->lru_prev = env->SMBAttrLRU;
+		if (env->SMBAttrLRU) env->SMBAttrLRU->lru_next = e;
+		else env->SMBAttrMRU = e;
+		env->SMBAttrLRU = e;
+	}
+}
+
+// a directory listing is only complete as long as all its entries are cached
+static void SMBAttrUnlist(smb_env *env, const char *key)
+{
+	char parent[SMB_MAXPATH];
+	smb_attr_entry *e;
+	char *p;
+
+	strcpy(parent, key);
+	p = strrchr(parent, '\\');
+	if (p == NULL)
+		return;
+	if (p == parent) p[1] = '\0';
+	else p[0] = '\0';
+
+	e = SMBAttrFind(env, parent);
+	if (e != NULL)
+	{
+		e->listed = 0;
+		e->listgen = ++env->SMBAttrGen;
+	}
+}
+
+static void SMBAttrRemove(smb_env *env, smb_attr_entry *e)
+{
+	smb_attr_entry **link;
+
+	if (e->path == NULL)
+		return;
+
+	link = &env->SMBAttrHash[e->key & (SMB_ATTR_HASHSIZE - 1)];
+	while (*link != e)
+		link = &(*link)->hash_next;
+	*link = e->hash_next;
+
+	SMBAttrUnlist(env, e->path);
+	free(e->path);
+	e->path = NULL;
+	e->hash_next = NULL;
+	e->fetched = 0;
+	e->listed = 0;
+	SMBAttrTouch(env, e, false);
+}
+
+static smb_attr_entry* SMBAttrGet(smb_env *env, const char *key)
+{
+	smb_attr_entry *e;
+	u32 h;
+
+	e = SMBAttrFind(env, key);
+	if (e == NULL)
+	{
+		e = env->SMBAttrLRU;
+		SMBAttrRemove(env, e);
+		e->path = strdup(key);
+		if (e->path == NULL)
+			return NULL;
+		h = SMBAttrHashKey(key);
+		e->key = h;
+		e->listgen = ++env->SMBAttrGen;
+		e->hash_next = env->SMBAttrHash[h & (SMB_ATTR_HASHSIZE - 1)];
+		env->SMBAttrHash[h & (SMB_ATTR_HASHSIZE - 1)] = e;
+	}
+	SMBAttrTouch(env, e, true);
+	return e;
+}
+
+static inline bool SMBAttrFresh(smb_env *env, u64 stamp)
+{
+	return stamp != 0 && diff_ticks(stamp, gettime()) < env->SMBAttrTTL;
+}
+
+static void SMBAttrStore(smb_env *env, const char *path, SMBDIRENTRY *dentry)
+{
+	char key[SMB_MAXPATH];
+	smb_attr_entry *e;
+
+	if (env->SMBAttrCache == NULL)
+		return;
+
+	SMBAttrKey(path, key);
+	e = SMBAttrGet(env, key);
+	if (e == NULL)
+		return;
+
+	e->size = dentry->size;
+	e->ctime = dentry->ctime;
+	e->atime = dentry->atime;
+	e->mtime = dentry->mtime;
+	e->attributes = dentry->attributes;
+	e->fetched = gettime();
+}
+
+// returns 1 if found, 0 if a complete listing of the parent says it does
+// not exist and -1 if the server has to be asked
+static int SMBAttrLookup(smb_env *env, const char *path, SMBDIRENTRY *dentry)
+{
+	char key[SMB_MAXPATH];
+	smb_attr_entry *e;
+	char *p;
+
+	if (env->SMBAttrCache == NULL)
+		return -1;
+
+	SMBAttrKey(path, key);
+	e = SMBAttrFind(env, key);
+	if (e != NULL && SMBAttrFresh(env, e->fetched))
+	{
+		SMBAttrTouch(env, e, true);
+		dentry->size = e->size;
+		dentry->ctime = e->ctime;
+		dentry->atime = e->atime;
+		dentry->mtime = e->mtime;
+		dentry->attributes = e->attributes;
+		strcpy(dentry->name, e->path);
+		env->SMBCacheStats.meta_hits++;
+		return 1;
+	}
+
+	p = strrchr(key, '\\');
+	if (e == NULL && p != NULL && p[1] != '\0')
+	{
+		if (p == key) p[1] = '\0';
+		else p[0] = '\0';
+		e = SMBAttrFind(env, key);
+		if (e != NULL && SMBAttrFresh(env, e->listed))
+		{
+			env->SMBCacheStats.meta_negative++;
+			return 0;
+		}
+	}
+	env->SMBCacheStats.meta_misses++;
+	return -1;
+}
+
+// drop what is known about path, with tree also everything below it
+static void SMBAttrInvalidate(smb_env *env, const char *path, bool tree)
+{
+	char key[SMB_MAXPATH];
+	smb_attr_entry *e;
+	int i, l;
+
+	if (env->SMBAttrCache == NULL)
+		return;
+
+	SMBAttrKey(path, key);
+	e = SMBAttrFind(env, key);
+	if (e != NULL)
+		SMBAttrRemove(env, e);
+	else
+		SMBAttrUnlist(env, key);
+
+	if (!tree)
+		return;
+
+	l = strlen(key);
+	for (i = 0; i < env->SMB_attr_entries; i++)
+	{
+		e = &env->SMBAttrCache[i];
+		if (e->path != NULL && strncasecmp(e->path, key, l) == 0 && e->path[l] == '\\')
+			SMBAttrRemove(env, e);
+	}
+}
+
+// called when a listing starts, the entry of dir has to stay put until it ends
+static u32 SMBAttrListStart(smb_env *env, const char *dir)
+{
+	char key[SMB_MAXPATH];
+	smb_attr_entry *e;
+
+	if (env->SMBAttrCache == NULL)
+		return 0;
+
+	SMBAttrKey(dir, key);
+	e = SMBAttrGet(env, key);
+	return e ? e->listgen : 0;
+}
+
+// called when a listing started at stamp ran to the end
+static void SMBAttrListed(smb_env *env, const char *dir, u32 gen, u64 stamp)
+{
+	char key[SMB_MAXPATH];
+	smb_attr_entry *e;
+
+	if (env->SMBAttrCache == NULL || (smbFlags & SMB_SRCH_ALL) != SMB_SRCH_ALL)
+		return;
+
+	SMBAttrKey(dir, key);
+	e = SMBAttrFind(env, key);
+	if (e != NULL && gen != 0 && gen == e->listgen)
+		e->listed = stamp;
+}
+
+static s32 SMBCachedPathInfo(smb_env *env, const char *path, SMBDIRENTRY *dentry)
+{
+	int found = SMBAttrLookup(env, path, dentry);
+
+	if (found > 0)
+		return SMB_SUCCESS;
+	if (found == 0)
+		return SMB_ERROR;
+
+	if (SMB_PathInfo(path, dentry, env->smbconn) != SMB_SUCCESS)
+		return SMB_ERROR;
+	SMBAttrStore(env, path, dentry);
+	return SMB_SUCCESS;
+}
+
+static void DestroySMBAttrCache(smb_env *env)
+{
+	int i;
+
+	if (env->SMBAttrCache != NULL)
+	{
+		for (i = 0; i < env->SMB_attr_entries; i++)
+		{
+			if (env->SMBAttrCache[i].path)
+				free(env->SMBAttrCache[i].path);
+		}
+		free(env->SMBAttrCache);
+		env->SMBAttrCache = NULL;
+	}
+	env->SMB_attr_entries = 0;
+	memset(env->SMBAttrHash, 0, sizeof(env->SMBAttrHash));
+	env->SMBAttrMRU = NULL;
+	env->SMBAttrLRU = NULL;
+	env->SMBAttrGen++;
+}
+
+static void SMBEnableAttrCache(smb_env *env, u32 entries, u32 ttl)
+{
+	u32 i;
+
+	DestroySMBAttrCache(env);
+
+	if (entries == 0 || ttl == 0)
+		return;
+
+	env->SMBAttrCache = (smb_attr_entry *) calloc(entries, sizeof(smb_attr_entry));
+	if (env->SMBAttrCache == NULL)
+		return;
+
+	env->SMB_attr_entries = entries;
+	env->SMBAttrTTL = millisecs_to_ticks(ttl);
+	for (i = 0; i < entries; i++)
+		SMBAttrTouch(env, &env->SMBAttrCache[i], false);
+}
+
 ///////////////////////////////////////////
 //         END CACHE FUNCTIONS           //
 ///////////////////////////////////////////
@@ -561,7 +1087,7 @@ static int __smb_open(struct _reent *r, void *fileStruct, const char *path, int
 	SMBDIRENTRY dentry;
 	bool fileExists = true;
 	_SMB_lock(env->pos);
-	if (SMB_PathInfo(fixedpath, &dentry, env->smbconn) != SMB_SUCCESS)
+	if (SMBCachedPathInfo(env, fixedpath, &dentry) != SMB_SUCCESS)
 		fileExists = false;
 
 	
@@ -604,6 +1130,8 @@ static int __smb_open(struct _reent *r, void *fileStruct, const char *path, int
 	if (!(flags & O_APPEND) && fileExists && ((flags & 0x03) != O_RDONLY))
 		smb_mode = SMB_OF_TRUNCATE;
 	file->handle = SMB_OpenFile(fixedpath, access, smb_mode, env->smbconn);
+	if (access != SMB_OPEN_READING)
+		SMBAttrInvalidate(env, fixedpath, false);
 	if (!file->handle)
 	{
 		r->_errno = ENOENT;
@@ -624,6 +1152,9 @@ static int __smb_open(struct _reent *r, void *fileStruct, const char *path, int
 	else
 		file->offset = 0;
 
+	file->ra_next = -1;
+	file->ra_window = 0;
+
 	file->access=access;
 
 	strcpy(file->filename, fixedpath);
@@ -795,6 +1326,7 @@ static ssize_t __smb_write(struct _reent *r, void *fd, const char *ptr, size_t l
 
 	_SMB_lock(file->env);
 	written = WriteSMBUsingCache(ptr, len, file);
+	SMBAttrInvalidate(&SMBEnv[file->env], file->filename, false);
     _SMB_unlock(file->env);
 
 	if (written <= 0)
@@ -818,6 +1350,8 @@ static int __smb_close(struct _reent *r, void *fd)
 	}
 	ClearSMBFileCache(file);
 	SMB_CloseFile(file->handle);
+	if (file->access != SMB_OPEN_READING)
+		SMBAttrInvalidate(&SMBEnv[j], file->filename, false);
 	file->len = 0;
 	file->offset = 0;
 	file->filename[0] = '\0';
@@ -870,7 +1404,7 @@ static int __smb_chdir(struct _reent *r, const char *path)
 	memset(&dentry, 0, sizeof(SMBDIRENTRY));
 
 	_SMB_lock(env->pos);
-	found = SMB_PathInfo(path_absolute, &dentry, env->smbconn);
+	found = SMBCachedPathInfo(env, path_absolute, &dentry);
 
 	if (found != SMB_SUCCESS)
 	{
@@ -907,8 +1441,10 @@ static int __smb_dirreset(struct _reent *r, DIR_ITER *dirState)
 	_SMB_lock(state->env);
 	SMB_FindClose(&state->smbdir, SMBEnv[state->env].smbconn);
 
-	strcpy(path_abs,SMBEnv[state->env].currentpath);
+	strcpy(path_abs,state->dir);
 	strcat(path_abs,"*");
+	state->attr_gen = SMBAttrListStart(&SMBEnv[state->env], state->dir);
+	state->attr_started = gettime();
 	int found = SMB_FindFirst(path_abs, smbFlags, &dentry, SMBEnv[state->env].smbconn);
 
 	if (found != SMB_SUCCESS)
@@ -984,7 +1520,7 @@ static DIR_ITER* __smb_diropen(struct _reent *r, DIR_ITER *dirState, const char
 	if(!env->diropen_root) // root must be valid - we don't need check it
 	{
 		memset(&dentry, 0, sizeof(SMBDIRENTRY));
-		found = SMB_PathInfo(path_absolute, &dentry, env->smbconn);
+		found = SMBCachedPathInfo(env, path_absolute, &dentry);
 		if (found != SMB_SUCCESS)
 		{
 			r->_errno = ENOENT;
@@ -1004,6 +1540,8 @@ static DIR_ITER* __smb_diropen(struct _reent *r, DIR_ITER *dirState, const char
 
 	strcat(path_absolute, "*");
 	memset(&dentry, 0, sizeof(SMBDIRENTRY));
+	state->attr_gen = SMBAttrListStart(env, state->dir);
+	state->attr_started = gettime();
 	found = SMB_FindFirst(path_absolute, smbFlags, &dentry, env->smbconn);
 
 	if (found != SMB_SUCCESS)
@@ -1053,19 +1591,19 @@ static int dentry_to_stat(SMBDIRENTRY *dentry, struct stat *st)
 	return 0;
 }
 
-static int cpy_dentry(SMBDIRENTRY *dest, SMBDIRENTRY *source)
+// directory listings fill the metadata cache in bulk
+static void cache_dentry(SMBDIRSTATESTRUCT *state, SMBDIRENTRY *dentry)
 {
-	if (!dest || !source)
-		return -1;
+	char path[SMB_MAXPATH];
 
-	dest->attributes=source->attributes;
-	dest->size=source->size;
-	dest->atime=source->atime;
-	dest->mtime=source->mtime;
-	dest->ctime=source->ctime;
-	strcpy(dest->name,source->name);
+	if (strcmp(dentry->name, ".") == 0 || strcmp(dentry->name, "..") == 0)
+		return;
+	if (strlen(state->dir) + strlen(dentry->name) >= SMB_MAXPATH)
+		return;
 
-	return 0;
+	strcpy(path, state->dir);
+	strcat(path, dentry->name);
+	SMBAttrStore(&SMBEnv[state->env], path, dentry);
 }
 
 static int __smb_dirnext(struct _reent *r, DIR_ITER *dirState, char *filename,
@@ -1094,9 +1632,7 @@ static int __smb_dirnext(struct _reent *r, DIR_ITER *dirState, char *filename,
 		strcpy(dentry.name, state->smbdir.name);
 		strcpy(filename, dentry.name);
 		dentry_to_stat(&dentry, filestat);
-		cpy_dentry(&last_dentry,&dentry);
-		last_env=state->env;
-		strcpy(last_path,state->dir);
+		cache_dentry(state, &dentry);
 		_SMB_unlock(state->env);
 		return 0;
 	}
@@ -1121,15 +1657,15 @@ static int __smb_dirnext(struct _reent *r, DIR_ITER *dirState, char *filename,
 	}
 	else
 	{
+		if (ret == SMB_NO_MORE_FILES)
+			SMBAttrListed(&SMBEnv[state->env], state->dir, state->attr_gen, state->attr_started);
 		r->_errno = ENOENT;
 		_SMB_unlock(state->env);
 		return -1;
 	}
 
 	dentry_to_stat(&dentry, filestat);
-	cpy_dentry(&last_dentry,&dentry);
-	last_env=state->env;
-	strcpy(last_path,state->dir);
+	cache_dentry(state, &dentry);
 	_SMB_unlock(state->env);
 	return 0;
 }
@@ -1186,20 +1722,8 @@ static int __smb_stat(struct _reent *r, const char *path, struct stat *st)
 		return -1;
 	}
 
-	if(env->pos==last_env) //optimization, usually after a dirnext we do stat
-	{
-		char file[SMB_MAXPATH];
-		strcpy(file,last_path);
-		strcat(file,last_dentry.name);
-		if(strcmp(file,path_absolute)==0)
-		{
-			dentry_to_stat(&last_dentry, st);
-			return 0;
-		}
-	}
-
 	_SMB_lock(env->pos);
-	if (SMB_PathInfo(path_absolute, &dentry, env->smbconn) != SMB_SUCCESS)
+	if (SMBCachedPathInfo(env, path_absolute, &dentry) != SMB_SUCCESS)
 	{
 		r->_errno = ENOENT;
 		_SMB_unlock(env->pos);
@@ -1265,6 +1789,7 @@ static int __smb_mkdir(struct _reent *r, const char *name, int mode)
 	_SMB_lock(env->pos);
         if(SMB_CreateDirectory(fixedName, env->smbconn) != SMB_SUCCESS)
             ret = -1;
+	SMBAttrInvalidate(env, fixedName, false);
 	_SMB_unlock(env->pos);
 
 	return ret;
@@ -1310,6 +1835,7 @@ static int __smb_unlink(struct _reent *r, const char *name)
             ret = SMB_DeleteDirectory(fixedName, env->smbconn);
         else
             ret = SMB_DeleteFile(fixedName, env->smbconn);
+	SMBAttrInvalidate(env, fixedName, isDir);
 	_SMB_unlock(env->pos);
 
 	if(ret != SMB_SUCCESS)
@@ -1361,6 +1887,8 @@ static int __smb_rename(struct _reent *r, const char *oldName, const char *newNa
 	_SMB_lock(env->pos);
 	if (SMB_Rename(fixedOldName, fixedNewName, env->smbconn) != SMB_SUCCESS)
 		ret = -1;
+	SMBAttrInvalidate(env, fixedOldName, true);
+	SMBAttrInvalidate(env, fixedNewName, true);
 	_SMB_unlock(env->pos);
 
 	return ret;
@@ -1448,6 +1976,7 @@ static void MountDevice(const char *name,SMBCONN smbconn, int env)
 	SMBEnv[env].name=strdup(aux);
 
 	SMBEnableReadAhead(aux,8);
+	SMBEnableAttrCache(&SMBEnv[env], SMB_ATTR_ENTRIES, SMB_ATTR_TTL);
 
 	free(aux);
 }
@@ -1477,6 +2006,11 @@ bool smbInitDevice(const char* name, const char *user, const char *password, con
 			LWP_MutexInit(&SMBEnv[i]._SMB_mutex, false);
 		}
 
+		if(cache_mutex == LWP_MUTEX_NULL)
+			LWP_MutexInit(&cache_mutex, false);
+		if(cache_cond == LWP_COND_NULL)
+			LWP_CondInit(&cache_cond);
+
 		if(cache_thread == LWP_THREAD_NULL)
 			if(LWP_CreateThread(&cache_thread, process_cache_thread, NULL, NULL, 0, 64) != 0)
 				return false;
@@ -1520,6 +2054,7 @@ void smbClose(const char* name)
 	char device[11];
 	sprintf(device, "%s:", env->name);
 	RemoveDevice(device);
+	DestroySMBAttrCache(env);
 	env->SMBCONNECTED=false;
 	_SMB_unlock(env->pos);
 }
@@ -1546,3 +2081,35 @@ void smbSetSearchFlags(unsigned short flags)
 {
 	smbFlags = flags;
 }
+
+bool smbSetMetadataCache(const char *name, u32 entries, u32 ttl)
+{
+	smb_env *env = FindSMBEnv(name);
+	if(env==NULL) return false;
+
+	_SMB_lock(env->pos);
+	SMBEnableAttrCache(env, entries, ttl);
+	_SMB_unlock(env->pos);
+	return (entries==0 || ttl==0 || env->SMBAttrCache!=NULL);
+}
+
+bool smbGetCacheStats(const char *name, smb_cache_stats *stats)
+{
+	smb_env *env = FindSMBEnv(name);
+	if(env==NULL || stats==NULL) return false;
+
+	_SMB_lock(env->pos);
+	*stats = env->SMBCacheStats;
+	_SMB_unlock(env->pos);
+	return true;
+}
+
+void smbResetCacheStats(const char *name)
+{
+	smb_env *env = FindSMBEnv(name);
+	if(env==NULL) return;
+
+	_SMB_lock(env->pos);
+	memset(&env->SMBCacheStats, 0, sizeof(smb_cache_stats));
+	_SMB_unlock(env->pos);
+}
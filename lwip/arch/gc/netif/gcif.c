@@ -18,6 +18,7 @@
 #include "netif/etharp.h"
 
 #include "netif/gcif/gcif.h"
+#include "network.h"
 
 //#define _BBA_DEBUG
 
@@ -171,6 +172,10 @@
 
 #define BBA_NAPI_WEIGHT 16
 
+#define BBA_RX_SPARES			8										/* pool pbufs kept ready for the rx path */
+#define BBA_TX_RING				4										/* frames queued for transmission */
+#define BBA_TX_SLOT_SIZE		(1536)									/* BBA_TX_MAX_PACKET_SIZE rounded up to the DMA granularity */
+
 
 #define X(a,b)  b,a
 struct bba_descr {
@@ -187,16 +192,29 @@ struct bba_priv {
 	lwpq_t tq_xmit;
 	err_t state;
 	struct eth_addr *ethaddr;
+
+	u32 rx_nspares;
+	struct pbuf *rx_spares[BBA_RX_SPARES];
+
+	u8 tx_busy;
+	u32 tx_head,tx_tail,tx_count;
+	u32 tx_resets;
+	u32 tx_len[BBA_TX_RING];
+
 	struct dev_stats {
 		u32 rx_errors,rx_overerrors,rx_crcerrors;
 		u32 rx_fifoerrors,rx_lengtherrors,rx_frameerrors;
-		u32 rx_bytes,rx_packets;
+		u32 rx_bytes,rx_packets,rx_nobufs;
 		u32 tx_errors,tx_carriererrors,tx_fifoerrors;
 		u32 tx_windowerrors,tx_collisions;
+		u32 tx_bytes,tx_packets;
+		u32 interrupts;
+		u64 irq_ticks;
 	} txrx_stats;
 };
 
 static lwpq_t wait_exi_queue;
+static u8 bba_txbuf[BBA_TX_RING][BBA_TX_SLOT_SIZE] __attribute__((aligned(32)));
 static struct bba_descr cur_descr;
 static struct netif *gc_netif = NULL;
 //static const struct eth_addr ethbroadcast = {{0xffU,0xffU,0xffU,0xffU,0xffU,0xffU}};
@@ -440,28 +458,18 @@ static __inline__ void __bba_exi_wake(struct bba_priv *priv)
 	EXI_Unlock(EXI_CHANNEL_0);
 }
 
-static __inline__ void __bba_tx_stop(struct bba_priv *priv)
+/* drop whatever sits in the tx ring, e.g. after a reset lost the
+   frame on the wire */
+static __inline__ void __bba_tx_flush(struct bba_priv *priv)
 {
 	u32 level;
 
 	_CPU_ISR_Disable(level);
-	while(priv->state==ERR_TXPENDING) {
-		LWIP_DEBUGF(NETIF_DEBUG,("__bba_tx_stop(pending tx)\n"));
-		LWP_ThreadSleep(priv->tq_xmit);
-	}
-	priv->state = ERR_TXPENDING;
-	_CPU_ISR_Restore(level);
-}
-
-static __inline__ void __bba_tx_wake(struct bba_priv *priv)
-{
-	u32 level;
-
-	_CPU_ISR_Disable(level);
-	if(priv->state==ERR_TXPENDING) {
-		priv->state = ERR_OK;
-		LWP_ThreadBroadcast(priv->tq_xmit);
-	}
+	priv->tx_tail = priv->tx_head;
+	priv->tx_count = 0;
+	priv->tx_busy = 0;
+	priv->tx_resets++;
+	LWP_ThreadBroadcast(priv->tq_xmit);
 	_CPU_ISR_Restore(level);
 }
 
@@ -525,7 +533,7 @@ static void __bba_reset()
 
 static void __bba_recv_init()
 {
-	bba_out8(BBA_NCRB,(BBA_NCRB_AB|BBA_NCRB_CA|BBA_NCRB_2_PACKETS_PER_INT));
+	bba_out8(BBA_NCRB,(BBA_NCRB_AB|BBA_NCRB_CA|BBA_NCRB_4_PACKETS_PER_INT));
 	bba_out8(BBA_SI_ACTRL2,0x74);
 	bba_out8(BBA_RXINTT, 0x00);
 	bba_out8(BBA_RXINTT+1, 0x06); /* 0x0600 = 61us */
@@ -635,41 +643,100 @@ void bba_process(struct pbuf *p,struct netif *dev)
 	}
 }
 
+/* hand the oldest queued frame to the BBA, EXI must be locked. The slot
+   buffers are aligned, so the frame goes out in a single DMA plus at
+   most 31 immediate bytes */
+static void __bba_tx_push(struct bba_priv *priv)
+{
+	u32 slot = priv->tx_tail;
+
+	bba_select();
+	bba_outsregister(BBA_WRTXFIFOD);
+	bba_outsdata_fast(bba_txbuf[slot],priv->tx_len[slot]);
+	bba_deselect();
+
+	bba_out8(BBA_NCRA,((bba_in8(BBA_NCRA)&~BBA_NCRA_ST0)|BBA_NCRA_ST1));		//&~BBA_NCRA_ST0
+}
+
+/* the frame on the wire is done, start the next one from the interrupt
+   so the sender doesn't have to wait for it */
+static void __bba_tx_done(struct bba_priv *priv,u32 ok)
+{
+	u32 level;
+
+	_CPU_ISR_Disable(level);
+	if(priv->tx_busy) {
+		if(ok) {
+			priv->txrx_stats.tx_packets++;
+			priv->txrx_stats.tx_bytes += priv->tx_len[priv->tx_tail];
+		}
+		priv->tx_tail = (priv->tx_tail+1)%BBA_TX_RING;
+		priv->tx_count--;
+		LWP_ThreadBroadcast(priv->tq_xmit);
+
+		if(priv->tx_count>0)
+			__bba_tx_push(priv);
+		else
+			priv->tx_busy = 0;
+	}
+	_CPU_ISR_Restore(level);
+}
+
 static err_t __bba_link_tx(struct netif *dev,struct pbuf *p)
 {
-	u8 tmpbuf[BBA_MINPKTSIZE];
+	u8 *buf;
+	u32 level,slot,len,kick,resets;
 	struct pbuf *tmp;
 	struct bba_priv *priv = (struct bba_priv*)dev->state;
 
-	__bba_tx_stop(priv);
-	__bba_exi_stop(priv);
-
 	if(p->tot_len>BBA_TX_MAX_PACKET_SIZE) {
 		LWIP_ERROR(("__bba_link_tx(%d,%p) pkt_size\n",p->tot_len,LWP_GetSelf()));
-		__bba_tx_wake(priv);
-		__bba_exi_wake(priv);
 		return ERR_PKTSIZE;
 	}
 
-	if(!__linkstate(priv)) {
-		LWIP_ERROR(("__bba_link_tx(error link state)\n"));
-		__bba_tx_wake(priv);
-		__bba_exi_wake(priv);
-		return ERR_ABRT;
-	}
-
 	LWIP_DEBUGF(NETIF_DEBUG,("__bba_link_tx(%d,%p)\n",p->tot_len,LWP_GetSelf()));
 
-	bba_select();
-	bba_outsregister(BBA_WRTXFIFOD);
-	for(tmp=p;tmp!=NULL;tmp=tmp->next) {
-		bba_outsdata_fast(tmp->payload,tmp->len);
+	_CPU_ISR_Disable(level);
+	while(priv->tx_count==BBA_TX_RING) {
+		LWIP_DEBUGF(NETIF_DEBUG,("__bba_link_tx(tx ring full)\n"));
+		LWP_ThreadSleep(priv->tq_xmit);
 	}
-	if(p->tot_len<BBA_MINPKTSIZE) bba_outsdata(tmpbuf,(BBA_MINPKTSIZE-p->tot_len));
-	bba_deselect();
 
-	bba_out8(BBA_NCRA,((bba_in8(BBA_NCRA)&~BBA_NCRA_ST0)|BBA_NCRA_ST1));		//&~BBA_NCRA_ST0
-	__bba_exi_wake(priv);
+	slot = priv->tx_head;
+	buf = bba_txbuf[slot];
+	for(len=0,tmp=p;tmp!=NULL;tmp=tmp->next) {
+		memcpy(buf+len,tmp->payload,tmp->len);
+		len += tmp->len;
+	}
+	if(len<BBA_MINPKTSIZE) {
+		memset(buf+len,0,(BBA_MINPKTSIZE-len));
+		len = BBA_MINPKTSIZE;
+	}
+	priv->tx_len[slot] = len;
+	priv->tx_head = (slot+1)%BBA_TX_RING;
+	priv->tx_count++;
+
+	kick = !priv->tx_busy;
+	priv->tx_busy = 1;
+	resets = priv->tx_resets;
+	_CPU_ISR_Restore(level);
+
+	// the transmitter is idle, nobody else will start it
+	if(kick) {
+		__bba_exi_stop(priv);
+		if(!__linkstate(priv)) {
+			LWIP_ERROR(("__bba_link_tx(error link state)\n"));
+			__bba_tx_flush(priv);
+			__bba_exi_wake(priv);
+			return ERR_ABRT;
+		}
+		// a reset while we waited for EXI voids our claim, whoever queued
+		// after it started the transmitter on their own
+		_CPU_ISR_Disable(level);
+		if(priv->tx_resets==resets && priv->tx_count>0) __bba_tx_push(priv);
+		_CPU_ISR_Restore(level);
+		__bba_exi_wake(priv);
+	}
 	return ERR_OK;
 }
 
@@ -679,10 +746,27 @@ static err_t __bba_start_tx(struct netif *dev,struct pbuf *p,struct ip_addr *ipa
 	return etharp_output(dev,ipaddr,p);
 }
 
+static struct pbuf* __bba_rx_getbuf(struct bba_priv *priv)
+{
+	if(priv->rx_nspares>0) return priv->rx_spares[--priv->rx_nspares];
+	return pbuf_alloc(PBUF_RAW,BBA_RX_MAX_PACKET_SIZE,PBUF_POOL);
+}
+
+static void __bba_rx_refill(struct bba_priv *priv)
+{
+	struct pbuf *p;
+
+	while(priv->rx_nspares<BBA_RX_SPARES) {
+		p = pbuf_alloc(PBUF_RAW,BBA_RX_MAX_PACKET_SIZE,PBUF_POOL);
+		if(!p) break;
+		priv->rx_spares[priv->rx_nspares++] = p;
+	}
+}
+
 static err_t bba_start_rx(struct netif *dev,u32 budget)
 {
-	s32 size;
-	u16 top,pos,rrp,rwp;
+	s32 size,chunk_size;
+	u16 top,pos,rrp,rwp,last_rrp;
 	u32 pkt_status,recvd;
 	struct pbuf *tmp,*p = NULL;
 	struct bba_priv *priv = (struct bba_priv*)dev->state;
@@ -690,43 +774,48 @@ static err_t bba_start_rx(struct netif *dev,u32 budget)
 	LWIP_DEBUGF(NETIF_DEBUG,("bba_start_rx()\n"));
 
 	recvd = 0;
+	top = ((BBA_INIT_RHBP+1)<<8);
 	rwp = bba_in12(BBA_RWP);
-	rrp = bba_in12(BBA_RRP);
+	rrp = last_rrp = bba_in12(BBA_RRP);
 	while(recvd<budget && rrp!=rwp) {
 		LWIP_DEBUGF(NETIF_DEBUG,("bba_start_rx(%04x,%04x)\n",rrp,rwp));
-		bba_ins(rrp<<8,(void*)(&cur_descr),sizeof(struct bba_descr));
+
+		// descriptor and frame are read in one go, the address auto-increments
+		pos = (rrp<<8);
+		bba_select();
+		bba_insregister(pos);
+		bba_insdata((void*)(&cur_descr),sizeof(struct bba_descr));
 		le32_to_cpus((u32*)((void*)(&cur_descr)));
 
 		size = (cur_descr.packet_len-4);
 		pkt_status = cur_descr.status;
-		if(size>(BBA_RX_MAX_PACKET_SIZE+4)) {
+		if(size<=0 || size>BBA_RX_MAX_PACKET_SIZE) {
 			LWIP_DEBUGF(NETIF_DEBUG|2,("bba_start_rx(size>BBA_RX_MAX_PACKET_SIZE)\n"));
-			continue;
-		}
-
-		if(pkt_status&(BBA_RX_STATUS_RERR|BBA_RX_STATUS_FAE)) {
-			LWIP_DEBUGF(NETIF_DEBUG|2,("bba_start_rx(pkt_status = 02x)\n",pkt_status));
+			priv->txrx_stats.rx_errors++;
+			priv->txrx_stats.rx_lengtherrors++;
+			p = NULL;
+		} else if(pkt_status&(BBA_RX_STATUS_RERR|BBA_RX_STATUS_FAE)) {
+			LWIP_DEBUGF(NETIF_DEBUG|2,("bba_start_rx(pkt_status = %02x)\n",pkt_status));
 			__bba_rx_err(pkt_status,priv);
-			rwp = bba_in12(BBA_RWP);
-			rrp = bba_in12(BBA_RRP);
-			continue;
-		}
-
-		pos = ((rrp<<8)+4);
-		top = ((BBA_INIT_RHBP+1)<<8);
-		LWIP_DEBUGF(NETIF_DEBUG,("bba_start_rx(%04x,%d,%04x)\n",pos,size,top));
+			p = NULL;
+		} else {
+			p = __bba_rx_getbuf(priv);
+			if(!p) {
+				// leave the frame in the BBA, we come back for it
+				bba_deselect();
+				priv->txrx_stats.rx_nobufs++;
+				break;
+			}
+			pbuf_realloc(p,size);
 
-		p = pbuf_alloc(PBUF_RAW,size,PBUF_POOL);
-		if(p) {
+			pos += sizeof(struct bba_descr);
+			LWIP_DEBUGF(NETIF_DEBUG,("bba_start_rx(%04x,%d,%04x)\n",pos,size,top));
 			for(tmp=p;tmp!=NULL;tmp=tmp->next) {
 				size = tmp->len;
-
-				bba_select();
-				bba_insregister(pos);
 				if((pos+size)<top) {
 					bba_insdata_fast(tmp->payload,size);
 				} else {
-					s32 chunk_size = (top-pos);
+					chunk_size = (top-pos);
 
 					size -= chunk_size;
 					pos = (BBA_INIT_RRP<<8);
@@ -734,19 +823,25 @@ static err_t bba_start_rx(struct netif *dev,u32 budget)
 					bba_deselect();
 					bba_select();
 					bba_insregister(pos);
-					bba_insdata_fast(tmp->payload+chunk_size,size);
+					bba_insdata_fast((u8*)tmp->payload+chunk_size,size);
 				}
-				bba_deselect();
 				pos += size;
 			}
-			dev->input(p,dev);
-		} else
-			break;
+			priv->txrx_stats.rx_packets++;
+			priv->txrx_stats.rx_bytes += p->tot_len;
+		}
+		bba_deselect();
+
+		// errored frames are skipped as well, otherwise they block the buffer
+		rrp = cur_descr.next_packet_ptr;
+		if(p) dev->input(p,dev);
 
 		recvd++;
-		bba_out12(BBA_RRP,(rrp=cur_descr.next_packet_ptr));
-		rwp = bba_in12(BBA_RWP);
+		if(rrp==rwp) rwp = bba_in12(BBA_RWP);
 	}
+	if(rrp!=last_rrp) bba_out12(BBA_RRP,rrp);
+	__bba_rx_refill(priv);
+
 	if(priv->flag&BBA_IR_RBFI) {
 		priv->flag &= ~BBA_IR_RBFI;
 		bba_out8(BBA_IMR,(bba_in8(BBA_IMR)|BBA_IMR_RBFIM));
@@ -759,8 +854,11 @@ static err_t bba_start_rx(struct netif *dev,u32 budget)
 static inline void bba_interrupt(struct netif *dev)
 {
 	u8 ir,imr,status,lrps,ltps;
+	u64 start = gettime();
 	struct bba_priv *priv = (struct bba_priv*)dev->state;
 
+	priv->txrx_stats.interrupts++;
+
 	ir = bba_in8(BBA_IR);
 	imr = bba_in8(BBA_IMR);
 	status = ir&imr;
@@ -774,9 +872,6 @@ static inline void bba_interrupt(struct netif *dev)
 		if(status&(BBA_IR_RI|BBA_IR_RBFI)) {
 			bba_start_rx(dev,0x20);
 		}
-		if(status&(BBA_IR_TI|BBA_IR_FIFOEI)) {
-			__bba_tx_wake(priv);
-		}
 		if(status&(BBA_IR_RBFI|BBA_IR_REI)) {
 			lrps = bba_in8(BBA_LRPS);
 			__bba_rx_err(lrps,priv);
@@ -784,7 +879,9 @@ static inline void bba_interrupt(struct netif *dev)
 		if(status&BBA_IR_TEI) {
 			ltps = bba_in8(BBA_LTPS);
 			__bba_tx_err(ltps,priv);
-			__bba_tx_wake(priv);
+		}
+		if(status&(BBA_IR_TI|BBA_IR_TEI|BBA_IR_FIFOEI)) {
+			__bba_tx_done(priv,!(status&(BBA_IR_TEI|BBA_IR_FIFOEI)));
 		}
 		if(status&BBA_IR_FRAGI) {
 			LWIP_DEBUGF(NETIF_DEBUG,("bba_interrupt(BBA_IR_FRAGI)\n"));
@@ -800,6 +897,7 @@ static inline void bba_interrupt(struct netif *dev)
 		imr = bba_in8(BBA_IMR);
 		status = ir&imr;
 	}
+	priv->txrx_stats.irq_ticks += diff_ticks(start,gettime());
 	LWIP_DEBUGF(NETIF_DEBUG,("bba_interrupt(exit)\n"));
 }
 
@@ -813,6 +911,9 @@ static err_t __bba_init(struct netif *dev)
 	LWIP_DEBUGF(NETIF_DEBUG,("initializing BBA...\n"));
 	bba_cmd_out8(0x02,BBA_CMD_IRMASKALL);
 
+	// a frame queued before the reset will never report completion
+	__bba_tx_flush(priv);
+
 	__bba_reset();
 
 	priv->revid = bba_cmd_in8(0x01);
@@ -1029,7 +1130,26 @@ dev_s bba_create(struct netif *dev)
 
 	priv->ethaddr = (struct eth_addr*)&(dev->hwaddr[0]);
 	priv->state = ERR_OK;
+	__bba_rx_refill(priv);
 
 	gc_netif = dev;
 	return priv;
 }
+
+void bba_getstats(struct netif *dev,struct net_ifstats *stats)
+{
+	u32 level;
+	struct bba_priv *priv = (struct bba_priv*)dev->state;
+
+	_CPU_ISR_Disable(level);
+	stats->interrupts = priv->txrx_stats.interrupts;
+	stats->irq_usecs = ticks_to_microsecs(priv->txrx_stats.irq_ticks);
+	stats->rx_packets = priv->txrx_stats.rx_packets;
+	stats->rx_bytes = priv->txrx_stats.rx_bytes;
+	stats->rx_errors = priv->txrx_stats.rx_errors;
+	stats->rx_nobufs = priv->txrx_stats.rx_nobufs;
+	stats->tx_packets = priv->txrx_stats.tx_packets;
+	stats->tx_bytes = priv->txrx_stats.tx_bytes;
+	stats->tx_errors = priv->txrx_stats.tx_errors;
+	_CPU_ISR_Restore(level);
+}
@@ -48,192 +48,243 @@
 
 #include "lwip/sys.h"
 
-/* This is a reference implementation of the checksum algorithm, with the
- * aim of being simple, correct and fully portable. Checksumming is the
- * first thing you would want to optimize for your platform. You will
- * need to port it to your architecture and in your sys_arch.h:
- * 
- * #define LWIP_CHKSUM <your_checksum_routine> 
-*/
-#ifndef LWIP_CHKSUM
-#define LWIP_CHKSUM lwip_standard_chksum
-
-/**
- * lwip checksum
+#include <string.h>
+
+/* Checksumming is the first thing you would want to optimize for your
+ * platform. The routines below sum 32 bits at a time, unrolled eight
+ * words deep; on the Gekko the words go through the carry chain of
+ * addc/adde, elsewhere into a 64 bit accumulator whose upper half
+ * collects the carries. A port may still plug in its own routine in
+ * sys_arch.h:
  *
- * @param dataptr points to start of data to be summed at any boundary
- * @param len length of data to be summed
- * @return host order (!) lwip checksum (non-inverted Internet sum) 
+ * #define LWIP_CHKSUM <your_checksum_routine>
  *
- * @note accumulator size limits summable lenght to 64k
- * @note host endianess is irrelevant (p3 RFC1071)
+ * All of them return the host order (!) lwip checksum (non-inverted
+ * Internet sum) and take data at any boundary. Host endianess is
+ * irrelevant (p3 RFC1071), the sum is built from native words and the
+ * bytes are swapped back at the end when the data started at an odd
+ * address.
  */
-static u16_t
-lwip_standard_chksum(void *dataptr, u16_t len)
-{
-  u32_t acc;
-  u16_t src;
-  u8_t *octetptr;
-
-  acc = 0;
-  /* dataptr may be at odd or even addresses */
-  octetptr = (u8_t*)dataptr;
-  while (len > 1)
-  {
-    /* declare first octet as most significant
-       thus assume network order, ignoring host order */
-    src = (*octetptr) << 8;
-    octetptr++;
-    /* declare second octet as least significant */
-    src |= (*octetptr);
-    octetptr++;
-    acc += src;
-    len -= 2;
-  }
-  if (len > 0)
-  {
-    /* accumulate remaining octet */
-    src = (*octetptr) << 8;
-    acc += src;
-  }
-  /* add deferred carry bits */
-  acc = (acc >> 16) + (acc & 0x0000ffffUL);
-  if ((acc & 0xffff0000) != 0) {
-    acc = (acc >> 16) + (acc & 0x0000ffffUL);
-  }
-  /* This maybe a little confusing: reorder sum using htons()
-     instead of ntohs() since it has a little less call overhead.
-     The caller must invert bits for Internet sum ! */
-  return htons((u16_t)acc);
-}
 
-#endif
+#if defined(GEKKO)
+typedef u32_t chksum_acc_t;
 
-#if 0
-/*
- * Curt McDowell
- * Broadcom Corp.
- * csm@broadcom.com
- *
- * IP checksum two bytes at a time with support for
- * unaligned buffer.
- * Works for len up to and including 0x20000.
- * by Curt McDowell, Broadcom Corp. 12/08/2005
- */
+static inline chksum_acc_t
+chksum_add8(chksum_acc_t acc, const u32_t *w)
+{
+  /* the second addze catches the carry of the first one */
+  __asm__("addc  %0,%0,%1\n\t"
+          "adde  %0,%0,%2\n\t"
+          "adde  %0,%0,%3\n\t"
+          "adde  %0,%0,%4\n\t"
+          "adde  %0,%0,%5\n\t"
+          "adde  %0,%0,%6\n\t"
+          "adde  %0,%0,%7\n\t"
+          "adde  %0,%0,%8\n\t"
+          "addze %0,%0\n\t"
+          "addze %0,%0"
+          : "+r"(acc)
+          : "r"(w[0]), "r"(w[1]), "r"(w[2]), "r"(w[3]),
+            "r"(w[4]), "r"(w[5]), "r"(w[6]), "r"(w[7])
+          : "xer");
+  return acc;
+}
 
-static u16_t
-lwip_standard_chksum2(void *dataptr, int len)
+static inline chksum_acc_t
+chksum_add(chksum_acc_t acc, u32_t w)
 {
-  u8_t *pb = dataptr;
-  u16_t *ps, t = 0;
-  u32_t sum = 0;
-  int odd = ((u32_t)pb & 1);
+  acc += w;
+  return acc + (acc < w);
+}
 
-  /* Get aligned to u16_t */
-  if (odd && len > 0) {
-    ((u8_t *)&t)[1] = *pb++;
-    len--;
-  }
+static inline u32_t
+chksum_fold(chksum_acc_t acc)
+{
+  acc = (acc >> 16) + (acc & 0xffffUL);
+  return (acc >> 16) + (acc & 0xffffUL);
+}
+#else
+typedef u64_t chksum_acc_t;
 
-  /* Add the bulk of the data */
-  ps = (u16_t *)pb;
-  while (len > 1) {
-    sum += *ps++;
-    len -= 2;
-  }
+static inline chksum_acc_t
+chksum_add8(chksum_acc_t acc, const u32_t *w)
+{
+  acc += w[0];
+  acc += w[1];
+  acc += w[2];
+  acc += w[3];
+  acc += w[4];
+  acc += w[5];
+  acc += w[6];
+  acc += w[7];
+  return acc;
+}
 
-  /* Consume left-over byte, if any */
-  if (len > 0)
-    ((u8_t *)&t)[0] = *(u8_t *)ps;;
+static inline chksum_acc_t
+chksum_add(chksum_acc_t acc, u32_t w)
+{
+  return acc + w;
+}
 
-  /* Add end bytes */
-  sum += t;
+static inline u32_t
+chksum_fold(chksum_acc_t acc)
+{
+  acc = (acc >> 32) + (acc & 0xffffffffULL);
+  acc = (acc >> 16) + (acc & 0xffffUL);
+  acc = (acc >> 16) + (acc & 0xffffUL);
+  return (u32_t)((acc >> 16) + (acc & 0xffffUL));
+}
+#endif
 
-  /*  Fold 32-bit sum to 16 bits */
-  while (sum >> 16)
-    sum = (sum & 0xffff) + (sum >> 16);
+/* finish a sum: fold to 16 bits and undo the odd start */
+static inline u16_t
+chksum_finish(chksum_acc_t acc, u16_t t, int odd)
+{
+  u32_t sum;
 
-  /* Swap if alignment was odd */
+  sum = chksum_fold(acc) + t;
+  sum = (sum >> 16) + (sum & 0xffffUL);
+  sum = (sum >> 16) + (sum & 0xffffUL);
   if (odd)
     sum = ((sum & 0xff) << 8) | ((sum & 0xff00) >> 8);
-
-  return sum;
+  return (u16_t)sum;
 }
 
 /**
- * An optimized checksum routine. Basically, it uses loop-unrolling on
- * the checksum loop, treating the head and tail bytes specially, whereas
- * the inner loop acts on 8 bytes at a time. 
+ * lwip checksum
  *
- * @arg start of buffer to be checksummed. May be an odd byte address.
- * @len number of bytes in the buffer to be checksummed.
- * 
- * @todo First argument type conflicts with generic checksum routine.
- * 
- * by Curt McDowell, Broadcom Corp. December 8th, 2005
+ * @param dataptr points to start of data to be summed at any boundary
+ * @param len length of data to be summed
+ * @return host order (!) lwip checksum (non-inverted Internet sum)
  */
-
 static u16_t
-lwip_standard_chksum4(u8_t *pb, int len)
+lwip_fast_chksum(void *dataptr, u16_t len)
 {
-  u16_t *ps, t = 0;
+  u8_t *pb = dataptr;
   u32_t *pl;
-  u32_t sum = 0, tmp;
-  /* starts at odd byte address? */
-  int odd = ((u32_t)pb & 1);
+  u16_t t = 0;
+  chksum_acc_t acc = 0;
+  int odd = ((mem_ptr_t)pb & 1);
 
+  /* an odd start pairs the bytes the other way round, the first one
+     goes to the second half of a word and the sum gets swapped back */
   if (odd && len > 0) {
     ((u8_t *)&t)[1] = *pb++;
     len--;
   }
-
-  ps = (u16_t *)pb;
-
-  if (((u32_t)ps & 3) && len > 1) {
-    sum += *ps++;
+  if (((mem_ptr_t)pb & 2) && len > 1) {
+    acc += *(u16_t *)pb;
+    pb += 2;
     len -= 2;
   }
 
-  pl = (u32_t *)ps;
+  pl = (u32_t *)pb;
+  while (len >= 32) {
+    acc = chksum_add8(acc, pl);
+    pl += 8;
+    len -= 32;
+  }
+  while (len >= 4) {
+    acc = chksum_add(acc, *pl++);
+    len -= 4;
+  }
 
-  while (len > 7)  {
-    tmp = sum + *pl++;          /* ping */
-    if (tmp < sum)
-      tmp++;                    /* add back carry */
+  pb = (u8_t *)pl;
+  if (len > 1) {
+    acc = chksum_add(acc, *(u16_t *)pb);
+    pb += 2;
+    len -= 2;
+  }
+  /* dangling tail byte remaining? */
+  if (len > 0)
+    ((u8_t *)&t)[0] = *pb;
 
-    sum = tmp + *pl++;          /* pong */
-    if (sum < tmp)
-      sum++;                    /* add back carry */
+  return chksum_finish(acc, t, odd);
+}
 
-    len -= 8;
-  }
+#ifndef LWIP_CHKSUM
+#define LWIP_CHKSUM lwip_fast_chksum
+#endif
 
-  /* make room in upper bits */
-  sum = (sum >> 16) + (sum & 0xffff);
+/* inet_chksum_copy:
+ *
+ * Copies len bytes from src to dst and returns what LWIP_CHKSUM(dst, len)
+ * would, touching the data once. The destination is aligned first, the
+ * source may sit at any boundary.
+ */
 
-  ps = (u16_t *)pl;
+u16_t
+inet_chksum_copy(void *dst, const void *src, u16_t len)
+{
+  u8_t *pd = dst;
+  const u8_t *ps = src;
+  u32_t w[8];
+  u16_t t = 0;
+  chksum_acc_t acc = 0;
+  int odd = ((mem_ptr_t)pd & 1);
 
-  /* 16-bit aligned word remaining? */
-  while (len > 1) {
-    sum += *ps++;
+  if (odd && len > 0) {
+    ((u8_t *)&t)[1] = *pd++ = *ps++;
+    len--;
+  }
+  if (((mem_ptr_t)pd & 2) && len > 1) {
+    memcpy(pd, ps, 2);
+    acc += *(u16_t *)pd;
+    pd += 2;
+    ps += 2;
     len -= 2;
   }
 
-  /* dangling tail byte remaining? */
-  if (len > 0)                  /* include odd byte */
-    ((u8_t *)&t)[0] = *(u8_t *)ps;
+  /* memcpy() of a constant size into registers becomes plain loads
+     and stores, misaligned ones included where the CPU handles them */
+  while (len >= 32) {
+    memcpy(w, ps, 32);
+    memcpy(pd, w, 32);
+    acc = chksum_add8(acc, w);
+    pd += 32;
+    ps += 32;
+    len -= 32;
+  }
+  while (len >= 4) {
+    memcpy(w, ps, 4);
+    *(u32_t *)pd = w[0];
+    acc = chksum_add(acc, w[0]);
+    pd += 4;
+    ps += 4;
+    len -= 4;
+  }
 
-  sum += t;                     /* add end bytes */
+  if (len > 1) {
+    memcpy(pd, ps, 2);
+    acc = chksum_add(acc, *(u16_t *)pd);
+    pd += 2;
+    ps += 2;
+    len -= 2;
+  }
+  if (len > 0)
+    ((u8_t *)&t)[0] = *pd = *ps;
 
-  while (sum >> 16)             /* combine halves */
-    sum = (sum >> 16) + (sum & 0xffff);
+  return chksum_finish(acc, t, odd);
+}
 
-  if (odd)
-    sum = ((sum & 0xff) << 8) | ((sum & 0xff00) >> 8);
+/* add the pseudo header to a partial sum and fold it to 16 bits */
+static u32_t
+inet_chksum_pseudo_hdr(u32_t acc,
+       struct ip_addr *src, struct ip_addr *dest,
+       u8_t proto, u16_t proto_len)
+{
+  acc += (src->addr & 0xffffUL);
+  acc += ((src->addr >> 16) & 0xffffUL);
+  acc += (dest->addr & 0xffffUL);
+  acc += ((dest->addr >> 16) & 0xffffUL);
+  acc += (u32_t)htons((u16_t)proto);
+  acc += (u32_t)htons(proto_len);
 
-  return sum;
+  while (acc >> 16) {
+    acc = (acc & 0xffffUL) + (acc >> 16);
+  }
+  return acc;
 }
-#endif
 
 /* inet_chksum_pseudo:
  *
@@ -270,17 +321,37 @@ inet_chksum_pseudo(struct pbuf *p,
   if (swapped) {
     acc = ((acc & 0xff) << 8) | ((acc & 0xff00UL) >> 8);
   }
-  acc += (src->addr & 0xffffUL);
-  acc += ((src->addr >> 16) & 0xffffUL);
-  acc += (dest->addr & 0xffffUL);
-  acc += ((dest->addr >> 16) & 0xffffUL);
-  acc += (u32_t)htons((u16_t)proto);
-  acc += (u32_t)htons(proto_len);
+  acc = inet_chksum_pseudo_hdr(acc, src, dest, proto, proto_len);
+  LWIP_DEBUGF(INET_DEBUG, ("inet_chksum_pseudo(): pbuf chain lwip_chksum()=%"X32_F"\n", acc));
+  return (u16_t)~(acc & 0xffffUL);
+}
 
-  while (acc >> 16) {
-    acc = (acc & 0xffffUL) + (acc >> 16);
+/* inet_chksum_pseudo_partial:
+ *
+ * Like inet_chksum_pseudo(), but only the first chksum_len bytes of the chain
+ * are summed. The rest was already summed into data_chksum, e.g. by
+ * inet_chksum_copy() while the data was copied in. chksum_len must be even.
+ */
+
+u16_t
+inet_chksum_pseudo_partial(struct pbuf *p,
+       struct ip_addr *src, struct ip_addr *dest,
+       u8_t proto, u16_t proto_len, u16_t chksum_len, u16_t data_chksum)
+{
+  u32_t acc;
+  struct pbuf *q;
+  u16_t len;
+
+  LWIP_ASSERT("inet_chksum_pseudo_partial: chksum_len must be even", (chksum_len & 1) == 0);
+
+  acc = data_chksum;
+  for(q = p; q != NULL && chksum_len > 0; q = q->next) {
+    len = q->len < chksum_len ? q->len : chksum_len;
+    LWIP_ASSERT("inet_chksum_pseudo_partial: pbuf boundary must be even", (len & 1) == 0);
+    acc += LWIP_CHKSUM(q->payload, len);
+    chksum_len -= len;
   }
-  LWIP_DEBUGF(INET_DEBUG, ("inet_chksum_pseudo(): pbuf chain lwip_chksum()=%"X32_F"\n", acc));
+  acc = inet_chksum_pseudo_hdr(acc, src, dest, proto, proto_len);
   return (u16_t)~(acc & 0xffffUL);
 }
 
@@ -318,7 +389,7 @@ inet_chksum_pbuf(struct pbuf *p)
     }
     if (q->len % 2 != 0) {
       swapped = 1 - swapped;
-      acc = (acc & 0x00ffUL << 8) | (acc & 0xff00UL >> 8);
+      acc = ((acc & 0x00ffUL) << 8) | ((acc & 0xff00UL) >> 8);
     }
   }
 
@@ -327,8 +327,8 @@ tcp_listen(struct tcp_pcb *pcb)
 void
 tcp_recved(struct tcp_pcb *pcb, u16_t len)
 {
-  if ((u32_t)pcb->rcv_wnd + len > TCP_WND) {
-    pcb->rcv_wnd = TCP_WND;
+  if (pcb->rcv_wnd + len > pcb->rcv_wnd_max) {
+    pcb->rcv_wnd = pcb->rcv_wnd_max;
   } else {
     pcb->rcv_wnd += len;
   }
@@ -346,19 +346,19 @@ tcp_recved(struct tcp_pcb *pcb, u16_t len)
      */
     tcp_ack(pcb);
   } 
-  else if (pcb->flags & TF_ACK_DELAY && pcb->rcv_wnd >= TCP_WND/2) {
+  else if (pcb->flags & TF_ACK_DELAY && pcb->rcv_wnd >= pcb->rcv_wnd_max/2) {
     /* If we can send a window update such that there is a full
      * segment available in the window, do so now.  This is sort of
      * nagle-like in its goals, and tries to hit a compromise between
      * sending acks each time the window is updated, and only sending
      * window updates when a timer expires.  The "threshold" used
-     * above (currently TCP_WND/2) can be tuned to be more or less
+     * above (currently rcv_wnd_max/2) can be tuned to be more or less
      * aggressive  */
     tcp_ack_now(pcb);
   }
 
-  LWIP_DEBUGF(TCP_DEBUG, ("tcp_recved: recveived %"U16_F" bytes, wnd %"U16_F" (%"U16_F").\n",
-         len, pcb->rcv_wnd, TCP_WND - pcb->rcv_wnd));
+  LWIP_DEBUGF(TCP_DEBUG, ("tcp_recved: recveived %"U16_F" bytes, wnd %"U32_F" (%"U32_F").\n",
+         len, pcb->rcv_wnd, pcb->rcv_wnd_max - pcb->rcv_wnd));
 }
 
 /**
@@ -398,6 +398,40 @@ tcp_new_port(void)
   return port;
 }
 
+/**
+ * Builds the options of a SYN or SYN|ACK segment: the MSS, plus the
+ * window scale and SACK-permitted options flagged in pcb->optflags.
+ * optdata must have room for three words, the length in bytes is
+ * returned.
+ */
+u8_t
+tcp_synopts(struct tcp_pcb *pcb, u32_t *optdata)
+{
+  u8_t len = 0;
+
+  optdata[len++] = htonl(((u32_t)2 << 24) |
+      ((u32_t)4 << 16) |
+      (((u32_t)pcb->mss / 256) << 8) |
+      (pcb->mss & 255));
+#if LWIP_WND_SCALE
+  if (pcb->optflags & TF_OPT_WSCALE) {
+    optdata[len++] = htonl(((u32_t)1 << 24) |
+        ((u32_t)3 << 16) |
+        ((u32_t)3 << 8) |
+        TCP_RCV_SCALE);
+  }
+#endif /* LWIP_WND_SCALE */
+#if LWIP_TCP_SACK_OUT
+  if (pcb->optflags & TF_OPT_SACK) {
+    optdata[len++] = htonl(((u32_t)1 << 24) |
+        ((u32_t)1 << 16) |
+        ((u32_t)4 << 8) |
+        2);
+  }
+#endif /* LWIP_TCP_SACK_OUT */
+  return len << 2;
+}
+
 /**
  * Connects to another host. The function given as the "connected"
  * argument will be called when the connection has been established.
@@ -407,7 +441,7 @@ err_t
 tcp_connect(struct tcp_pcb *pcb, struct ip_addr *ipaddr, u16_t port,
       err_t (* connected)(void *arg, struct tcp_pcb *tpcb, err_t err))
 {
-  u32_t optdata;
+  u32_t optdata[3];
   err_t ret;
   u32_t iss;
 
@@ -426,7 +460,7 @@ tcp_connect(struct tcp_pcb *pcb, struct ip_addr *ipaddr, u16_t port,
   pcb->snd_nxt = iss;
   pcb->lastack = iss - 1;
   pcb->snd_lbb = iss - 1;
-  pcb->rcv_wnd = TCP_WND;
+  pcb->rcv_wnd = pcb->rcv_wnd_max;
   pcb->snd_wnd = TCP_WND;
   pcb->mss = TCP_MSS;
   pcb->cwnd = 1;
@@ -437,13 +471,16 @@ tcp_connect(struct tcp_pcb *pcb, struct ip_addr *ipaddr, u16_t port,
 #endif /* LWIP_CALLBACK_API */  
   TCP_REG(&tcp_active_pcbs, pcb);
   
-  /* Build an MSS option */
-  optdata = htonl(((u32_t)2 << 24) | 
-      ((u32_t)4 << 16) | 
-      (((u32_t)pcb->mss / 256) << 8) |
-      (pcb->mss & 255));
-
-  ret = tcp_enqueue(pcb, NULL, 0, TCP_SYN, 0, (u8_t *)&optdata, 4);
+  /* Offer every option we support, the SYN|ACK tells what the
+     peer agreed to. */
+#if LWIP_WND_SCALE
+  pcb->optflags |= TF_OPT_WSCALE;
+#endif /* LWIP_WND_SCALE */
+#if LWIP_TCP_SACK_OUT
+  pcb->optflags |= TF_OPT_SACK;
+#endif /* LWIP_TCP_SACK_OUT */
+
+  ret = tcp_enqueue(pcb, NULL, 0, TCP_SYN, 0, (u8_t *)optdata, tcp_synopts(pcb, optdata));
   if (ret == ERR_OK) { 
     tcp_output(pcb);
   }
@@ -817,8 +854,10 @@ tcp_alloc(u8_t prio)
     memset(pcb, 0, sizeof(struct tcp_pcb));
     pcb->prio = TCP_PRIO_NORMAL;
     pcb->snd_buf = TCP_SND_BUF;
+    pcb->snd_buf_max = TCP_SND_BUF;
     pcb->snd_queuelen = 0;
     pcb->rcv_wnd = TCP_WND;
+    pcb->rcv_wnd_max = TCP_WND;
     pcb->tos = 0;
     pcb->ttl = TCP_TTL;
     pcb->mss = TCP_MSS;
@@ -347,7 +347,7 @@ static err_t
 tcp_listen_input(struct tcp_pcb_listen *pcb)
 {
   struct tcp_pcb *npcb;
-  u32_t optdata;
+  u32_t optdata[3];
 
   /* In the LISTEN state, we check for incoming SYN segments,
      creates a new PCB, and responds with a SYN|ACK. */
@@ -392,13 +392,9 @@ tcp_listen_input(struct tcp_pcb_listen *pcb)
     /* Parse any options in the SYN. */
     tcp_parseopt(npcb);
 
-    /* Build an MSS option. */
-    optdata = htonl(((u32_t)2 << 24) |
-        ((u32_t)4 << 16) |
-        (((u32_t)npcb->mss / 256) << 8) |
-        (npcb->mss & 255));
-    /* Send a SYN|ACK together with the MSS option. */
-    tcp_enqueue(npcb, NULL, 0, TCP_SYN | TCP_ACK, 0, (u8_t *)&optdata, 4);
+    /* Send a SYN|ACK together with the MSS option and whatever
+       else the peer offered and we support. */
+    tcp_enqueue(npcb, NULL, 0, TCP_SYN | TCP_ACK, 0, (u8_t *)optdata, tcp_synopts(npcb, optdata));
     return tcp_output(npcb);
   }
   return ERR_OK;
@@ -629,23 +625,32 @@ tcp_receive(struct tcp_pcb *pcb)
   s32_t off;
   s16_t m;
   u32_t right_wnd_edge;
+  u32_t wnd;
   u16_t new_tot_len;
 
 
   if (flags & TCP_ACK) {
     right_wnd_edge = pcb->snd_wnd + pcb->snd_wl1;
 
+    /* The window field of a SYN is never scaled. */
+    wnd = tcphdr->wnd;
+#if LWIP_WND_SCALE
+    if (!(flags & TCP_SYN)) {
+      wnd <<= pcb->snd_scale;
+    }
+#endif /* LWIP_WND_SCALE */
+
     /* Update window. */
     if (TCP_SEQ_LT(pcb->snd_wl1, seqno) ||
        (pcb->snd_wl1 == seqno && TCP_SEQ_LT(pcb->snd_wl2, ackno)) ||
-       (pcb->snd_wl2 == ackno && tcphdr->wnd > pcb->snd_wnd)) {
-      pcb->snd_wnd = tcphdr->wnd;
+       (pcb->snd_wl2 == ackno && wnd > pcb->snd_wnd)) {
+      pcb->snd_wnd = wnd;
       pcb->snd_wl1 = seqno;
       pcb->snd_wl2 = ackno;
       LWIP_DEBUGF(TCP_WND_DEBUG, ("tcp_receive: window update %"U32_F"\n", pcb->snd_wnd));
 #if TCP_WND_DEBUG
     } else {
-      if (pcb->snd_wnd != tcphdr->wnd) {
+      if (pcb->snd_wnd != wnd) {
         LWIP_DEBUGF(TCP_WND_DEBUG, ("tcp_receive: no window update lastack %"U32_F" snd_max %"U32_F" ackno %"U32_F" wl1 %"U32_F" seqno %"U32_F" wl2 %"U32_F"\n",
                                pcb->lastack, pcb->snd_max, ackno, pcb->snd_wl1, seqno, pcb->snd_wl2));
       }
@@ -1014,6 +1019,10 @@ tcp_receive(struct tcp_pcb *pcb)
 
       } else {
         /* We get here if the incoming segment is out-of-sequence. */
+#if LWIP_TCP_SACK_OUT
+        /* The ACK below reports the block holding this segment first. */
+        pcb->sack_recent = seqno;
+#endif /* LWIP_TCP_SACK_OUT */
         tcp_ack_now(pcb);
 #if TCP_QUEUE_OOSEQ
         /* We queue the segment on the ->ooseq queue. */
@@ -1150,7 +1159,9 @@ tcp_receive(struct tcp_pcb *pcb)
  * tcp_parseopt:
  *
  * Parses the options contained in the incoming segment. (Code taken
- * from uIP with only small changes.)
+ * from uIP with only small changes.) Only called for segments with
+ * the SYN flag set, which is where the window scale and
+ * SACK-permitted options are negotiated.
  *
  */
 
@@ -1160,10 +1171,15 @@ tcp_parseopt(struct tcp_pcb *pcb)
   u8_t c;
   u8_t *opts, opt;
   u16_t mss;
+  u8_t offered;
 
   opts = (u8_t *)tcphdr + TCP_HLEN;
 
-  /* Parse the TCP MSS option, if present. */
+  /* What we offered in our own SYN on an active open; a listening
+     pcb has offered nothing yet and simply echoes what it accepts. */
+  offered = pcb->optflags;
+  pcb->optflags = 0;
+
   if(TCPH_HDRLEN(tcphdr) > 0x5) {
     for(c = 0; c < (TCPH_HDRLEN(tcphdr) - 5) << 2 ;) {
       opt = opts[c];
@@ -1178,9 +1194,22 @@ tcp_parseopt(struct tcp_pcb *pcb)
         /* An MSS option with the right option length. */
         mss = (opts[c + 2] << 8) | opts[c + 3];
         pcb->mss = mss > TCP_MSS? TCP_MSS: mss;
-
-        /* And we are done processing options. */
-        break;
+        c += 0x04;
+#if LWIP_WND_SCALE
+      } else if (opt == 0x03 &&
+        opts[c + 1] == 0x03) {
+        /* A window scale option, RFC 1323 caps the shift at 14. */
+        pcb->snd_scale = opts[c + 2] > 14? 14: opts[c + 2];
+        pcb->optflags |= TF_OPT_WSCALE;
+        c += 0x03;
+#endif /* LWIP_WND_SCALE */
+#if LWIP_TCP_SACK_OUT
+      } else if (opt == 0x04 &&
+        opts[c + 1] == 0x02) {
+        /* SACK permitted. */
+        pcb->optflags |= TF_OPT_SACK;
+        c += 0x02;
+#endif /* LWIP_TCP_SACK_OUT */
       } else {
   if (opts[c + 1] == 0) {
           /* If the length field is zero, the options are malformed
@@ -1193,6 +1222,27 @@ tcp_parseopt(struct tcp_pcb *pcb)
       }
     }
   }
+
+  /* An active open only keeps what both ends sent. */
+  if (offered != 0) {
+    pcb->optflags &= offered;
+  }
+
+#if LWIP_WND_SCALE
+  if (pcb->optflags & TF_OPT_WSCALE) {
+    pcb->rcv_scale = TCP_RCV_SCALE;
+  } else {
+    /* No scaling, our window has to fit in the 16 bit header field. */
+    pcb->snd_scale = 0;
+    pcb->rcv_scale = 0;
+    if (pcb->rcv_wnd_max > 0xffff) {
+      pcb->rcv_wnd_max = 0xffff;
+    }
+    if (pcb->rcv_wnd > 0xffff) {
+      pcb->rcv_wnd = 0xffff;
+    }
+  }
+#endif /* LWIP_WND_SCALE */
 }
 #endif /* LWIP_TCP */
 
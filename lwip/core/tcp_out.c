@@ -56,6 +56,9 @@
 
 /* Forward declarations.*/
 static void tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb);
+#if LWIP_TCP_SACK_OUT
+static u8_t tcp_sack_blocks(struct tcp_pcb *pcb, u32_t *opts);
+#endif /* LWIP_TCP_SACK_OUT */
 
 err_t
 tcp_send_ctrl(struct tcp_pcb *pcb, u8_t flags)
@@ -177,6 +180,10 @@ tcp_enqueue(struct tcp_pcb *pcb, void *arg, u16_t len,
     }
     seg->next = NULL;
     seg->p = NULL;
+#if TCP_CHECKSUM_ON_COPY
+    seg->chksum = 0;
+    seg->chksum_valid = 0;
+#endif
 
     /* first segment of to-be-queued data? */
     if (queue == NULL) {
@@ -212,8 +219,18 @@ tcp_enqueue(struct tcp_pcb *pcb, void *arg, u16_t len,
       }
       ++queuelen;
       if (arg != NULL) {
+#if TCP_CHECKSUM_ON_COPY
+        seg->chksum = inet_chksum_copy(seg->p->payload, ptr, seglen);
+        seg->chksum_valid = 1;
+#else
         memcpy(seg->p->payload, ptr, seglen);
+#endif
       }
+#if TCP_CHECKSUM_ON_COPY
+      else if (seglen == 0) {
+        seg->chksum_valid = 1;
+      }
+#endif
       seg->dataptr = seg->p->payload;
     }
     /* do not copy data */
@@ -313,6 +330,20 @@ tcp_enqueue(struct tcp_pcb *pcb, void *arg, u16_t len,
     /* Remove TCP header from first segment of our to-be-queued list */
     pbuf_header(queue->p, -TCP_HLEN);
     pbuf_cat(useg->p, queue->p);
+#if TCP_CHECKSUM_ON_COPY
+    if (useg->chksum_valid && queue->chksum_valid) {
+      u32_t acc = queue->chksum;
+      /* the appended data starts at an odd offset, its bytes pair the
+         other way round */
+      if (useg->len & 1) {
+        acc = ((acc & 0xff) << 8) | ((acc & 0xff00UL) >> 8);
+      }
+      acc += useg->chksum;
+      useg->chksum = (u16_t)((acc & 0xffffUL) + (acc >> 16));
+    } else {
+      useg->chksum_valid = 0;
+    }
+#endif
     useg->len += queue->len;
     useg->next = queue->next;
 
@@ -369,6 +400,63 @@ memerr:
   return ERR_MEM;
 }
 
+#if LWIP_TCP_SACK_OUT
+/**
+ * Fills opts with a SACK option (RFC 2018) describing the data held
+ * on the ->ooseq queue: up to four blocks of contiguous segments,
+ * the block holding the latest out-of-sequence arrival first.
+ * Returns the option length in bytes, 0 if there is nothing to report.
+ */
+static u8_t
+tcp_sack_blocks(struct tcp_pcb *pcb, u32_t *opts)
+{
+  struct tcp_seg *seg;
+  u32_t blk[8];
+  u32_t left, right;
+  u8_t n, i;
+
+  if (!(pcb->optflags & TF_OPT_SACK) || pcb->ooseq == NULL) {
+    return 0;
+  }
+
+  n = 0;
+  seg = pcb->ooseq;
+  while (seg != NULL) {
+    /* Merge the run of segments that continue each other. */
+    left = seg->tcphdr->seqno;
+    right = left + TCP_TCPLEN(seg);
+    for (seg = seg->next; seg != NULL && seg->tcphdr->seqno == right; seg = seg->next) {
+      right += TCP_TCPLEN(seg);
+    }
+
+    if (TCP_SEQ_BETWEEN(pcb->sack_recent, left, right - 1)) {
+      for (i = (n < 4 ? n : 3); i > 0; i--) {
+        blk[i * 2] = blk[i * 2 - 2];
+        blk[i * 2 + 1] = blk[i * 2 - 1];
+      }
+      blk[0] = left;
+      blk[1] = right;
+      if (n < 4) {
+        n++;
+      }
+    } else if (n < 4) {
+      blk[n * 2] = left;
+      blk[n * 2 + 1] = right;
+      n++;
+    }
+  }
+
+  opts[0] = htonl(((u32_t)1 << 24) |
+      ((u32_t)1 << 16) |
+      ((u32_t)5 << 8) |
+      (2 + n * 8));
+  for (i = 0; i < n * 2; i++) {
+    opts[i + 1] = htonl(blk[i]);
+  }
+  return 4 + n * 8;
+}
+#endif /* LWIP_TCP_SACK_OUT */
+
 /* find out what we can send and send it */
 err_t
 tcp_output(struct tcp_pcb *pcb)
@@ -377,6 +465,10 @@ tcp_output(struct tcp_pcb *pcb)
   struct tcp_hdr *tcphdr;
   struct tcp_seg *seg, *useg;
   u32_t wnd;
+  u8_t optlen = 0;
+#if LWIP_TCP_SACK_OUT
+  u32_t sackopts[9];
+#endif /* LWIP_TCP_SACK_OUT */
 #if TCP_CWND_DEBUG
   s16_t i = 0;
 #endif /* TCP_CWND_DEBUG */
@@ -408,7 +500,11 @@ tcp_output(struct tcp_pcb *pcb)
   if (pcb->flags & TF_ACK_NOW &&
      (seg == NULL ||
       ntohl(seg->tcphdr->seqno) - pcb->lastack + seg->len > wnd)) {
-    p = pbuf_alloc(PBUF_IP, TCP_HLEN, PBUF_RAM);
+#if LWIP_TCP_SACK_OUT
+    /* Tell the sender which out-of-sequence data we already hold. */
+    optlen = tcp_sack_blocks(pcb, sackopts);
+#endif /* LWIP_TCP_SACK_OUT */
+    p = pbuf_alloc(PBUF_IP, TCP_HLEN + optlen, PBUF_RAM);
     if (p == NULL) {
       LWIP_DEBUGF(TCP_OUTPUT_DEBUG, ("tcp_output: (ACK) could not allocate pbuf\n"));
       return ERR_BUF;
@@ -423,9 +519,14 @@ tcp_output(struct tcp_pcb *pcb)
     tcphdr->seqno = htonl(pcb->snd_nxt);
     tcphdr->ackno = htonl(pcb->rcv_nxt);
     TCPH_FLAGS_SET(tcphdr, TCP_ACK);
-    tcphdr->wnd = htons(pcb->rcv_wnd);
+    tcphdr->wnd = htons(tcp_adv_wnd(pcb));
     tcphdr->urgp = 0;
-    TCPH_HDRLEN_SET(tcphdr, 5);
+    TCPH_HDRLEN_SET(tcphdr, 5 + optlen / 4);
+#if LWIP_TCP_SACK_OUT
+    if (optlen > 0) {
+      memcpy((u8_t *)tcphdr + TCP_HLEN, sackopts, optlen);
+    }
+#endif /* LWIP_TCP_SACK_OUT */
 
     tcphdr->chksum = 0;
 #if CHECKSUM_GEN_TCP
@@ -527,9 +628,12 @@ tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb)
   /* silly window avoidance */
   if (pcb->rcv_wnd < pcb->mss) {
     seg->tcphdr->wnd = 0;
+  } else if (TCPH_FLAGS(seg->tcphdr) & TCP_SYN) {
+    /* the window in a SYN segment is never scaled */
+    seg->tcphdr->wnd = htons((u16_t)(pcb->rcv_wnd > 0xffff ? 0xffff : pcb->rcv_wnd));
   } else {
     /* advertise our receive window size in this TCP segment */
-    seg->tcphdr->wnd = htons(pcb->rcv_wnd);
+    seg->tcphdr->wnd = htons(tcp_adv_wnd(pcb));
   }
 
   /* If we don't have a local IP address, we get one by
@@ -562,6 +666,16 @@ tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb)
   seg->p->payload = seg->tcphdr;
 
   seg->tcphdr->chksum = 0;
+#if TCP_CHECKSUM_ON_COPY
+  if (seg->chksum_valid) {
+    /* the data was summed when it was copied in, only the header is left */
+    seg->tcphdr->chksum = inet_chksum_pseudo_partial(seg->p,
+             &(pcb->local_ip),
+             &(pcb->remote_ip),
+             IP_PROTO_TCP, seg->p->tot_len,
+             TCPH_HDRLEN(seg->tcphdr) * 4, seg->chksum);
+  } else
+#endif
 #if CHECKSUM_GEN_TCP
   seg->tcphdr->chksum = inet_chksum_pseudo(seg->p,
              &(pcb->local_ip),
@@ -593,7 +707,7 @@ tcp_rst(u32_t seqno, u32_t ackno,
   tcphdr->seqno = htonl(seqno);
   tcphdr->ackno = htonl(ackno);
   TCPH_FLAGS_SET(tcphdr, TCP_RST | TCP_ACK);
-  tcphdr->wnd = htons(TCP_WND);
+  tcphdr->wnd = htons((u16_t)(TCP_WND > 0xffff ? 0xffff : TCP_WND));
   tcphdr->urgp = 0;
   TCPH_HDRLEN_SET(tcphdr, 5);
 
@@ -691,7 +805,7 @@ tcp_keepalive(struct tcp_pcb *pcb)
    tcphdr->dest = htons(pcb->remote_port);
    tcphdr->seqno = htonl(pcb->snd_nxt - 1);
    tcphdr->ackno = htonl(pcb->rcv_nxt);
-   tcphdr->wnd = htons(pcb->rcv_wnd);
+   tcphdr->wnd = htons(tcp_adv_wnd(pcb));
    tcphdr->urgp = 0;
    TCPH_HDRLEN_SET(tcphdr, 5);
    
@@ -1,4 +1,5 @@
 #include <time.h>
+#include <stddef.h>
 #include <errno.h>
 #include <unistd.h>
 #include <ogcsys.h>
@@ -45,12 +46,30 @@
 #define STACKSIZE				32768
 #define MQBOX_SIZE				256
 #define NUM_SOCKETS				MEMP_NUM_NETCONN
+#define NUM_EPOLLS				4
+#define ZCSENT_LINGER			10
+
+struct netepoll;
 
 struct netsocket {
 	struct netconn *conn;
 	struct netbuf *lastdata;
 	u16 lastoffset,rcvevt,sendevt,flags;
 	s32 err;
+
+	struct netepoll *ep;
+	struct netsocket *ep_next;
+	u32 ep_events,ep_queued;
+	void *ep_data;
+};
+
+struct netepoll {
+	u32 used;
+	struct netsocket *ready;
+	struct netsocket *ready_tail;
+	u32 waiters;
+	mutex_t lck;
+	cond_t cond;
 };
 
 struct netselect_cb {
@@ -79,6 +98,7 @@ static wd_cntrl dhcp_finetimer_cntrl;
 static struct netif g_hNetIF;
 static struct netif g_hLoopIF;
 static struct netsocket sockets[NUM_SOCKETS];
+static struct netepoll epolls[NUM_EPOLLS];
 static struct netselect_cb *selectcb_list = NULL;
 
 static const s32 err_to_errno_table[] = {
@@ -104,6 +124,12 @@ static const s32 err_to_errno_table[] = {
   ((unsigned)(-(err)) < ERR_TO_ERRNO_TABLE_SIZE ? \
     err_to_errno_table[-(err)] : EIO)
 
+/* net_recv_zc() hands out pbufs as struct netzcbuf */
+typedef char netzcbuf_matches_pbuf[(offsetof(struct pbuf,next)==offsetof(struct netzcbuf,next) &&
+									offsetof(struct pbuf,payload)==offsetof(struct netzcbuf,data) &&
+									offsetof(struct pbuf,tot_len)==offsetof(struct netzcbuf,tot_len) &&
+									offsetof(struct pbuf,len)==offsetof(struct netzcbuf,len))?1:-1];
+
 static sys_sem netsocket_sem;
 static sys_sem sockselect_sem;
 static sys_mbox netthread_mbox;
@@ -111,6 +137,28 @@ static sys_mbox netthread_mbox;
 static sys_thread hnet_thread;
 static u8 netthread_stack[STACKSIZE];
 
+#if LWIP_TCPIP_CORE_LOCKING
+static mutex_t netcore_lck = LWP_MUTEX_NULL;
+#define LOCK_TCPIP_CORE()		LWP_MutexLock(netcore_lck)
+#define UNLOCK_TCPIP_CORE()		LWP_MutexUnlock(netcore_lck)
+#else
+#define LOCK_TCPIP_CORE()
+#define UNLOCK_TCPIP_CORE()
+#endif
+
+/* received frames, filled by the driver (usually from its interrupt
+   handler) and emptied by the tcpip thread in one go */
+struct net_rxslot {
+	struct pbuf *p;
+	struct netif *inp;
+};
+
+static struct net_rxslot net_rxq[TCPIP_RXQ_SIZE];
+static volatile u32 net_rxq_head = 0;
+static volatile u32 net_rxq_tail = 0;
+static u32 net_rxq_posted = 0;
+static struct net_msg net_rxq_msg = { NETMSG_INPUT };
+
 static u32 tcp_timer_active = 0;
 
 static struct netbuf* netbuf_new();
@@ -127,7 +175,7 @@ static err_t netconn_bind(struct netconn *,struct ip_addr *,u16);
 static err_t netconn_listen(struct netconn *);
 static struct netbuf* netconn_recv(struct netconn *);
 static err_t netconn_send(struct netconn *,struct netbuf *);
-static err_t netconn_write(struct netconn *,const void *,u32,u8);
+static err_t netconn_write(struct netconn *,const void *,u32,u8,struct netconn_zcreq **);
 static err_t netconn_connect(struct netconn *,struct ip_addr *,u16);
 static err_t netconn_disconnect(struct netconn *);
 
@@ -160,7 +208,9 @@ static apimsg_decode decode[APIMSG_MAX] = {
 static void apimsg_post(struct api_msg *);
 
 static err_t net_input(struct pbuf *,struct netif *);
+#if !LWIP_TCPIP_CORE_LOCKING
 static void net_apimsg(struct api_msg *);
+#endif
 static err_t net_callback(void (*)(void *),void *);
 static void* net_thread(void *);
 
@@ -326,6 +376,7 @@ static struct netconn* netconn_new_with_proto_and_callback(enum netconn_type t,u
 	conn->socket = 0;
 	conn->callback = cb;
 	conn->recvavail = 0;
+	conn->zcsent = NULL;
 	
 	msg = memp_malloc(MEMP_API_MSG);
 	if(!msg) {
@@ -579,7 +630,10 @@ static err_t netconn_send(struct netconn *conn,struct netbuf *buf)
 	return conn->err;
 }
 
-static err_t netconn_write(struct netconn *conn,const void *dataptr,u32 size,u8 copy)
+/* with zc set, the request is linked to the connection by the first
+   chunk's do_write(); *zc is cleared then, so a request still in *zc
+   on return was never seen by the stack */
+static err_t netconn_write(struct netconn *conn,const void *dataptr,u32 size,u8 copy,struct netconn_zcreq **zc)
 {
 	u32 dummy;
 	struct api_msg *msg;
@@ -595,6 +649,7 @@ static err_t netconn_write(struct netconn *conn,const void *dataptr,u32 size,u8
 	
 	msg->type = APIMSG_WRITE;
 	msg->msg.conn = conn;
+	msg->msg.msg.w.zc = (zc ? *zc : NULL);
 	conn->state = NETCONN_WRITE;
 	while(conn->err==ERR_OK && size>0) {
 		msg->msg.msg.w.dataptr = (void*)dataptr;
@@ -630,6 +685,7 @@ static err_t netconn_write(struct netconn *conn,const void *dataptr,u32 size,u8
 		}
 	}
 ret:
+	if(zc) *zc = msg->msg.msg.w.zc;
 	memp_free(MEMP_API_MSG,msg);
 	conn->state = NETCONN_NONE;
 
@@ -755,6 +811,30 @@ static err_t recv_tcp(void *arg,struct tcp_pcb *pcb,struct pbuf *p,err_t err)
 	return ERR_OK;
 }
 
+/* hand back zero-copy buffers the peer has acknowledged */
+static void zcsent_acked(struct netconn *conn,struct tcp_pcb *pcb)
+{
+	struct netconn_zcreq *zc;
+
+	while((zc=conn->zcsent)!=NULL && TCP_SEQ_GEQ(pcb->lastack,zc->seq_end)) {
+		conn->zcsent = zc->next;
+		if(zc->cb) zc->cb(conn->socket,zc->data,zc->len,0,zc->usrdata);
+		mem_free(zc);
+	}
+}
+
+/* the pcb is gone, and with it every reference to the buffers */
+static void zcsent_flush(struct netconn *conn,s32 result)
+{
+	struct netconn_zcreq *zc;
+
+	while((zc=conn->zcsent)!=NULL) {
+		conn->zcsent = zc->next;
+		if(zc->cb) zc->cb(conn->socket,zc->data,zc->len,result,zc->usrdata);
+		mem_free(zc);
+	}
+}
+
 static void err_tcp(void *arg,err_t err)
 {
 	struct netconn *conn = (struct netconn*)arg;
@@ -763,6 +843,7 @@ static void err_tcp(void *arg,err_t err)
 	if(conn) {
 		conn->err = err;
 		conn->pcb.tcp = NULL;
+		zcsent_flush(conn,-err_to_errno(err));
 		if(conn->recvmbox!=SYS_MBOX_NULL) {
 			if(conn->callback) (*conn->callback)(conn,NETCONN_EVTRCVPLUS,0);
 			MQ_Send(conn->recvmbox,(mqmsg_t)NULL,MQ_MSG_BLOCK);
@@ -785,7 +866,7 @@ static err_t poll_tcp(void *arg,struct tcp_pcb *pcb)
 	struct netconn *conn = (struct netconn*)arg;
 
 	LWIP_DEBUGF(API_MSG_DEBUG, ("api_msg: poll_tcp\n"));
-	if(conn && conn->sem!=SYS_SEM_NULL && (conn->state==NETCONN_WRITE || conn->state==NETCONN_CLOSE))
+	if(conn && conn->sem!=SYS_SEM_NULL && (conn->state==NETCONN_WRITE || conn->state==NETCONN_CLOSE || conn->zcsent))
 		LWP_SemPost(conn->sem);
 	
 	return ERR_OK;
@@ -796,6 +877,9 @@ static err_t sent_tcp(void *arg,struct tcp_pcb *pcb,u16 len)
 	struct netconn *conn = (struct netconn*)arg;
 
 	LWIP_DEBUGF(API_MSG_DEBUG, ("api_msg: sent_tcp: sent %d bytes\n",len));
+	if(conn && conn->zcsent)
+		zcsent_acked(conn,pcb);
+
 	if(conn && conn->sem!=SYS_SEM_NULL)
 		LWP_SemPost(conn->sem);
 
@@ -859,6 +943,7 @@ static err_t accept_func(void *arg,struct tcp_pcb *newpcb,err_t err)
 	newconn->callback = conn->callback;
 	newconn->socket = -1;
 	newconn->recvavail = 0;
+	newconn->zcsent = NULL;
 
 	MQ_Send(mbox,(mqmsg_t)newconn,MQ_MSG_BLOCK);
 	return ERR_OK;
@@ -941,7 +1026,11 @@ static void do_delconn(struct apimsg_msg *msg)
 					tcp_recv(msg->conn->pcb.tcp,NULL);
 					tcp_poll(msg->conn->pcb.tcp,NULL,0);
 					tcp_err(msg->conn->pcb.tcp,NULL);
-					if(tcp_close(msg->conn->pcb.tcp)!=ERR_OK)
+					if(msg->conn->zcsent) {
+						// unacknowledged zero-copy data can't outlive its owner
+						tcp_abort(msg->conn->pcb.tcp);
+						zcsent_flush(msg->conn,-ECONNABORTED);
+					} else if(tcp_close(msg->conn->pcb.tcp)!=ERR_OK)
 						tcp_abort(msg->conn->pcb.tcp);
 				}
 				break;
@@ -1195,6 +1284,14 @@ static void do_write(struct apimsg_msg *msg)
 				msg->conn->err = ERR_VAL;
 				break;
 			case NETCONN_TCP:
+				if(msg->msg.w.zc) {
+					struct netconn_zcreq **pzc = &msg->conn->zcsent;
+
+					msg->msg.w.zc->seq_end = msg->conn->pcb.tcp->snd_lbb + msg->msg.w.zc->len;
+					while(*pzc) pzc = &(*pzc)->next;
+					*pzc = msg->msg.w.zc;
+					msg->msg.w.zc = NULL;
+				}
 				err = tcp_write(msg->conn->pcb.tcp,msg->msg.w.dataptr,msg->msg.w.len,msg->msg.w.copy);
 				if(err==ERR_OK && (!msg->conn->pcb.tcp->unacked || (msg->conn->pcb.tcp->flags&TF_NODELAY)
 					|| msg->conn->pcb.tcp->snd_queuelen>1)) {
@@ -1248,29 +1345,74 @@ static void apimsg_input(struct api_msg *msg)
 
 static void apimsg_post(struct api_msg *msg)
 {
+#if LWIP_TCPIP_CORE_LOCKING
+	LOCK_TCPIP_CORE();
+	apimsg_input(msg);
+	UNLOCK_TCPIP_CORE();
+#else
 	net_apimsg(msg);
+#endif
 }
 
 /* tcpip thread part */
 static err_t net_input(struct pbuf *p,struct netif *inp)
 {
-	struct net_msg *msg = memp_malloc(MEMP_TCPIP_MSG);
-			   
+	u32 level,post;
+	struct net_rxslot *slot;
+
 	LWIP_DEBUGF(TCPIP_DEBUG, ("net_input: %p %p\n", p,inp));
 
-	if(msg==NULL) {
-		LWIP_ERROR(("net_input: msg out of memory.\n"));
+	_CPU_ISR_Disable(level);
+	if((net_rxq_head-net_rxq_tail)>=TCPIP_RXQ_SIZE) {
+		_CPU_ISR_Restore(level);
+		LWIP_ERROR(("net_input: rx queue full.\n"));
 		pbuf_free(p);
 		return ERR_MEM;
 	}
+	slot = &net_rxq[net_rxq_head&(TCPIP_RXQ_SIZE-1)];
+	slot->p = p;
+	slot->inp = inp;
+	net_rxq_head++;
 
-	msg->type = NETMSG_INPUT;
-	msg->msg.inp.p = p;
-	msg->msg.inp.net = inp;
-	MQ_Send(netthread_mbox,(mqmsg_t)msg,MQ_MSG_BLOCK);
+	// only the first frame of a burst wakes the thread
+	post = !net_rxq_posted;
+	net_rxq_posted = 1;
+	_CPU_ISR_Restore(level);
+
+	if(post && MQ_Send(netthread_mbox,(mqmsg_t)&net_rxq_msg,MQ_MSG_BLOCK)==FALSE) {
+		_CPU_ISR_Disable(level);
+		net_rxq_posted = 0;
+		_CPU_ISR_Restore(level);
+	}
 	return ERR_OK;
 }
 
+static void net_rxq_process()
+{
+	u32 level,cnt;
+	struct pbuf *p;
+	struct netif *inp;
+
+	cnt = 0;
+	while(1) {
+		_CPU_ISR_Disable(level);
+		if(net_rxq_tail==net_rxq_head) {
+			net_rxq_posted = 0;
+			_CPU_ISR_Restore(level);
+			break;
+		}
+		p = net_rxq[net_rxq_tail&(TCPIP_RXQ_SIZE-1)].p;
+		inp = net_rxq[net_rxq_tail&(TCPIP_RXQ_SIZE-1)].inp;
+		net_rxq_tail++;
+		_CPU_ISR_Restore(level);
+
+		bba_process(p,inp);
+		cnt++;
+	}
+	LWIP_DEBUGF(TCPIP_DEBUG, ("net_rxq_process: %u packets\n", cnt));
+}
+
+#if !LWIP_TCPIP_CORE_LOCKING
 static void net_apimsg(struct api_msg *apimsg)
 {
 	struct net_msg *msg = memp_malloc(MEMP_TCPIP_MSG);
@@ -1286,6 +1428,7 @@ static void net_apimsg(struct api_msg *apimsg)
 	msg->msg.apimsg = apimsg;
 	MQ_Send(netthread_mbox,(mqmsg_t)msg,MQ_MSG_BLOCK);
 }
+#endif
 
 static err_t net_callback(void (*f)(void *),void *ctx)
 {
@@ -1334,14 +1477,15 @@ static void* net_thread(void *arg)
 
 	while(1) {
 		MQ_Receive(netthread_mbox,(mqmsg_t)&msg,MQ_MSG_BLOCK);
+		LOCK_TCPIP_CORE();
 		switch(msg->type) {
 			case NETMSG_API:
 			    LWIP_DEBUGF(TCPIP_DEBUG, ("net_thread: API message %p\n", (void *)msg));
 				apimsg_input(msg->msg.apimsg);
 				break;
 			case NETMSG_INPUT:
-			    LWIP_DEBUGF(TCPIP_DEBUG, ("net_thread: IP packet %p\n", (void *)msg));
-				bba_process(msg->msg.inp.p,msg->msg.inp.net);
+			    LWIP_DEBUGF(TCPIP_DEBUG, ("net_thread: IP packets %p\n", (void *)msg));
+				net_rxq_process();
 				break;
 			case NETMSG_CALLBACK:
 			    LWIP_DEBUGF(TCPIP_DEBUG, ("net_thread: CALLBACK %p\n", (void *)msg));
@@ -1350,7 +1494,8 @@ static void* net_thread(void *arg)
 			default:
 				break;
 		}
-		memp_free(MEMP_TCPIP_MSG,msg);
+		UNLOCK_TCPIP_CORE();
+		if(msg!=&net_rxq_msg) memp_free(MEMP_TCPIP_MSG,msg);
 	}
 	return NULL;
 }
@@ -1371,6 +1516,11 @@ static s32 alloc_socket(struct netconn *conn)
 			sockets[i].sendevt = 1;
 			sockets[i].flags = 0;
 			sockets[i].err = 0;
+			sockets[i].ep = NULL;
+			sockets[i].ep_next = NULL;
+			sockets[i].ep_events = 0;
+			sockets[i].ep_queued = 0;
+			sockets[i].ep_data = NULL;
 			LWP_SemPost(netsocket_sem);
 			return i;
 		}
@@ -1396,11 +1546,56 @@ static struct netsocket* get_socket(s32 s)
 	return sock;
 }
 
+static u32 epoll_readiness(struct netsocket *sock)
+{
+	u32 events = 0;
+
+	if(sock->lastdata || sock->rcvevt) events |= POLLIN;
+	if(sock->sendevt) events |= POLLOUT;
+	if(sock->conn && sock->conn->err!=ERR_OK) events |= POLLERR;
+	return events;
+}
+
+/* put sock on the ready list if it has something to report; called
+   with ep->lck held */
+static void epoll_queue(struct netepoll *ep,struct netsocket *sock)
+{
+	if(sock->ep_queued) return;
+	if(!(epoll_readiness(sock)&(sock->ep_events|POLLERR))) return;
+
+	sock->ep_next = NULL;
+	sock->ep_queued = 1;
+	if(ep->ready_tail)
+		ep->ready_tail->ep_next = sock;
+	else
+		ep->ready = sock;
+	ep->ready_tail = sock;
+	LWP_CondSignal(ep->cond);
+}
+
+static void epoll_unqueue(struct netepoll *ep,struct netsocket *sock)
+{
+	struct netsocket **psock,*prev = NULL;
+
+	if(!sock->ep_queued) return;
+
+	for(psock=&ep->ready;*psock;prev=*psock,psock=&(*psock)->ep_next) {
+		if(*psock==sock) {
+			*psock = sock->ep_next;
+			if(ep->ready_tail==sock) ep->ready_tail = prev;
+			break;
+		}
+	}
+	sock->ep_next = NULL;
+	sock->ep_queued = 0;
+}
+
 static void evt_callback(struct netconn *conn,enum netconn_evt evt,u32 len)
 {
 	s32 s;
 	struct netsocket *sock;
 	struct netselect_cb *scb;
+	struct netepoll *ep;
 	
 	if(conn) {
 		s = conn->socket;
@@ -1452,7 +1647,19 @@ static void evt_callback(struct netconn *conn,enum netconn_evt evt,u32 len)
 			break;
 		}
 	}
-	
+
+	// only a change towards ready is news for an epoll set, which
+	// net_epoll_close can't tear down while we hold sockselect_sem
+	if(evt==NETCONN_EVTRCVPLUS || evt==NETCONN_EVTSENDPLUS) {
+		LWP_SemWait(sockselect_sem);
+		ep = sock->ep;
+		if(ep) {
+			LWP_MutexLock(ep->lck);
+			if(sock->ep==ep) epoll_queue(ep,sock);
+			LWP_MutexUnlock(ep->lck);
+		}
+		LWP_SemPost(sockselect_sem);
+	}
 }
 
 extern const devoptab_t dotab_stdnet;
@@ -1484,6 +1691,12 @@ s32 if_configex(struct in_addr *local_ip,struct in_addr *netmask,struct in_addr
 	if (g_netinitiated < 2) {
 		// init tcpip thread message box
 		if(MQ_Init(&netthread_mbox,MQBOX_SIZE)!=MQ_ERROR_SUCCESSFUL) return -1;
+#if LWIP_TCPIP_CORE_LOCKING
+		if(LWP_MutexInit(&netcore_lck,FALSE)!=0) {
+			MQ_Close(netthread_mbox);
+			return -1;
+		}
+#endif
 		++g_netinitiated;
 	}
 
@@ -1607,6 +1820,14 @@ s32 net_get_mac_address(void *mac_buf)
 	return 0;
 }
 
+s32 net_get_ifstats(struct net_ifstats *stats)
+{
+	if(stats==NULL) return -EINVAL;
+	if(g_hNetIF.state==NULL) return -ENXIO;
+	bba_getstats(&g_hNetIF,stats);
+	return 0;
+}
+
 
 s32 net_init()
 {
@@ -1831,6 +2052,62 @@ s32 net_recvfrom(s32 s,void *mem,s32 len,u32 flags,struct sockaddr *from,socklen
 	return copylen;
 }
 
+s32 net_recv_zc(s32 s,struct netzcbuf **zb,u32 flags)
+{
+	struct netsocket *sock;
+	struct netbuf *buf;
+	struct pbuf *p,*q;
+	u32 offset;
+
+	LWIP_DEBUGF(SOCKETS_DEBUG, ("net_recv_zc(%d, %p, 0x%x)\n", s, zb, flags));
+	if(zb==NULL) return -EINVAL;
+	*zb = NULL;
+
+	sock = get_socket(s);
+	if(!sock) return -ENOTSOCK;
+
+	if(sock->lastdata) {
+		buf = sock->lastdata;
+		offset = sock->lastoffset;
+	} else {
+		if(((flags&MSG_DONTWAIT) || (sock->flags&O_NONBLOCK)) && !sock->rcvevt) {
+			LWIP_DEBUGF(SOCKETS_DEBUG, ("net_recv_zc(%d): returning EWOULDBLOCK\n", s));
+			return -EWOULDBLOCK;
+		}
+		buf = netconn_recv(sock->conn);
+		if(!buf) {
+		    LWIP_DEBUGF(SOCKETS_DEBUG, ("net_recv_zc(%d): buf == NULL!\n", s));
+			return 0;
+		}
+		offset = 0;
+	}
+	sock->lastdata = NULL;
+	sock->lastoffset = 0;
+
+	p = buf->p;
+	buf->p = NULL;
+	netbuf_delete(buf);
+
+	// drop what an earlier net_recv() already copied out
+	while(p && offset>=p->len) {
+		offset -= p->len;
+		q = p->next;
+		if(q) pbuf_ref(q);
+		pbuf_free(p);
+		p = q;
+	}
+	if(!p) return 0;
+	if(offset) pbuf_header(p,-(s16)offset);
+
+	*zb = (struct netzcbuf*)p;
+	return p->tot_len;
+}
+
+void net_zcbuf_release(struct netzcbuf *zb)
+{
+	if(zb) pbuf_free((struct pbuf*)zb);
+}
+
 s32 net_read(s32 s,void *mem,s32 len)
 {
 	return net_recvfrom(s,mem,len,0,NULL,NULL);
@@ -1904,7 +2181,7 @@ s32 net_send(s32 s,const void *data,s32 len,u32 flags)
 			netbuf_delete(buf);
 			break;
 		case NETCONN_TCP:
-			err = netconn_write(sock->conn,data,len,NETCONN_COPY);
+			err = netconn_write(sock->conn,data,len,NETCONN_COPY,NULL);
 			break;
 		default:
 			err = ERR_ARG;
@@ -1924,6 +2201,43 @@ s32 net_write(s32 s,const void *data,s32 size)
 	return net_send(s,data,size,0);
 }
 
+s32 net_send_zc(s32 s,const void *data,s32 len,u32 flags,netzcsent cb,void *usrdata)
+{
+	struct netsocket *sock;
+	struct netconn_zcreq *zc;
+	err_t err;
+
+	LWIP_DEBUGF(SOCKETS_DEBUG, ("net_send_zc(%d, data=%p, size=%d, flags=0x%x)\n", s, data, len, flags));
+	if(data==NULL || len<=0) return -EINVAL;
+
+	sock = get_socket(s);
+	if(!sock) return -ENOTSOCK;
+	if(netconn_type(sock->conn)!=NETCONN_TCP) return -EOPNOTSUPP;
+
+	zc = mem_malloc(sizeof(struct netconn_zcreq));
+	if(!zc) return -ENOBUFS;
+
+	zc->next = NULL;
+	zc->data = data;
+	zc->len = len;
+	zc->cb = cb;
+	zc->usrdata = usrdata;
+
+	err = netconn_write(sock->conn,data,len,NETCONN_NOCOPY,&zc);
+	if(zc) {
+		// never reached the stack, so the buffer is already ours again
+		if(cb) cb(s,data,len,-err_to_errno(err),usrdata);
+		mem_free(zc);
+	}
+	if(err!=ERR_OK) {
+		LWIP_DEBUGF(SOCKETS_DEBUG, ("net_send_zc(%d) err=%d\n", s, err));
+		return -err_to_errno(err);
+	}
+
+	LWIP_DEBUGF(SOCKETS_DEBUG, ("net_send_zc(%d) ok size=%d\n", s, len));
+	return len;
+}
+
 s32 net_connect(s32 s,struct sockaddr *name,socklen_t namelen)
 {
 	struct netsocket *sock;
@@ -1963,6 +2277,16 @@ s32 net_close(s32 s)
 
 	LWIP_DEBUGF(SOCKETS_DEBUG, ("net_close(%d)\n", s));
 
+	// zero-copy buffers are the caller's again only once acknowledged,
+	// a peer that stops acknowledging gets the connection aborted
+	sock = get_socket(s);
+	if(sock) {
+		u64 deadline = gettime() + secs_to_ticks(ZCSENT_LINGER);
+
+		while(sock->conn->zcsent!=NULL && sock->conn->err==ERR_OK && gettime()<deadline)
+			LWP_SemWait(sock->conn->sem);
+	}
+
 	LWP_SemWait(netsocket_sem);
 	
 	sock = get_socket(s);
@@ -1970,6 +2294,15 @@ s32 net_close(s32 s)
 		LWP_SemPost(netsocket_sem);
 		return -ENOTSOCK;
 	}
+
+	if(sock->ep) {
+		struct netepoll *ep = sock->ep;
+
+		LWP_MutexLock(ep->lck);
+		epoll_unqueue(ep,sock);
+		sock->ep = NULL;
+		LWP_MutexUnlock(ep->lck);
+	}
 	
 	netconn_delete(sock->conn);
 	if(sock->lastdata) netbuf_delete(sock->lastdata);
@@ -2132,6 +2465,223 @@ s32 net_select(s32 maxfdp1,fd_set *readset,fd_set *writeset,fd_set *exceptset,st
 	return nready;
 }
 
+static struct netepoll* get_epoll(s32 epfd)
+{
+	if(epfd<0 || epfd>=NUM_EPOLLS || !epolls[epfd].used) {
+	    LWIP_DEBUGF(SOCKETS_DEBUG, ("get_epoll(%d): invalid\n", epfd));
+		return NULL;
+	}
+	return &epolls[epfd];
+}
+
+s32 net_epoll_create()
+{
+	s32 i;
+	struct netepoll *ep;
+
+	LWP_SemWait(netsocket_sem);
+	for(i=0;i<NUM_EPOLLS;i++) {
+		ep = &epolls[i];
+		if(!ep->used) {
+			if(LWP_MutexInit(&ep->lck,FALSE)!=0) break;
+			if(LWP_CondInit(&ep->cond)!=0) {
+				LWP_MutexDestroy(ep->lck);
+				break;
+			}
+			ep->ready = NULL;
+			ep->ready_tail = NULL;
+			ep->waiters = 0;
+			ep->used = 1;
+			LWP_SemPost(netsocket_sem);
+			LWIP_DEBUGF(SOCKETS_DEBUG, ("net_epoll_create() = %d\n", i));
+			return i;
+		}
+	}
+	LWP_SemPost(netsocket_sem);
+	return -ENOMEM;
+}
+
+s32 net_epoll_ctl(s32 epfd,s32 op,s32 s,struct net_epoll_event *event)
+{
+	s32 err = 0;
+	struct netepoll *ep;
+	struct netsocket *sock;
+
+	LWIP_DEBUGF(SOCKETS_DEBUG, ("net_epoll_ctl(%d, %d, %d)\n", epfd, op, s));
+
+	if(op!=NET_EPOLL_CTL_DEL && event==NULL) return -EINVAL;
+
+	// keeps net_epoll_close and net_close out until ep->lck is held
+	LWP_SemWait(netsocket_sem);
+	ep = get_epoll(epfd);
+	if(!ep) {
+		LWP_SemPost(netsocket_sem);
+		return -EBADF;
+	}
+	sock = get_socket(s);
+	if(!sock) {
+		LWP_SemPost(netsocket_sem);
+		return -ENOTSOCK;
+	}
+
+	LWP_MutexLock(ep->lck);
+	LWP_SemPost(netsocket_sem);
+	switch(op) {
+		case NET_EPOLL_CTL_ADD:
+			if(sock->ep) {
+				err = EEXIST;
+				break;
+			}
+			sock->ep = ep;
+			sock->ep_events = event->events;
+			sock->ep_data = event->data;
+			sock->ep_next = NULL;
+			sock->ep_queued = 0;
+			epoll_queue(ep,sock);
+			break;
+		case NET_EPOLL_CTL_MOD:
+			if(sock->ep!=ep) {
+				err = ENOENT;
+				break;
+			}
+			sock->ep_events = event->events;
+			sock->ep_data = event->data;
+			epoll_queue(ep,sock);
+			break;
+		case NET_EPOLL_CTL_DEL:
+			if(sock->ep!=ep) {
+				err = ENOENT;
+				break;
+			}
+			epoll_unqueue(ep,sock);
+			sock->ep = NULL;
+			break;
+		default:
+			err = EINVAL;
+			break;
+	}
+	LWP_MutexUnlock(ep->lck);
+
+	return -err;
+}
+
+s32 net_epoll_wait(s32 epfd,struct net_epoll_event *events,s32 maxevents,s32 timeout)
+{
+	s32 n = 0;
+	u32 ready;
+	struct timespec tb;
+	struct netepoll *ep;
+	struct netsocket *sock,*requeue = NULL,*requeue_tail = NULL;
+
+	if(events==NULL || maxevents<=0) return -EINVAL;
+
+	LWP_SemWait(netsocket_sem);
+	ep = get_epoll(epfd);
+	if(!ep) {
+		LWP_SemPost(netsocket_sem);
+		return -EBADF;
+	}
+	LWP_MutexLock(ep->lck);
+	ep->waiters++;
+	LWP_SemPost(netsocket_sem);
+
+	while(ep->used) {
+		while(n<maxevents && (sock=ep->ready)!=NULL) {
+			ep->ready = sock->ep_next;
+			if(ep->ready==NULL) ep->ready_tail = NULL;
+			sock->ep_next = NULL;
+			sock->ep_queued = 0;
+
+			// the list may be stale, report what holds now
+			ready = epoll_readiness(sock)&(sock->ep_events|POLLERR);
+			if(!ready) continue;
+
+			events[n].events = ready;
+			events[n].data = sock->ep_data;
+			n++;
+
+			// level-triggered sockets stay listed while they are ready
+			if(!(sock->ep_events&NET_EPOLLET)) {
+				sock->ep_queued = 1;
+				if(requeue_tail)
+					requeue_tail->ep_next = sock;
+				else
+					requeue = sock;
+				requeue_tail = sock;
+			}
+		}
+		if(n>0 || timeout==0) break;
+
+		if(timeout<0)
+			LWP_CondWait(ep->cond,ep->lck);
+		else {
+			tb.tv_sec = timeout/TB_MSPERSEC;
+			tb.tv_nsec = (timeout%TB_MSPERSEC)*TB_NSPERMS;
+			if(LWP_CondTimedWait(ep->cond,ep->lck,&tb)==ETIMEDOUT) break;
+		}
+	}
+
+	// behind anything that turned ready meanwhile, so nobody starves
+	if(requeue) {
+		if(ep->ready_tail)
+			ep->ready_tail->ep_next = requeue;
+		else
+			ep->ready = requeue;
+		ep->ready_tail = requeue_tail;
+	}
+
+	ep->waiters--;
+	if(!ep->used) {
+		// closed under us, net_epoll_close waits for the last one to leave
+		if(ep->waiters==0) LWP_CondBroadcast(ep->cond);
+		n = -EBADF;
+	}
+	LWP_MutexUnlock(ep->lck);
+
+	LWIP_DEBUGF(SOCKETS_DEBUG, ("net_epoll_wait(%d) = %d\n", epfd, n));
+	return n;
+}
+
+s32 net_epoll_close(s32 epfd)
+{
+	s32 i;
+	struct netepoll *ep;
+
+	LWP_SemWait(netsocket_sem);
+	ep = get_epoll(epfd);
+	if(!ep) {
+		LWP_SemPost(netsocket_sem);
+		return -EBADF;
+	}
+
+	// evt_callback looks at sock->ep under sockselect_sem only
+	LWP_SemWait(sockselect_sem);
+	LWP_MutexLock(ep->lck);
+	for(i=0;i<NUM_SOCKETS;i++) {
+		if(sockets[i].ep==ep) {
+			sockets[i].ep = NULL;
+			sockets[i].ep_next = NULL;
+			sockets[i].ep_queued = 0;
+		}
+	}
+	ep->ready = NULL;
+	ep->ready_tail = NULL;
+	ep->used = 0;
+	LWP_SemPost(sockselect_sem);
+
+	// wake whoever sleeps in net_epoll_wait and let them leave first
+	while(ep->waiters>0) {
+		LWP_CondBroadcast(ep->cond);
+		LWP_CondWait(ep->cond,ep->lck);
+	}
+	LWP_MutexUnlock(ep->lck);
+
+	LWP_CondDestroy(ep->cond);
+	LWP_MutexDestroy(ep->lck);
+	LWP_SemPost(netsocket_sem);
+	return 0;
+}
+
 s32 net_getsockopt(s32 s,u32 level,u32 optname,const void *optval,socklen_t optlen)
 {
 	s32 err = 0;
@@ -2152,6 +2702,12 @@ s32 net_getsockopt(s32 s,u32 level,u32 optname,const void *optval,socklen_t optl
 				case SO_REUSEPORT:
 					if(optlen<sizeof(u32)) err = EINVAL;
 					break;
+				case SO_RCVBUF:
+				case SO_SNDBUF:
+					if(optlen<sizeof(u32)) err = EINVAL;
+					else if(sock->conn->type!=NETCONN_TCP) err = ENOPROTOOPT;
+					else if(sock->conn->pcb.tcp==NULL || sock->conn->pcb.tcp->state==LISTEN) err = EINVAL;
+					break;
 				default:
 					LWIP_DEBUGF(SOCKETS_DEBUG, ("net_getsockopt(%d, SOL_SOCKET, UNIMPL: optname=0x%x, ..)\n", s, optname));
 					err = ENOPROTOOPT;
@@ -2211,6 +2767,12 @@ s32 net_getsockopt(s32 s,u32 level,u32 optname,const void *optval,socklen_t optl
 				case SO_REUSEPORT:
 					(*(u32*)optval) = (sock->conn->pcb.tcp->so_options & optname) ? 1 : 0;
 					break;
+				case SO_RCVBUF:
+					(*(u32*)optval) = sock->conn->pcb.tcp->rcv_wnd_max;
+					break;
+				case SO_SNDBUF:
+					(*(u32*)optval) = sock->conn->pcb.tcp->snd_buf_max;
+					break;
 			}
 		}
 		break;
@@ -2243,6 +2805,45 @@ s32 net_getsockopt(s32 s,u32 level,u32 optname,const void *optval,socklen_t optl
 	return 0;
 }
 
+/* The receive buffer is the TCP receive window: data stays counted
+   against it until the application has read it. Growing it opens
+   the window by the difference; it can't exceed what fits in the
+   header field after window scaling. */
+static void net_setrcvbuf(struct tcp_pcb *pcb,u32 size)
+{
+	u32 limit = 0xffff;
+
+#if LWIP_WND_SCALE
+	/* not negotiated yet: allow what we'll ask for in our SYN */
+	if(pcb->state==CLOSED || pcb->state==SYN_SENT)
+		limit = (u32)0xffff<<TCP_RCV_SCALE;
+	else
+		limit = (u32)0xffff<<pcb->rcv_scale;
+#endif
+	if(size>limit) size = limit;
+	if(size<TCP_MSS) size = TCP_MSS;
+
+	if(size>pcb->rcv_wnd_max)
+		pcb->rcv_wnd += size - pcb->rcv_wnd_max;
+	else if(pcb->rcv_wnd>size)
+		pcb->rcv_wnd = size;
+	pcb->rcv_wnd_max = size;
+}
+
+/* The send buffer bounds how much unacknowledged data tcp_enqueue()
+   accepts, which caps the bytes in flight per round trip. */
+static void net_setsndbuf(struct tcp_pcb *pcb,u32 size)
+{
+	u32 queued;
+
+	if(size>0xffff) size = 0xffff;
+	if(size<TCP_MSS) size = TCP_MSS;
+
+	queued = (pcb->snd_buf_max>pcb->snd_buf) ? pcb->snd_buf_max - pcb->snd_buf : 0;
+	pcb->snd_buf = (size>queued) ? size - queued : 0;
+	pcb->snd_buf_max = size;
+}
+
 s32 net_setsockopt(s32 s,u32 level,u32 optname,const void *optval,socklen_t optlen)
 {
 	s32 err = 0;
@@ -2262,6 +2863,13 @@ s32 net_setsockopt(s32 s,u32 level,u32 optname,const void *optval,socklen_t optl
 				case SO_REUSEPORT:
 					if(optlen<sizeof(u32)) err = EINVAL;
 					break;
+				case SO_RCVBUF:
+				case SO_SNDBUF:
+					/* the buffers of an accepted socket come from tcp_alloc(), so set them on the connection, not the listener */
+					if(optlen<sizeof(u32)) err = EINVAL;
+					else if(sock->conn->type!=NETCONN_TCP) err = ENOPROTOOPT;
+					else if(sock->conn->pcb.tcp==NULL || sock->conn->pcb.tcp->state==LISTEN) err = EINVAL;
+					break;
 				default:
 					LWIP_DEBUGF(SOCKETS_DEBUG, ("net_setsockopt(%d, SOL_SOCKET, UNIMPL: optname=0x%x, ..)\n", s, optname));
 					err = ENOPROTOOPT;
@@ -2322,6 +2930,14 @@ s32 net_setsockopt(s32 s,u32 level,u32 optname,const void *optval,socklen_t optl
 						sock->conn->pcb.tcp->so_options &= ~optname;
 					LWIP_DEBUGF(SOCKETS_DEBUG, ("net_setsockopt(%d, SOL_SOCKET, optname=0x%x, ..) -> %s\n", s, optname, (*(u32*)optval?"on":"off")));
 					break;
+				case SO_RCVBUF:
+					net_setrcvbuf(sock->conn->pcb.tcp,*(u32*)optval);
+					LWIP_DEBUGF(SOCKETS_DEBUG, ("net_setsockopt(%d, SOL_SOCKET, SO_RCVBUF, ..) -> %u\n", s, sock->conn->pcb.tcp->rcv_wnd_max));
+					break;
+				case SO_SNDBUF:
+					net_setsndbuf(sock->conn->pcb.tcp,*(u32*)optval);
+					LWIP_DEBUGF(SOCKETS_DEBUG, ("net_setsockopt(%d, SOL_SOCKET, SO_SNDBUF, ..) -> %u\n", s, sock->conn->pcb.tcp->snd_buf_max));
+					break;
 			}
 		}
 		break;
@@ -2371,7 +2987,7 @@ s32 net_ioctl(s32 s, u32 cmd, void *argp)
 		case FIONREAD:
 			if(!argp) return -EINVAL;
 
-			*((u16_t*)argp) = sock->conn->recvavail;
+			*((u16_t*)argp) = (sock->conn->recvavail>0xffff) ? 0xffff : sock->conn->recvavail;
 
 			LWIP_DEBUGF(SOCKETS_DEBUG, ("net_ioctl(%d, FIONREAD, %p) = %u\n", s, argp, *((u16*)argp)));
 			return 0;
@@ -0,0 +1,205 @@
+/*-------------------------------------------------------------
+
+dvd_sched_test.c -- Drive the DVD read scheduler on simulated queues
+
+Copyright (C) 2026
+
+This software is provided 'as-is', without any express or implied
+warranty.  In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1.	The origin of this software must not be misrepresented; you
+must not claim that you wrote the original software. If you use
+this software in a product, an acknowledgment in the product
+documentation would be appreciated but is not required.
+
+2.	Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3.	This notice may not be removed or altered from any source
+distribution.
+
+-------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gctypes.h>
+#include <ogc/dvd.h>
+
+#include "lwp_queue.inl"
+#include "dvd_sched.h"
+
+#define DVD_SCHED_SEEKCMD		0x0002
+#define NBLOCKS					16
+
+static lwp_queue queue;
+static dvdcmdblk blocks[NBLOCKS];
+static u32 nblocks;
+static u8 membuf[0x200000];
+static int failures = 0;
+
+#define CHECK(cond) do { \
+	if(!(cond)) { \
+		printf("%s:%d: %s failed\n",__FILE__,__LINE__,#cond); \
+		failures++; \
+	} \
+} while(0)
+
+static void reset(void)
+{
+	memset(blocks,0,sizeof(blocks));
+	nblocks = 0;
+	__lwp_queue_init_empty(&queue);
+}
+
+static dvdcmdblk* queue_cmd(u32 cmd,s64 offset,u32 len,void *buf)
+{
+	dvdcmdblk *block = &blocks[nblocks++];
+
+	block->cmd = cmd;
+	block->offset = offset;
+	block->len = len;
+	block->buf = buf;
+	__lwp_queue_appendI(&queue,&block->node);
+	return block;
+}
+
+static dvdcmdblk* queue_read(s64 offset,u32 len,void *buf)
+{
+	return queue_cmd(DVD_SCHED_READCMD,offset,len,buf);
+}
+
+static void test_cscan(void)
+{
+	dvdcmdblk *a,*b,*c,*d;
+
+	reset();
+	CHECK(__dvd_schedpick(&queue,0)==NULL);
+
+	a = queue_read(0x50000,0x800,membuf);
+	b = queue_read(0x10000,0x800,membuf);
+	c = queue_read(0x90000,0x800,membuf);
+	d = queue_read(0x30000,0x800,membuf);
+
+	// ascending from the head, then wrap around to the lowest offset
+	CHECK(__dvd_schedpick(&queue,0x40000)==a);
+	CHECK(__dvd_schedpick(&queue,0x50800)==c);
+	CHECK(__dvd_schedpick(&queue,0x90800)==b);
+	CHECK(__dvd_schedpick(&queue,0x10800)==d);
+	CHECK(__lwp_queue_isempty(&queue));
+}
+
+static void test_cscan_ties(void)
+{
+	dvdcmdblk *a,*b;
+
+	reset();
+	a = queue_read(0x8000,0x800,membuf);
+	b = queue_read(0x8000,0x800,membuf);
+
+	// a read right at the head counts as ahead, equal offsets stay in order
+	CHECK(__dvd_schedpick(&queue,0x8000)==a);
+	CHECK(__dvd_schedpick(&queue,0x8000)==b);
+}
+
+static void test_fifo_fallback(void)
+{
+	dvdcmdblk *a,*s,*b;
+
+	reset();
+	a = queue_read(0x80000,0x800,membuf);
+	s = queue_cmd(DVD_SCHED_SEEKCMD,0,0,NULL);
+	b = queue_read(0x1000,0x800,membuf);
+
+	// only the reads in front of the seek are candidates
+	CHECK(__dvd_schedpick(&queue,0)==a);
+	// a seek at the front is served first, in queue order
+	CHECK(__dvd_schedpick(&queue,0x80800)==s);
+	CHECK(__dvd_schedpick(&queue,0)==b);
+	CHECK(__lwp_queue_isempty(&queue));
+}
+
+static void test_merge(void)
+{
+	u32 cnt,len;
+	dvdcmdblk *merged[DVD_SCHED_MAXMERGE];
+	dvdcmdblk *lead,*in,*next,*far,*dup,*gap;
+
+	reset();
+	lead = queue_read(0x100000,0x8000,membuf);
+	far = queue_read(0x110000,0x8000,membuf + 0x10000);		// continues only after next
+	dup = queue_read(0x108000,0x8000,membuf + 0x40000);		// covered only after next
+	in = queue_read(0x101000,0x800,membuf + 0x80000);		// inside the lead's range
+	next = queue_read(0x108000,0x8000,membuf + 0x8000);
+	gap = queue_read(0x118000,0x8000,membuf + 0x20000);		// next on disc, not in memory
+
+	CHECK(__dvd_schedpick(&queue,0x100000)==lead);
+	cnt = __dvd_schedmerge(&queue,lead,merged,DVD_SCHED_MAXMERGE,&len);
+
+	CHECK(cnt==4);
+	CHECK(len==0x18000);
+	CHECK(merged[0]==in);
+	CHECK(merged[1]==next);
+	CHECK(merged[2]==far);
+	CHECK(merged[3]==dup);
+	// what could not be merged stays queued
+	CHECK(__dvd_schedpick(&queue,0x100000+len)==gap);
+	CHECK(__lwp_queue_isempty(&queue));
+}
+
+static void test_merge_limits(void)
+{
+	u32 i,cnt,len;
+	dvdcmdblk *merged[DVD_SCHED_MAXMERGE];
+	dvdcmdblk *lead;
+
+	// stops at max blocks
+	reset();
+	lead = queue_read(0,0x800,membuf);
+	for(i=1;i<=DVD_SCHED_MAXMERGE+2;i++)
+		queue_read(i*0x800,0x800,membuf + i*0x800);
+	CHECK(__dvd_schedpick(&queue,0)==lead);
+	cnt = __dvd_schedmerge(&queue,lead,merged,DVD_SCHED_MAXMERGE,&len);
+	CHECK(cnt==DVD_SCHED_MAXMERGE);
+	CHECK(len==(DVD_SCHED_MAXMERGE+1)*0x800);
+
+	// stops at the longest drive command
+	reset();
+	lead = queue_read(0,DVD_SCHED_MAXMERGELEN-0x800,membuf);
+	queue_read(DVD_SCHED_MAXMERGELEN-0x800,0x800,membuf + DVD_SCHED_MAXMERGELEN-0x800);
+	queue_read(DVD_SCHED_MAXMERGELEN,0x800,membuf + DVD_SCHED_MAXMERGELEN);
+	CHECK(__dvd_schedpick(&queue,0)==lead);
+	cnt = __dvd_schedmerge(&queue,lead,merged,DVD_SCHED_MAXMERGE,&len);
+	CHECK(cnt==1);
+	CHECK(len==DVD_SCHED_MAXMERGELEN);
+
+	// never across a non-read command
+	reset();
+	lead = queue_read(0,0x800,membuf);
+	queue_cmd(DVD_SCHED_SEEKCMD,0,0,NULL);
+	queue_read(0x800,0x800,membuf + 0x800);
+	CHECK(__dvd_schedpick(&queue,0)==lead);
+	cnt = __dvd_schedmerge(&queue,lead,merged,DVD_SCHED_MAXMERGE,&len);
+	CHECK(cnt==0);
+	CHECK(len==0x800);
+}
+
+int main(void)
+{
+	test_cscan();
+	test_cscan_ties();
+	test_fifo_fallback();
+	test_merge();
+	test_merge_limits();
+
+	if(failures) {
+		printf("dvd_sched_test: %d checks failed\n",failures);
+		return 1;
+	}
+	printf("dvd_sched_test: all checks passed\n");
+	return 0;
+}
@@ -0,0 +1,75 @@
+/*-------------------------------------------------------------
+
+cc.h -- Host stand-in for the lwIP port types
+
+Copyright (C) 2026
+
+This software is provided 'as-is', without any express or implied
+warranty.  In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1.	The origin of this software must not be misrepresented; you
+must not claim that you wrote the original software. If you use
+this software in a product, an acknowledgment in the product
+documentation would be appreciated but is not required.
+
+2.	Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3.	This notice may not be removed or altered from any source
+distribution.
+
+-------------------------------------------------------------*/
+#ifndef __ARCH_CC_H__
+#define __ARCH_CC_H__
+
+/* Lets lwIP sources build on the host for the tests in this directory.
+ * The target version is gc/netif/arch/cc.h.
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#ifndef LITTLE_ENDIAN
+#define LITTLE_ENDIAN	1234
+#endif
+#ifndef BIG_ENDIAN
+#define BIG_ENDIAN		4321
+#endif
+#ifndef BYTE_ORDER
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__==__ORDER_BIG_ENDIAN__
+#define BYTE_ORDER		BIG_ENDIAN
+#else
+#define BYTE_ORDER		LITTLE_ENDIAN
+#endif
+#endif
+
+typedef uint8_t		u8_t;
+typedef int8_t		s8_t;
+typedef uint16_t	u16_t;
+typedef int16_t		s16_t;
+typedef uint32_t	u32_t;
+typedef int32_t		s32_t;
+typedef uint64_t	u64_t;
+typedef uintptr_t	mem_ptr_t;
+
+#define PACK_STRUCT_FIELD(x) x
+#define PACK_STRUCT_STRUCT __attribute__((packed))
+#define PACK_STRUCT_BEGIN
+#define PACK_STRUCT_END
+
+#define LWIP_PLATFORM_ASSERT(x) { printf(x); abort(); }
+#define LWIP_PLATFORM_DIAG(x) printf x
+
+#define U16_F "hu"
+#define S16_F "hd"
+#define X16_F "hx"
+#define U32_F "u"
+#define S32_F "d"
+#define X32_F "x"
+
+#endif /* __ARCH_CC_H__ */
@@ -0,0 +1,41 @@
+/*-------------------------------------------------------------
+
+sys_arch.h -- Host stand-in for the lwIP OS glue
+
+Copyright (C) 2026
+
+This software is provided 'as-is', without any express or implied
+warranty.  In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1.	The origin of this software must not be misrepresented; you
+must not claim that you wrote the original software. If you use
+this software in a product, an acknowledgment in the product
+documentation would be appreciated but is not required.
+
+2.	Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3.	This notice may not be removed or altered from any source
+distribution.
+
+-------------------------------------------------------------*/
+#ifndef __SYS_GC_H__
+#define __SYS_GC_H__
+
+/* The tests only call code that never blocks, the target version is
+ * gc/netif/arch/sys_arch.h.
+ */
+#define SYS_MBOX_NULL		0
+#define SYS_SEM_NULL		0
+
+typedef int sys_sem_t;
+typedef int sys_mbox_t;
+typedef int sys_thread_t;
+typedef unsigned int sys_prot_t;
+
+#endif /* __SYS_GC_H__ */
@@ -0,0 +1,105 @@
+/*-------------------------------------------------------------
+
+chksum_bench.c -- Throughput of the lwIP checksum routines
+
+Copyright (C) 2026
+
+This software is provided 'as-is', without any express or implied
+warranty.  In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1.	The origin of this software must not be misrepresented; you
+must not claim that you wrote the original software. If you use
+this software in a product, an acknowledgment in the product
+documentation would be appreciated but is not required.
+
+2.	Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3.	This notice may not be removed or altered from any source
+distribution.
+
+-------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lwip/core/inet.c"
+
+#if BYTE_ORDER != BIG_ENDIAN
+u16_t htons(u16_t x)
+{
+	return (u16_t)((x<<8)|(x>>8));
+}
+#endif
+
+#define BENCH_BYTES		(256u<<20)		// per routine and size
+
+static u8_t src_buf[65536 + 4] __attribute__((aligned(32)));
+static u8_t dst_buf[65536 + 4] __attribute__((aligned(32)));
+static volatile u32_t sink;
+
+// the plain RFC 1071 loop, as a baseline
+static u16_t ref_chksum(const u8_t *p,u32_t len)
+{
+	u32_t acc = 0;
+
+	while(len>1) {
+		acc += (p[0]<<8)|p[1];
+		p += 2;
+		len -= 2;
+	}
+	if(len) acc += p[0]<<8;
+	while(acc>>16) acc = (acc&0xffff) + (acc>>16);
+	return acc;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+static double run(int what,u8_t *d,u8_t *s,u32_t len)
+{
+	u32_t i, n = BENCH_BYTES/len;
+	double t = now();
+
+	for(i=0;i<n;i++) {
+		switch(what) {
+			case 0: sink += ref_chksum(s,len); break;
+			case 1: sink += lwip_fast_chksum(s,len); break;
+			case 2: memcpy(d,s,len); sink += lwip_fast_chksum(d,len); break;
+			case 3: sink += inet_chksum_copy(d,s,len); break;
+		}
+	}
+	t = now() - t;
+	return (double)n*len/t/(1024*1024);
+}
+
+int main(void)
+{
+	static const u32_t sizes[] = { 40, 576, 1460, 8192, 65535 };
+	u32_t i;
+
+	for(i=0;i<sizeof(src_buf);i++) src_buf[i] = rand();
+
+	printf("%8s %10s %10s %14s %14s   (MB/s)\n","bytes","rfc1071","chksum","memcpy+chksum","chksum_copy");
+	for(i=0;i<sizeof(sizes)/sizeof(sizes[0]);i++) {
+		printf("%8u",(unsigned)sizes[i]);
+		printf(" %10.0f",run(0,dst_buf,src_buf,sizes[i]));
+		printf(" %10.0f",run(1,dst_buf,src_buf,sizes[i]));
+		printf(" %14.0f",run(2,dst_buf,src_buf,sizes[i]));
+		printf(" %14.0f",run(3,dst_buf,src_buf,sizes[i]));
+		// unaligned source, as for data taken from user buffers
+		printf("   src+1: %.0f\n",run(3,dst_buf,src_buf+1,sizes[i]));
+	}
+	return 0;
+}
@@ -0,0 +1,147 @@
+/*-------------------------------------------------------------
+
+chksum_test.c -- Check the lwIP checksum routines against RFC 1071
+
+Copyright (C) 2026
+
+This software is provided 'as-is', without any express or implied
+warranty.  In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1.	The origin of this software must not be misrepresented; you
+must not claim that you wrote the original software. If you use
+this software in a product, an acknowledgment in the product
+documentation would be appreciated but is not required.
+
+2.	Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3.	This notice may not be removed or altered from any source
+distribution.
+
+-------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* lwip_fast_chksum() is static, so the file is pulled in whole */
+#include "lwip/core/inet.c"
+
+#if BYTE_ORDER != BIG_ENDIAN
+u16_t htons(u16_t x)
+{
+	return (u16_t)((x<<8)|(x>>8));
+}
+#endif
+
+#define MAXLEN		65535
+// both routines only look at the low two address bits
+#define MAXALIGN	4
+
+static u8_t src_buf[MAXLEN + 2*MAXALIGN] __attribute__((aligned(32)));
+static u8_t dst_buf[MAXLEN + 2*MAXALIGN] __attribute__((aligned(32)));
+static unsigned long checks = 0;
+
+/* RFC 1071 sums the data as big endian 16 bit words. lwIP keeps the sum
+ * so that storing it as a native u16 gives the same two bytes.
+ */
+static u16_t ref_result(u64_t acc)
+{
+	u8_t b[2];
+	u16_t r;
+
+	while(acc>>16) acc = (acc&0xffff) + (acc>>16);
+	b[0] = acc>>8;
+	b[1] = acc&0xff;
+	memcpy(&r,b,2);
+	return r;
+}
+
+static void fail(const char *what,int sa,int da,u32_t len,u16_t got,u16_t exp)
+{
+	printf("%s: src+%d dst+%d len %u: got %04x, expected %04x\n",what,sa,da,(unsigned)len,got,exp);
+	exit(1);
+}
+
+static void fill(int pattern)
+{
+	u32_t i;
+
+	srand(pattern + 1);
+	for(i=0;i<sizeof(src_buf);i++) {
+		switch(pattern) {
+			case 0: src_buf[i] = rand()&0xff; break;
+			case 1: src_buf[i] = 0xff; break;			// every add carries
+			default: src_buf[i] = (i&1) ? 0x01 : 0xff; break;
+		}
+	}
+}
+
+// every length at every alignment, the reference sum grows one byte at a time
+static void test_chksum(void)
+{
+	int sa;
+	u32_t len;
+	u64_t acc;
+	u8_t *p;
+
+	for(sa=0;sa<MAXALIGN;sa++) {
+		p = src_buf + sa;
+		acc = 0;
+		for(len=0;len<=MAXLEN;len++) {
+			u16_t exp, got;
+
+			if(len>0) acc += ((len-1)&1) ? p[len-1] : (u32_t)p[len-1]<<8;
+			exp = ref_result(acc);
+			got = lwip_fast_chksum(p,len);
+			if(got!=exp) fail("lwip_fast_chksum",sa,0,len,got,exp);
+			checks++;
+		}
+	}
+}
+
+static void test_copy(void)
+{
+	int sa, da;
+	u32_t len;
+	u64_t acc;
+	u8_t *s, *d;
+
+	for(sa=0;sa<MAXALIGN;sa++) {
+		for(da=0;da<MAXALIGN;da++) {
+			s = src_buf + sa;
+			d = dst_buf + da;
+			acc = 0;
+			memset(dst_buf,0xa5,sizeof(dst_buf));
+			for(len=0;len<=MAXLEN;len++) {
+				u16_t exp, got;
+
+				if(len>0) acc += ((len-1)&1) ? s[len-1] : (u32_t)s[len-1]<<8;
+				exp = ref_result(acc);
+				d[len] = 0xa5;
+				got = inet_chksum_copy(d,s,len);
+				if(got!=exp) fail("inet_chksum_copy",sa,da,len,got,exp);
+				if(memcmp(d,s,len)!=0 || d[len]!=0xa5 || (da>0 && d[-1]!=0xa5))
+					fail("inet_chksum_copy data",sa,da,len,0,0);
+				checks++;
+			}
+		}
+	}
+}
+
+int main(void)
+{
+	int pattern;
+
+	for(pattern=0;pattern<3;pattern++) {
+		fill(pattern);
+		test_chksum();
+		test_copy();
+	}
+	printf("chksum_test: %lu checks passed\n",checks);
+	return 0;
+}